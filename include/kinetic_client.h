@@ -49,6 +49,15 @@ KineticClient * KineticClient_Init(KineticClientConfig *config);
  */
 void KineticClient_Shutdown(KineticClient * const client);
 
+/**
+ * @brief Gets the counters for the client's pool of response buffers
+ *
+ * @param client The pointer returned from `KineticClient_Init`
+ * @param stats  Populated with a snapshot of the pool's counters
+ */
+void KineticClient_GetResponsePoolStats(KineticClient const * const client,
+    KineticResponsePoolStats * const stats);
+
 /**
  * @brief Creates a session with the Kinetic Device per specified configuration.
  *
@@ -112,7 +121,8 @@ KineticStatus KineticClient_NoOp(KineticSession* const session);
  * @param entry         Key/value entry for object to store. 'value' must
  *                      specify the data to be stored. If a closure is provided
  *                      this pointer must remain valid until the closure callback
- *                      is called.
+ *                      is called. The value is sent directly from its buffer,
+ *                      so it must not be modified until then.
  *
  * @param closure       Optional closure. If specified, operation will be
  *                      executed in asynchronous mode, and closure callback
@@ -215,6 +225,75 @@ KineticStatus KineticClient_Delete(KineticSession* const session,
                                    KineticEntry* const entry,
                                    KineticCompletionClosure* closure);
 
+/**
+ * @brief Executes a `PUT` operation for each of a batch of entries.
+ *
+ * The requests are packed and sent together, which is much cheaper than
+ * sending them one at a time when the entries are small. They are still
+ * separate operations on the device, so some may fail while others succeed.
+ *
+ * @param session       The connected KineticSession to use for the operations.
+ * @param entries       Array of COUNT key/value entries to store, as for
+ *                      KineticClient_Put.
+ * @param count         Number of entries.
+ * @param statuses      Array of COUNT statuses, which will receive each
+ *                      entry's resulting KineticStatus. If a closure is
+ *                      provided, this and the entries must remain valid until
+ *                      the closure callback is called.
+ * @param closure       Optional closure. If specified, the operations will be
+ *                      executed in asynchronous mode, and closure callback
+ *                      will be called once, after the last one completes,
+ *                      with the first failing status (if any).
+ *
+ * @return              Returns KINETIC_STATUS_SUCCESS if the batch was sent
+ *                      (in asynchronous mode) or every operation succeeded,
+ *                      and otherwise the first failing status. If nothing
+ *                      could be sent, the closure will not be called.
+ */
+KineticStatus KineticClient_PutBatch(KineticSession* const session,
+                                     KineticEntry* const entries,
+                                     size_t count,
+                                     KineticStatus* const statuses,
+                                     KineticCompletionClosure* closure);
+
+/**
+ * @brief Executes a `GET` operation for each of a batch of entries.
+ *
+ * @param session       The connected KineticSession to use for the operations.
+ * @param entries       Array of COUNT key/value entries to retrieve, as for
+ *                      KineticClient_Get.
+ * @param count         Number of entries.
+ * @param statuses      Array of COUNT statuses, as for KineticClient_PutBatch.
+ * @param closure       Optional closure, as for KineticClient_PutBatch.
+ *
+ * @return              Returns the resulting KineticStatus, as for
+ *                      KineticClient_PutBatch.
+ */
+KineticStatus KineticClient_GetBatch(KineticSession* const session,
+                                     KineticEntry* const entries,
+                                     size_t count,
+                                     KineticStatus* const statuses,
+                                     KineticCompletionClosure* closure);
+
+/**
+ * @brief Executes a `DELETE` operation for each of a batch of entries.
+ *
+ * @param session       The connected KineticSession to use for the operations.
+ * @param entries       Array of COUNT key/value entries to delete, as for
+ *                      KineticClient_Delete.
+ * @param count         Number of entries.
+ * @param statuses      Array of COUNT statuses, as for KineticClient_PutBatch.
+ * @param closure       Optional closure, as for KineticClient_PutBatch.
+ *
+ * @return              Returns the resulting KineticStatus, as for
+ *                      KineticClient_PutBatch.
+ */
+KineticStatus KineticClient_DeleteBatch(KineticSession* const session,
+                                        KineticEntry* const entries,
+                                        size_t count,
+                                        KineticStatus* const statuses,
+                                        KineticCompletionClosure* closure);
+
 /**
  * @brief Executes a `GETKEYRANGE` operation to retrieve a set of keys in the range
  * specified range from the Kinetic Device
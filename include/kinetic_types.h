@@ -70,10 +70,10 @@
 typedef enum _KineticAlgorithm {
     KINETIC_ALGORITHM_INVALID = -1, ///< Invalid algorithm value
     KINETIC_ALGORITHM_SHA1 = 2,     ///< SHA1
-    KINETIC_ALGORITHM_SHA2 = 3,     ///< SHA2
-    KINETIC_ALGORITHM_SHA3 = 4,     ///< SHA3
-    KINETIC_ALGORITHM_CRC32 = 5,    ///< CRC32
-    KINETIC_ALGORITHM_CRC64 = 6     ///< CRC64
+    KINETIC_ALGORITHM_SHA2 = 3,     ///< SHA2 (SHA-256)
+    KINETIC_ALGORITHM_SHA3 = 4,     ///< SHA3 (tags not computed by the client)
+    KINETIC_ALGORITHM_CRC32 = 5,    ///< CRC32 (CRC-32C)
+    KINETIC_ALGORITHM_CRC64 = 6     ///< CRC64 (CRC-64/XZ)
 } KineticAlgorithm;
 
 
@@ -139,6 +139,40 @@ typedef struct _KineticSessionConfig {
 
     /// Operation timeout. If 0, use the default (10 seconds).
     uint16_t timeoutSeconds;
+
+    /// Operation timeout in milliseconds, for deadlines shorter than
+    /// a second. If non-zero, this is used instead of `timeoutSeconds'.
+    uint32_t timeoutMsec;
+
+    /// Maximum number of operations in flight at once on this session.
+    /// If 0, use the default (10).
+    uint32_t maxOutstandingOperations;
+
+    /// Set to `true' to read the device's limits log upon connecting, and
+    /// allow as many operations in flight as it reports it can accept
+    /// (the lesser of `maxOutstandingReadRequests' and
+    /// `maxOutstandingWriteRequests'), instead of `maxOutstandingOperations'.
+    /// Responses are also limited to its `maxMessageSize' and
+    /// `maxValueSize', rather than 1 MiB each.
+    bool useDeviceLimits;
+
+    /// Set to `true' to adjust the number of operations in flight as the
+    /// session runs: growing it while latency stays flat, and halving it
+    /// when an operation times out or the device reports it is busy.
+    bool adaptiveWindow;
+
+    /// Set to `true' to complete operations on the thread that receives
+    /// their responses, rather than handing each one to the threadpool,
+    /// when their closure is marked `nonBlocking'. This saves a thread
+    /// handoff per operation, including for the blocking API. Only cheap
+    /// operations are completed inline: PUT, DELETE, NOOP, FLUSHALLDATA,
+    /// and GETs into a value buffer of at most 4 KiB without `computeTag'.
+    bool inlineCompletion;
+
+    /// Set to `true' to check the HMAC of each response to an HMAC
+    /// authenticated request, failing the request with
+    /// `KINETIC_STATUS_HMAC_FAILURE' if it doesn't match.
+    bool verifyResponseHmac;
 } KineticSessionConfig;
 
 /**
@@ -222,6 +256,8 @@ typedef void (*KineticCompletionCallback)(KineticCompletionData* kinetic_data, v
 typedef struct _KineticCompletionClosure {
     KineticCompletionCallback callback; ///< Function to be called upon completion
     void* clientData;                   ///< Optional client-supplied data which will be supplied to callback
+    bool nonBlocking;                   ///< Set if callback returns promptly and never waits on the session,
+                                        ///< so it may be run on the receiving thread (see `inlineCompletion')
 } KineticCompletionClosure;
 
 /**
@@ -242,7 +278,7 @@ typedef struct _KineticEntry {
     ByteBuffer newVersion;      ///< New version for the object to assume once written to disk (optional)
     bool metadataOnly;          ///< If set for a GET request, will return only the metadata for the specified object (`value` will not be retrieved)
     bool force;                 ///< If set for a GET/DELETE request, will override `version` checking
-    bool computeTag;            ///< If set and an algorithm is specified, the tag will be populated with the calculated hash for integrity checking
+    bool computeTag;            ///< If set and an algorithm is specified, a PUT will populate the tag with the calculated hash for integrity checking, and a GET will check the value received against its tag (failing with `KINETIC_STATUS_DATA_ERROR` on mismatch)
     KineticSynchronization synchronization; ///< Synchronization method to use for PUT/DELETE requests.
 } KineticEntry;
 
@@ -501,6 +537,7 @@ typedef enum _KineticCommand_Priority{
  */
 #define KINETIC_CLIENT_DEFAULT_LOG_LEVEL 0
 #define KINETIC_CLIENT_DEFAULT_READER_THREADS 4
+#define KINETIC_CLIENT_DEFAULT_WRITER_THREADS 2
 #define KINETIC_CLIENT_DEFAULT_MAX_THREADPOOL_THREADS 8
 
 /**
@@ -514,8 +551,25 @@ typedef struct {
     int logLevel;                   ///< Logging level (-1:none, 0:error, 1:info, 2:verbose, 3:full)
     uint8_t readerThreads;          ///< Number of threads used for handling incoming responses and status messages
     uint8_t maxThreadpoolThreads;   ///< Max number of threads to use for the threadpool that handles response callbacks.
+    uint8_t writerThreads;          ///< Number of threads used for writing requests submitted with a completion closure
 } KineticClientConfig;
 
+/**
+ * @brief Counters for a KineticClient's pool of response buffers
+ * (returned from KineticClient_GetResponsePoolStats()).
+ *
+ * Responses are allocated from per-size-class free lists, and only fall
+ * back to the heap when the matching list is empty.
+ */
+typedef struct {
+    uint64_t allocations;           ///< Responses allocated
+    uint64_t hits;                  ///< Allocations reusing a pooled buffer
+    uint64_t misses;                ///< Allocations that needed a new buffer from the heap
+    uint64_t recycled;              ///< Responses freed back into the pool
+    uint64_t released;              ///< Responses freed to the heap because the pool was full
+    uint64_t cachedBytes;           ///< Bytes currently held in the pool's free lists
+} KineticResponsePoolStats;
+
 /**
  * @brief Provides a string representation for a Kinetic message type.
  *
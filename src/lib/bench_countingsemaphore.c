@@ -0,0 +1,148 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "kinetic_countingsemaphore.h"
+
+/* Measure the cost of taking and giving the outstanding operations
+ * semaphore from many threads at once, comparing a semaphore that takes
+ * its mutex on every call (as KineticCountingSemaphore did before it had
+ * an atomic fast path) with the current one. A window much larger than
+ * the thread count only exercises the fast path; a small window makes
+ * threads wait for each other. */
+
+#define DEF_ROUNDS (200 * 1000)
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    uint32_t count;
+    uint32_t num_waiting;
+} locked_sem;
+
+static void locked_take(locked_sem *sem) {
+    pthread_mutex_lock(&sem->mutex);
+    sem->num_waiting++;
+    while (sem->count == 0) {
+        pthread_cond_wait(&sem->available, &sem->mutex);
+    }
+    sem->num_waiting--;
+    sem->count--;
+    pthread_mutex_unlock(&sem->mutex);
+}
+
+static void locked_give(locked_sem *sem) {
+    pthread_mutex_lock(&sem->mutex);
+    if (sem->count == 0 && sem->num_waiting > 0) {
+        pthread_cond_signal(&sem->available);
+    }
+    sem->count++;
+    pthread_mutex_unlock(&sem->mutex);
+}
+
+typedef struct {
+    pthread_t thread;
+    size_t rounds;
+    locked_sem *locked;
+    KineticCountingSemaphore *sem;
+} worker;
+
+static void *locked_worker(void *arg) {
+    worker *w = arg;
+    for (size_t i = 0; i < w->rounds; i++) {
+        locked_take(w->locked);
+        locked_give(w->locked);
+    }
+    return NULL;
+}
+
+static void *kinetic_worker(void *arg) {
+    worker *w = arg;
+    for (size_t i = 0; i < w->rounds; i++) {
+        KineticCountingSemaphore_Take(w->sem);
+        KineticCountingSemaphore_Give(w->sem);
+    }
+    return NULL;
+}
+
+static double elapsed_usec(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000.0
+      + (end->tv_usec - start->tv_usec);
+}
+
+static double run(void *(*fun)(void *), worker *workers, int threads) {
+    struct timeval start;
+    struct timeval end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < threads; i++) {
+        int res = pthread_create(&workers[i].thread, NULL, fun, &workers[i]);
+        assert(res == 0);
+    }
+    for (int i = 0; i < threads; i++) {
+        int res = pthread_join(workers[i].thread, NULL);
+        assert(res == 0);
+    }
+    gettimeofday(&end, NULL);
+    return elapsed_usec(&start, &end);
+}
+
+static void bench(int threads, uint32_t window, size_t rounds) {
+    locked_sem locked = { .count = window };
+    pthread_mutex_init(&locked.mutex, NULL);
+    pthread_cond_init(&locked.available, NULL);
+    KineticCountingSemaphore *sem = KineticCountingSemaphore_Create(window);
+    assert(sem);
+
+    worker *workers = calloc(threads, sizeof(*workers));
+    assert(workers);
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (worker){ .rounds = rounds, .locked = &locked, .sem = sem, };
+    }
+
+    double locked_usec = run(locked_worker, workers, threads);
+    double kinetic_usec = run(kinetic_worker, workers, threads);
+    assert(locked.count == window);
+
+    double ops = (double)threads * rounds;
+    printf("threads %3d, window %5u -- mutex %8.2f nsec / take+give, "
+        "atomic %8.2f nsec / take+give (%.2fx)\n", threads, window,
+        (1000.0 * locked_usec) / ops, (1000.0 * kinetic_usec) / ops,
+        locked_usec / kinetic_usec);
+
+    free(workers);
+    KineticCountingSemaphore_Destroy(sem);
+    pthread_cond_destroy(&locked.available);
+    pthread_mutex_destroy(&locked.mutex);
+}
+
+int main(int argc, char **argv) {
+    size_t rounds = DEF_ROUNDS;
+    if (argc > 1) { rounds = strtoul(argv[1], NULL, 10); }
+
+    const uint32_t windows[] = { 10, 1024 };
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        for (int threads = 1; threads <= 64; threads *= 4) {
+            bench(threads, windows[w], rounds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <openssl/hmac.h>
+
+#include "kinetic_hmac.h"
+#include "kinetic_nbo.h"
+
+/* Measure the cost of signing a request's command bytes, keying the
+ * HMAC for every request (as was done before sessions cached the key
+ * schedule) versus starting from the session's precomputed key. */
+
+#define DEF_SIGNS (1000 * 1000)
+
+static double elapsed_usec(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000.0
+      + (end->tv_usec - start->tv_usec);
+}
+
+static void bench(const ByteArray key, size_t cmd_len, size_t signs) {
+    uint8_t *cmd = malloc(cmd_len);
+    uint8_t *input = malloc(sizeof(uint32_t) + cmd_len);
+    assert(cmd && input);
+    for (size_t i = 0; i < cmd_len; i++) { cmd[i] = (uint8_t)i; }
+
+    uint8_t hmacData[KINETIC_HMAC_MAX_LEN];
+    Com__Seagate__Kinetic__Proto__Message__HMACauth hmacAuth = {
+        .hmac = { .data = hmacData, .len = sizeof(hmacData) },
+    };
+    Com__Seagate__Kinetic__Proto__Message msg = {
+        .has_commandbytes = true,
+        .commandbytes = { .data = cmd, .len = cmd_len },
+        .hmacauth = &hmacAuth,
+    };
+
+    /* Key for every request, as HMAC_Init_ex with the key did. */
+    struct timeval start;
+    struct timeval end;
+    uint8_t expected[EVP_MAX_MD_SIZE];
+    unsigned int expected_len = 0;
+    uint32_t lenNBO = KineticNBO_FromHostU32(cmd_len);
+    memcpy(input, &lenNBO, sizeof(lenNBO));
+    memcpy(&input[sizeof(lenNBO)], cmd, cmd_len);
+    gettimeofday(&start, NULL);
+    for (size_t i = 0; i < signs; i++) {
+        HMAC(EVP_sha1(), key.data, (int)key.len,
+            input, sizeof(uint32_t) + cmd_len, expected, &expected_len);
+    }
+    gettimeofday(&end, NULL);
+    double rekey_usec = elapsed_usec(&start, &end);
+
+    /* Start from the precomputed key schedule. */
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
+    KineticHMAC hmac;
+    gettimeofday(&start, NULL);
+    for (size_t i = 0; i < signs; i++) {
+        KineticHMAC_Init(&hmac, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
+        KineticHMAC_Populate(&hmac, &msg, &hmacKey);
+    }
+    gettimeofday(&end, NULL);
+    double cached_usec = elapsed_usec(&start, &end);
+
+    assert(expected_len == hmacAuth.hmac.len);
+    assert(memcmp(expected, hmacAuth.hmac.data, expected_len) == 0);
+
+    printf("command %6zu bytes -- keyed per request %8.2f nsec / sign, "
+        "precomputed key %8.2f nsec / sign\n", cmd_len,
+        (1000.0 * rekey_usec) / signs, (1000.0 * cached_usec) / signs);
+
+    KineticHMAC_KeyClear(&hmacKey);
+    free(input);
+    free(cmd);
+}
+
+int main(int argc, char **argv) {
+    size_t signs = DEF_SIGNS;
+    if (argc > 1) { signs = strtoul(argv[1], NULL, 10); }
+
+    const ByteArray key = ByteArray_CreateWithCString("asdfasdf");
+    for (size_t cmd_len = 32; cmd_len <= 4096; cmd_len *= 4) {
+        bench(key, cmd_len, signs);
+    }
+    return 0;
+}
@@ -25,6 +25,14 @@
 #define ATOMIC_BOOL_COMPARE_AND_SWAP(PTR, OLD, NEW)     \
     (__sync_bool_compare_and_swap(PTR, OLD, NEW))
 
+/* Load *PTR, ordered before any later loads and stores. */
+#define ATOMIC_LOAD_ACQUIRE(PTR)                        \
+    (__atomic_load_n(PTR, __ATOMIC_ACQUIRE))
+
+/* Store V in *PTR, ordered after any earlier loads and stores. */
+#define ATOMIC_STORE_RELEASE(PTR, V)                    \
+    (__atomic_store_n(PTR, V, __ATOMIC_RELEASE))
+
 /* Spin attempting to atomically adjust F by ADJ until successful */
 #define SPIN_ADJ(F, ADJ)                                                \
     do {                                                                \
@@ -0,0 +1,228 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "bus.h"
+
+/* Measure round-trip latency at queue depth 1, with each completion
+ * handed to the threadpool (as before) or called directly on the
+ * listener thread (bus_user_msg.inline_cb). The responder echoes each
+ * request from the other end of a socketpair, and the client waits for
+ * each completion on a condition variable, like the blocking API. */
+
+#define DEF_ROUNDS (20 * 1000)
+#define WARMUP_ROUNDS 1000
+
+typedef struct {
+    int64_t seq_id;
+} prot_header_t;
+
+typedef struct {
+    size_t used;
+    uint8_t buf[sizeof(prot_header_t)];
+} socket_info;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool completed;
+    bus_send_status_t status;
+} waiter;
+
+static bus_sink_cb_res_t sink_cb(uint8_t *read_buf,
+        size_t read_size, void *socket_udata) {
+    socket_info *si = (socket_info *)socket_udata;
+    assert(si->used + read_size <= sizeof(si->buf));
+    memcpy(&si->buf[si->used], read_buf, read_size);
+    si->used += read_size;
+
+    bus_sink_cb_res_t res = {
+        .next_read = sizeof(si->buf) - si->used,
+    };
+    if (si->used == sizeof(si->buf)) {
+        si->used = 0;
+        res.next_read = sizeof(si->buf);
+        res.full_msg_buffer = si->buf;
+    }
+    return res;
+}
+
+static bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata) {
+    (void)socket_udata;
+    prot_header_t header;
+    memcpy(&header, msg, sizeof(header));
+    bus_unpack_cb_res_t res = {
+        .ok = true,
+        .u.success = {
+            .seq_id = header.seq_id,
+            .msg = msg,
+        },
+    };
+    return res;
+}
+
+static void unexpected_msg_cb(void *msg,
+        int64_t seq_id, void *bus_udata, void *socket_udata) {
+    (void)msg;
+    (void)bus_udata;
+    (void)socket_udata;
+    errx(1, "unexpected message, seq_id %lld", (long long)seq_id);
+}
+
+static void completion_cb(bus_msg_result_t *res, void *udata) {
+    waiter *w = (waiter *)udata;
+    pthread_mutex_lock(&w->lock);
+    w->status = res->status;
+    w->completed = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Echo each request back as its response, until the socket closes. */
+static void *responder(void *arg) {
+    int fd = *(int *)arg;
+    uint8_t buf[sizeof(prot_header_t)];
+    for (;;) {
+        size_t got = 0;
+        while (got < sizeof(buf)) {
+            ssize_t res = read(fd, &buf[got], sizeof(buf) - got);
+            if (res <= 0) { return NULL; }
+            got += res;
+        }
+        if (write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) { return NULL; }
+    }
+}
+
+static double now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static int64_t seq_id = 1;
+
+static double round_trip(struct bus *b, int fd, bool inline_cb) {
+    waiter w = { .completed = false };
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    prot_header_t header = { .seq_id = seq_id };
+    bus_user_msg msg = {
+        .fd = fd,
+        .type = BUS_SOCKET_PLAIN,
+        .seq_id = seq_id,
+        .msg = (uint8_t *)&header,
+        .msg_size = sizeof(header),
+        .cb = completion_cb,
+        .udata = &w,
+        .timeout_sec = 10,
+        .inline_cb = inline_cb,
+    };
+    seq_id++;
+
+    double start = now_usec();
+    if (!Bus_SendRequest(b, &msg)) { errx(1, "Bus_SendRequest"); }
+    pthread_mutex_lock(&w.lock);
+    while (!w.completed) { pthread_cond_wait(&w.cond, &w.lock); }
+    pthread_mutex_unlock(&w.lock);
+    double usec = now_usec() - start;
+
+    if (w.status != BUS_SEND_SUCCESS) { errx(1, "request failed: %d", w.status); }
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+    return usec;
+}
+
+static void bench(struct bus *b, int fd, bool inline_cb, size_t rounds) {
+    double *usec = calloc(rounds, sizeof(*usec));
+    if (usec == NULL) { err(1, "calloc"); }
+
+    for (size_t i = 0; i < WARMUP_ROUNDS; i++) {
+        (void)round_trip(b, fd, inline_cb);
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < rounds; i++) {
+        usec[i] = round_trip(b, fd, inline_cb);
+        total += usec[i];
+    }
+    qsort(usec, rounds, sizeof(*usec), cmp_double);
+
+    printf("%-10s -- mean %7.2f usec, p50 %7.2f, p99 %7.2f, max %8.2f\n",
+        inline_cb ? "inline" : "threadpool", total / rounds,
+        usec[rounds / 2], usec[(rounds * 99) / 100], usec[rounds - 1]);
+    free(usec);
+}
+
+int main(int argc, char **argv) {
+    size_t rounds = DEF_ROUNDS;
+    if (argc > 1) { rounds = strtoul(argv[1], NULL, 10); }
+    if (rounds == 0) { errx(1, "usage: %s [ROUNDS]", argv[0]); }
+
+    int fds[2];
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) { err(1, "socketpair"); }
+    if (-1 == fcntl(fds[0], F_SETFL, O_NONBLOCK)) { err(1, "fcntl"); }
+
+    pthread_t echo;
+    if (0 != pthread_create(&echo, NULL, responder, &fds[1])) {
+        errx(1, "pthread_create");
+    }
+
+    bus_config cfg = {
+        .sink_cb = sink_cb,
+        .unpack_cb = unpack_cb,
+        .unexpected_msg_cb = unexpected_msg_cb,
+        .listener_count = 1,
+    };
+    bus_result res = {0};
+    if (!Bus_Init(&cfg, &res)) { errx(1, "Bus_Init: %d", res.status); }
+    struct bus *b = res.bus;
+
+    socket_info si = { .used = 0 };
+    if (!Bus_RegisterSocket(b, BUS_SOCKET_PLAIN, fds[0], &si)) {
+        errx(1, "Bus_RegisterSocket");
+    }
+
+    for (int i = 0; i < 2; i++) {
+        bench(b, fds[0], false, rounds);
+        bench(b, fds[0], true, rounds);
+    }
+
+    void *unused = NULL;
+    (void)Bus_ReleaseSocket(b, fds[0], &unused);
+    Bus_Shutdown(b);
+    Bus_Free(b);
+    close(fds[0]);
+    close(fds[1]);
+    pthread_join(echo, NULL);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <err.h>
+#include <sys/time.h>
+
+#include "bus_internal_types.h"
+#include "listener.h"
+#include "listener_helper.h"
+#include "listener_task.h"
+#include "listener_internal_types.h"
+
+/* Measure the cost of looking up in-flight responses by <fd, seq_id>,
+ * as the listener does for every incoming message, with increasing
+ * numbers of messages in flight. The cost per lookup should stay flat. */
+
+#define DEF_LOOKUPS (10 * 1000 * 1000)
+#define SOCKETS 100
+
+static double elapsed_usec(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000.0
+      + (end->tv_usec - start->tv_usec);
+}
+
+static void bench(struct listener *l, int in_flight, size_t lookups) {
+    rx_info_t *infos[MAX_PENDING_MESSAGES];
+
+    /* Spread the in-flight messages over the sockets, with each
+     * socket's sequence IDs increasing monotonically. */
+    for (int i = 0; i < in_flight; i++) {
+        rx_info_t *info = ListenerHelper_GetFreeRXInfo(l);
+        assert(info);
+        int fd = 3 + (i % SOCKETS);
+        int64_t seq_id = 1000 + (i / SOCKETS);
+        info->state = RIS_HOLD;
+        TimerWheel_Schedule(&l->timers, &info->timer, 10000);
+        info->u.hold.fd = fd;
+        info->u.hold.seq_id = seq_id;
+        ListenerHelper_IndexRXInfo(l, info, fd, seq_id);
+        infos[i] = info;
+    }
+
+    struct timeval start;
+    struct timeval end;
+    size_t found = 0;
+    gettimeofday(&start, NULL);
+    for (size_t i = 0; i < lookups; i++) {
+        rx_info_t *info = infos[(i * 7919) % in_flight];
+        if (ListenerHelper_FindInfoBySequenceID(l,
+                info->u.hold.fd, info->u.hold.seq_id) == info) {
+            found++;
+        }
+    }
+    gettimeofday(&end, NULL);
+    assert(found == lookups);
+
+    double usec = elapsed_usec(&start, &end);
+    printf("in flight %5d -- %8.2f nsec / lookup\n",
+        in_flight, (1000.0 * usec) / lookups);
+
+    for (int i = 0; i < in_flight; i++) {
+        ListenerTask_ReleaseRXInfo(l, infos[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t lookups = DEF_LOOKUPS;
+    if (argc > 1) { lookups = strtoul(argv[1], NULL, 10); }
+
+    struct bus b = {
+        .log_level = 0,
+    };
+    struct listener *l = Listener_Init(&b, NULL);
+    if (l == NULL) { errx(1, "Listener_Init"); }
+
+    for (int in_flight = 1; in_flight <= MAX_PENDING_MESSAGES; in_flight *= 2) {
+        bench(l, in_flight, lookups);
+    }
+
+    l->shutdown_notify_fd = LISTENER_SHUTDOWN_COMPLETE_FD;
+    Listener_Free(l);
+    return 0;
+}
@@ -28,6 +28,8 @@
 #include "bus.h"
 #include "bus_poll.h"
 #include "send.h"
+#include "send_queue.h"
+#include "sender.h"
 #include "listener.h"
 #include "threadpool.h"
 #include "bus_internal_types.h"
@@ -41,6 +43,8 @@
 #include "listener_task.h"
 
 static int listener_id_of_socket(struct bus *b, int fd);
+static void release_connection(struct bus *b, connection_info *ci);
+static void close_connection(struct bus *b, connection_info *ci);
 static void noop_log_cb(log_event_t event,
         int log_level, const char *msg, void *udata);
 static void noop_error_cb(bus_unpack_cb_res_t result, void *socket_udata);
@@ -48,6 +52,7 @@ static bool attempt_to_increase_resource_limits(struct bus *b);
 
 static void set_defaults(bus_config *cfg) {
     if (cfg->listener_count == 0) { cfg->listener_count = 1; }
+    if (cfg->sender_count == 0) { cfg->sender_count = cfg->listener_count; }
 }
 
 #ifdef TEST
@@ -74,6 +79,10 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
         res->status = BUS_INIT_ERROR_MISSING_UNPACK_CB;
         return false;
     }
+    if (!Listener_IsSupportedPollBackend(config->poll_backend)) {
+        res->status = BUS_INIT_ERROR_UNSUPPORTED_POLL_BACKEND;
+        return false;
+    }
     if (config->log_cb == NULL) {
         config->log_cb = noop_log_cb;
         config->log_level = INT_MIN;
@@ -86,6 +95,7 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
 
     uint8_t locks_initialized = 0;
     struct listener **ls = NULL;     /* listeners */
+    struct sender **ss = NULL;       /* senders */
     struct threadpool *tp = NULL;
     bool *joined = NULL;
     pthread_t *threads = NULL;
@@ -100,6 +110,8 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
     b->unpack_cb = config->unpack_cb;
     b->unexpected_msg_cb = config->unexpected_msg_cb;
     b->error_cb = config->error_cb;
+    b->match_cb = config->match_cb;
+    b->idle_cb = config->idle_cb;
     b->log_cb = config->log_cb;
     b->log_level = config->log_level;
     b->udata = config->bus_udata;
@@ -108,6 +120,11 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
         goto cleanup;
     }
     locks_initialized++;
+    if (0 != pthread_cond_init(&b->fd_set_released, NULL)) {
+        res->status = BUS_INIT_ERROR_MUTEX_INIT_FAIL;
+        goto cleanup;
+    }
+    locks_initialized++;
 
     attempt_to_increase_resource_limits(b);
 
@@ -136,6 +153,19 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
         goto cleanup;
     }
 
+    ss = calloc(config->sender_count, sizeof(*ss));
+    if (ss == NULL) {
+        goto cleanup;
+    }
+
+    for (int i = 0; i < config->sender_count; i++) {
+        ss[i] = Sender_Init(b);
+        if (ss[i] == NULL) {
+            res->status = BUS_INIT_ERROR_PTHREAD_INIT_FAIL;
+            goto cleanup;
+        }
+    }
+
     int thread_count = config->listener_count;
     joined = calloc(thread_count, sizeof(bool));
     threads = calloc(thread_count, sizeof(pthread_t));
@@ -150,6 +180,8 @@ bool Bus_Init(bus_config *config, struct bus_result *res) {
 
     b->listener_count = config->listener_count;
     b->listeners = ls;
+    b->sender_count = config->sender_count;
+    b->senders = ss;
     b->threadpool = tp;
     b->joined = joined;
     b->threads = threads;
@@ -175,12 +207,24 @@ cleanup:
         }
         free(ls);
     }
+    if (ss) {
+        for (int i = 0; i < config->sender_count; i++) {
+            if (ss[i]) {
+                Sender_Shutdown(ss[i]);
+                Sender_Free(ss[i]);
+            }
+        }
+        free(ss);
+    }
     if (tp) { Threadpool_Free(tp); }
     if (joined) { free(joined); }
     if (b) {
-        if (locks_initialized > 1) {
+        if (locks_initialized > 0) {
             pthread_mutex_destroy(&b->fd_set_lock);
         }
+        if (locks_initialized > 1) {
+            pthread_cond_destroy(&b->fd_set_released);
+        }
         free(b);
     }
 
@@ -225,10 +269,13 @@ static bool attempt_to_increase_resource_limits(struct bus *b) {
 }
 
 /* Pack message to deliver on behalf of the user into an envelope
- * that can track status / routing along the way.
+ * that can track status / routing along the way. This takes a
+ * reference on the connection, which the caller must drop with
+ * release_connection once it's done with it.
  *
  * The box should only ever be accessible on a single thread at a time. */
-static boxed_msg *box_msg(struct bus *b, bus_user_msg *msg) {
+static boxed_msg *box_msg(struct bus *b, bus_user_msg *msg,
+        connection_info **out_ci) {
     boxed_msg *box = NULL;
     #ifdef TEST
     box = test_box;
@@ -249,8 +296,9 @@ static boxed_msg *box_msg(struct bus *b, bus_user_msg *msg) {
     void *value = NULL;
 #endif
     connection_info *ci = NULL;
-    if (Yacht_Get(b->fd_set, box->fd, &value)) {
+    if (b->fd_set && Yacht_Get(b->fd_set, box->fd, &value)) {
         ci = (connection_info *)value;
+        ci->refs++;
     }
     if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
 
@@ -262,62 +310,128 @@ static boxed_msg *box_msg(struct bus *b, bus_user_msg *msg) {
         return NULL;
     } else {
         box->ssl = ci->ssl;
+        *out_ci = ci;
     }
 
-    if ((msg->seq_id <= ci->largest_wr_seq_id_seen)
-            && (ci->largest_wr_seq_id_seen != BUS_NO_SEQ_ID)) {
-        BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 256,
-            "rejecting request <fd:%d, seq_id:%lld> due to non-monotonic sequence ID, largest seen is %lld",
-            box->fd, (long long)msg->seq_id, (long long)ci->largest_wr_seq_id_seen);
-        free(box);
-        return NULL;
+    if (msg->timeout_msec > 0) {
+        box->timeout_msec = msg->timeout_msec;
+    } else if (msg->timeout_sec > 0) {
+        box->timeout_msec = 1000U * msg->timeout_sec;
     } else {
-        ci->largest_wr_seq_id_seen = msg->seq_id;
-    }
-
-    box->timeout_sec = (time_t)msg->timeout_sec;
-    if (box->timeout_sec == 0) {
-        box->timeout_sec = BUS_DEFAULT_TIMEOUT_SEC;
+        box->timeout_msec = 1000U * BUS_DEFAULT_TIMEOUT_SEC;
     }
 
     box->out_seq_id = msg->seq_id;
-    box->out_msg_size = msg->msg_size;
 
     /* Store message by pointer, since the client code calling in is
-     * blocked until we are done sending. */
-    box->out_msg = msg->msg;
+     * blocked until we are done sending. The segment list is copied,
+     * since it may be queued after the caller's frame is gone. */
+    if (msg->msg_iov) {
+        box->out_iovcnt = msg->msg_iovcnt;
+        box->out_msg_size = 0;
+        for (int i = 0; i < msg->msg_iovcnt; i++) {
+            box->out_iov_buf[i] = msg->msg_iov[i];
+            box->out_msg_size += msg->msg_iov[i].iov_len;
+        }
+        box->out_iov = box->out_iov_buf;
+    } else {
+        box->out_msg = msg->msg;
+        box->out_msg_size = msg->msg_size;
+    }
 
     box->cb = msg->cb;
     box->udata = msg->udata;
+    box->inline_cb = msg->inline_cb;
     return box;
 }
 
-bool Bus_SendRequest(struct bus *b, bus_user_msg *msg)
+bool Bus_QueueRequest(struct bus *b, bus_user_msg *msg, bus_send_ticket *ticket)
 {
     if (b == NULL || msg == NULL || msg->fd == -1) {
         return false;
     }
+    if (msg->msg_iov &&
+            (msg->msg_iovcnt < 1 || msg->msg_iovcnt > BUS_MAX_IOV)) {
+        return false;
+    }
 
-    boxed_msg *box = box_msg(b, msg);
+    connection_info *ci = NULL;
+    boxed_msg *box = box_msg(b, msg, &ci);
     if (box == NULL) {
         return false;
     }
 
+    bool pushed = SendQueue_Push(b, ci, box, ticket);
+    /* A ticket keeps the connection until Bus_FlushRequest. */
+    if (!pushed || ticket == NULL) { release_connection(b, ci); }
+    if (!pushed) {
+        free(box);
+        return false;
+    }
+
     BUS_LOG_SNPRINTF(b, 3-0, LOG_SENDING_REQUEST, b->udata, 64,
-        "Sending request <fd:%d, seq_id:%lld>", msg->fd, (long long)msg->seq_id);
-    bool res = Send_DoBlockingSend(b, box);
+        "Queued request <fd:%d, seq_id:%lld>", msg->fd, (long long)msg->seq_id);
+    return true;
+}
+
+bool Bus_FlushRequest(struct bus *b, bus_send_ticket *ticket)
+{
+    connection_info *ci = (connection_info *)ticket->conn;
+    bool res = SendQueue_Flush(b, ci, ticket);
+    release_connection(b, ci);
     BUS_LOG_SNPRINTF(b, 3, LOG_SENDING_REQUEST, b->udata, 64,
         "...request sent, result %d", res);
+    return res;
+}
 
-    /* The send was rejected -- free the box, but don't call the error
-     * handling callback. */
-    if (!res) {
-        BUS_LOG_SNPRINTF(b, 3, LOG_SENDING_REQUEST, b->udata, 64,
-            "Freeing box since request was rejected: %p", (void *)box);
-        free(box);
+bool Bus_SendRequest(struct bus *b, bus_user_msg *msg)
+{
+    bus_send_ticket ticket;
+    if (!Bus_QueueRequest(b, msg, &ticket)) {
+        return false;
     }
+    return Bus_FlushRequest(b, &ticket);
+}
 
-    return res;
+bool Bus_GetSocketStats(struct bus *b, int fd, bus_socket_stats *stats)
+{
+    if (b == NULL || stats == NULL) {
+        return false;
+    }
+
+    /* Hold the hash table lock so the connection can't be freed. */
+    if (0 != pthread_mutex_lock(&b->fd_set_lock)) { assert(false); }
+    #ifndef TEST
+    void *value = NULL;
+    #endif
+    bool found = b->fd_set && Yacht_Get(b->fd_set, fd, &value);
+    if (found) {
+        SendQueue_GetStats((connection_info *)value, stats);
+    }
+    if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
+    return found;
+}
+
+/* Drop a reference on CI taken by box_msg. */
+static void release_connection(struct bus *b, connection_info *ci) {
+    if (0 != pthread_mutex_lock(&b->fd_set_lock)) { assert(false); }
+    assert(ci->refs > 0);
+    ci->refs--;
+    if (ci->refs == 0) { pthread_cond_broadcast(&b->fd_set_released); }
+    if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
+}
+
+/* Fail everything still queued on CI, which has already been removed
+ * from the hash table, then wait until no other thread holds a reference
+ * on it, so it can be freed. */
+static void close_connection(struct bus *b, connection_info *ci) {
+    SendQueue_Close(b, &ci->send_queue);
+
+    if (0 != pthread_mutex_lock(&b->fd_set_lock)) { assert(false); }
+    while (ci->refs > 0) {
+        pthread_cond_wait(&b->fd_set_released, &b->fd_set_lock);
+    }
+    if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
 }
 
 static int listener_id_of_socket(struct bus *b, int fd) {
@@ -329,6 +443,11 @@ struct listener *Bus_GetListenerForSocket(struct bus *b, int fd) {
     return b->listeners[listener_id_of_socket(b, fd)];
 }
 
+static struct sender *sender_of_socket(struct bus *b, int fd) {
+    if (b->sender_count == 0) { return NULL; }
+    return b->senders[fd % b->sender_count];
+}
+
 /* Get the string key for a log event ID. */
 const char *Bus_LogEventStr(log_event_t event) {
     switch (event) {
@@ -364,6 +483,15 @@ bool Bus_RegisterSocket(struct bus *b, bus_socket_t type, int fd, void *udata) {
     connection_info *ci = calloc(1, sizeof(*ci));
     #endif
     if (ci == NULL) { goto cleanup; }
+    SendQueue_Init(&ci->send_queue, sender_of_socket(b, fd));
+
+    /* The sender thread writes to many sockets at once, so it must
+     * never block on a full one. */
+    if (!Util_SetNonblocking(fd)) {
+        BUS_LOG_SNPRINTF(b, 0, LOG_SOCKET_REGISTERED, b->udata, 64,
+            "failed to make socket %d non-blocking", fd);
+        goto cleanup;
+    }
 
     SSL *ssl = NULL;
     if (type == BUS_SOCKET_SSL) {
@@ -408,6 +536,7 @@ bool Bus_RegisterSocket(struct bus *b, bus_socket_t type, int fd, void *udata) {
     return true;
 cleanup:
     if (ci) {
+        SendQueue_Destroy(b, &ci->send_queue);
         free(ci);
     }
     BUS_LOG(b, 2, LOG_SOCKET_REGISTERED, "failed to add socket", b->udata);
@@ -441,7 +570,7 @@ bool Bus_ReleaseSocket(struct bus *b, int fd, void **socket_udata_out) {
     void *old_value = NULL;
     #endif
     if (0 != pthread_mutex_lock(&b->fd_set_lock)) { assert(false); }
-    bool rm_ok = Yacht_Remove(b->fd_set, fd, &old_value);
+    bool rm_ok = b->fd_set && Yacht_Remove(b->fd_set, fd, &old_value);
     if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
     if (!rm_ok) {
         return false;
@@ -449,6 +578,7 @@ bool Bus_ReleaseSocket(struct bus *b, int fd, void **socket_udata_out) {
 
     connection_info *ci = (connection_info *)old_value;
     assert(ci != NULL);
+    close_connection(b, ci);
 
     if (socket_udata_out) { *socket_udata_out = ci->udata; }
 
@@ -460,6 +590,14 @@ bool Bus_ReleaseSocket(struct bus *b, int fd, void **socket_udata_out) {
         res = BusSSL_Disconnect(b, ci->ssl);
     }
 
+    bus_socket_stats stats;
+    SendQueue_GetStats(ci, &stats);
+    BUS_LOG_SNPRINTF(b, 2, LOG_SOCKET_REGISTERED, b->udata, 128,
+        "socket %d sent %llu requests in %llu writes (%.2f per write)",
+        fd, (unsigned long long)stats.requests,
+        (unsigned long long)stats.writes, stats.coalescing);
+
+    SendQueue_Destroy(b, &ci->send_queue);
     free(ci);
     return res;
 }
@@ -486,6 +624,8 @@ void free_connection_cb(void *value, void *udata) {
         return;
     }
 
+    close_connection(b, ci);
+    SendQueue_Destroy(b, &ci->send_queue);
     free(ci);
 }
 
@@ -500,10 +640,15 @@ bool Bus_Shutdown(bus *b) {
         }
     }
 
-    if (b->fd_set) {
+    /* Detach the table first, so no new requests find a connection. */
+    if (0 != pthread_mutex_lock(&b->fd_set_lock)) { assert(false); }
+    struct yacht *fd_set = b->fd_set;
+    b->fd_set = NULL;
+    if (0 != pthread_mutex_unlock(&b->fd_set_lock)) { assert(false); }
+
+    if (fd_set) {
         BUS_LOG(b, 2, LOG_SHUTDOWN, "removing all connections", b->udata);
-        Yacht_Free(b->fd_set, free_connection_cb, b);
-        b->fd_set = NULL;
+        Yacht_Free(fd_set, free_connection_cb, b);
     }
 
     #ifndef TEST
@@ -541,6 +686,14 @@ bool Bus_Shutdown(bus *b) {
         }
     }
 
+    BUS_LOG(b, 2, LOG_SHUTDOWN, "shutting down sender threads", b->udata);
+    for (int i = 0; i < b->sender_count; i++) {
+        if (!Sender_Shutdown(b->senders[i])) {
+            b->shutdown_state = SHUTDOWN_STATE_RUNNING;
+            return false;
+        }
+    }
+
     BUS_LOG(b, 2, LOG_SHUTDOWN, "done with shutdown", b->udata);
     b->shutdown_state = SHUTDOWN_STATE_HALTED;
     return true;
@@ -574,12 +727,23 @@ static void box_cleanup_cb(void *udata) {
 }
 
 /* Deliver a boxed message to the thread pool to execute.
- * The boxed message will be freed by the threadpool. */
+ * The boxed message will be freed by the threadpool.
+ *
+ * If the callback doesn't block and the message was successful, it is
+ * called directly instead, saving a handoff and wakeup. */
 bool Bus_ProcessBoxedMessage(struct bus *b,
         struct boxed_msg *box, size_t *backpressure) {
     assert(box);
     assert(box->result.status != BUS_SEND_UNDEFINED);
 
+    if (box->inline_cb && box->result.status == BUS_SEND_SUCCESS) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
+            "Delivering boxed message -- %p -- inline, where it will be freed", (void*)box);
+        if (backpressure) { *backpressure = 0; }
+        box_execute_cb(box);
+        return true;
+    }
+
     struct threadpool_task task = {
         .task = box_execute_cb,
         .cleanup = box_cleanup_cb,
@@ -608,6 +772,11 @@ void Bus_Free(bus *b) {
     }
     free(b->listeners);
 
+    for (int i = 0; i < b->sender_count; i++) {
+        Sender_Free(b->senders[i]);
+    }
+    free(b->senders);
+
     int limit = (1000 * THREAD_SHUTDOWN_SECONDS)/10;
     for (int i = 0; i < limit; i++) {
         BUS_LOG_SNPRINTF(b, 3, LOG_SHUTDOWN, b->udata, 128,
@@ -626,6 +795,7 @@ void Bus_Free(bus *b) {
     free(b->joined);
     free(b->threads);
     pthread_mutex_destroy(&b->fd_set_lock);
+    pthread_cond_destroy(&b->fd_set_released);
 
     BusSSL_CtxFree(b);
     free(b);
@@ -39,6 +39,34 @@ bool Bus_Init(bus_config *config, struct bus_result *res);
  * */
 bool Bus_SendRequest(struct bus *b, bus_user_msg *msg);
 
+/** Queue a request to be sent, without sending it yet. Requests on a
+ * socket are sent in the order they are queued, so their sequence IDs
+ * must increase.
+ *
+ * Returns false if the request has been rejected, as for Bus_SendRequest.
+ * Otherwise, TICKET tracks the request, and must be passed to
+ * Bus_FlushRequest. The message must not change until then, and the
+ * socket can't be released (Bus_ReleaseSocket waits for it).
+ *
+ * If TICKET is NULL, this returns without waiting for the request to be
+ * written: the socket's sender thread writes it, and if it can't, the
+ * callback gets the error. The message must not change until then.
+ * */
+bool Bus_QueueRequest(struct bus *b, bus_user_msg *msg, bus_send_ticket *ticket);
+
+/** Block until a queued request has been transmitted. If no other thread
+ * is writing to its socket, this writes it, along with any other queued
+ * requests, gathering as many of them into each write as possible.
+ *
+ * Returns whether the request was accepted, as for Bus_SendRequest.
+ * */
+bool Bus_FlushRequest(struct bus *b, bus_send_ticket *ticket);
+
+/** Get statistics about the requests sent on a socket, including how
+ * many were coalesced into each write. Returns false if the socket
+ * isn't registered. */
+bool Bus_GetSocketStats(struct bus *b, int fd, bus_socket_stats *stats);
+
 /** Register a socket connected to an endpoint, and data that will be passed
  * to all interactions on that socket.
  *
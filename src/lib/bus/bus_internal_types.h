@@ -28,6 +28,25 @@
 #include "bus.h"
 #include "yacht.h"
 
+/* epoll(7) is only available on Linux; elsewhere, listeners always
+ * use poll(2). */
+#ifdef __linux__
+#define BUS_HAVE_EPOLL 1
+#include <sys/epoll.h>
+#else
+#define BUS_HAVE_EPOLL 0
+#endif
+
+/* The io_uring backend needs Linux 5.19+ headers, so it is only built
+ * when BUS_USE_IO_URING is defined (`make BUS_IO_URING=1`). When it's
+ * not built, or the kernel doesn't support it, listeners use epoll. */
+#if BUS_HAVE_EPOLL && defined(BUS_USE_IO_URING)
+#define BUS_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#else
+#define BUS_HAVE_IO_URING 0
+#endif
+
 /* Struct for a message that will be passed from client to listener to
  * threadpool, proceeding directly to the threadpool if there is an error
  * along the way. This must only have a single owner at a time. */
@@ -37,12 +56,13 @@ typedef struct boxed_msg {
      * has completed or failed due to timeout / unrecoverable error. */
     bus_msg_result_t result;
 
-    /** Message send timeout. */
-    time_t timeout_sec;
+    /** Message send timeout, in msec. */
+    uint32_t timeout_msec;
 
     /** Callback and userdata to which the bus_msg_result_t above will be sunk. */
     bus_msg_cb *cb;
     void *udata;
+    bool inline_cb;             ///< see bus_user_msg.inline_cb
 
     /** Event timestamps to track timeouts. */
     struct timeval tv_send_start;
@@ -53,8 +73,17 @@ typedef struct boxed_msg {
     SSL *ssl;                   ///< valid pointer or BUS_BOXED_MSG_NO_SSL
     int64_t out_seq_id;
     uint8_t *out_msg;
+    const struct iovec *out_iov; ///< segments to gather, or NULL to send out_msg
+    int out_iovcnt;
     size_t out_msg_size;
     size_t out_sent_size;
+
+    /** Copy of the user's segments, which out_iov points to. */
+    struct iovec out_iov_buf[BUS_MAX_IOV];
+
+    /** Connection send queue linkage, while waiting to be sent. */
+    struct boxed_msg *next;
+    bus_send_ticket *ticket;
 } boxed_msg;
 
 /** Special "NO SSL" value, to distinguish from a NULL SSL handle. */
@@ -72,6 +101,8 @@ typedef struct bus {
     bus_unpack_cb *unpack_cb;         ///< Message unpacking callback
     bus_unexpected_msg_cb *unexpected_msg_cb; //< Unexpected message callback
     bus_error_cb *error_cb;           ///< Error handling callback
+    bus_match_cb *match_cb;           ///< Request matching callback, or NULL
+    bus_idle_cb *idle_cb;             ///< Idle socket callback, or NULL
     void *udata;                      ///< User data for callbacks
 
     int log_level;                    ///< Log level
@@ -82,6 +113,9 @@ typedef struct bus {
 
     bool *joined;                     ///< Which threads have joined
     pthread_t *threads;               ///< Threads
+
+    uint8_t sender_count;             ///< Number of sender threads
+    struct sender **senders;          ///< Sender array
     shutdown_state_t shutdown_state;  ///< Current shutdown state
 
     struct threadpool *threadpool;    ///< Thread pool
@@ -90,6 +124,7 @@ typedef struct bus {
     /** Locked hash table for fd -> connection_info */
     struct yacht *fd_set;
     pthread_mutex_t fd_set_lock;
+    pthread_cond_t fd_set_released;   ///< a connection's refs reached 0
 } bus;
 
 /** Special timeout value indicating UNBOUND. */
@@ -105,6 +140,58 @@ typedef enum {
     RX_ERROR_TIMEOUT = -34,
 } rx_error_t;
 
+/** Requests waiting to be written to a socket. Whichever client thread
+ * finds no writer active becomes the writer, and drains the queue with
+ * gathered writes until its own request has been sent. Requests that
+ * nobody is waiting on are written by the socket's sender thread, which
+ * polls all of its queues' sockets at once and never blocks on one. */
+typedef struct send_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t sent;        ///< signalled as requests are sent
+    boxed_msg *head;
+    boxed_msg *tail;
+    bool writing;               ///< whether a thread is writing the queue
+    bool closing;               ///< being destroyed; refuses new requests and writers
+    uint32_t waiters;           ///< threads in SendQueue_Flush
+
+    struct sender *sender;      ///< sender thread for unwaited requests
+    bool scheduled;             ///< whether it's on the sender's ready list
+    struct send_queue *next_ready;  ///< next queue on the sender's ready list
+    struct send_queue *next_active; ///< next queue the sender is writing
+
+    /* The batch the sender thread is writing, which it owns while
+     * writing is set. It's written as the socket becomes writable, and
+     * how much of each box has been sent is kept in the box, so a slow
+     * socket only holds up its own queue. */
+    boxed_msg *batch[BUS_MAX_BATCH];
+    bus_send_ticket *batch_tickets[BUS_MAX_BATCH];
+    size_t batch_count;         ///< boxes registered with the listener
+    size_t batch_sent;          ///< boxes sent (or failed) so far
+    struct timeval batch_start;
+    uint32_t batch_timeout_msec;
+
+    uint64_t requests;          ///< requests written
+    uint64_t writes;            ///< writer passes they were written in
+} send_queue;
+
+/** A sender thread, which writes the send queues scheduled with it.
+ * It polls the sockets of all of its active queues at once, and writes
+ * whichever are writable without blocking. */
+typedef struct sender {
+    struct bus *bus;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;        ///< signalled as queues are dropped
+    int wake_pipe[2];           ///< written to wake the thread from poll
+    bool woken;                 ///< whether wake_pipe has unread data
+    send_queue *head;           ///< ready list
+    send_queue *tail;
+    send_queue *active;         ///< queues with a batch being written
+    size_t active_count;
+    send_queue *current;        ///< queue being started, if any
+    bool shutdown;
+} sender;
+
 /** Per-socket connection context. (Owned by the listener.) */
 typedef struct {
     /* Shared */
@@ -115,12 +202,23 @@ typedef struct {
     /* Shared, cleaned up by client */
     SSL *ssl;                   ///< SSL handle. Must be valid or BUS_NO_SSL.
 
-    /** Set by client thread. Monotonically increasing max sequence ID. */
+    /** Set by client thread, with send_queue.lock held. Monotonically
+     * increasing max sequence ID. */
     int64_t largest_wr_seq_id_seen;
 
+    /* Shared by client threads */
+    send_queue send_queue;
+
+    /** Client threads queueing or flushing requests on the connection,
+     * which must finish before it's freed. Guarded by the bus's
+     * fd_set_lock. */
+    uint32_t refs;
+
     /* Set by listener thread */
     rx_error_t error;
     size_t to_read_size;
+    struct rx_info_t *match;    ///< request the sink is receiving into, if any
+    bool idle_check;            ///< call idle_cb at the listener's next idle check
 } connection_info;
 
 /** Arbitrary byte used to tag writes from the listener. */
@@ -27,7 +27,8 @@ const char *Bus_LogEventStr(log_event_t event);
  * This will level sockets between multiple threads. */
 struct listener *Bus_GetListenerForSocket(struct bus *b, int fd);
 
-/** Deliver a boxed message to the thread pool to execute. */
+/** Deliver a boxed message to the thread pool to execute, or execute
+ * it directly if its callback is marked inline and it succeeded. */
 bool Bus_ProcessBoxedMessage(struct bus *b,
     struct boxed_msg *box, size_t *backpressure);
 
@@ -20,6 +20,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "threadpool.h"
 
@@ -36,6 +37,13 @@ struct boxed_msg;
 /* Special sequence ID value indicating none was available. */
 #define BUS_NO_SEQ_ID (-1)
 
+/* Max number of segments in a gathered (msg_iov) message. */
+#define BUS_MAX_IOV 8
+
+/* Max number of queued messages a socket's SendQueue writes together,
+ * and that KineticOperation_SendRequests queues under one send lock. */
+#define BUS_MAX_BATCH 64
+
 #ifdef TEST
 #define BUS_LOG(B, LEVEL, EVENT_KEY, MSG, UDATA) (void)B
 #define BUS_LOG_SNPRINTF(B, LEVEL, EVENT_KEY, UDATA, MAX_SZ, FMT, ...) (void)B
@@ -111,11 +119,19 @@ typedef void (bus_log_cb)(log_event_t event, int log_level, const char *msg, voi
 typedef struct {
     size_t next_read;           /* size for next read */
     void *full_msg_buffer;      /* can be NULL */
+
+    /* If MATCH is set, look up the pending request with sequence ID
+     * SEQ_ID before sinking any more, see bus_match_cb below. */
+    bool match;
+    int64_t seq_id;
 } bus_sink_cb_res_t;
 
 /* Sink READ_SIZE bytes in READ_BUF into a protocol handler. This read
- * size is based on the previously requested size. (If the size for the
- * next request is undefined, this can be called with a READ_SIZE of 0.)
+ * size is based on the previously requested size: it will never be
+ * larger, but may be smaller if that's all that has arrived so far.
+ * The listener reads as much as is available, so one read is passed
+ * along in as many calls as it takes to sink all of it. (If the size for
+ * the next request is undefined, this can be called with a READ_SIZE of 0.)
  *
  * The (void *) that was passed in during Bus_RegisterSocket will be
  * passed along.
@@ -128,6 +144,17 @@ typedef struct {
 typedef bus_sink_cb_res_t (bus_sink_cb)(uint8_t *read_buf,
     size_t read_size, void *socket_udata);
 
+/* Pass the udata of the pending request with sequence ID SEQ_ID to the
+ * protocol handler, after bus_sink_cb asked for it to be matched. This
+ * lets the rest of the response be received directly into buffers the
+ * request's udata points to, rather than accumulated and copied.
+ *
+ * It's only called if the request has been sent and is still waiting
+ * for its response. If the request is completed (e.g. by a timeout)
+ * before the sink has completed the response, this is called again with
+ * a NULL MSG_UDATA, after which the sink must not touch those buffers. */
+typedef void (bus_match_cb)(int64_t seq_id, void *msg_udata, void *socket_udata);
+
 /* Result from an attempting to unpack a message according to the user
  * protocol's unpack callback. See bus_unpack_cb below. */
 typedef struct {
@@ -157,17 +184,41 @@ typedef void (bus_error_cb)(bus_unpack_cb_res_t result, void *socket_udata);
 typedef void (bus_unexpected_msg_cb)(void *msg,
     int64_t seq_id, void *bus_udata, void *socket_udata);
 
+/* Release per-socket resources, such as a grown reassembly buffer, once
+ * they have gone unused. This is called on the listener thread about
+ * once a second after the socket has received a message, and again each
+ * second for as long as it returns true, to say the socket still holds
+ * something that may be released later. It's never called while the
+ * socket is idle and holds nothing. */
+typedef bool (bus_idle_cb)(void *socket_udata);
+
+/* How listener threads wait for incoming data. */
+typedef enum {
+    BUS_POLL_BACKEND_POLL = 0,  /* poll(2), on all platforms (default) */
+    BUS_POLL_BACKEND_EPOLL = 1, /* epoll(7), only on Linux */
+    BUS_POLL_BACKEND_IO_URING = 2, /* io_uring(7), if built with it;
+                                    * falls back to epoll or poll */
+} bus_poll_backend_t;
+
 /* Configuration for the messaging bus */
 typedef struct bus_config {
     /* If omitted, these fields will be set to defaults. */
     int listener_count;
+    int sender_count;           /* threads writing async requests */
     struct threadpool_config threadpool_cfg;
 
+    /* With epoll, each wakeup only costs time proportional to the
+     * number of sockets that are ready, rather than the number of
+     * sockets registered with the listener. */
+    bus_poll_backend_t poll_backend;
+
     /* Callbacks */
     bus_sink_cb *sink_cb;       /* required */
     bus_unpack_cb *unpack_cb;   /* required */
     bus_unexpected_msg_cb *unexpected_msg_cb;
     bus_error_cb *error_cb;
+    bus_match_cb *match_cb;     /* optional */
+    bus_idle_cb *idle_cb;       /* optional */
 
     int log_level;
     bus_log_cb *log_cb;         /* optional */
@@ -186,6 +237,7 @@ typedef enum {
     BUS_INIT_ERROR_THREADPOOL_INIT_FAIL = -7,
     BUS_INIT_ERROR_PTHREAD_INIT_FAIL = -8,
     BUS_INIT_ERROR_MUTEX_INIT_FAIL = -9,
+    BUS_INIT_ERROR_UNSUPPORTED_POLL_BACKEND = -10,
 } Bus_Init_res_t;
 
 typedef enum {
@@ -238,12 +290,42 @@ typedef struct {
     int64_t seq_id;
     uint8_t *msg;
     size_t msg_size;
+
+    /* If non-NULL, the message is gathered from MSG_IOVCNT segments
+     * instead of MSG, and MSG_SIZE is ignored. The segments are sent
+     * from where they are, so they must not change until the callback
+     * has been called. */
+    const struct iovec *msg_iov;
+    int msg_iovcnt;
+
     uint16_t timeout_sec;
+    uint32_t timeout_msec;  ///< if non-zero, used instead of timeout_sec
 
     bus_msg_cb *cb;
     void *udata;
+
+    /* If set, CB never blocks, so a successful response may be
+     * delivered by calling CB directly on the listener thread instead
+     * of handing it to the threadpool. Failures still go through the
+     * threadpool. */
+    bool inline_cb;
 } bus_user_msg;
 
+/* A request queued by Bus_QueueRequest, until Bus_FlushRequest has
+ * seen it sent. */
+typedef struct {
+    void *conn;         ///< connection the request is queued on
+    bool done;          ///< set once a writer has tried to send it
+    bool accepted;      ///< set if it was sent, as for Bus_SendRequest
+} bus_send_ticket;
+
+/* Statistics about the requests sent on a socket. */
+typedef struct {
+    uint64_t requests;  ///< requests written to the socket
+    uint64_t writes;    ///< gathered writes they were coalesced into
+    double coalescing;  ///< average requests per gathered write
+} bus_socket_stats;
+
 /* This opaque bus struct represents the only user-facing interface to
  * the network handling code. Callbacks are provided to react to network
  * events. */
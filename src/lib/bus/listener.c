@@ -31,9 +31,13 @@
 #include "listener_cmd.h"
 #include "listener_task.h"
 #include "listener_internal.h"
+#include "listener_uring.h"
 #include "syscall.h"
 #include "util.h"
 
+static bool init_io_uring(struct listener *l);
+static bool init_epoll(struct listener *l);
+
 struct listener *Listener_Init(struct bus *b, struct bus_config *cfg) {
     struct listener *l = calloc(1, sizeof(*l));
     if (l == NULL) { return NULL; }
@@ -42,8 +46,18 @@ struct listener *Listener_Init(struct bus *b, struct bus_config *cfg) {
     l->bus = b;
     BUS_LOG(b, 2, LOG_LISTENER, "init", b->udata);
 
+    /* Start with a read buffer large enough to read many responses at
+     * once. It will grow if a single response needs more. */
+    l->read_buf = malloc(DEFAULT_READ_BUF_SIZE);
+    if (l->read_buf == NULL) {
+        free(l);
+        return NULL;
+    }
+    l->read_buf_size = DEFAULT_READ_BUF_SIZE;
+
     int pipes[2];
     if (0 != pipe(pipes)) {
+        free(l->read_buf);
         free(l);
         return NULL;
     }
@@ -77,6 +91,7 @@ struct listener *Listener_Init(struct bus *b, struct bus_config *cfg) {
             }
             syscall_close(l->commit_pipe);
             syscall_close(l->incoming_msg_pipe);
+            free(l->read_buf);
             free(l);
             return NULL;
         }
@@ -84,11 +99,79 @@ struct listener *Listener_Init(struct bus *b, struct bus_config *cfg) {
         l->msg_freelist = msg;
     }
     l->rx_info_max_used = 0;
-
-    (void)cfg;
+    TimerWheel_Init(&l->timers, 0);
+
+    l->poll_backend = (cfg ? cfg->poll_backend : BUS_POLL_BACKEND_POLL);
+    if (l->poll_backend == BUS_POLL_BACKEND_IO_URING && !init_io_uring(l)) {
+        l->poll_backend = (BUS_HAVE_EPOLL ? BUS_POLL_BACKEND_EPOLL : BUS_POLL_BACKEND_POLL);
+        BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 64,
+            "io_uring is unavailable, using %s",
+            (BUS_HAVE_EPOLL ? "epoll" : "poll"));
+    }
+    if (!init_epoll(l)) {
+        for (int i = 0; i < MAX_QUEUE_MESSAGES; i++) {
+            listener_msg *msg = &l->msgs[i];
+            syscall_close(msg->pipes[0]);
+            syscall_close(msg->pipes[1]);
+        }
+        syscall_close(l->commit_pipe);
+        syscall_close(l->incoming_msg_pipe);
+        free(l->read_buf);
+        free(l);
+        return NULL;
+    }
     return l;
 }
 
+bool Listener_IsSupportedPollBackend(bus_poll_backend_t backend) {
+    switch (backend) {
+    case BUS_POLL_BACKEND_POLL:
+        return true;
+    case BUS_POLL_BACKEND_EPOLL:
+        return BUS_HAVE_EPOLL;
+    case BUS_POLL_BACKEND_IO_URING:
+        return true;            /* falls back if unavailable */
+    default:
+        return false;
+    }
+}
+
+static bool init_io_uring(struct listener *l) {
+#if BUS_HAVE_IO_URING
+    return ListenerUring_Init(l);
+#else
+    (void)l;
+    return false;
+#endif
+}
+
+/* If the listener is using epoll, create its epoll instance and register
+ * the incoming command pipe. Sockets are registered as they are added. */
+static bool init_epoll(struct listener *l) {
+#if BUS_HAVE_EPOLL
+    l->epoll_fd = LISTENER_NO_FD;
+    if (l->poll_backend != BUS_POLL_BACKEND_EPOLL) { return true; }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) { return false; }
+
+    /* The command pipe is the only fd registered with a NULL data.ptr. */
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+    if (-1 == syscall_epoll_ctl(epoll_fd, EPOLL_CTL_ADD,
+            l->incoming_msg_pipe, &ev)) {
+        syscall_close(epoll_fd);
+        return false;
+    }
+    l->epoll_fd = epoll_fd;
+    return true;
+#else
+    return l->poll_backend != BUS_POLL_BACKEND_EPOLL;
+#endif
+}
+
 bool Listener_AddSocket(struct listener *l,
         connection_info *ci, int *notify_fd) {
     listener_msg *msg = ListenerHelper_GetFreeMsg(l);
@@ -111,7 +194,7 @@ bool Listener_RemoveSocket(struct listener *l, int fd, int *notify_fd) {
 }
 
 bool Listener_HoldResponse(struct listener *l, int fd,
-        int64_t seq_id, int16_t timeout_sec, int *notify_fd) {
+        int64_t seq_id, uint32_t timeout_msec, uint16_t *backpressure) {
     listener_msg *msg = ListenerHelper_GetFreeMsg(l);
     struct bus *b = l->bus;
     if (msg == NULL) {
@@ -126,10 +209,10 @@ bool Listener_HoldResponse(struct listener *l, int fd,
     msg->type = MSG_HOLD_RESPONSE;
     msg->u.hold.fd = fd;
     msg->u.hold.seq_id = seq_id;
-    msg->u.hold.timeout_sec = timeout_sec;
-    msg->u.hold.notify_fd = msg->pipes[1];
+    msg->u.hold.timeout_msec = timeout_msec;
+    *backpressure = ListenerTask_GetBackpressure(l);
 
-    bool pm_res = ListenerHelper_PushMessage(l, msg, notify_fd);
+    bool pm_res = ListenerHelper_PushRXMessage(l, msg);
     if (!pm_res) {
         BUS_LOG_SNPRINTF(b, 0, LOG_MEMORY, b->udata, 128,
             "Listener_HoldResponse with <fd:%d, seq_id:%lld> FAILED",
@@ -157,10 +240,10 @@ bool Listener_ExpectResponse(struct listener *l, boxed_msg *box,
     *backpressure = ListenerTask_GetBackpressure(l);
     BUS_ASSERT(b, b->udata, box->result.status != BUS_SEND_UNDEFINED);
 
-    bool pm = ListenerHelper_PushMessage(l, msg, NULL);
+    bool pm = ListenerHelper_PushRXMessage(l, msg);
     if (!pm) {
         BUS_LOG_SNPRINTF(b, 0, LOG_MEMORY, b->udata, 128,
-            "! ListenerHelper_PushMessage fail %p", (void*)box);
+            "! ListenerHelper_PushRXMessage fail %p", (void*)box);
     }
     return pm;
 }
@@ -229,6 +312,16 @@ void Listener_Free(struct listener *l) {
 
         syscall_close(l->commit_pipe);
         syscall_close(l->incoming_msg_pipe);
+#if BUS_HAVE_EPOLL
+        if (l->poll_backend == BUS_POLL_BACKEND_EPOLL) {
+            syscall_close(l->epoll_fd);
+        }
+#endif
+#if BUS_HAVE_IO_URING
+        if (l->poll_backend == BUS_POLL_BACKEND_IO_URING) {
+            ListenerUring_Free(l);
+        }
+#endif
 
         free(l);
     }
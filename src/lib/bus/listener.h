@@ -22,7 +22,7 @@
 #include "bus_internal_types.h"
 
 /** How many bits to >> the backpressure value from commands
- * delivered to the listener. */
+ * delivered to the listener, and from HOLD messages. */
 #define LISTENER_BACKPRESSURE_SHIFT 0 /* TODO */
 
 /** How many bits to >> the backpressure value from the listener when a
@@ -36,15 +36,18 @@ struct listener;
 /** Initialize the listener. */
 struct listener *Listener_Init(struct bus *b, struct bus_config *cfg);
 
+/** Can listeners use this poll backend on this platform? */
+bool Listener_IsSupportedPollBackend(bus_poll_backend_t backend);
+
 /** Add/remove sockets' metadata from internal info. Blocking. */
 bool Listener_AddSocket(struct listener *l, connection_info *ci, int *notify_fd);
 bool Listener_RemoveSocket(struct listener *l, int fd, int *notify_fd);
 
 /** The client is about to start a write, the listener should hold on to
- * the response (with timeout) if it arrives before receiving further
- * instructions from the client. */
+ * the response (for up to TIMEOUT_MSEC) if it arrives before receiving
+ * further instructions from the client. Non-blocking. */
 bool Listener_HoldResponse(struct listener *l, int fd,
-    int64_t seq_id, int16_t timeout_sec, int *notify_fd);
+    int64_t seq_id, uint32_t timeout_msec, uint16_t *backpressure);
 
 /** The client has finished a write, the listener should expect a response. */
 bool Listener_ExpectResponse(struct listener *l, boxed_msg *box,
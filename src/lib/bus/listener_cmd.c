@@ -24,11 +24,17 @@
 #include "listener_cmd_internal.h"
 #include "listener_task.h"
 #include "listener_helper.h"
+#include "listener_uring.h"
+#include "atomic.h"
 
 static void msg_handler(listener *l, listener_msg *pmsg);
 static void add_socket(listener *l, connection_info *ci, int notify_fd);
 static void remove_socket(listener *l, int fd, int notify_fd);
-static void hold_response(listener *l, int fd, int64_t seq_id, int16_t timeout_sec, int notify_fd);
+static bool register_socket(listener *l, connection_info *ci);
+#if BUS_HAVE_EPOLL
+static void forget_epoll_socket(listener *l, connection_info *ci, bool is_active);
+#endif
+static void hold_response(listener *l, int fd, int64_t seq_id, uint32_t timeout_msec);
 static void expect_response(listener *l, boxed_msg *box);
 static void shutdown(listener *l, int notify_fd);
 
@@ -97,6 +103,9 @@ void ListenerCmd_CheckIncomingMessages(listener *l, int *res) {
             } else {
                 for (ssize_t i = 0; i < rd; i++) {
                     uint8_t msg_id = cmd_buf[i];
+                    if (msg_id == LISTENER_DOORBELL_ID) {
+                        continue;  /* RX queue is checked below */
+                    }
                     listener_msg *msg = &l->msgs[msg_id];
                     msg_handler(l, msg);
                 }
@@ -105,6 +114,34 @@ void ListenerCmd_CheckIncomingMessages(listener *l, int *res) {
             }
         }
     }
+
+    /* Register any pending HOLDs/EXPECTs before reading responses. */
+    ListenerCmd_ProcessRXQueue(l);
+}
+
+void ListenerCmd_ProcessRXQueue(listener *l) {
+    listener_msg *head = NULL;
+    for (;;) {
+        head = l->rx_queue;
+        if (head == NULL) { return; }
+        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&l->rx_queue, head, NULL)) { break; }
+    }
+
+    /* Messages were pushed onto a stack, so reverse them to process
+     * them in the order they were sent. */
+    listener_msg *fifo = NULL;
+    while (head) {
+        listener_msg *next = head->next;
+        head->next = fifo;
+        fifo = head;
+        head = next;
+    }
+
+    while (fifo) {
+        listener_msg *next = fifo->next;  /* msg_handler releases it */
+        msg_handler(l, fifo);
+        fifo = next;
+    }
 }
 
 static void msg_handler(listener *l, listener_msg *pmsg) {
@@ -112,8 +149,6 @@ static void msg_handler(listener *l, listener_msg *pmsg) {
     BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 128,
         "Handling message -- %p, type %d", (void*)pmsg, pmsg->type);
 
-    l->is_idle = false;
-
     listener_msg msg = *pmsg;
     switch (msg.type) {
 
@@ -125,7 +160,7 @@ static void msg_handler(listener *l, listener_msg *pmsg) {
         break;
     case MSG_HOLD_RESPONSE:
         hold_response(l, msg.u.hold.fd, msg.u.hold.seq_id,
-            msg.u.hold.timeout_sec, msg.u.hold.notify_fd);
+            msg.u.hold.timeout_msec);
         break;
     case MSG_EXPECT_RESPONSE:
         expect_response(l, msg.u.expect.box);
@@ -157,7 +192,6 @@ static void swap(listener *l, int a, int b) {
 }
 
 static void add_socket(listener *l, connection_info *ci, int notify_fd) {
-    /* TODO: if epoll, just register with the OS. */
     struct bus *b = l->bus;
     BUS_LOG(b, 3, LOG_LISTENER, "adding socket", b->udata);
 
@@ -175,6 +209,23 @@ static void add_socket(listener *l, connection_info *ci, int notify_fd) {
         }
     }
 
+    /* Prime the pump by sinking 0 bytes and getting a size to expect. */
+    bus_sink_cb_res_t sink_res = b->sink_cb(l->read_buf, 0, ci->udata);
+    BUS_ASSERT(b, b->udata, sink_res.full_msg_buffer == NULL);  // should have nothing to handle yet
+    ci->to_read_size = sink_res.next_read;
+
+    if (!ListenerTask_GrowReadBuf(l, ci->to_read_size)) {
+        free(ci);
+        ListenerCmd_NotifyCaller(l, notify_fd);
+        return;             /* alloc failure */
+    }
+
+    if (!register_socket(l, ci)) {
+        free(ci);
+        ListenerCmd_NotifyCaller(l, notify_fd);
+        return;
+    }
+
     int id = l->tracked_fds;
     l->fd_info[id] = ci;
     l->fds[id + INCOMING_MSG_PIPE].fd = ci->fd;
@@ -198,21 +249,46 @@ static void add_socket(listener *l, connection_info *ci, int notify_fd) {
         }
     }
 
-    /* Prime the pump by sinking 0 bytes and getting a size to expect. */
-    bus_sink_cb_res_t sink_res = b->sink_cb(l->read_buf, 0, ci->udata);
-    BUS_ASSERT(b, b->udata, sink_res.full_msg_buffer == NULL);  // should have nothing to handle yet
-    ci->to_read_size = sink_res.next_read;
-
-    if (!ListenerTask_GrowReadBuf(l, ci->to_read_size)) {
-        free(ci);
-        ListenerCmd_NotifyCaller(l, notify_fd);
-        return;             /* alloc failure */
-    }
-
     BUS_LOG(b, 3, LOG_LISTENER, "added socket", b->udata);
     ListenerCmd_NotifyCaller(l, notify_fd);
 }
 
+/* Start watching a new socket with the listener's epoll instance or
+ * io_uring, if it uses one. (With poll, adding its pollfd is enough.) */
+static bool register_socket(listener *l, connection_info *ci) {
+    struct bus *b = l->bus;
+    (void)b;
+    switch (l->poll_backend) {
+#if BUS_HAVE_EPOLL
+    case BUS_POLL_BACKEND_EPOLL:
+    {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = ci,
+        };
+        if (-1 == syscall_epoll_ctl(l->epoll_fd, EPOLL_CTL_ADD, ci->fd, &ev)) {
+            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
+                "epoll_ctl failure adding socket %d: %s", ci->fd, strerror(errno));
+            errno = 0;
+            return false;
+        }
+        return true;
+    }
+#endif
+#if BUS_HAVE_IO_URING
+    case BUS_POLL_BACKEND_IO_URING:
+        if (!ListenerUring_AddSocket(l, ci)) {
+            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
+                "io_uring failure adding socket %d", ci->fd);
+            return false;
+        }
+        return true;
+#endif
+    default:
+        return true;
+    }
+}
+
 static void remove_socket(listener *l, int fd, int notify_fd) {
     struct bus *b = l->bus;
     BUS_LOG_SNPRINTF(b, 2, LOG_LISTENER, b->udata, 128,
@@ -224,6 +300,19 @@ static void remove_socket(listener *l, int fd, int notify_fd) {
         struct pollfd removing_pfd = l->fds[id + INCOMING_MSG_PIPE];
         if (removing_pfd.fd == fd) {
             bool is_active = (removing_pfd.events & POLLIN) > 0;
+            if (l->fd_info[id]->match) {
+                ListenerHelper_UnmatchRXInfo(l, l->fd_info[id], true);
+            }
+#if BUS_HAVE_EPOLL
+            if (l->poll_backend == BUS_POLL_BACKEND_EPOLL) {
+                forget_epoll_socket(l, l->fd_info[id], is_active);
+            }
+#endif
+#if BUS_HAVE_IO_URING
+            if (l->poll_backend == BUS_POLL_BACKEND_IO_URING) {
+                ListenerUring_RemoveSocket(l, l->fd_info[id]);
+            }
+#endif
             if (l->tracked_fds > 1) {
                 int last_active = l->tracked_fds - l->inactive_fds - 1;
 
@@ -253,8 +342,25 @@ static void remove_socket(listener *l, int fd, int notify_fd) {
     ListenerCmd_NotifyCaller(l, notify_fd);
 }
 
+#if BUS_HAVE_EPOLL
+/* Stop epoll from reporting a socket that is being removed, and drop
+ * any events for it left from the current wakeup, since the client
+ * may free its connection_info once it has been notified. (Inactive
+ * sockets were already unregistered when they errored.) */
+static void forget_epoll_socket(listener *l, connection_info *ci, bool is_active) {
+    if (is_active) {
+        (void)syscall_epoll_ctl(l->epoll_fd, EPOLL_CTL_DEL, ci->fd, NULL);
+    }
+    for (int i = 0; i < l->epoll_ready; i++) {
+        if (l->epoll_events[i].data.ptr == ci) {
+            l->epoll_events[i].events = 0;
+        }
+    }
+}
+#endif
+
 static void hold_response(listener *l, int fd, int64_t seq_id,
-        int16_t timeout_sec, int notify_fd) {
+        uint32_t timeout_msec) {
     struct bus *b = l->bus;
 
     BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 128,
@@ -265,7 +371,6 @@ static void hold_response(listener *l, int fd, int64_t seq_id,
         BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
             "failed to get free rx_info for <fd:%d, seq_id:%lld>, dropping it",
             fd, (long long)seq_id);
-        ListenerCmd_NotifyCaller(l, notify_fd);
         return;
     }
     BUS_ASSERT(b, b->udata, info);
@@ -275,12 +380,12 @@ static void hold_response(listener *l, int fd, int64_t seq_id,
         (void *)info, info->id, fd, (long long)seq_id);
 
     info->state = RIS_HOLD;
-    info->timeout_sec = timeout_sec;
+    TimerWheel_Schedule(&l->timers, &info->timer, timeout_msec);
     info->u.hold.fd = fd;
     info->u.hold.seq_id = seq_id;
     info->u.hold.has_result = false;
     memset(&info->u.hold.result, 0, sizeof(info->u.hold.result));
-    ListenerCmd_NotifyCaller(l, notify_fd);
+    ListenerHelper_IndexRXInfo(l, info, fd, seq_id);
 }
 
 static void expect_response(listener *l, struct boxed_msg *box) {
@@ -333,7 +438,7 @@ static void expect_response(listener *l, struct boxed_msg *box) {
             info->u.expect.error = RX_ERROR_NONE;
             info->u.expect.has_result = false;
             /* Switch over to client's transferred timeout */
-            info->timeout_sec = box->timeout_sec;
+            TimerWheel_Schedule(&l->timers, &info->timer, box->timeout_msec);
         }
     } else if (info && info->state == RIS_EXPECT) {
         /* Multiple identical EXPECTs should never happen, outside of
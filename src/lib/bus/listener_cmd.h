@@ -26,4 +26,7 @@ void ListenerCmd_NotifyCaller(listener *l, int fd);
 /** Process incoming commands, if any. */
 void ListenerCmd_CheckIncomingMessages(listener *l, int *res);
 
+/** Process HOLD and EXPECT messages queued by senders, if any. */
+void ListenerCmd_ProcessRXQueue(listener *l);
+
 #endif
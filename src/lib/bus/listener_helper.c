@@ -95,6 +95,48 @@ bool ListenerHelper_PushMessage(struct listener *l, listener_msg *msg, int *repl
     }
 }
 
+bool ListenerHelper_PushRXMessage(struct listener *l, listener_msg *msg) {
+    struct bus *b = l->bus;
+    BUS_ASSERT(b, b->udata, msg);
+    bool rx_msg = (msg->type == MSG_HOLD_RESPONSE
+        || msg->type == MSG_EXPECT_RESPONSE);
+    BUS_ASSERT(b, b->udata, rx_msg);
+
+    for (;;) {
+        listener_msg *head = l->rx_queue;
+        msg->next = head;
+        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&l->rx_queue, head, msg)) {
+            /* Only ring the doorbell on the transition from empty: if the
+             * queue was non-empty, whoever made it so already rang it,
+             * and the listener has not taken the queue yet. */
+            if (head != NULL) { return true; }
+            break;
+        }
+    }
+
+    #ifndef TEST
+    uint8_t msg_buf[sizeof(uint8_t)];
+    #endif
+    msg_buf[0] = LISTENER_DOORBELL_ID;
+
+    for (;;) {
+        ssize_t wr = syscall_write(l->commit_pipe, msg_buf, sizeof(msg_buf));
+        if (wr == sizeof(msg_buf)) {
+            return true;
+        } else if (errno == EINTR) { /* signal interrupted; retry */
+            errno = 0;
+            continue;
+        } else {
+            /* The message is already queued, and will be processed the
+             * next time the listener wakes up, so don't fail the send. */
+            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
+                "doorbell write error, errno %d", errno);
+            errno = 0;
+            return true;
+        }
+    }
+}
+
 rx_info_t *ListenerHelper_GetFreeRXInfo(struct listener *l) {
     struct bus *b = l->bus;
 
@@ -111,8 +153,8 @@ rx_info_t *ListenerHelper_GetFreeRXInfo(struct listener *l) {
         if (l->rx_info_max_used < head->id) {
             BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 128,
                 "rx_info_max_used <- %d", head->id);
+            BUS_ASSERT(b, b->udata, head->id < MAX_PENDING_MESSAGES);
             l->rx_info_max_used = head->id;
-            BUS_ASSERT(b, b->udata, l->rx_info_max_used < MAX_PENDING_MESSAGES);
         }
 
         BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 128,
@@ -122,34 +164,81 @@ rx_info_t *ListenerHelper_GetFreeRXInfo(struct listener *l) {
     }
 }
 
+/* A large prime used to spread around the hashes. */
+#define LARGE_PRIME (4294967291L /* (2 ** 32) - 5 */)
+
+/* Sequence IDs are allocated monotonically per socket, so mixing in
+ * the file descriptor and keeping the high bits spreads them evenly. */
+static size_t index_bucket(int fd, int64_t seq_id) {
+    uint64_t h = ((uint64_t)seq_id ^ ((uint64_t)fd << 32)) * LARGE_PRIME;
+    return (size_t)((h ^ (h >> 32)) & (RX_INFO_INDEX_SIZE - 1));
+}
+
+void ListenerHelper_IndexRXInfo(listener *l, rx_info_t *info,
+        int fd, int64_t seq_id) {
+    struct bus *b = l->bus;
+    BUS_ASSERT(b, b->udata, info->index_next == NULL);
+    size_t bucket = index_bucket(fd, seq_id);
+
+    BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 128,
+        "indexing info %d as <fd:%d, seq_id:%lld> in bucket %zd",
+        info->id, fd, (long long)seq_id, bucket);
+
+    info->index_fd = fd;
+    info->index_seq_id = seq_id;
+    info->index_next = l->rx_info_index[bucket];
+    l->rx_info_index[bucket] = info;
+}
+
+void ListenerHelper_UnindexRXInfo(listener *l, rx_info_t *info) {
+    struct bus *b = l->bus;
+    size_t bucket = index_bucket(info->index_fd, info->index_seq_id);
+
+    rx_info_t **prev = &l->rx_info_index[bucket];
+    while (*prev != NULL) {
+        if (*prev == info) {
+            *prev = info->index_next;
+            info->index_next = NULL;
+            return;
+        }
+        prev = &(*prev)->index_next;
+    }
+
+    BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
+        "info %d not in index as <fd:%d, seq_id:%lld>",
+        info->id, info->index_fd, (long long)info->index_seq_id);
+    BUS_ASSERT(b, b->udata, false);
+}
+
 rx_info_t *ListenerHelper_FindInfoBySequenceID(listener *l,
         int fd, int64_t seq_id) {
     struct bus *b = l->bus;
-    for (int i = 0; i <= l->rx_info_max_used; i++) {
-        rx_info_t *info = &l->rx_info[i];
+    size_t bucket = index_bucket(fd, seq_id);
+
+    for (rx_info_t *info = l->rx_info_index[bucket];
+         info != NULL; info = info->index_next) {
+        if (info->index_fd != fd || info->index_seq_id != seq_id) {
+            continue;
+        }
 
         switch (info->state) {
-        case RIS_INACTIVE:
-            break;            /* skip */
         case RIS_HOLD:
             BUS_LOG_SNPRINTF(b, 4, LOG_MEMORY, b->udata, 128,
                 "find_info_by_sequence_id: info (%p) at +%d: <fd:%d, seq_id:%lld>",
                 (void*)info, info->id, fd, (long long)seq_id);
-            if (info->u.hold.fd == fd && info->u.hold.seq_id == seq_id) {
-                return info;
-            }
-            break;
+            return info;
         case RIS_EXPECT:
         {
             struct boxed_msg *box = info->u.expect.box;
             BUS_LOG_SNPRINTF(b, 4, LOG_MEMORY, b->udata, 128,
                 "find_info_by_sequence_id: info (%p) at +%d [s %d]: box is %p",
                 (void*)info, info->id, info->u.expect.error, (void*)box);
-            if (box != NULL && box->out_seq_id == seq_id && box->fd == fd) {
+            if (box != NULL) {
                 return info;
             }
             break;
         }
+        case RIS_INACTIVE:
         default:
             BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
                 "match fail %d on line %d", info->state, __LINE__);
@@ -166,3 +255,34 @@ rx_info_t *ListenerHelper_FindInfoBySequenceID(listener *l,
     /* Not found. Probably an unsolicited status message. */
     return NULL;
 }
+
+void ListenerHelper_MatchRXInfo(listener *l, connection_info *ci, rx_info_t *info) {
+    struct bus *b = l->bus;
+    BUS_ASSERT(b, b->udata, info->state == RIS_EXPECT);
+    BUS_ASSERT(b, b->udata, info->u.expect.box);
+    BUS_ASSERT(b, b->udata, ci->match == NULL);
+    BUS_ASSERT(b, b->udata, info->match == NULL);
+
+    BUS_LOG_SNPRINTF(b, 4, LOG_LISTENER, b->udata, 128,
+        "matching info %d to <fd:%d, seq_id:%lld>",
+        info->id, ci->fd, (long long)info->index_seq_id);
+    ci->match = info;
+    info->match = ci;
+    b->match_cb(info->index_seq_id, info->u.expect.box->udata, ci->udata);
+}
+
+void ListenerHelper_UnmatchRXInfo(listener *l, connection_info *ci, bool revoke) {
+    struct bus *b = l->bus;
+    rx_info_t *info = ci->match;
+    if (info == NULL) { return; }
+    BUS_ASSERT(b, b->udata, info->match == ci);
+
+    ci->match = NULL;
+    info->match = NULL;
+    if (revoke) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 128,
+            "revoking match of info %d to <fd:%d, seq_id:%lld>",
+            info->id, ci->fd, (long long)info->index_seq_id);
+        b->match_cb(info->index_seq_id, NULL, ci->udata);
+    }
+}
@@ -28,11 +28,30 @@ listener_msg *ListenerHelper_GetFreeMsg(listener *l);
 /** Push a message into the listener's message queue. */
 bool ListenerHelper_PushMessage(struct listener *l, listener_msg *msg, int *reply_fd);
 
+/** Push a HOLD or EXPECT message onto the listener's RX queue, waking
+ * the listener if the queue was empty. Does not wait for the listener. */
+bool ListenerHelper_PushRXMessage(struct listener *l, listener_msg *msg);
+
 /** Get a free RX_INFO record, if any are available. */
 rx_info_t *ListenerHelper_GetFreeRXInfo(listener *l);
 
+/** Add INFO to the listener's index under a <file descriptor, sequence_id> pair. */
+void ListenerHelper_IndexRXInfo(listener *l, rx_info_t *info,
+    int fd, int64_t seq_id);
+
+/** Remove INFO from the listener's index. */
+void ListenerHelper_UnindexRXInfo(listener *l, rx_info_t *info);
+
 /** Try to find an RX_INFO record by a <file descriptor, sequence_id> pair. */
 rx_info_t *ListenerHelper_FindInfoBySequenceID(listener *l,
     int fd, int64_t seq_id);
 
+/** Note that CI's sink is receiving its current response directly into
+ * the buffers of INFO's request, and pass the request's udata to it. */
+void ListenerHelper_MatchRXInfo(listener *l, connection_info *ci, rx_info_t *info);
+
+/** Forget the request CI's sink is receiving into, if any. If REVOKE is
+ * set, the sink is told to stop using the request's buffers. */
+void ListenerHelper_UnmatchRXInfo(listener *l, connection_info *ci, bool revoke);
+
 #endif
@@ -20,10 +20,13 @@
 
 #include "bus_types.h"
 #include "bus_internal_types.h"
+#include "timer_wheel.h"
 
 #include <poll.h>
 
-/** Default size for the read buffer, which will grow on demand. */
+/** Default size for the read buffer, which will grow on demand.
+ * Sockets are read into it as much as is available, then split into
+ * messages by the sink CB. */
 #define DEFAULT_READ_BUF_SIZE (1024L * 1024L)
 
 /** ID of the `struct pollfd` for the listener's incoming command
@@ -64,8 +67,7 @@ typedef struct listener_msg {
         struct {
             int fd;
             int64_t seq_id;
-            int16_t timeout_sec;
-            int notify_fd;
+            uint32_t timeout_msec;
         } hold;
         struct {
             boxed_msg *box;
@@ -76,9 +78,13 @@ typedef struct listener_msg {
     } u;
 } listener_msg;
 
-/** How long the listener should wait for responses before becoming idle
- * and blocking. */
-#define LISTENER_TASK_TIMEOUT_DELAY 100
+/** How long the listener waits before retrying delivery of a response
+ * to a full threadpool, in msec. */
+#define LISTENER_RETRY_DELAY_MSEC 100
+
+/** How often the listener calls the idle callback for sockets that have
+ * received messages, in msec. See bus_idle_cb. */
+#define LISTENER_IDLE_CHECK_MSEC 1000
 
 typedef enum {
     RIS_HOLD = 1,
@@ -92,7 +98,18 @@ typedef struct rx_info_t {
     struct rx_info_t *next;
 
     rx_info_state state;
-    time_t timeout_sec;
+    timer_wheel_node timer;     ///< timeout, or retry of delivery
+
+    /* Key and chain link for the listener's <fd, seq_id> index.
+     * These are set while the info is HOLD or EXPECT, since the
+     * EXPECT's box may be released before the info itself. */
+    int index_fd;
+    int64_t index_seq_id;
+    struct rx_info_t *index_next;
+
+    /** Socket whose sink is receiving the response directly into the
+     * request's buffers, if any. See bus_match_cb. */
+    connection_info *match;
 
     union {
         struct {
@@ -119,8 +136,17 @@ typedef struct rx_info_t {
  * TODO: Capacity planning. */
 #define MAX_PENDING_MESSAGES (1024)
 
+/** Number of buckets in the listener's <fd, seq_id> index, as a power
+ * of 2. This should be at least MAX_PENDING_MESSAGES, so chains stay short. */
+#define RX_INFO_INDEX_SIZE2 11
+#define RX_INFO_INDEX_SIZE (1 << RX_INFO_INDEX_SIZE2)
+
 /** Max number of unprocessed queue messages */
 #define MAX_QUEUE_MESSAGES (32)
+
+/** Byte written to the listener's command pipe to wake it up when the
+ * RX queue becomes non-empty. This is never a valid message ID. */
+#define LISTENER_DOORBELL_ID (0xFF)
 typedef uint32_t msg_flag_t;
 
 /** Special value meaning poll should block indefinitely. */
@@ -144,15 +170,30 @@ typedef struct listener {
     /* Pipes used to wake the sleeping listener on queue input. */
     int commit_pipe;
     int incoming_msg_pipe;
-    bool is_idle;
 
     rx_info_t rx_info[MAX_PENDING_MESSAGES];
     rx_info_t *rx_info_freelist;
     uint16_t rx_info_in_use;
     uint16_t rx_info_max_used;
 
+    /** Timeouts and delivery retries for rx_info records, in msec. */
+    struct timer_wheel timers;
+
+    /** Next idle callback check, scheduled on l->timers while any
+     * socket has connection_info.idle_check set. */
+    timer_wheel_node idle_timer;
+
+    /** Index of HOLD and EXPECT rx_info records, hashed by <fd, seq_id>
+     * and chained through rx_info_t.index_next. */
+    rx_info_t *rx_info_index[RX_INFO_INDEX_SIZE];
+
     listener_msg msgs[MAX_QUEUE_MESSAGES];
     listener_msg *msg_freelist;
+
+    /** Lock-free stack of HOLD and EXPECT messages pushed by senders,
+     * which is taken whole and processed in FIFO order by the
+     * listener. Senders don't wait for these to be processed. */
+    listener_msg *rx_queue;
     int16_t msgs_in_use;
     int64_t largest_seq_id_seen;
 
@@ -179,6 +220,23 @@ typedef struct listener {
 
     bool error_occured;         ///< Flag indicating post-poll handling is necessary.
 
+    /** How the listener waits for incoming data. With epoll, l->fds and
+     * l->fd_info still track the sockets, but only the sockets in
+     * l->epoll_events are visited after each wakeup. */
+    bus_poll_backend_t poll_backend;
+#if BUS_HAVE_EPOLL
+    int epoll_fd;
+    /** Events from the last epoll_wait, translated to poll(2) flags.
+     * Sockets have their connection_info as data.ptr, and entries
+     * with no events left (the command pipe, or a socket removed
+     * since the wakeup) are skipped. */
+    int epoll_ready;
+    struct epoll_event epoll_events[MAX_FDS + 1];
+#endif
+#if BUS_HAVE_IO_URING
+    struct listener_uring *uring; ///< io_uring state, see listener_uring.c
+#endif
+
     /* Read buffer and it's size. Will be grown on demand. */
     size_t read_buf_size;
     uint8_t *read_buf;
@@ -17,89 +17,72 @@
 
 #include "listener_io.h"
 #include "listener_helper.h"
+#include "listener_cmd.h"
 
 #include <unistd.h>
 #include <assert.h>
 
 #include "listener_task.h"
+#include "listener_uring.h"
 #include "syscall.h"
 #include "util.h"
 
+static int attempt_recv_socket(listener *l, connection_info *ci,
+    short events, short revents);
 static ssize_t socket_read_plain(struct bus *b,
-    listener *l, int pfd_i, connection_info *ci);
+    listener *l, connection_info *ci);
 static ssize_t socket_read_ssl(struct bus *b,
-    listener *l, int pfd_i, connection_info *ci);
+    listener *l, connection_info *ci);
 static bool sink_socket_read(struct bus *b,
-    listener *l, connection_info *ci, ssize_t size);
+    listener *l, connection_info *ci, uint8_t *buf, ssize_t size);
 static void print_SSL_error(struct bus *b,
     connection_info *ci, int lvl, const char *prefix);
-static void set_error_for_socket(listener *l, int id,
-    int fd, rx_error_t err);
+static void set_error_for_socket(listener *l,
+    connection_info *ci, rx_error_t err);
 static void process_unpacked_message(listener *l,
     connection_info *ci, bus_unpack_cb_res_t result);
 static void move_errored_active_sockets_to_end(listener *l);
+static void match_request(listener *l, connection_info *ci, int64_t seq_id);
+static void schedule_idle_check(listener *l, connection_info *ci);
+#if BUS_HAVE_IO_URING
+static void attempt_recv_uring(listener *l);
+#endif
 
 void ListenerIO_AttemptRecv(listener *l, int available) {
     /*   --> failure --> set 'closed' error on socket, don't die */
     struct bus *b = l->bus;
-    int read_from = 0;
     BUS_LOG(b, 3, LOG_LISTENER, "attempting receive", b->udata);
 
-    for (int i = 0; i < l->tracked_fds; i++) {
-        if (read_from == available) { break; }
-        struct pollfd *fd = &l->fds[i + INCOMING_MSG_PIPE];
-        connection_info *ci = l->fd_info[i];
-        BUS_ASSERT(b, b->udata, ci->fd == fd->fd);
-
-        BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 64,
-            "poll: l->fds[%d]->revents: 0x%04x",  // NOCOMMIT
-            i + INCOMING_MSG_PIPE, fd->revents);
-
-        /* If a socket is about to be shut down, we want to get a
-         * complete read from it if possible, because it's likely to be
-         * an UNSOLICITEDSTATUS message with a reason for the hangup.
-         * Only do single reads otherwise, though, otherwise the
-         * listener can end up blocking too long handling consecutive
-         * reads on a busy connection and causing the incoming command
-         * queue to get backed up. */
-        bool is_closing = fd->events & (POLLERR | POLLNVAL | POLLHUP);
-
-        if (fd->revents & POLLIN) {
-            // Try to read what we can (possibly before hangup)
-            ssize_t cur_read = 0;
-            size_t to_read = ci->to_read_size;
-            do {
-                BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
-                    "reading %zd bytes from socket (buf is %zd)",
-                    ci->to_read_size, l->read_buf_size);
-                BUS_ASSERT(b, b->udata, l->read_buf_size >= to_read);
-
-                switch (ci->type) {
-                case BUS_SOCKET_PLAIN:
-                    cur_read = socket_read_plain(b, l, i, ci);
-                    break;
-                case BUS_SOCKET_SSL:
-                    cur_read = socket_read_ssl(b, l, i, ci);
-                    break;
-                default:
-                    BUS_ASSERT(b, b->udata, false);
-                }
-                // -1: socket error
-                // 0: no more to read
-            } while (is_closing && cur_read > 0 && ci->to_read_size > 0);
-            read_from++;
+#if BUS_HAVE_IO_URING
+    if (l->poll_backend == BUS_POLL_BACKEND_IO_URING) {
+        attempt_recv_uring(l);
+        (void)available;
+    } else
+#endif
+#if BUS_HAVE_EPOLL
+    if (l->poll_backend == BUS_POLL_BACKEND_EPOLL) {
+        /* Only visit the sockets that epoll reported as ready. */
+        for (int i = 0; i < l->epoll_ready; i++) {
+            struct epoll_event *ev = &l->epoll_events[i];
+            if (ev->events == 0) { continue; }
+            attempt_recv_socket(l, ev->data.ptr, POLLIN, (short)ev->events);
         }
-
-        if (fd->revents & (POLLERR | POLLNVAL)) {
-            read_from++;
-            BUS_LOG(b, 2, LOG_LISTENER,
-                "pollfd: socket error (POLLERR | POLLNVAL)", b->udata);
-            set_error_for_socket(l, i, ci->fd, RX_ERROR_POLLERR);
-        } else if (fd->revents & POLLHUP) {
-            read_from++;
-            BUS_LOG(b, 3, LOG_LISTENER, "pollfd: socket error POLLHUP",
-                b->udata);
-            set_error_for_socket(l, i, ci->fd, RX_ERROR_POLLHUP);
+        (void)available;
+    } else
+#endif
+    {
+        int read_from = 0;
+        for (int i = 0; i < l->tracked_fds; i++) {
+            if (read_from == available) { break; }
+            struct pollfd *fd = &l->fds[i + INCOMING_MSG_PIPE];
+            connection_info *ci = l->fd_info[i];
+            BUS_ASSERT(b, b->udata, ci->fd == fd->fd);
+
+            BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 64,
+                "poll: l->fds[%d]->revents: 0x%04x",  // NOCOMMIT
+                i + INCOMING_MSG_PIPE, fd->revents);
+
+            read_from += attempt_recv_socket(l, ci, fd->events, fd->revents);
         }
     }
 
@@ -111,23 +94,83 @@ void ListenerIO_AttemptRecv(listener *l, int available) {
     }
 }
 
-static ssize_t socket_read_plain(struct bus *b, listener *l, int pfd_i, connection_info *ci) {
-    ssize_t accum = 0;
-    while (ci->to_read_size > 0) {
-        ssize_t size = syscall_read(ci->fd, l->read_buf, ci->to_read_size);
+/* Handle the poll events (REVENTS) for a single socket, and return
+ * how many of the ready file descriptors were accounted for. */
+static int attempt_recv_socket(listener *l, connection_info *ci,
+        short events, short revents) {
+    struct bus *b = l->bus;
+    int read_from = 0;
+
+    /* If a socket is about to be shut down, we want to get a
+     * complete read from it if possible, because it's likely to be
+     * an UNSOLICITEDSTATUS message with a reason for the hangup.
+     * Only do single reads otherwise, though, otherwise the
+     * listener can end up blocking too long handling consecutive
+     * reads on a busy connection and causing the incoming command
+     * queue to get backed up. */
+    bool is_closing = events & (POLLERR | POLLNVAL | POLLHUP);
+
+    if (revents & POLLIN) {
+        // Try to read what we can (possibly before hangup)
+        ssize_t cur_read = 0;
+        size_t to_read = ci->to_read_size;
+        do {
+            BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
+                "reading %zd bytes from socket (buf is %zd)",
+                ci->to_read_size, l->read_buf_size);
+            BUS_ASSERT(b, b->udata, l->read_buf_size >= to_read);
+
+            switch (ci->type) {
+            case BUS_SOCKET_PLAIN:
+                cur_read = socket_read_plain(b, l, ci);
+                break;
+            case BUS_SOCKET_SSL:
+                cur_read = socket_read_ssl(b, l, ci);
+                break;
+            default:
+                BUS_ASSERT(b, b->udata, false);
+            }
+            // -1: socket error
+            // 0: no more to read
+        } while (is_closing && cur_read > 0 && ci->to_read_size > 0);
+        read_from++;
+    }
+
+    if (revents & (POLLERR | POLLNVAL)) {
+        read_from++;
+        BUS_LOG(b, 2, LOG_LISTENER,
+            "pollfd: socket error (POLLERR | POLLNVAL)", b->udata);
+        set_error_for_socket(l, ci, RX_ERROR_POLLERR);
+    } else if (revents & POLLHUP) {
+        read_from++;
+        BUS_LOG(b, 3, LOG_LISTENER, "pollfd: socket error POLLHUP",
+            b->udata);
+        set_error_for_socket(l, ci, RX_ERROR_POLLHUP);
+    }
+    return read_from;
+}
+
+/* Make a single read of up to the size of the read buffer, rather than
+ * just the next message piece the sink asked for, so that several
+ * pipelined responses can be framed from one read. Anything left on the
+ * socket waits for the next poll, so a busy connection can't hold up
+ * the others on this listener. */
+static ssize_t socket_read_plain(struct bus *b, listener *l, connection_info *ci) {
+    for (;;) {
+        ssize_t size = syscall_read(ci->fd, l->read_buf, l->read_buf_size);
         if (size == -1) {
             BUS_LOG_SNPRINTF(b, 6, LOG_LISTENER, b->udata, 64,
                 "read: size %zd, errno %d", size, errno);
             if (errno == EAGAIN) {
                 errno = 0;
-                return accum;
+                return 0;
             } else if (Util_IsResumableIOError(errno)) {
                 errno = 0;
                 continue;
             } else {
                 BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
                     "read: socket error reading, %d", errno);
-                set_error_for_socket(l, pfd_i, ci->fd, RX_ERROR_READ_FAILURE);
+                set_error_for_socket(l, ci, RX_ERROR_READ_FAILURE);
                 errno = 0;
                 return -1;
             }
@@ -136,13 +179,10 @@ static ssize_t socket_read_plain(struct bus *b, listener *l, int pfd_i, connecti
         if (size > 0) {
             BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 64,
                 "read: %zd", size);
-            sink_socket_read(b, l, ci, size);
-            accum += size;
-        } else {
-            return accum;
+            sink_socket_read(b, l, ci, l->read_buf, size);
         }
+        return size;
     }
-    return accum;
 }
 
 static void print_SSL_error(struct bus *b, connection_info *ci, int lvl, const char *prefix) {
@@ -158,12 +198,12 @@ static void print_SSL_error(struct bus *b, connection_info *ci, int lvl, const c
     (void)prefix;
 }
 
-static ssize_t socket_read_ssl(struct bus *b, listener *l, int pfd_i, connection_info *ci) {
+static ssize_t socket_read_ssl(struct bus *b, listener *l, connection_info *ci) {
     BUS_ASSERT(b, b->udata, ci->ssl);
     ssize_t accum = 0;
     while (ci->to_read_size > 0) {
         // ssize_t pending = SSL_pending(ci->ssl);
-        ssize_t size = (ssize_t)syscall_SSL_read(ci->ssl, l->read_buf, ci->to_read_size);
+        ssize_t size = (ssize_t)syscall_SSL_read(ci->ssl, l->read_buf, l->read_buf_size);
 
         if (size == -1) {
             int reason = syscall_SSL_get_error(ci->ssl, size);
@@ -188,7 +228,7 @@ static ssize_t socket_read_ssl(struct bus *b, listener *l, int pfd_i, connection
                     BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
                         "SSL_read fd %d: errno %d", ci->fd, errno);
                     print_SSL_error(b, ci, 1, "SSL_ERROR_SYSCALL");
-                    set_error_for_socket(l, pfd_i, ci->fd, RX_ERROR_READ_FAILURE);
+                    set_error_for_socket(l, ci, RX_ERROR_READ_FAILURE);
                     return -1;
                 }
                 break;
@@ -197,19 +237,22 @@ static ssize_t socket_read_ssl(struct bus *b, listener *l, int pfd_i, connection
             {
                 BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
                     "SSL_read fd %d: ZERO_RETURN (HUP)", ci->fd);
-                set_error_for_socket(l, pfd_i, ci->fd, RX_ERROR_POLLHUP);
+                set_error_for_socket(l, ci, RX_ERROR_POLLHUP);
                 return -1;
             }
 
             default:
                 print_SSL_error(b, ci, 1, "SSL_ERROR UNKNOWN");
-                set_error_for_socket(l, pfd_i, ci->fd, RX_ERROR_READ_FAILURE);
+                set_error_for_socket(l, ci, RX_ERROR_READ_FAILURE);
                 BUS_ASSERT(b, b->udata, false);
             }
         } else if (size > 0) {
-            sink_socket_read(b, l, ci, size);
+            sink_socket_read(b, l, ci, l->read_buf, size);
             accum += size;
-            if ((size_t)accum == ci->to_read_size) { break; }
+            /* SSL_read returns at most one record at a time, so keep
+             * going until it would block, but don't let one busy
+             * connection hold up the others indefinitely. */
+            if ((size_t)accum >= l->read_buf_size) { break; }
         } else {
             break;
         }
@@ -219,8 +262,13 @@ static ssize_t socket_read_ssl(struct bus *b, listener *l, int pfd_i, connection
 
 #define DUMP_READ 0
 
+/* Pass SIZE bytes read from a socket to the sink callback, in pieces of
+ * no more than it asked for, unpacking each message it completes. A
+ * message's last piece may be followed by any number of others, and a
+ * trailing partial message is accumulated by the sink until the rest
+ * is read. */
 static bool sink_socket_read(struct bus *b,
-        listener *l, connection_info *ci, ssize_t size) {
+        listener *l, connection_info *ci, uint8_t *buf, ssize_t size) {
     BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
         "read %zd bytes, calling sink CB", size);
 
@@ -228,27 +276,46 @@ static bool sink_socket_read(struct bus *b,
     printf("\n");
     for (int i = 0; i < size; i++) {
         if (i > 0 && (i & 15) == 0) { printf("\n"); }
-        printf("%02x ", l->read_buf[i]);
+        printf("%02x ", buf[i]);
     }
     printf("\n\n");
 #endif
 
-    bus_sink_cb_res_t sres = b->sink_cb(l->read_buf, size, ci->udata);
-    if (sres.full_msg_buffer) {
-        BUS_LOG(b, 3, LOG_LISTENER, "calling unpack CB", b->udata);
-        bus_unpack_cb_res_t ures = b->unpack_cb(sres.full_msg_buffer, ci->udata);
+    size_t offset = 0;
+    while (offset < (size_t)size && ci->to_read_size > 0) {
+        size_t piece = (size_t)size - offset;
+        if (piece > ci->to_read_size) { piece = ci->to_read_size; }
+
+        bus_sink_cb_res_t sres = b->sink_cb(&buf[offset], piece, ci->udata);
+        offset += piece;
+        if (sres.match) {
+            match_request(l, ci, sres.seq_id);
+        }
+        if (sres.full_msg_buffer) {
+            if (ci->match) { ListenerHelper_UnmatchRXInfo(l, ci, false); }
+            BUS_LOG(b, 3, LOG_LISTENER, "calling unpack CB", b->udata);
+            bus_unpack_cb_res_t ures = b->unpack_cb(sres.full_msg_buffer, ci->udata);
+            BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
+                "process_unpacked_message: ok? %d, seq_id:%lld",
+                ures.ok, (long long)ures.u.success.seq_id);
+            process_unpacked_message(l, ci, ures);
+            schedule_idle_check(l, ci);
+        }
+
+        ci->to_read_size = sres.next_read;
+
         BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
-            "process_unpacked_message: ok? %d, seq_id:%lld",
-            ures.ok, (long long)ures.u.success.seq_id);
-        process_unpacked_message(l, ci, ures);
+            "expecting next read to have %zd bytes", ci->to_read_size);
     }
 
-    ci->to_read_size = sres.next_read;
-
-    BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
-        "expecting next read to have %zd bytes", ci->to_read_size);
+    if (offset < (size_t)size) {
+        BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
+            "sink CB stopped reading, dropping %zd bytes",
+            (size_t)size - offset);
+    }
 
-    /* Grow read buffer if necessary. */
+    /* Grow read buffer if necessary. This is only done once the whole
+     * read has been sunk, since BUF may be the read buffer. */
     if (ci->to_read_size > l->read_buf_size) {
         if (!ListenerTask_GrowReadBuf(l, ci->to_read_size)) {
             BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
@@ -260,8 +327,48 @@ static bool sink_socket_read(struct bus *b,
     return true;
 }
 
-static void set_error_for_socket(listener *l, int id, int fd, rx_error_t err) {
+#if BUS_HAVE_IO_URING
+/* Handle the completions from the listener's io_uring. Plain sockets'
+ * data has already been received into one of the ring's buffers, so
+ * it goes straight to the sink callback; SSL sockets only get a
+ * readiness notification, and are read as with poll. */
+static void attempt_recv_uring(listener *l) {
+    struct bus *b = l->bus;
+    listener_uring_completion *c = NULL;
+    while ((c = ListenerUring_NextCompletion(l)) != NULL) {
+        connection_info *ci = c->ci;
+
+        if (ci->type == BUS_SOCKET_SSL) {
+            short revents = (c->res < 0 ? POLLERR : (short)c->res);
+            attempt_recv_socket(l, ci, POLLIN, revents);
+        } else if (c->res > 0) {
+            BUS_LOG_SNPRINTF(b, 5, LOG_LISTENER, b->udata, 64,
+                "recv: %d", c->res);
+            sink_socket_read(b, l, ci, c->buf, c->res);
+        } else if (c->res == 0) {
+            BUS_LOG(b, 3, LOG_LISTENER, "recv: socket error POLLHUP",
+                b->udata);
+            set_error_for_socket(l, ci, RX_ERROR_POLLHUP);
+        } else if (c->res == -ENOBUFS || Util_IsResumableIOError(-c->res)) {
+            /* Out of ring buffers, or interrupted -- just try again. */
+        } else {
+            BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
+                "recv: socket error reading, %d", -c->res);
+            set_error_for_socket(l, ci, RX_ERROR_READ_FAILURE);
+        }
+
+        if (ci->error < 0) {
+            ListenerUring_Release(l, c);
+        } else {
+            ListenerUring_Rearm(l, c);
+        }
+    }
+}
+#endif
+
+static void set_error_for_socket(listener *l, connection_info *ci, rx_error_t err) {
     l->error_occured = true;
+    int fd = ci->fd;
 
     /* Mark all pending messages on this socket as being failed due to error. */
     struct bus *b = l->bus;
@@ -285,6 +392,8 @@ static void set_error_for_socket(listener *l, int id, int fd, rx_error_t err) {
             struct boxed_msg *box = info->u.expect.box;
             if (box && box->fd == fd) {
                 info->u.expect.error = err;
+                /* Notify the client on the next pass over the timers. */
+                TimerWheel_Schedule(&l->timers, &info->timer, 0);
             }
             break;
         }
@@ -297,8 +406,7 @@ static void set_error_for_socket(listener *l, int id, int fd, rx_error_t err) {
         }
     }
 
-    connection_info *newly_inactive_ci = l->fd_info[id];
-    newly_inactive_ci->error = err;
+    ci->error = err;
 }
 
 static void move_errored_active_sockets_to_end(listener *l) {
@@ -308,6 +416,12 @@ static void move_errored_active_sockets_to_end(listener *l) {
         int fd = pfd->fd;
         if (ci->error < 0 && pfd->events & POLLIN) {
             pfd->events &= ~POLLIN;
+#if BUS_HAVE_EPOLL
+            if (l->poll_backend == BUS_POLL_BACKEND_EPOLL) {
+                /* Likewise, stop epoll from reporting it. */
+                (void)syscall_epoll_ctl(l->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            }
+#endif
             /* move socket to end, so it won't be poll'd and get repeated POLLHUP. */
             int last_active = l->tracked_fds - l->inactive_fds - 1;
             if (id != last_active) {
@@ -329,6 +443,41 @@ static void move_errored_active_sockets_to_end(listener *l) {
     }
 }
 
+/* The sink has parsed enough of a response to know its sequence ID, so
+ * let it receive the rest directly into the request's buffers, if the
+ * request has been sent and is still waiting for it. */
+static void match_request(listener *l, connection_info *ci, int64_t seq_id) {
+    struct bus *b = l->bus;
+    if (b->match_cb == NULL) { return; }
+    BUS_ASSERT(b, b->udata, ci->match == NULL);
+
+    rx_info_t *info = ListenerHelper_FindInfoBySequenceID(l, ci->fd, seq_id);
+    if ((info == NULL || info->state == RIS_HOLD) && l->rx_queue != NULL) {
+        /* Its EXPECT may not have been processed yet. */
+        ListenerCmd_ProcessRXQueue(l);
+        info = ListenerHelper_FindInfoBySequenceID(l, ci->fd, seq_id);
+    }
+
+    if (info && info->state == RIS_EXPECT &&
+            info->u.expect.error == RX_ERROR_NONE && info->match == NULL) {
+        ListenerHelper_MatchRXInfo(l, ci, info);
+    } else {
+        BUS_LOG_SNPRINTF(b, 4, LOG_LISTENER, b->udata, 128,
+            "no request to match for <fd:%d, seq_id:%lld>",
+            ci->fd, (long long)seq_id);
+    }
+}
+
+/* The socket received a message, so check back with the idle callback,
+ * if any, once the socket may have gone quiet. */
+static void schedule_idle_check(listener *l, connection_info *ci) {
+    if (l->bus->idle_cb == NULL) { return; }
+    ci->idle_check = true;
+    if (!TimerWheel_IsScheduled(&l->idle_timer)) {
+        TimerWheel_Schedule(&l->timers, &l->idle_timer, LISTENER_IDLE_CHECK_MSEC);
+    }
+}
+
 static void process_unpacked_message(listener *l,
         connection_info *ci, bus_unpack_cb_res_t result) {
     struct bus *b = l->bus;
@@ -340,6 +489,13 @@ static void process_unpacked_message(listener *l,
         void *opaque_msg = result.u.success.msg;
 
         rx_info_t *info = ListenerHelper_FindInfoBySequenceID(l, ci->fd, seq_id);
+        if (info == NULL && l->rx_queue != NULL) {
+            /* The sender queues the HOLD before writing the request, but
+             * it may not have been processed yet if the response arrived
+             * quickly, so process the queue and check again. */
+            ListenerCmd_ProcessRXQueue(l);
+            info = ListenerHelper_FindInfoBySequenceID(l, ci->fd, seq_id);
+        }
 
         if (info) {
             switch (info->state) {
@@ -21,8 +21,12 @@
 #include "syscall.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stddef.h>
 #include "listener_cmd.h"
 #include "listener_io.h"
+#include "listener_helper.h"
+#include "listener_uring.h"
 #include "atomic.h"
 
 #ifdef TEST
@@ -36,9 +40,14 @@ int poll_res = 0;
 #endif
 
 static void tick_handler(listener *l);
+static void advance_timers(listener *l, struct timeval *now);
+static void expire_rx_info(timer_wheel_node *n, void *udata);
+static void check_idle_sockets(listener *l);
+static void schedule_retry(listener *l, rx_info_t *info);
 static void clean_up_completed_info(listener *l, rx_info_t *info);
 static void retry_delivery(listener *l, rx_info_t *info);
 static void observe_backpressure(listener *l, size_t backpressure);
+static int wait_for_events(listener *l, int delay);
 
 void *ListenerTask_MainLoop(void *arg) {
     listener *self = (listener *)arg;
@@ -53,29 +62,28 @@ void *ListenerTask_MainLoop(void *arg) {
     /* The listener thread has full control over its execution -- the
      * only thing other threads can do is reserve messages from l->msgs,
      * write commands into them, and then commit them by writing their
-     * msg->id into the incoming command ID pipe. All cross-thread
+     * msg->id into the incoming command ID pipe (or, for HOLD and
+     * EXPECT, pushing them onto l->rx_queue). All cross-thread
      * communication is managed at the command interface, so it doesn't
      * need any internal locking. */
 
     WHILE (self->shutdown_notify_fd == LISTENER_NO_FD) {
-        if (!Util_Timestamp(&now, true)) {
-            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
-                "timestamp failure: %d", errno);
-        }
+        advance_timers(self, &now);
         time_t cur_sec = now.tv_sec;
         if (cur_sec != last_sec) {
             tick_handler(self);
             last_sec = cur_sec;
         }
 
-        int delay = (self->is_idle ? INFINITE_DELAY : LISTENER_TASK_TIMEOUT_DELAY);
+        /* Block until the next timeout (or retry) is due, if any. */
+        int64_t next = TimerWheel_NextDelay(&self->timers);
+        int delay = (next < 0 ? INFINITE_DELAY
+            : (next > INT_MAX ? INT_MAX : (int)next));
         #ifndef TEST
         int poll_res = 0;
         #endif
 
-        int to_poll = self->tracked_fds - self->inactive_fds + INCOMING_MSG_PIPE;
-
-        poll_res = syscall_poll(self->fds, to_poll, delay);
+        poll_res = wait_for_events(self, delay);
         BUS_LOG_SNPRINTF(b, (poll_res == 0 ? 6 : 4), LOG_LISTENER, b->udata, 64,
             "poll res %d", poll_res);
 
@@ -88,6 +96,10 @@ void *ListenerTask_MainLoop(void *arg) {
                 BUS_ASSERT(b, b->udata, false);
             }
         } else if (poll_res > 0) {
+            /* The wait may have blocked for a long time, and HOLD/EXPECT
+             * timeouts are scheduled relative to the wheel's time, so
+             * bring it up to date before running any commands. */
+            advance_timers(self, &now);
             ListenerCmd_CheckIncomingMessages(self, &poll_res);
             if (poll_res > 0) {
                 ListenerIO_AttemptRecv(self, poll_res);
@@ -114,9 +126,76 @@ void *ListenerTask_MainLoop(void *arg) {
     return NULL;
 }
 
+/* Wait up to DELAY msec for incoming commands or data. Returns the
+ * number of ready file descriptors (or -1 on error), the same as poll. */
+static int wait_for_events(listener *l, int delay) {
+#if BUS_HAVE_EPOLL
+    if (l->poll_backend == BUS_POLL_BACKEND_EPOLL) {
+        int res = syscall_epoll_wait(l->epoll_fd, l->epoll_events,
+            MAX_FDS + 1, delay);
+        l->epoll_ready = (res > 0 ? res : 0);
+        l->fds[INCOMING_MSG_PIPE_ID].revents = 0;
+
+        /* Translate events to poll flags, so the rest of the listener
+         * doesn't care which backend is in use, and move the command
+         * pipe's events to its pollfd. */
+        for (int i = 0; i < l->epoll_ready; i++) {
+            struct epoll_event *ev = &l->epoll_events[i];
+            short revents = ((ev->events & EPOLLIN ? POLLIN : 0)
+                | (ev->events & EPOLLERR ? POLLERR : 0)
+                | (ev->events & EPOLLHUP ? POLLHUP : 0));
+            if (ev->data.ptr == NULL) {
+                l->fds[INCOMING_MSG_PIPE_ID].revents = revents;
+                ev->events = 0;
+            } else {
+                ev->events = (uint32_t)revents;
+            }
+        }
+        return res;
+    }
+#endif
+#if BUS_HAVE_IO_URING
+    if (l->poll_backend == BUS_POLL_BACKEND_IO_URING) {
+        return ListenerUring_Wait(l, delay);
+    }
+#endif
+
+    int to_poll = l->tracked_fds - l->inactive_fds + INCOMING_MSG_PIPE;
+    return syscall_poll(l->fds, to_poll, delay);
+}
+
+/* Read the clock into NOW and advance the timer wheel to it,
+ * expiring any timeouts and retries that are due. */
+static void advance_timers(listener *l, struct timeval *now) {
+    struct bus *b = l->bus;
+    if (!Util_Timestamp(now, true)) {
+        BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
+            "timestamp failure: %d", errno);
+    }
+    uint64_t now_msec = (uint64_t)now->tv_sec * 1000 + now->tv_usec / 1000;
+    TimerWheel_Advance(&l->timers, now_msec, expire_rx_info, l);
+}
+
+/* Call the idle callback for each socket that has received messages
+ * since it last reported holding nothing, and check again later if any
+ * of them still hold something. */
+static void check_idle_sockets(listener *l) {
+    struct bus *b = l->bus;
+    bool again = false;
+    for (int i = 0; i < l->tracked_fds; i++) {
+        connection_info *ci = l->fd_info[i];
+        if (ci->idle_check) {
+            ci->idle_check = b->idle_cb(ci->udata);
+            if (ci->idle_check) { again = true; }
+        }
+    }
+    if (again) {
+        TimerWheel_Schedule(&l->timers, &l->idle_timer, LISTENER_IDLE_CHECK_MSEC);
+    }
+}
+
 static void tick_handler(listener *l) {
     struct bus *b = l->bus;
-    bool any_work = false;
 
     BUS_LOG_SNPRINTF(b, 2, LOG_LISTENER, b->udata, 128,
         "tick... %p: %d of %d msgs in use, %d of %d rx_info in use, %d tracked_fds",
@@ -130,98 +209,95 @@ static void tick_handler(listener *l) {
     }
 
     if (b->log_level > 5 || 0) { ListenerTask_DumpRXInfoTable(l); }
+}
 
-    for (int i = 0; i <= l->rx_info_max_used; i++) {
-        rx_info_t *info = &l->rx_info[i];
+/* An rx_info's timer expired: either it timed out, or a delivery
+ * or failure notification needs to be retried. Also handles the
+ * listener's idle check. */
+static void expire_rx_info(timer_wheel_node *n, void *udata) {
+    listener *l = (listener *)udata;
+    struct bus *b = l->bus;
+    if (n == &l->idle_timer) {  /* not an rx_info, but shares the wheel */
+        check_idle_sockets(l);
+        return;
+    }
+    rx_info_t *info = (rx_info_t *)((uint8_t *)n - offsetof(rx_info_t, timer));
+    BUS_ASSERT(b, b->udata, info == &l->rx_info[info->id]);
 
-        switch (info->state) {
-        case RIS_INACTIVE:
-            break;
-        case RIS_HOLD:
-            any_work = true;
-            /* Check timeout */
-            if (info->timeout_sec == 1) {
-                #ifndef TEST
-                struct timeval cur;
-                #endif
-                if (!Util_Timestamp(&cur, false)) {
-                    BUS_LOG(b, 0, LOG_LISTENER,
-                        "gettimeofday failure in tick_handler!", b->udata);
-                    continue;
-                }
+    switch (info->state) {
+    case RIS_HOLD:
+    {
+        #ifndef TEST
+        struct timeval cur;
+        #endif
+        if (!Util_Timestamp(&cur, false)) {
+            BUS_LOG(b, 0, LOG_LISTENER,
+                "gettimeofday failure in expire_rx_info!", b->udata);
+        }
 
-                /* never got a response, but we don't have the callback
-                 * either -- the client will notify about the timeout. */
-                BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
-                    "timing out hold info %p -- <fd:%d, seq_id:%lld> at (%ld.%ld)",
-                    (void*)info, info->u.hold.fd, (long long)info->u.hold.seq_id,
-                    (long)cur.tv_sec, (long)cur.tv_usec);
+        /* never got a response, but we don't have the callback
+         * either -- the client will notify about the timeout. */
+        BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 128,
+            "timing out hold info %p -- <fd:%d, seq_id:%lld> at (%ld.%ld)",
+            (void*)info, info->u.hold.fd, (long long)info->u.hold.seq_id,
+            (long)cur.tv_sec, (long)cur.tv_usec);
 
-                ListenerTask_ReleaseRXInfo(l, info);
-            } else {
-                BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
-                    "decrementing countdown on info %p [%u]: %ld",
-                    (void*)info, info->id, info->timeout_sec - 1);
-                info->timeout_sec--;
-            }
-            break;
-        case RIS_EXPECT:
-            any_work = true;
-            if (info->u.expect.error == RX_ERROR_READY_FOR_DELIVERY) {
-                BUS_LOG(b, 4, LOG_LISTENER,
-                    "retrying RX event delivery", b->udata);
-                retry_delivery(l, info);
-            } else if (info->u.expect.error == RX_ERROR_DONE) {
-                BUS_LOG_SNPRINTF(b, 4, LOG_LISTENER, b->udata, 64,
-                    "cleaning up completed RX event at info %p", (void*)info);
-                clean_up_completed_info(l, info);
-            } else if (info->u.expect.error != RX_ERROR_NONE) {
-                BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 64,
-                    "notifying of rx failure -- error %d (info %p)",
-                    info->u.expect.error, (void*)info);
-                ListenerTask_NotifyMessageFailure(l, info, BUS_SEND_RX_FAILURE);
-            } else if (info->timeout_sec == 1) {
-                #ifndef TEST
-                struct timeval cur;
-                #endif
-                if (!Util_Timestamp(&cur, false)) {
-                    BUS_LOG(b, 0, LOG_LISTENER,
-                        "gettimeofday failure in tick_handler!", b->udata);
-                    continue;
-                }
-                struct boxed_msg *box = info->u.expect.box;
-                BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 256 + 64,
-                    "notifying of rx failure -- timeout (info %p) -- "
-                    "<fd:%d, seq_id:%lld>, from time (queued:%ld.%ld) to (sent:%ld.%ld) to (now:%ld.%ld)",
-                    (void*)info, box->fd, (long long)box->out_seq_id,
-                    (long)box->tv_send_start.tv_sec, (long)box->tv_send_start.tv_usec,
-                    (long)box->tv_send_done.tv_sec, (long)box->tv_send_done.tv_usec,
-                    (long)cur.tv_sec, (long)cur.tv_usec);
-                (void)box;
-
-                ListenerTask_NotifyMessageFailure(l, info, BUS_SEND_RX_TIMEOUT);
-            } else {
-                BUS_LOG_SNPRINTF(b, 3, LOG_LISTENER, b->udata, 64,
-                    "decrementing countdown on info %p [%u]: %ld",
-                    (void*)info, info->id, info->timeout_sec - 1);
-                info->timeout_sec--;
+        ListenerTask_ReleaseRXInfo(l, info);
+        break;
+    }
+    case RIS_EXPECT:
+        if (info->u.expect.error == RX_ERROR_READY_FOR_DELIVERY) {
+            BUS_LOG(b, 4, LOG_LISTENER,
+                "retrying RX event delivery", b->udata);
+            retry_delivery(l, info);
+        } else if (info->u.expect.error == RX_ERROR_DONE) {
+            BUS_LOG_SNPRINTF(b, 4, LOG_LISTENER, b->udata, 64,
+                "cleaning up completed RX event at info %p", (void*)info);
+            clean_up_completed_info(l, info);
+        } else if (info->u.expect.error != RX_ERROR_NONE) {
+            BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 64,
+                "notifying of rx failure -- error %d (info %p)",
+                info->u.expect.error, (void*)info);
+            ListenerTask_NotifyMessageFailure(l, info, BUS_SEND_RX_FAILURE);
+        } else {
+            #ifndef TEST
+            struct timeval cur;
+            #endif
+            if (!Util_Timestamp(&cur, false)) {
+                BUS_LOG(b, 0, LOG_LISTENER,
+                    "gettimeofday failure in expire_rx_info!", b->udata);
             }
-            break;
-        default:
-            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
-                "match fail %d on line %d", info->state, __LINE__);
-            BUS_ASSERT(b, b->udata, false);
+            struct boxed_msg *box = info->u.expect.box;
+            BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 256 + 64,
+                "notifying of rx failure -- timeout (info %p) -- "
+                "<fd:%d, seq_id:%lld>, from time (queued:%ld.%ld) to (sent:%ld.%ld) to (now:%ld.%ld)",
+                (void*)info, box->fd, (long long)box->out_seq_id,
+                (long)box->tv_send_start.tv_sec, (long)box->tv_send_start.tv_usec,
+                (long)box->tv_send_done.tv_sec, (long)box->tv_send_done.tv_usec,
+                (long)cur.tv_sec, (long)cur.tv_usec);
+            (void)box;
+
+            ListenerTask_NotifyMessageFailure(l, info, BUS_SEND_RX_TIMEOUT);
         }
+        break;
+    default:
+        BUS_LOG_SNPRINTF(b, 0, LOG_LISTENER, b->udata, 64,
+            "match fail %d on line %d", info->state, __LINE__);
+        BUS_ASSERT(b, b->udata, false);
     }
-    if (!any_work) { l->is_idle = true; }
+}
+
+/* The threadpool was full, so try again shortly. */
+static void schedule_retry(listener *l, rx_info_t *info) {
+    TimerWheel_Schedule(&l->timers, &info->timer, LISTENER_RETRY_DELAY_MSEC);
 }
 
 void ListenerTask_DumpRXInfoTable(listener *l) {
     for (int i = 0; i <= l->rx_info_max_used; i++) {
         rx_info_t *info = &l->rx_info[i];
 
-        printf(" -- state: %d, info[%d]: timeout %ld",
-            info->state, info->id, info->timeout_sec);
+        printf(" -- state: %d, info[%d]: deadline %lld",
+            info->state, info->id, (long long)info->timer.deadline);
         switch (l->rx_info[i].state) {
         case RIS_HOLD:
             printf(", fd %d, seq_id %lld, has_result? %d\n",
@@ -251,22 +327,25 @@ static void retry_delivery(listener *l, rx_info_t *info) {
     struct boxed_msg *box = info->u.expect.box;
     info->u.expect.box = NULL;       /* release */
     BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
-        "releasing box %p at line %d", (void*)box, __LINE__);
+        "releasing box %p (seq_id %lld) at line %d",
+        (void*)box, (long long)box->out_seq_id, __LINE__);
     BUS_ASSERT(b, b->udata, box->result.status == BUS_SEND_SUCCESS);
 
     #ifndef TEST
     size_t backpressure = 0;
     #endif
+    /* Once delivered, the box may already have been freed. */
     if (Bus_ProcessBoxedMessage(l->bus, box, &backpressure)) {
         BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
-            "successfully delivered box %p (seq_id %lld) from info %d at line %d (retry)",
-            (void*)box, (long long)box->out_seq_id, info->id, __LINE__);
+            "successfully delivered box %p from info %d at line %d (retry)",
+            (void*)box, info->id, __LINE__);
         info->u.expect.error = RX_ERROR_DONE;
         ListenerTask_ReleaseRXInfo(l, info);
     } else {
         BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
             "returning box %p at line %d", (void*)box, __LINE__);
-        info->u.expect.box = box;    /* retry in tick_handler */
+        info->u.expect.box = box;
+        schedule_retry(l, info);
     }
 
     observe_backpressure(l, backpressure);
@@ -286,8 +365,8 @@ static void clean_up_completed_info(listener *l, rx_info_t *info) {
     if (info->u.expect.box) {
         struct boxed_msg *box = info->u.expect.box;
         if (box->result.status != BUS_SEND_SUCCESS) {
-            printf("*** info %d: info->timeout %ld\n",
-                info->id, info->timeout_sec);
+            printf("*** info %d: info->deadline %lld\n",
+                info->id, (long long)info->timer.deadline);
             printf("    info->error %d\n", info->u.expect.error);
             printf("    info->box == %p\n", (void*)box);
             printf("    info->box->result.status == %d\n", box->result.status);
@@ -305,7 +384,8 @@ static void clean_up_completed_info(listener *l, rx_info_t *info) {
         } else {
             BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
                 "returning box %p at line %d", (void*)box, __LINE__);
-            info->u.expect.box = box;    /* retry in tick_handler */
+            info->u.expect.box = box;
+            schedule_retry(l, info);
         }
     } else {                    /* already processed, just release it */
         ListenerTask_ReleaseRXInfo(l, info);
@@ -337,8 +417,9 @@ void ListenerTask_NotifyMessageFailure(listener *l,
         info->u.expect.error = RX_ERROR_DONE;
         ListenerTask_ReleaseRXInfo(l, info);
     } else {
-        /* RetuBus_RegisterSocket to info, will be released on retry. */
+        /* Return to info, will be released on retry. */
         info->u.expect.box = box;
+        schedule_retry(l, info);
     }
 
     observe_backpressure(l, backpressure);
@@ -403,6 +484,13 @@ void ListenerTask_ReleaseRXInfo(struct listener *l, rx_info_t *info) {
         info->id, (void *)info, info->state);
 
     BUS_ASSERT(b, b->udata, info->state != RIS_INACTIVE);
+    if (info->match) {
+        /* The response is still being received into the request's
+         * buffers, which the client may now reuse. */
+        ListenerHelper_UnmatchRXInfo(l, info->match, true);
+    }
+    ListenerHelper_UnindexRXInfo(l, info);
+    TimerWheel_Cancel(&l->timers, &info->timer);
     info->state = RIS_INACTIVE;
     memset(&info->u, 0, sizeof(info->u));
     info->next = l->rx_info_freelist;
@@ -416,7 +504,8 @@ void ListenerTask_ReleaseRXInfo(struct listener *l, rx_info_t *info) {
             l->rx_info_max_used--;
             if (l->rx_info_max_used == 0) { break; }
         }
-        BUS_ASSERT(b, b->udata, l->rx_info_max_used < MAX_PENDING_MESSAGES);
+        uint16_t max_used = l->rx_info_max_used;
+        BUS_ASSERT(b, b->udata, max_used < MAX_PENDING_MESSAGES);
     }
 
     l->rx_info_in_use--;
@@ -515,7 +604,8 @@ void ListenerTask_AttemptDelivery(listener *l, struct rx_info_t *info) {
     } else {
         BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
             "returning box %p at line %d", (void*)box, __LINE__);
-        info->u.expect.box = box; /* retry in tick_handler */
+        info->u.expect.box = box;
+        schedule_retry(l, info);
     }
     observe_backpressure(l, backpressure);
 }
@@ -0,0 +1,498 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* for MAP_ANONYMOUS and MAP_POPULATE */
+#endif
+
+#include "listener_uring.h"
+
+#if BUS_HAVE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include "syscall.h"
+#include "atomic.h"
+
+/* The listener keeps one receive (or, for SSL sockets, one readiness
+ * poll) outstanding per socket, plus a poll on the incoming command
+ * pipe. Received data lands in buffers the kernel picks from a ring of
+ * provided buffers, so sockets don't need buffers of their own, and a
+ * single io_uring_enter both submits new receives and waits for any
+ * that have completed. */
+
+/** Submission and completion queue sizes. There is at most one
+ * outstanding request per socket (plus cancellations), so the
+ * completion queue can hold all of them. */
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+/** Number of provided receive buffers (a power of 2), and their size. */
+#define URING_BUF_COUNT 64
+#define URING_BUF_SIZE (64 * 1024)
+#define URING_BUF_GROUP 0
+
+/** Removed sockets hold their slot until their request completes. */
+#define URING_SLOT_COUNT (2 * MAX_FDS)
+
+/** user_data values for requests that aren't for a socket slot. */
+#define URING_TAG_CMD_PIPE (UINT64_MAX)
+#define URING_TAG_CANCEL (UINT64_MAX - 1)
+
+/** Longest wait (msec) while the command pipe couldn't be re-armed. */
+#define URING_REARM_RETRY_MSEC 1
+
+typedef struct {
+    connection_info *ci;        ///< NULL once the socket is removed
+    bool in_use;
+    bool armed;                 ///< a receive or poll is outstanding
+    bool needs_arm;             ///< couldn't be armed, submission queue full
+} uring_slot;
+
+/** A completion, copied out of the completion queue. */
+typedef struct {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+} uring_done;
+
+struct listener_uring {
+    int fd;
+
+    /* Submission queue, shared with the kernel. */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue, shared with the kernel. */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    /* Provided receive buffers. */
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    uint8_t *bufs;
+    uint16_t buf_tail;
+
+    uring_slot slots[URING_SLOT_COUNT];
+    bool arm_backlog;           ///< some slots have needs_arm set
+    bool cmd_pipe_needs_arm;    ///< couldn't be re-armed, submission queue full
+
+    /* Completions from the last wait. */
+    uring_done done[URING_CQ_ENTRIES];
+    int done_count;
+    int done_next;
+    listener_uring_completion cur;  ///< the last NextCompletion result
+};
+
+static bool map_rings(struct listener_uring *u, struct io_uring_params *p);
+static bool setup_buffers(struct listener_uring *u);
+static void free_uring(struct listener_uring *u);
+static struct io_uring_sqe *get_sqe(struct listener_uring *u);
+static void commit_sqe(struct listener_uring *u);
+static bool arm_cmd_pipe(listener *l);
+static void arm_slot(listener *l, uint16_t id);
+static void add_buffer(struct listener_uring *u, uint16_t buf_id);
+
+bool ListenerUring_Init(listener *l) {
+    struct bus *b = l->bus;
+    struct listener_uring *u = calloc(1, sizeof(*u));
+    if (u == NULL) { return false; }
+    u->fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+
+    int fd = syscall_io_uring_setup(URING_SQ_ENTRIES, &p);
+    if (fd == -1) {
+        BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 128,
+            "io_uring_setup failure: %s", strerror(errno));
+        errno = 0;
+        goto cleanup;
+    }
+    u->fd = fd;
+
+    /* Needed for timed waits, and so completions are never dropped. */
+    const uint32_t features = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((p.features & features) != features) {
+        BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 128,
+            "io_uring missing features: 0x%08x", p.features);
+        goto cleanup;
+    }
+
+    if (!map_rings(u, &p)) { goto cleanup; }
+    if (!setup_buffers(u)) {
+        BUS_LOG_SNPRINTF(b, 1, LOG_LISTENER, b->udata, 128,
+            "io_uring buffer ring setup failure: %s", strerror(errno));
+        errno = 0;
+        goto cleanup;
+    }
+
+    l->uring = u;
+    if (!arm_cmd_pipe(l)) {
+        l->uring = NULL;
+        goto cleanup;
+    }
+    return true;
+
+cleanup:
+    free_uring(u);
+    return false;
+}
+
+void ListenerUring_Free(listener *l) {
+    free_uring(l->uring);
+    l->uring = NULL;
+}
+
+bool ListenerUring_AddSocket(listener *l, connection_info *ci) {
+    struct listener_uring *u = l->uring;
+    for (uint16_t id = 0; id < URING_SLOT_COUNT; id++) {
+        uring_slot *slot = &u->slots[id];
+        if (!slot->in_use) {
+            slot->in_use = true;
+            slot->ci = ci;
+            arm_slot(l, id);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ListenerUring_RemoveSocket(listener *l, connection_info *ci) {
+    struct listener_uring *u = l->uring;
+    for (uint16_t id = 0; id < URING_SLOT_COUNT; id++) {
+        uring_slot *slot = &u->slots[id];
+        if (!slot->in_use || slot->ci != ci) { continue; }
+
+        slot->ci = NULL;
+        slot->needs_arm = false;
+        if (slot->armed) {
+            /* The slot is freed when the request completes, either
+             * normally or as cancelled. If the cancellation can't be
+             * queued, it will complete once the socket is closed. */
+            struct io_uring_sqe *sqe = get_sqe(u);
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = id;
+                sqe->user_data = URING_TAG_CANCEL;
+                commit_sqe(u);
+            }
+        } else {
+            slot->in_use = false;
+        }
+        return;
+    }
+}
+
+int ListenerUring_Wait(listener *l, int delay) {
+    struct listener_uring *u = l->uring;
+    u->done_count = 0;
+    u->done_next = 0;
+    l->fds[INCOMING_MSG_PIPE_ID].revents = 0;
+
+    /* Without the command pipe armed, commands would go unnoticed, so
+     * re-arm it first, and don't block for long if that still fails. */
+    if (u->cmd_pipe_needs_arm) {
+        u->cmd_pipe_needs_arm = !arm_cmd_pipe(l);
+        if (u->cmd_pipe_needs_arm &&
+                (delay == INFINITE_DELAY || delay > URING_REARM_RETRY_MSEC)) {
+            delay = URING_REARM_RETRY_MSEC;
+        }
+    }
+
+    if (u->arm_backlog) {
+        u->arm_backlog = false;
+        for (uint16_t id = 0; id < URING_SLOT_COUNT; id++) {
+            uring_slot *slot = &u->slots[id];
+            if (slot->in_use && slot->needs_arm) { arm_slot(l, id); }
+        }
+    }
+
+    struct __kernel_timespec ts = {
+        .tv_sec = delay / 1000,
+        .tv_nsec = (delay % 1000) * 1000000L,
+    };
+    struct io_uring_getevents_arg arg = {
+        .ts = (delay == INFINITE_DELAY ? 0 : (uint64_t)(uintptr_t)&ts),
+    };
+    unsigned to_submit = *u->sq_tail - ATOMIC_LOAD_ACQUIRE(u->sq_head);
+    int res = syscall_io_uring_enter(u->fd, to_submit, 1,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (res == -1) {
+        if (errno == ETIME || errno == EBUSY) {
+            /* Timed out, or the completion queue is full: collect
+             * whatever has completed. */
+            errno = 0;
+        } else {
+            return -1;
+        }
+    }
+
+    int ready = 0;
+    unsigned head = *u->cq_head;
+    unsigned tail = ATOMIC_LOAD_ACQUIRE(u->cq_tail);
+    for (; head != tail && u->done_count < URING_CQ_ENTRIES; head++) {
+        struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        if (cqe->user_data == URING_TAG_CMD_PIPE) {
+            l->fds[INCOMING_MSG_PIPE_ID].revents =
+                (cqe->res < 0 ? POLLERR : (short)cqe->res);
+            ready++;
+            if (!arm_cmd_pipe(l)) { u->cmd_pipe_needs_arm = true; }
+        } else if (cqe->user_data == URING_TAG_CANCEL) {
+            /* nothing to do */
+        } else {
+            u->done[u->done_count] = (uring_done){
+                .user_data = cqe->user_data,
+                .res = cqe->res,
+                .flags = cqe->flags,
+            };
+            u->done_count++;
+            ready++;
+        }
+    }
+    ATOMIC_STORE_RELEASE(u->cq_head, head);
+    return ready;
+}
+
+listener_uring_completion *ListenerUring_NextCompletion(listener *l) {
+    struct listener_uring *u = l->uring;
+    listener_uring_completion *c = &u->cur;
+    while (u->done_next < u->done_count) {
+        uring_done *d = &u->done[u->done_next];
+        u->done_next++;
+
+        uint16_t id = (uint16_t)d->user_data;
+        uring_slot *slot = &u->slots[id];
+        slot->armed = false;
+
+        *c = (listener_uring_completion){
+            .ci = slot->ci,
+            .res = d->res,
+            .slot = id,
+        };
+        if (d->flags & IORING_CQE_F_BUFFER) {
+            c->has_buf = true;
+            c->buf_id = (uint16_t)(d->flags >> IORING_CQE_BUFFER_SHIFT);
+            c->buf = &u->bufs[(size_t)c->buf_id * URING_BUF_SIZE];
+        }
+
+        if (slot->ci == NULL) {  /* removed since it completed */
+            ListenerUring_Release(l, c);
+            slot->in_use = false;
+            continue;
+        }
+        return c;
+    }
+    return NULL;
+}
+
+void ListenerUring_Rearm(listener *l, listener_uring_completion *c) {
+    ListenerUring_Release(l, c);
+    arm_slot(l, c->slot);
+}
+
+void ListenerUring_Release(listener *l, listener_uring_completion *c) {
+    struct listener_uring *u = l->uring;
+    if (c->has_buf) {
+        add_buffer(u, c->buf_id);
+        ATOMIC_STORE_RELEASE(&u->buf_ring->tail, u->buf_tail);
+        c->has_buf = false;
+    }
+}
+
+static bool map_rings(struct listener_uring *u, struct io_uring_params *p) {
+    u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && u->cq_ring_size > u->sq_ring_size) {
+        u->sq_ring_size = u->cq_ring_size;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        return false;
+    }
+
+    if (single_mmap) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            return false;
+        }
+    }
+
+    u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        return false;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_entries = *(unsigned *)(sq + p->sq_off.ring_entries);
+
+    /* SQEs are always used in ring order, so the indirection array
+     * is set up once. */
+    unsigned *sq_array = (unsigned *)(sq + p->sq_off.array);
+    for (unsigned i = 0; i < u->sq_entries; i++) { sq_array[i] = i; }
+
+    uint8_t *cq = u->cq_ring;
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return true;
+}
+
+static bool setup_buffers(struct listener_uring *u) {
+    u->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) { return false; }
+    u->buf_ring = ring;
+
+    u->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (u->bufs == NULL) { return false; }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (-1 == syscall_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < URING_BUF_COUNT; i++) { add_buffer(u, i); }
+    ATOMIC_STORE_RELEASE(&u->buf_ring->tail, u->buf_tail);
+    return true;
+}
+
+static void free_uring(struct listener_uring *u) {
+    if (u == NULL) { return; }
+    /* Closing the ring cancels any outstanding requests. */
+    if (u->fd != -1) { syscall_close(u->fd); }
+    if (u->sqes) { munmap(u->sqes, u->sqes_size); }
+    if (u->cq_ring && u->cq_ring != u->sq_ring) { munmap(u->cq_ring, u->cq_ring_size); }
+    if (u->sq_ring) { munmap(u->sq_ring, u->sq_ring_size); }
+    if (u->buf_ring) { munmap(u->buf_ring, u->buf_ring_size); }
+    free(u->bufs);
+    free(u);
+}
+
+/* Get the next free SQE, submitting queued ones first if the
+ * submission queue is full. Returns NULL if that fails. */
+static struct io_uring_sqe *get_sqe(struct listener_uring *u) {
+    unsigned tail = *u->sq_tail;
+    if (tail - ATOMIC_LOAD_ACQUIRE(u->sq_head) == u->sq_entries) {
+        (void)syscall_io_uring_enter(u->fd, u->sq_entries, 0, 0, NULL, 0);
+        if (tail - ATOMIC_LOAD_ACQUIRE(u->sq_head) == u->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/* Make the SQE from get_sqe visible to the kernel. It's submitted by
+ * the next io_uring_enter. */
+static void commit_sqe(struct listener_uring *u) {
+    ATOMIC_STORE_RELEASE(u->sq_tail, *u->sq_tail + 1);
+}
+
+static bool arm_cmd_pipe(listener *l) {
+    struct listener_uring *u = l->uring;
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (sqe == NULL) { return false; }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = l->incoming_msg_pipe;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_TAG_CMD_PIPE;
+    commit_sqe(u);
+    return true;
+}
+
+static void arm_slot(listener *l, uint16_t id) {
+    struct listener_uring *u = l->uring;
+    uring_slot *slot = &u->slots[id];
+    connection_info *ci = slot->ci;
+
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (sqe == NULL) {
+        slot->needs_arm = true;
+        u->arm_backlog = true;
+        return;
+    }
+
+    if (ci->type == BUS_SOCKET_SSL) {
+        /* OpenSSL does its own reads, so just wait until it can. */
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = ci->fd;
+        sqe->poll32_events = POLLIN;
+    } else {
+        /* Receive whatever is available -- the listener frames
+         * messages from it as they're passed to the sink. */
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = ci->fd;
+        sqe->len = URING_BUF_SIZE;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+    }
+    sqe->user_data = id;
+    commit_sqe(u);
+    slot->armed = true;
+    slot->needs_arm = false;
+}
+
+/* Queue a buffer for the kernel to receive into. It becomes visible
+ * once the buffer ring's tail is published. */
+static void add_buffer(struct listener_uring *u, uint16_t buf_id) {
+    struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)&u->bufs[(size_t)buf_id * URING_BUF_SIZE];
+    buf->len = URING_BUF_SIZE;
+    buf->bid = buf_id;
+    u->buf_tail++;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef LISTENER_URING_H
+#define LISTENER_URING_H
+
+#include "bus_types.h"
+#include "bus_internal_types.h"
+#include "listener_internal_types.h"
+
+#if BUS_HAVE_IO_URING
+
+/** A completed receive (or, for SSL sockets, readiness poll). */
+typedef struct {
+    connection_info *ci;
+    int32_t res;        ///< bytes read, poll events, or -errno
+    uint8_t *buf;       ///< received data, if res > 0 for a plain socket
+    uint16_t slot;
+    uint16_t buf_id;
+    bool has_buf;
+} listener_uring_completion;
+
+/** Set up the listener's io_uring. Returns false if the kernel doesn't
+ * support everything needed, in which case another backend should be used. */
+bool ListenerUring_Init(listener *l);
+
+/** Free the listener's io_uring, if any. */
+void ListenerUring_Free(listener *l);
+
+/** Start receiving on a socket. Returns false if the listener can't
+ * track any more sockets. */
+bool ListenerUring_AddSocket(listener *l, connection_info *ci);
+
+/** Stop receiving on a socket. Completions for it that are already
+ * pending are dropped, so the client may free CI once notified. */
+void ListenerUring_RemoveSocket(listener *l, connection_info *ci);
+
+/** Submit pending requests and wait up to DELAY msec for completions.
+ * The command pipe's events are put in l->fds[INCOMING_MSG_PIPE_ID].
+ * Returns the number of completions, or -1 on error, like poll. */
+int ListenerUring_Wait(listener *l, int delay);
+
+/** Get the next completion from the last wait, or NULL if there are no
+ * more. Each completion must be passed to either ListenerUring_Rearm or
+ * ListenerUring_Release before getting the next one. */
+listener_uring_completion *ListenerUring_NextCompletion(listener *l);
+
+/** Return C's buffer to the kernel and receive on its socket again. */
+void ListenerUring_Rearm(listener *l, listener_uring_completion *c);
+
+/** Return C's buffer to the kernel, without receiving again. */
+void ListenerUring_Release(listener *l, listener_uring_completion *c);
+
+#endif
+
+#endif
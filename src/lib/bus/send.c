@@ -24,7 +24,6 @@
 #include <errno.h>
 
 #include "bus.h"
-#include "bus_poll.h"
 #include "bus_types.h"
 #include "bus_internal_types.h"
 #include "listener.h"
@@ -40,13 +39,13 @@ struct timeval start;
 struct timeval now;
 struct pollfd fds[1];
 size_t backpressure = 0;
+uint16_t hold_backpressure = 0;
 int poll_errno = 0;
 int write_errno = 0;
-int completion_pipe = -1;
 #endif
 
 static bool attempt_to_enqueue_HOLD_message_to_listener(struct bus *b,
-    int fd, int64_t seq_id, int16_t timeout_sec);
+    int fd, int64_t seq_id, uint32_t timeout_msec);
 /* Do a blocking send.
  *
  * RetuBus_RegisterSocketing true indicates that the message has been queued up for
@@ -67,7 +66,7 @@ bool Send_DoBlockingSend(bus *b, boxed_msg *box) {
         (void *)box, box->fd, (long long)box->out_seq_id,
         box->out_msg_size, (void *)box->out_msg);
 
-    int timeout_msec = box->timeout_sec * 1000;
+    int timeout_msec = box->timeout_msec;
 
 #ifndef TEST
     struct timeval start;
@@ -89,15 +88,18 @@ bool Send_DoBlockingSend(bus *b, boxed_msg *box) {
      * because (in rare cases) the response may arrive between finishing
      * the write and the listener processing the notification. In that
      * case, it should hold onto the unrecognized response until the
-     * client notifies it (and passes it the callback).
+     * client notifies it (and passes it the callback). This doesn't
+     * wait for the listener: it checks its queue for a matching HOLD
+     * before treating a response as unexpected.
      *
-     * This timeout is several extra seconds so that we don't have
+     * This timeout is SEND_HOLD_TIMEOUT_SLACK_MSEC longer so that we don't have
      * a window where the HOLD message has timed out, but the
      * EXPECT hasn't, leading to ambiguity about what to do with
      * the response (which may or may not have arrived).
      * */
     if (!attempt_to_enqueue_HOLD_message_to_listener(b,
-            box->fd, box->out_seq_id, box->timeout_sec + 5)) {
+            box->fd, box->out_seq_id,
+            box->timeout_msec + SEND_HOLD_TIMEOUT_SLACK_MSEC)) {
         return false;
     }
     assert(box->out_sent_size == 0);
@@ -179,8 +181,147 @@ bool Send_DoBlockingSend(bus *b, boxed_msg *box) {
     return true;
 }
 
+/* Do a blocking send of several boxes to the same socket.
+ *
+ * Every box is registered with the listener before any of them are
+ * written, and then they are written in order from a single poll loop,
+ * so a batch of small requests can go out in one writev. If the loop
+ * fails or times out, all boxes that have not been sent yet get the
+ * failure status through their callbacks. */
+size_t Send_DoBlockingSendBatch(bus *b, boxed_msg **boxes, size_t count) {
+    /* Note: the same assumptions as Send_DoBlockingSend apply. */
+    assert(b);
+    assert(boxes);
+    assert(count > 0);
+
+    int fd = boxes[0]->fd;
+    int timeout_msec = boxes[0]->timeout_msec;
+    for (size_t i = 1; i < count; i++) {
+        assert(boxes[i]->fd == fd);
+        if ((int)boxes[i]->timeout_msec < timeout_msec) {
+            timeout_msec = boxes[i]->timeout_msec;
+        }
+    }
+
+    BUS_LOG_SNPRINTF(b, 3, LOG_SENDER, b->udata, 256,
+        "doing blocking send of %zd boxes, with <fd:%d, seq_id %lld...>",
+        count, fd, (long long)boxes[0]->out_seq_id);
+
+#ifndef TEST
+    struct timeval now;
+    struct pollfd fds[1];
+#endif
+    size_t held = Send_HoldBatch(b, boxes, count);
+    if (held == 0) { return 0; }
+    struct timeval batch_start = boxes[0]->tv_send_start;
+
+    fds[0].fd = fd;
+    fds[0].events = POLLOUT;
+
+    size_t sent = 0;
+    bus_send_status_t status = BUS_SEND_TX_TIMEOUT;
+    int rem_msec = timeout_msec;
+
+    while (sent < held && rem_msec > 0) {
+        if (Util_Timestamp(&now, true)) {
+            size_t usec_elapsed = (((now.tv_sec - batch_start.tv_sec) * 1000000)
+                + (now.tv_usec - batch_start.tv_usec));
+            size_t msec_elapsed = usec_elapsed / 1000;
+
+            rem_msec = timeout_msec - msec_elapsed;
+        } else {
+            BUS_LOG_SNPRINTF(b, 0, LOG_SENDER, b->udata, 128,
+                "gettimeofday failure in poll loop: %d", errno);
+            status = BUS_SEND_TX_FAILURE;
+            break;
+        }
+
+        #ifdef TEST
+        errno = poll_errno;
+        #endif
+        int res = syscall_poll(fds, 1, rem_msec);
+        BUS_LOG_SNPRINTF(b, 3, LOG_SENDER, b->udata, 256,
+            "handle_write batch: poll res %d", res);
+        if (res == -1) {
+            if (errno == EINTR || errno == EAGAIN) { /* interrupted/try again */
+                errno = 0;
+                continue;
+            } else {
+                status = BUS_SEND_TX_FAILURE;
+                break;
+            }
+        } else if (res == 1) {
+            short revents = fds[0].revents;
+            if (revents & POLLNVAL) {
+                status = BUS_SEND_UNREGISTERED_SOCKET;
+                break;
+            } else if (revents & (POLLERR | POLLHUP)) {
+                status = BUS_SEND_TX_FAILURE;
+                break;
+            } else if (revents & POLLOUT) {
+                size_t completed = 0;
+                SendHelper_HandleWrite_res hw_res = SendHelper_HandleWriteBatch(b,
+                    &boxes[sent], held - sent, &completed);
+                sent += completed;
+
+                BUS_LOG_SNPRINTF(b, 4, LOG_SENDER, b->udata, 256,
+                    "SendHelper_HandleWriteBatch res %d, %zd completed",
+                    hw_res, completed);
+
+                if (hw_res == SHHW_ERROR) {
+                    status = BUS_SEND_TX_FAILURE;
+                    break;
+                }
+            } else {
+                BUS_LOG_SNPRINTF(b, 0, LOG_SENDER, b->udata, 256,
+                    "match fail %d", revents);
+                assert(false);  /* match fail */
+            }
+        } else if (res == 0) {  /* timeout */
+            break;
+        }
+    }
+
+    if (sent < held) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_SENDER, b->udata, 256,
+            "do_blocking_send_batch on <fd:%d>: %zd unsent, status %d",
+            fd, held - sent, status);
+    }
+    for (size_t i = sent; i < held; i++) {
+        Send_HandleFailure(b, boxes[i], status);
+    }
+    return held;
+}
+
+size_t Send_HoldBatch(bus *b, boxed_msg **boxes, size_t count) {
+    #ifndef TEST
+    struct timeval start;
+    #endif
+    if (!Util_Timestamp(&start, true)) {
+        BUS_LOG_SNPRINTF(b, 0, LOG_SENDER, b->udata, 128,
+            "gettimeofday failure: %d", errno);
+        return 0;
+    }
+
+    /* Boxes the listener can't be told about are rejected, along
+     * with everything after them, to keep the sequence IDs in order. */
+    size_t held = 0;
+    while (held < count) {
+        boxed_msg *box = boxes[held];
+        if (!attempt_to_enqueue_HOLD_message_to_listener(b,
+                box->fd, box->out_seq_id,
+                box->timeout_msec + SEND_HOLD_TIMEOUT_SLACK_MSEC)) {
+            break;
+        }
+        assert(box->out_sent_size == 0);
+        box->tv_send_start = start;
+        held++;
+    }
+    return held;
+}
+
 static bool attempt_to_enqueue_HOLD_message_to_listener(struct bus *b,
-    int fd, int64_t seq_id, int16_t timeout_sec) {
+    int fd, int64_t seq_id, uint32_t timeout_msec) {
     BUS_LOG_SNPRINTF(b, 5, LOG_SENDER, b->udata, 128,
       "telling listener to HOLD response, with <fd:%d, seq_id:%lld>",
         fd, (long long)seq_id);
@@ -190,10 +331,12 @@ static bool attempt_to_enqueue_HOLD_message_to_listener(struct bus *b,
     const int max_retries = SEND_NOTIFY_LISTENER_RETRIES;
     for (int try = 0; try < max_retries; try++) {
         #ifndef TEST
-        int completion_pipe = -1;
+        uint16_t hold_backpressure = 0;
         #endif
-        if (Listener_HoldResponse(l, fd, seq_id, timeout_sec, &completion_pipe)) {
-            return BusPoll_OnCompletion(b, completion_pipe);
+        if (Listener_HoldResponse(l, fd, seq_id, timeout_msec, &hold_backpressure)) {
+            Bus_BackpressureDelay(b, hold_backpressure,
+                LISTENER_BACKPRESSURE_SHIFT);
+            return true;
         } else {
             /* Don't apply much backpressure here since the client
              * thread will get it when the message is done sending. */
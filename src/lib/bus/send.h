@@ -30,6 +30,17 @@
  * the callback-based error handling will not be used. */
 bool Send_DoBlockingSend(struct bus *b, boxed_msg *box);
 
+/* Do a blocking send of COUNT boxes to the same socket, in order.
+ * Returns how many of them (from the start of BOXES) were queued up for
+ * delivery, with the same meaning as Send_DoBlockingSend's true. */
+size_t Send_DoBlockingSendBatch(struct bus *b, boxed_msg **boxes, size_t count);
+
+/* Register COUNT boxes to the same socket with its listener, in order,
+ * before any of them are written, and timestamp them as started. Returns
+ * how many (from the start of BOXES) were registered; the rest must be
+ * rejected, to keep the sequence IDs in order. */
+size_t Send_HoldBatch(struct bus *b, boxed_msg **boxes, size_t count);
+
 void Send_HandleFailure(struct bus *b, boxed_msg *box, bus_send_status_t status);
 
 #endif
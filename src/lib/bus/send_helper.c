@@ -24,14 +24,22 @@
 #include "util.h"
 
 #include <assert.h>
+#include <errno.h>
 
 static ssize_t write_plain(struct bus *b, boxed_msg *box);
+static ssize_t write_plain_iov(struct bus *b, boxed_msg *box);
+static int get_unsent_iov(boxed_msg *box, struct iovec *iov);
+static int get_unsent_iov_max(boxed_msg *box, struct iovec *iov, int max);
+static ssize_t writev_once(struct bus *b, int fd, struct iovec *iov, int iovcnt);
+static SendHelper_HandleWrite_res finish_send(bus *b, boxed_msg *box);
 static ssize_t write_ssl(struct bus *b, boxed_msg *box, SSL *ssl);
 static bool enqueue_EXPECT_message_to_listener(bus *b, boxed_msg *box);
 
 #ifdef TEST
 struct timeval done;
 uint16_t backpressure = 0;
+struct iovec iov[BUS_MAX_IOV];
+struct iovec batch_iov[SEND_BATCH_MAX_IOV];
 #endif
 
 SendHelper_HandleWrite_res SendHelper_HandleWrite(bus *b, boxed_msg *box) {
@@ -52,12 +60,11 @@ SendHelper_HandleWrite_res SendHelper_HandleWrite(bus *b, boxed_msg *box) {
         Send_HandleFailure(b, box, BUS_SEND_TX_FAILURE);
         return SHHW_ERROR;
     } else if (wrsz == 0) {
-        /* If the OS set POLLOUT but we can't actually write, then
-         * just go back to the poll() loop with no progress.
-         * If we busywait on this, something is deeply wrong. */
-        BUS_LOG_SNPRINTF(b, 1, LOG_SENDER, b->udata, 128,
-            "suspicious: wrote %zd bytes to <fd:%d, seq_id%lld>",
-            wrsz, box->fd, (long long)box->out_seq_id);
+        /* The socket isn't writable after all (e.g. EAGAIN), so just
+         * go back to the poll() loop with no progress. */
+        BUS_LOG_SNPRINTF(b, 4, LOG_SENDER, b->udata, 128,
+            "no progress writing <fd:%d, seq_id:%lld>",
+            box->fd, (long long)box->out_seq_id);
     } else {
         /* Update amount written so far */
         box->out_sent_size += wrsz;
@@ -71,28 +78,87 @@ SendHelper_HandleWrite_res SendHelper_HandleWrite(bus *b, boxed_msg *box) {
         "wrote %zd, rem is %zd", wrsz, rem);
 
     if (rem == 0) {             /* check if whole message is written */
-        #ifndef TEST
-        struct timeval done;
-        #endif
-        if (Util_Timestamp(&done, true)) {
-            box->tv_send_done = done;
-        } else {
-            Send_HandleFailure(b, box, BUS_SEND_TIMESTAMP_ERROR);
-            return SHHW_ERROR;
-        }
-
-        if (enqueue_EXPECT_message_to_listener(b, box)) {
-            return SHHW_DONE;
-        } else {
-            Send_HandleFailure(b, box, BUS_SEND_TX_TIMEOUT_NOTIFYING_LISTENER);
-            return SHHW_ERROR;
-        }
+        return finish_send(b, box);
     } else {
         return SHHW_OK;
     }
 }
 
+SendHelper_HandleWrite_res SendHelper_HandleWriteBatch(bus *b,
+        boxed_msg **boxes, size_t count, size_t *completed) {
+    assert(count > 0);
+    *completed = 0;
+
+    if (boxes[0]->ssl != BUS_NO_SSL) {
+        /* SSL has no gathering write, so send the boxes one at a time. */
+        SendHelper_HandleWrite_res res = SendHelper_HandleWrite(b, boxes[0]);
+        if (res == SHHW_OK) { return SHHW_OK; }
+        *completed = 1;
+        if (res == SHHW_ERROR) { return SHHW_ERROR; }
+        return (count == 1 ? SHHW_DONE : SHHW_OK);
+    }
+
+    #ifndef TEST
+    struct iovec batch_iov[SEND_BATCH_MAX_IOV];
+    #endif
+    int iovcnt = 0;
+    for (size_t i = 0; i < count && iovcnt < SEND_BATCH_MAX_IOV; i++) {
+        iovcnt += get_unsent_iov_max(boxes[i], &batch_iov[iovcnt],
+            SEND_BATCH_MAX_IOV - iovcnt);
+    }
+
+    ssize_t wrsz = writev_once(b, boxes[0]->fd, batch_iov, iovcnt);
+    if (wrsz == -1) {
+        return SHHW_ERROR;
+    } else if (wrsz == 0) {
+        BUS_LOG_SNPRINTF(b, 4, LOG_SENDER, b->udata, 128,
+            "no progress writing <fd:%d, seq_id:%lld>",
+            boxes[0]->fd, (long long)boxes[0]->out_seq_id);
+        return SHHW_OK;
+    }
+
+    /* Spread the bytes written over the boxes, in order, and hand each
+     * one that is now fully sent over to the listener. */
+    size_t left = wrsz;
+    for (size_t i = 0; i < count; i++) {
+        boxed_msg *box = boxes[i];
+        size_t rem = box->out_msg_size - box->out_sent_size;
+        size_t step = (left < rem ? left : rem);
+        box->out_sent_size += step;
+        left -= step;
+        if (step < rem) { break; }
+
+        SendHelper_HandleWrite_res res = finish_send(b, box);
+        (*completed)++;
+        if (res == SHHW_ERROR) { return SHHW_ERROR; }
+    }
+    return (*completed == count ? SHHW_DONE : SHHW_OK);
+}
+
+/* Timestamp a box that has been sent in full and pass it on to the
+ * listener, or fail it. */
+static SendHelper_HandleWrite_res finish_send(bus *b, boxed_msg *box) {
+    #ifndef TEST
+    struct timeval done;
+    #endif
+    if (Util_Timestamp(&done, true)) {
+        box->tv_send_done = done;
+    } else {
+        Send_HandleFailure(b, box, BUS_SEND_TIMESTAMP_ERROR);
+        return SHHW_ERROR;
+    }
+
+    if (enqueue_EXPECT_message_to_listener(b, box)) {
+        return SHHW_DONE;
+    } else {
+        Send_HandleFailure(b, box, BUS_SEND_TX_TIMEOUT_NOTIFYING_LISTENER);
+        return SHHW_ERROR;
+    }
+}
+
 static ssize_t write_plain(struct bus *b, boxed_msg *box) {
+    if (box->out_iov) { return write_plain_iov(b, box); }
+
     int fd = box->fd;
     uint8_t *msg = box->out_msg;
     size_t msg_size = box->out_msg_size;
@@ -107,7 +173,12 @@ static ssize_t write_plain(struct bus *b, boxed_msg *box) {
     for (;;) {
         ssize_t wrsz = syscall_write(fd, &msg[sent_size], rem);
         if (wrsz == -1) {
-            if (Util_IsResumableIOError(errno)) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* The socket's send buffer is full; leave the rest for
+                 * the next POLLOUT, rather than spinning on it. */
+                errno = 0;
+                return 0;
+            } else if (Util_IsResumableIOError(errno)) {
                 errno = 0;
                 continue;
             } else {
@@ -127,17 +198,105 @@ static ssize_t write_plain(struct bus *b, boxed_msg *box) {
     }
 }
 
+/* Fill IOV with the parts of the box's segments that have not been
+ * sent yet, and return how many there are. */
+static int get_unsent_iov(boxed_msg *box, struct iovec *iov) {
+    return get_unsent_iov_max(box, iov, BUS_MAX_IOV);
+}
+
+/* Like get_unsent_iov, but fills at most MAX entries, and also
+ * handles boxes that were not gathered from segments. */
+static int get_unsent_iov_max(boxed_msg *box, struct iovec *iov, int max) {
+    if (box->out_iov == NULL) {
+        if (max < 1 || box->out_sent_size == box->out_msg_size) { return 0; }
+        iov[0].iov_base = &box->out_msg[box->out_sent_size];
+        iov[0].iov_len = box->out_msg_size - box->out_sent_size;
+        return 1;
+    }
+    size_t skip = box->out_sent_size;
+    int count = 0;
+    for (int i = 0; i < box->out_iovcnt && count < max; i++) {
+        size_t len = box->out_iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        iov[count].iov_base = (uint8_t *)box->out_iov[i].iov_base + skip;
+        iov[count].iov_len = len - skip;
+        skip = 0;
+        count++;
+    }
+    return count;
+}
+
+static ssize_t write_plain_iov(struct bus *b, boxed_msg *box) {
+    int fd = box->fd;
+    #ifndef TEST
+    struct iovec iov[BUS_MAX_IOV];
+    #endif
+    int iovcnt = get_unsent_iov(box, iov);
+
+    BUS_LOG_SNPRINTF(b, 10, LOG_SENDER, b->udata, 64,
+        "writev %d segments to %d, %zd bytes",
+        iovcnt, fd, box->out_msg_size - box->out_sent_size);
+
+    return writev_once(b, fd, iov, iovcnt);
+}
+
+static ssize_t writev_once(struct bus *b, int fd, struct iovec *iov, int iovcnt) {
+    /* Attempt a single write. ('for' is due to continue-based retry.) */
+    for (;;) {
+        ssize_t wrsz = syscall_writev(fd, iov, iovcnt);
+        if (wrsz == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* The socket's send buffer is full; leave the rest for
+                 * the next POLLOUT, rather than spinning on it. */
+                errno = 0;
+                return 0;
+            } else if (Util_IsResumableIOError(errno)) {
+                errno = 0;
+                continue;
+            } else {
+                /* will notify about closed socket upstream */
+                BUS_LOG_SNPRINTF(b, 1, LOG_SENDER, b->udata, 64,
+                    "writev: socket error writing, %s", strerror(errno));
+                errno = 0;
+                return -1;
+            }
+        } else if (wrsz > 0) {
+            BUS_LOG_SNPRINTF(b, 5, LOG_SENDER, b->udata, 64,
+                "sent: %zd", wrsz);
+            return wrsz;
+        } else {
+            return 0;
+        }
+    }
+}
+
 static ssize_t write_ssl(struct bus *b, boxed_msg *box, SSL *ssl) {
     uint8_t *msg = box->out_msg;
     size_t msg_size = box->out_msg_size;
     ssize_t rem = msg_size - box->out_sent_size;
+    size_t offset = box->out_sent_size;
+    if (box->out_iov) {
+        /* SSL has no gathering write, so send the rest of the current
+         * segment; the poll loop will come back for the others. */
+        #ifndef TEST
+        struct iovec iov[BUS_MAX_IOV];
+        #endif
+        if (get_unsent_iov(box, iov) > 0) {
+            msg = iov[0].iov_base;
+            rem = iov[0].iov_len;
+            offset = 0;
+        }
+    }
     int fd = box->fd;
     (void)fd;
     ssize_t written = 0;
     assert(rem >= 0);
 
     while (rem > 0) {
-        ssize_t wrsz = syscall_SSL_write(ssl, &msg[box->out_sent_size], rem);
+        ssize_t wrsz = syscall_SSL_write(ssl, &msg[offset], rem);
         BUS_LOG_SNPRINTF(b, 5, LOG_SENDER, b->udata, 64,
             "SSL_write: socket %d, write %zd => wrsz %zd",
             fd, rem, wrsz);
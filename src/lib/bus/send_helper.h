@@ -29,4 +29,11 @@ typedef enum {
 
 SendHelper_HandleWrite_res SendHelper_HandleWrite(bus *b, boxed_msg *box);
 
+/* Make a single write of as much of BOXES as possible. Each box that is
+ * finished, either sent in full and handed to the listener or failed, is
+ * counted in *COMPLETED. On SHHW_ERROR, the rest are left for the caller
+ * to fail. */
+SendHelper_HandleWrite_res SendHelper_HandleWriteBatch(bus *b,
+    boxed_msg **boxes, size_t count, size_t *completed);
+
 #endif
@@ -20,7 +20,21 @@
 
 #include "send.h"
 
+#include <limits.h>
+
 #define SEND_NOTIFY_LISTENER_RETRIES 10
 #define SEND_NOTIFY_LISTENER_RETRY_DELAY 5
 
+/* How much longer the listener holds a response than the request's
+ * timeout, in msec. */
+#define SEND_HOLD_TIMEOUT_SLACK_MSEC 5000
+
+/* Max number of segments gathered into one write by a batch send:
+ * enough for a full batch, within the system's IOV_MAX. */
+#if defined(IOV_MAX) && IOV_MAX < BUS_MAX_BATCH * BUS_MAX_IOV
+#define SEND_BATCH_MAX_IOV IOV_MAX
+#else
+#define SEND_BATCH_MAX_IOV (BUS_MAX_BATCH * BUS_MAX_IOV)
+#endif
+
 #endif
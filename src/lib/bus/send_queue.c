@@ -0,0 +1,416 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "send_queue.h"
+#include "send.h"
+#include "send_helper.h"
+#include "sender.h"
+#include "util.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <poll.h>
+
+#ifdef TEST
+struct timeval now;
+#endif
+
+static void drain_in_lock(struct bus *b, send_queue *q,
+    bus_send_ticket *ticket);
+static void schedule_in_lock(send_queue *q);
+static size_t take_batch_in_lock(send_queue *q,
+    boxed_msg **boxes, bus_send_ticket **tickets);
+static void reject_boxes(struct bus *b, boxed_msg **boxes,
+    bus_send_ticket **tickets, size_t from, size_t count);
+static void finish_batch_in_lock(send_queue *q, bus_send_ticket **tickets,
+    size_t accepted, size_t count);
+static bool start_async_batch_in_lock(struct bus *b, send_queue *q);
+static int async_msec_remaining(send_queue *q);
+
+void SendQueue_Init(send_queue *q, struct sender *s) {
+    if (0 != pthread_mutex_init(&q->lock, NULL)) { assert(false); }
+    if (0 != pthread_cond_init(&q->sent, NULL)) { assert(false); }
+    q->head = NULL;
+    q->tail = NULL;
+    q->writing = false;
+    q->closing = false;
+    q->waiters = 0;
+    q->sender = s;
+    q->scheduled = false;
+    q->next_ready = NULL;
+    q->batch_count = 0;
+    q->batch_sent = 0;
+    q->batch_timeout_msec = 0;
+    q->requests = 0;
+    q->writes = 0;
+}
+
+void SendQueue_Close(struct bus *b, send_queue *q) {
+    /* Refuse new requests, and keep the queue from being rescheduled. */
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    q->closing = true;
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+    if (q->sender) { Sender_Unschedule(q->sender, q); }
+
+    /* Let an active writer finish its pass, then fail everything left,
+     * waking anybody waiting on it. */
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    while (q->writing) {
+        pthread_cond_wait(&q->sent, &q->lock);
+    }
+    boxed_msg *box = q->head;
+    boxed_msg *unwaited = NULL;
+    q->head = NULL;
+    q->tail = NULL;
+    while (box != NULL) {
+        boxed_msg *next = box->next;
+        BUS_LOG_SNPRINTF(b, 3, LOG_SENDER, b->udata, 128,
+            "failing unsent request <fd:%d, seq_id:%lld>",
+            box->fd, (long long)box->out_seq_id);
+        if (box->ticket) {
+            box->ticket->done = true;
+            free(box);
+        } else {
+            box->next = unwaited;
+            unwaited = box;
+        }
+        box = next;
+    }
+    pthread_cond_broadcast(&q->sent);
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+    while (unwaited != NULL) {
+        boxed_msg *next = unwaited->next;
+        Send_HandleFailure(b, unwaited, BUS_SEND_TX_FAILURE);
+        unwaited = next;
+    }
+}
+
+void SendQueue_Destroy(struct bus *b, send_queue *q) {
+    SendQueue_Close(b, q);
+
+    /* The lock and condition can't be destroyed until every waiter has
+     * seen its ticket finish and left. */
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    while (q->waiters > 0) {
+        pthread_cond_wait(&q->sent, &q->lock);
+    }
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+    pthread_cond_destroy(&q->sent);
+    pthread_mutex_destroy(&q->lock);
+}
+
+bool SendQueue_Push(struct bus *b, connection_info *ci,
+        boxed_msg *box, bus_send_ticket *ticket) {
+    send_queue *q = &ci->send_queue;
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+
+    if (q->closing) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 128,
+            "rejecting request <fd:%d, seq_id:%lld> to a closing connection",
+            box->fd, (long long)box->out_seq_id);
+        if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+        return false;
+    }
+
+    /* Checking the sequence ID and queueing must be atomic, since the
+     * queue is written in order. */
+    if ((box->out_seq_id <= ci->largest_wr_seq_id_seen)
+            && (ci->largest_wr_seq_id_seen != BUS_NO_SEQ_ID)) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_MEMORY, b->udata, 256,
+            "rejecting request <fd:%d, seq_id:%lld> due to non-monotonic sequence ID, largest seen is %lld",
+            box->fd, (long long)box->out_seq_id, (long long)ci->largest_wr_seq_id_seen);
+        if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+        return false;
+    }
+    ci->largest_wr_seq_id_seen = box->out_seq_id;
+
+    if (ticket) { *ticket = (bus_send_ticket){ .conn = ci }; }
+    box->ticket = ticket;
+    box->next = NULL;
+    if (q->tail) {
+        q->tail->next = box;
+    } else {
+        q->head = box;
+    }
+    q->tail = box;
+
+    /* If nobody will wait on it, have the sender thread write it, unless
+     * a writer is already active (it will hand off when it's done). */
+    if (ticket == NULL && !q->writing) {
+        schedule_in_lock(q);
+    }
+
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+    return true;
+}
+
+bool SendQueue_Flush(struct bus *b, connection_info *ci, bus_send_ticket *ticket) {
+    send_queue *q = &ci->send_queue;
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    q->waiters++;
+
+    while (!ticket->done) {
+        if (q->writing || q->closing) {
+            /* Another thread is writing, and may pick this one up, or
+             * the queue is being destroyed, which will fail it. */
+            pthread_cond_wait(&q->sent, &q->lock);
+        } else {
+            q->writing = true;
+            drain_in_lock(b, q, ticket);
+            q->writing = false;
+            /* Let a waiting thread take over, if anything is left, and
+             * leave the rest to the sender thread otherwise. */
+            pthread_cond_broadcast(&q->sent);
+            if (q->head != NULL) { schedule_in_lock(q); }
+        }
+    }
+    bool accepted = ticket->accepted;
+
+    q->waiters--;
+    if (q->closing && q->waiters == 0) { pthread_cond_broadcast(&q->sent); }
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+    return accepted;
+}
+
+bool SendQueue_StartAsync(struct bus *b, send_queue *q) {
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    q->scheduled = false;
+    bool started = false;
+    if (!q->writing && !q->closing) {
+        q->writing = true;
+        started = start_async_batch_in_lock(b, q);
+    }
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+    return started;
+}
+
+int SendQueue_AsyncFd(send_queue *q) {
+    assert(q->batch_sent < q->batch_count);
+    return q->batch[q->batch_sent]->fd;
+}
+
+int SendQueue_WriteAsync(struct bus *b, send_queue *q, short revents) {
+    /* The batch belongs to the sender thread; only closing is shared. */
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    bool closing = q->closing;
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+    bus_send_status_t status = BUS_SEND_UNDEFINED;
+    if (closing) {
+        status = BUS_SEND_TX_FAILURE;
+    } else if (revents & POLLNVAL) {
+        status = BUS_SEND_UNREGISTERED_SOCKET;
+    } else if (revents & (POLLERR | POLLHUP)) {
+        status = BUS_SEND_TX_FAILURE;
+    } else if (revents & POLLOUT) {
+        size_t completed = 0;
+        SendHelper_HandleWrite_res res = SendHelper_HandleWriteBatch(b,
+            &q->batch[q->batch_sent], q->batch_count - q->batch_sent, &completed);
+        q->batch_sent += completed;
+        if (res == SHHW_ERROR) { status = BUS_SEND_TX_FAILURE; }
+    }
+
+    int rem_msec = 0;
+    if (status == BUS_SEND_UNDEFINED && q->batch_sent < q->batch_count) {
+        rem_msec = async_msec_remaining(q);
+        if (rem_msec < 0) {
+            status = BUS_SEND_TIMESTAMP_ERROR;
+        } else if (rem_msec == 0) {
+            status = BUS_SEND_TX_TIMEOUT;
+        }
+    }
+
+    if (status != BUS_SEND_UNDEFINED) {
+        BUS_LOG_SNPRINTF(b, 3, LOG_SENDER, b->udata, 256,
+            "async send on <fd:%d>: %zd unsent, status %d",
+            q->batch[q->batch_sent]->fd, q->batch_count - q->batch_sent, status);
+        for (size_t i = q->batch_sent; i < q->batch_count; i++) {
+            Send_HandleFailure(b, q->batch[i], status);
+        }
+        q->batch_sent = q->batch_count;
+    }
+    if (q->batch_sent < q->batch_count) { return rem_msec; }
+
+    /* Done with this batch, so start the next, if there is one. */
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    finish_batch_in_lock(q, q->batch_tickets, q->batch_count, q->batch_count);
+    bool more = start_async_batch_in_lock(b, q);
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+    return more ? 0 : -1;
+}
+
+void SendQueue_GetStats(connection_info *ci, bus_socket_stats *stats) {
+    send_queue *q = &ci->send_queue;
+    if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+    stats->requests = q->requests;
+    stats->writes = q->writes;
+    if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+    stats->coalescing = (stats->writes > 0)
+        ? (double)stats->requests / stats->writes : 0.0;
+}
+
+/* Schedule the queue with its sender thread, if it isn't already. */
+static void schedule_in_lock(send_queue *q) {
+    if (!q->scheduled && !q->closing && q->sender != NULL) {
+        q->scheduled = true;
+        Sender_Schedule(q->sender, q);
+    }
+}
+
+/* Take as many queued requests as fit in one pass. The tickets are saved
+ * now, because the listener owns (and may free) each box once it has
+ * been sent. */
+static size_t take_batch_in_lock(send_queue *q,
+        boxed_msg **boxes, bus_send_ticket **tickets) {
+    size_t count = 0;
+    size_t bytes = 0;
+    while (q->head != NULL && count < BUS_MAX_BATCH) {
+        boxed_msg *box = q->head;
+        if (count > 0 && bytes + box->out_msg_size > SEND_QUEUE_MAX_BYTES) {
+            break;
+        }
+        q->head = box->next;
+        if (q->head == NULL) { q->tail = NULL; }
+        bytes += box->out_msg_size;
+        tickets[count] = box->ticket;
+        boxes[count++] = box;
+    }
+    return count;
+}
+
+/* The sends of boxes FROM..COUNT were rejected. If someone is waiting on
+ * a request, free the box, but don't call the error handling callback;
+ * otherwise, the callback is the only way to report it. */
+static void reject_boxes(struct bus *b, boxed_msg **boxes,
+        bus_send_ticket **tickets, size_t from, size_t count) {
+    for (size_t i = from; i < count; i++) {
+        if (tickets[i]) {
+            free(boxes[i]);
+        } else {
+            Send_HandleFailure(b, boxes[i], BUS_SEND_TX_FAILURE);
+        }
+    }
+}
+
+/* Finish a batch of COUNT requests, the first ACCEPTED of which were
+ * accepted for delivery, and wake anybody waiting on them. */
+static void finish_batch_in_lock(send_queue *q, bus_send_ticket **tickets,
+        size_t accepted, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (tickets[i] == NULL) { continue; }
+        tickets[i]->accepted = (i < accepted);
+        tickets[i]->done = true;
+    }
+    if (accepted > 0) {
+        q->requests += accepted;
+        q->writes++;
+    }
+    pthread_cond_broadcast(&q->sent);
+}
+
+/* Write queued requests, in order, until TICKET's has been sent (or
+ * until the queue is empty, if TICKET is NULL). Called with the queue
+ * locked, but unlocks it while writing, so other threads can add to it
+ * in the meantime. */
+static void drain_in_lock(struct bus *b, send_queue *q,
+        bus_send_ticket *ticket) {
+    while ((ticket == NULL || !ticket->done) && q->head != NULL && !q->closing) {
+        boxed_msg *boxes[BUS_MAX_BATCH];
+        bus_send_ticket *tickets[BUS_MAX_BATCH];
+        size_t count = take_batch_in_lock(q, boxes, tickets);
+
+        if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+        BUS_LOG_SNPRINTF(b, 4, LOG_SENDER, b->udata, 128,
+            "writing %zd queued requests to <fd:%d>", count, boxes[0]->fd);
+
+        size_t accepted = 0;
+        if (count == 1) {
+            accepted = Send_DoBlockingSend(b, boxes[0]) ? 1 : 0;
+        } else {
+            accepted = Send_DoBlockingSendBatch(b, boxes, count);
+        }
+        reject_boxes(b, boxes, tickets, accepted, count);
+
+        if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+        finish_batch_in_lock(q, tickets, accepted, count);
+    }
+}
+
+/* Take the next batch for the sender thread and register it with the
+ * listener, without writing any of it yet. If the queue is empty (or
+ * closing), give up writing it and return false. Called with the queue
+ * locked and writing set, but unlocks it while registering. */
+static bool start_async_batch_in_lock(struct bus *b, send_queue *q) {
+    while (q->head != NULL && !q->closing) {
+        size_t count = take_batch_in_lock(q, q->batch, q->batch_tickets);
+        if (0 != pthread_mutex_unlock(&q->lock)) { assert(false); }
+
+        BUS_LOG_SNPRINTF(b, 4, LOG_SENDER, b->udata, 128,
+            "starting async write of %zd queued requests to <fd:%d>",
+            count, q->batch[0]->fd);
+
+        size_t held = Send_HoldBatch(b, q->batch, count);
+        reject_boxes(b, q->batch, q->batch_tickets, held, count);
+        uint32_t timeout_msec = UINT32_MAX;
+        for (size_t i = 0; i < held; i++) {
+            if (q->batch[i]->timeout_msec < timeout_msec) {
+                timeout_msec = q->batch[i]->timeout_msec;
+            }
+        }
+
+        if (0 != pthread_mutex_lock(&q->lock)) { assert(false); }
+        if (held > 0) {
+            /* Only the rejected requests are finished now. */
+            for (size_t i = held; i < count; i++) {
+                if (q->batch_tickets[i] == NULL) { continue; }
+                q->batch_tickets[i]->accepted = false;
+                q->batch_tickets[i]->done = true;
+            }
+            if (held < count) { pthread_cond_broadcast(&q->sent); }
+            q->batch_count = held;
+            q->batch_sent = 0;
+            q->batch_start = q->batch[0]->tv_send_start;
+            q->batch_timeout_msec = timeout_msec;
+            return true;
+        }
+        finish_batch_in_lock(q, q->batch_tickets, 0, count);
+    }
+
+    q->batch_count = 0;
+    q->batch_sent = 0;
+    q->writing = false;
+    pthread_cond_broadcast(&q->sent);
+    return false;
+}
+
+/* How many msec the sender's batch has left before it times out, or -1
+ * if the time can't be checked. */
+static int async_msec_remaining(send_queue *q) {
+    #ifndef TEST
+    struct timeval now;
+    #endif
+    if (!Util_Timestamp(&now, true)) { return -1; }
+    int64_t msec_elapsed = ((now.tv_sec - q->batch_start.tv_sec) * 1000LL)
+        + ((now.tv_usec - q->batch_start.tv_usec) / 1000);
+    if (msec_elapsed >= q->batch_timeout_msec) { return 0; }
+    int64_t rem_msec = q->batch_timeout_msec - msec_elapsed;
+    return (rem_msec > INT_MAX) ? INT_MAX : (int)rem_msec;
+}
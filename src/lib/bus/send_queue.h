@@ -0,0 +1,78 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include "bus_types.h"
+#include "bus_internal_types.h"
+
+/* Max number of bytes of requests a writer gathers into one pass, beyond
+ * the first request. Larger requests are written on their own. */
+#define SEND_QUEUE_MAX_BYTES (256 * 1024)
+
+/* Initialize a connection's send queue. Requests that nobody waits on
+ * will be written by sender S. */
+void SendQueue_Init(send_queue *q, struct sender *s);
+
+/* Close a connection's send queue. New requests are refused from then
+ * on, and requests still in it are failed without being written, once
+ * any active writer has finished. Threads flushing or about to flush
+ * their requests return as soon as those are finished. */
+void SendQueue_Close(struct bus *b, send_queue *q);
+
+/* Destroy a connection's send queue, closing it first (if it isn't
+ * already). This waits for every thread blocked in SendQueue_Flush to
+ * return. */
+void SendQueue_Destroy(struct bus *b, send_queue *q);
+
+/* Add BOX to the end of CI's send queue, with TICKET to track it. If
+ * TICKET is NULL, nobody will wait on the request, so the queue's sender
+ * thread writes it, and a failure to write it is reported to its callback.
+ * Returns false (without queueing it) if its sequence ID is not larger
+ * than that of every request queued before it, or the queue is being
+ * destroyed. */
+bool SendQueue_Push(struct bus *b, connection_info *ci,
+    boxed_msg *box, bus_send_ticket *ticket);
+
+/* Block until the request tracked by TICKET has been sent, writing it
+ * (and whatever else is queued) if no other thread is. Returns whether
+ * it was accepted for delivery, as for Send_DoBlockingSend. */
+bool SendQueue_Flush(struct bus *b, connection_info *ci, bus_send_ticket *ticket);
+
+/* Start writing the queue from its sender thread, unless another thread
+ * is writing: take its next batch of requests, and register them with
+ * the listener. Returns whether there is a batch to write, in which case
+ * the sender owns the queue until SendQueue_WriteAsync returns -1. */
+bool SendQueue_StartAsync(struct bus *b, send_queue *q);
+
+/* Get the socket the sender is writing the queue's batch to. */
+int SendQueue_AsyncFd(send_queue *q);
+
+/* Make one non-blocking write of the queue's batch if REVENTS (from
+ * polling its socket for POLLOUT) say it's writable, failing whatever is
+ * left of the batch on a socket error, once it times out, or if the
+ * queue is closing. When the batch is done, the next one is started.
+ * Returns how many msec the batch has left before it times out (0 for a
+ * batch that was just started), or -1 once there is nothing left to
+ * write, and the sender gives the queue up. */
+int SendQueue_WriteAsync(struct bus *b, send_queue *q, short revents);
+
+/* Get statistics about the requests sent from CI's queue. */
+void SendQueue_GetStats(connection_info *ci, bus_socket_stats *stats);
+
+#endif
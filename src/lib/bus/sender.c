@@ -0,0 +1,272 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "sender.h"
+#include "send_queue.h"
+#include "syscall.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static void *sender_main_loop(void *arg);
+static void wake_in_lock(struct sender *s);
+
+struct sender *Sender_Init(struct bus *b) {
+    struct sender *s = calloc(1, sizeof(*s));
+    if (s == NULL) { return NULL; }
+    s->bus = b;
+
+    if (0 != pthread_mutex_init(&s->lock, NULL)) {
+        free(s);
+        return NULL;
+    }
+    if (0 != pthread_cond_init(&s->idle, NULL)) {
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return NULL;
+    }
+    if (0 != pipe(s->wake_pipe)) {
+        pthread_cond_destroy(&s->idle);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return NULL;
+    }
+
+    if (0 != pthread_create(&s->thread, NULL, sender_main_loop, s)) {
+        syscall_close(s->wake_pipe[0]);
+        syscall_close(s->wake_pipe[1]);
+        pthread_cond_destroy(&s->idle);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void Sender_Schedule(struct sender *s, send_queue *q) {
+    if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+    q->next_ready = NULL;
+    if (s->tail) {
+        s->tail->next_ready = q;
+    } else {
+        s->head = q;
+    }
+    s->tail = q;
+    wake_in_lock(s);
+    if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+}
+
+static bool is_active_in_lock(struct sender *s, send_queue *q) {
+    for (send_queue *cur = s->active; cur != NULL; cur = cur->next_active) {
+        if (cur == q) { return true; }
+    }
+    return false;
+}
+
+void Sender_Unschedule(struct sender *s, send_queue *q) {
+    if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+    send_queue *prev = NULL;
+    for (send_queue *cur = s->head; cur != NULL; cur = cur->next_ready) {
+        if (cur == q) {
+            if (prev) {
+                prev->next_ready = q->next_ready;
+            } else {
+                s->head = q->next_ready;
+            }
+            if (s->tail == q) { s->tail = prev; }
+            break;
+        }
+        prev = cur;
+    }
+
+    /* If the sender is writing Q, it gives it up on its next pass, once
+     * it sees that Q is closing. */
+    while (s->current == q || is_active_in_lock(s, q)) {
+        wake_in_lock(s);
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+}
+
+bool Sender_Shutdown(struct sender *s) {
+    if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+    bool already = s->shutdown;
+    s->shutdown = true;
+    wake_in_lock(s);
+    if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+    if (already) { return true; }
+
+    void *unused = NULL;
+    if (0 != syscall_pthread_join(s->thread, &unused)) {
+        BUS_LOG(s->bus, 0, LOG_SHUTDOWN, "failed to join sender thread", s->bus->udata);
+        return false;
+    }
+    return true;
+}
+
+void Sender_Free(struct sender *s) {
+    if (s == NULL) { return; }
+    assert(s->head == NULL);
+    assert(s->active == NULL);
+    syscall_close(s->wake_pipe[0]);
+    syscall_close(s->wake_pipe[1]);
+    pthread_cond_destroy(&s->idle);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+/* Wake the sender thread from poll, unless it has already been woken. */
+static void wake_in_lock(struct sender *s) {
+    if (s->woken) { return; }
+    s->woken = true;
+    uint8_t byte = 0;
+    for (;;) {
+        ssize_t wr = syscall_write(s->wake_pipe[1], &byte, sizeof(byte));
+        if (wr == 1) { return; }
+        if (wr == -1 && errno == EINTR) { continue; }
+        BUS_LOG_SNPRINTF(s->bus, 0, LOG_SENDER, s->bus->udata, 64,
+            "failed to wake sender thread: %s", strerror(errno));
+        assert(false);
+        return;
+    }
+}
+
+/* Start writing the queues on the ready list. Returns whether any were
+ * started. */
+static bool start_ready_queues(struct sender *s) {
+    bool started_any = false;
+    if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+    while (s->head != NULL) {
+        send_queue *q = s->head;
+        s->head = q->next_ready;
+        if (s->head == NULL) { s->tail = NULL; }
+        s->current = q;
+        if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+
+        bool started = SendQueue_StartAsync(s->bus, q);
+
+        if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+        s->current = NULL;
+        if (started) {
+            q->next_active = s->active;
+            s->active = q;
+            s->active_count++;
+            started_any = true;
+        }
+        pthread_cond_broadcast(&s->idle);
+    }
+    if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+    return started_any;
+}
+
+/* Make sure *FDS has room for COUNT entries. */
+static bool grow_fds(struct pollfd **fds, size_t *size, size_t count) {
+    if (count <= *size) { return true; }
+    size_t nsize = (*size == 0) ? 8 : *size;
+    while (nsize < count) { nsize *= 2; }
+    struct pollfd *nfds = realloc(*fds, nsize * sizeof(*nfds));
+    if (nfds == NULL) { return false; }
+    *fds = nfds;
+    *size = nsize;
+    return true;
+}
+
+/* Each pass polls the wake pipe and the sockets of all active queues at
+ * once, then makes one non-blocking write to each writable socket, so a
+ * slow or stalled drive only holds up its own requests. The queues
+ * (and their order) only change on this thread. */
+static void *sender_main_loop(void *arg) {
+    struct sender *s = (struct sender *)arg;
+    struct bus *b = s->bus;
+    struct pollfd *fds = NULL;
+    size_t fds_size = 0;
+    int timeout = -1;
+
+    for (;;) {
+        if (start_ready_queues(s)) { timeout = 0; }
+
+        if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+        if (s->shutdown && s->head == NULL && s->active == NULL) {
+            if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+            break;
+        }
+        size_t nfds = s->active_count + 1;
+        if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+
+        if (!grow_fds(&fds, &fds_size, nfds)) {
+            BUS_LOG(b, 0, LOG_SENDER, "failed to allocate poll set", b->udata);
+            syscall_poll(NULL, 0, 10);
+            continue;
+        }
+        fds[0] = (struct pollfd){ .fd = s->wake_pipe[0], .events = POLLIN };
+        size_t i = 1;
+        for (send_queue *q = s->active; q != NULL; q = q->next_active) {
+            fds[i++] = (struct pollfd){ .fd = SendQueue_AsyncFd(q), .events = POLLOUT };
+        }
+
+        int res = syscall_poll(fds, nfds, timeout);
+        if (res == -1) {
+            if (errno != EINTR) {
+                BUS_LOG_SNPRINTF(b, 0, LOG_SENDER, b->udata, 64,
+                    "sender poll error: %s", strerror(errno));
+            }
+            errno = 0;
+            for (i = 0; i < nfds; i++) { fds[i].revents = 0; }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint8_t buf[16];
+            ssize_t rd = syscall_read(s->wake_pipe[0], buf, sizeof(buf));
+            (void)rd;
+            if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+            s->woken = false;
+            if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+        }
+
+        /* One write to each writable socket. This also fails batches
+         * that have timed out, or whose queues are closing. */
+        timeout = -1;
+        send_queue *prev = NULL;
+        send_queue *q = s->active;
+        i = 1;
+        while (q != NULL) {
+            send_queue *next = q->next_active;
+            int rem_msec = SendQueue_WriteAsync(b, q, fds[i++].revents);
+            if (rem_msec < 0) {
+                if (0 != pthread_mutex_lock(&s->lock)) { assert(false); }
+                if (prev) {
+                    prev->next_active = next;
+                } else {
+                    s->active = next;
+                }
+                s->active_count--;
+                pthread_cond_broadcast(&s->idle);
+                if (0 != pthread_mutex_unlock(&s->lock)) { assert(false); }
+            } else {
+                if (timeout == -1 || rem_msec < timeout) { timeout = rem_msec; }
+                prev = q;
+            }
+            q = next;
+        }
+    }
+    free(fds);
+
+    BUS_LOG(b, 3, LOG_SENDER, "sender thread exiting", b->udata);
+    return NULL;
+}
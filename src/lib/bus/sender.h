@@ -0,0 +1,42 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef SENDER_H
+#define SENDER_H
+
+#include "bus_types.h"
+#include "bus_internal_types.h"
+
+/* Create a sender and start its thread. Returns NULL on failure. */
+struct sender *Sender_Init(struct bus *b);
+
+/* Add Q to the sender's ready list, so its queued requests get written.
+ * Called with Q's lock held, once Q has been marked as scheduled. */
+void Sender_Schedule(struct sender *s, send_queue *q);
+
+/* Take Q off the sender's ready list, waiting if the sender is writing
+ * it, so that Q can be destroyed. Q must already be marked as closing, so
+ * the sender gives it up. Must not be called with Q's lock held. */
+void Sender_Unschedule(struct sender *s, send_queue *q);
+
+/* Stop the sender's thread. Returns false if it could not be joined. */
+bool Sender_Shutdown(struct sender *s);
+
+/* Free a sender, after it has been shut down. */
+void Sender_Free(struct sender *s);
+
+#endif
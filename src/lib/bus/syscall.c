@@ -15,12 +15,20 @@
  * See www.openkinetic.org for more project information
  */
 
+#if defined(__linux__) && defined(BUS_USE_IO_URING) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE             /* for syscall(2) */
+#endif
+
 #include "syscall.h"
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
 
+#if BUS_HAVE_IO_URING
+#include <sys/syscall.h>
+#endif
+
 /* Wrappers for syscalls, to allow mocking for testing. */
 int syscall_poll(struct pollfd fds[], nfds_t nfds, int timeout) {
     return poll(fds, nfds, timeout);
@@ -34,10 +42,43 @@ ssize_t syscall_write(int fildes, const void *buf, size_t nbyte) {
     return write(fildes, buf, nbyte);
 }
 
+ssize_t syscall_writev(int fildes, const struct iovec *iov, int iovcnt) {
+    return writev(fildes, iov, iovcnt);
+}
+
 ssize_t syscall_read(int fildes, void *buf, size_t nbyte) {
     return read(fildes, buf, nbyte);
 }
 
+#if BUS_HAVE_EPOLL
+int syscall_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    return epoll_ctl(epfd, op, fd, event);
+}
+
+int syscall_epoll_wait(int epfd, struct epoll_event *events,
+        int maxevents, int timeout) {
+    return epoll_wait(epfd, events, maxevents, timeout);
+}
+#endif
+
+#if BUS_HAVE_IO_URING
+/* glibc doesn't wrap the io_uring syscalls. */
+int syscall_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+int syscall_io_uring_enter(int fd, unsigned to_submit,
+        unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit,
+        min_complete, flags, arg, argsz);
+}
+
+int syscall_io_uring_register(int fd, unsigned opcode,
+        void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+#endif
+
 /* Wrappers for OpenSSL calls. */
 int syscall_SSL_write(SSL *ssl, const void *buf, int num) {
     return SSL_write(ssl, buf, num);
@@ -21,13 +21,29 @@
 #include "bus_internal_types.h"
 #include <poll.h>
 #include <time.h>
+#include <sys/uio.h>
 
 /** Wrappers for syscalls, to allow mocking for testing. */
 int syscall_poll(struct pollfd fds[], nfds_t nfds, int timeout);
 int syscall_close(int fd);
 ssize_t syscall_write(int fildes, const void *buf, size_t nbyte);
+ssize_t syscall_writev(int fildes, const struct iovec *iov, int iovcnt);
 ssize_t syscall_read(int fildes, void *buf, size_t nbyte);
 
+#if BUS_HAVE_EPOLL
+int syscall_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int syscall_epoll_wait(int epfd, struct epoll_event *events,
+    int maxevents, int timeout);
+#endif
+
+#if BUS_HAVE_IO_URING
+int syscall_io_uring_setup(unsigned entries, struct io_uring_params *p);
+int syscall_io_uring_enter(int fd, unsigned to_submit,
+    unsigned min_complete, unsigned flags, void *arg, size_t argsz);
+int syscall_io_uring_register(int fd, unsigned opcode,
+    void *arg, unsigned nr_args);
+#endif
+
 /** Wrappers for OpenSSL calls. */
 int syscall_SSL_write(SSL *ssl, const void *buf, int num);
 int syscall_SSL_read(SSL *ssl, void *buf, int num);
@@ -0,0 +1,184 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/* Span of each level's slots, and of the whole wheel, in msec. */
+#define LEVEL_SHIFT(L) ((L) * TIMER_WHEEL_SLOTS2)
+#define WHEEL_SPAN (1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS))
+
+static void place(struct timer_wheel *w, timer_wheel_node *n);
+static void unlink_node(struct timer_wheel *w, timer_wheel_node *n);
+static void cascade(struct timer_wheel *w);
+static int next_occupied(uint64_t bits, unsigned from);
+
+void TimerWheel_Init(struct timer_wheel *w, uint64_t now) {
+    memset(w, 0, sizeof(*w));
+    w->tick = now + 1;
+}
+
+void TimerWheel_Schedule(struct timer_wheel *w, timer_wheel_node *n, uint32_t delay) {
+    if (n->pprev) {
+        unlink_node(w, n);
+    } else {
+        w->count++;
+    }
+    n->deadline = w->tick - 1 + delay;
+    place(w, n);
+}
+
+void TimerWheel_Cancel(struct timer_wheel *w, timer_wheel_node *n) {
+    if (n->pprev) {
+        unlink_node(w, n);
+        w->count--;
+    }
+}
+
+bool TimerWheel_IsScheduled(const timer_wheel_node *n) {
+    return n->pprev != NULL;
+}
+
+size_t TimerWheel_Advance(struct timer_wheel *w, uint64_t now,
+        TimerWheel_Expire_cb *cb, void *udata) {
+    size_t expired = 0;
+    while (w->tick <= now) {
+        if (w->count == 0) {    /* nothing to do, just catch up */
+            w->tick = now + 1;
+            break;
+        }
+
+        unsigned idx = w->tick & SLOT_MASK;
+        if (idx == 0) { cascade(w); }
+
+        /* Skip ahead to the next occupied slot, or the next cascade. */
+        uint64_t pending = w->occupied[0] >> idx;
+        if ((pending & 1) == 0) {
+            uint64_t skip = (pending ? (uint64_t)__builtin_ctzll(pending)
+                : (uint64_t)(TIMER_WHEEL_SLOTS - idx));
+            uint64_t next = w->tick + skip;
+            w->tick = (next <= now ? next : now + 1);
+            continue;
+        }
+
+        /* Detach the slot and move time forward before calling back,
+         * so timers rescheduled by the callback land in later slots. */
+        timer_wheel_node *n = w->slots[0][idx];
+        w->slots[0][idx] = NULL;
+        w->occupied[0] &= ~(1ULL << idx);
+        w->tick++;
+
+        while (n) {
+            timer_wheel_node *next = n->next;
+            n->next = NULL;
+            n->pprev = NULL;
+            w->count--;
+            expired++;
+            cb(n, udata);
+            n = next;
+        }
+    }
+    return expired;
+}
+
+int64_t TimerWheel_NextDelay(const struct timer_wheel *w) {
+    if (w->count == 0) { return -1; }
+
+    /* Level 0 slots expire at their own tick. Higher levels' slots need
+     * to be cascaded when the wheel reaches the start of their span. */
+    uint64_t earliest = UINT64_MAX;
+    int first = next_occupied(w->occupied[0], w->tick & SLOT_MASK);
+    if (first >= 0) { earliest = w->tick + first; }
+
+    for (int l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+        if (w->occupied[l] == 0) { continue; }
+        uint64_t base = w->tick >> LEVEL_SHIFT(l);
+        bool at_boundary = (w->tick & ((1ULL << LEVEL_SHIFT(l)) - 1)) == 0;
+        unsigned from = (base + (at_boundary ? 0 : 1)) & SLOT_MASK;
+        int offset = next_occupied(w->occupied[l], from);
+        uint64_t start = (base + (at_boundary ? 0 : 1) + offset) << LEVEL_SHIFT(l);
+        if (start < earliest) { earliest = start; }
+    }
+
+    /* Relative to the time the wheel was last advanced to. */
+    return (int64_t)(earliest - (w->tick - 1));
+}
+
+/* Put N in the slot for its deadline, at the finest level whose span
+ * reaches it. Past deadlines go in the next slot to be processed. */
+static void place(struct timer_wheel *w, timer_wheel_node *n) {
+    uint64_t deadline = n->deadline;
+    if (deadline < w->tick) { deadline = w->tick; }
+    uint64_t delta = deadline - w->tick;
+    if (delta >= WHEEL_SPAN) {
+        deadline = w->tick + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+
+    uint8_t level = 0;
+    while (delta >= (1ULL << LEVEL_SHIFT(level + 1))) { level++; }
+    uint8_t slot = (deadline >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+    timer_wheel_node **head = &w->slots[level][slot];
+    n->level = level;
+    n->slot = slot;
+    n->next = *head;
+    if (n->next) { n->next->pprev = &n->next; }
+    n->pprev = head;
+    *head = n;
+    w->occupied[level] |= (1ULL << slot);
+}
+
+static void unlink_node(struct timer_wheel *w, timer_wheel_node *n) {
+    *n->pprev = n->next;
+    if (n->next) { n->next->pprev = n->pprev; }
+    if (w->slots[n->level][n->slot] == NULL) {
+        w->occupied[n->level] &= ~(1ULL << n->slot);
+    }
+    n->next = NULL;
+    n->pprev = NULL;
+}
+
+/* The wheel has reached the start of a new level 0 rotation, so move
+ * the timers in the current slot of each higher level down a level,
+ * going up a level each time that level also starts a new rotation. */
+static void cascade(struct timer_wheel *w) {
+    for (int l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+        unsigned idx = (w->tick >> LEVEL_SHIFT(l)) & SLOT_MASK;
+        timer_wheel_node *n = w->slots[l][idx];
+        w->slots[l][idx] = NULL;
+        w->occupied[l] &= ~(1ULL << idx);
+
+        while (n) {
+            timer_wheel_node *next = n->next;
+            place(w, n);
+            n = next;
+        }
+        if (idx != 0) { break; }
+    }
+}
+
+/* Get the offset from FROM to the next set bit in BITS, wrapping
+ * around, or -1 if there are none. */
+static int next_occupied(uint64_t bits, unsigned from) {
+    if (bits == 0) { return -1; }
+    uint64_t rotated = (from == 0 ? bits
+        : (bits >> from) | (bits << (TIMER_WHEEL_SLOTS - from)));
+    return __builtin_ctzll(rotated);
+}
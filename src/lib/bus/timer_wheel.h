@@ -0,0 +1,79 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Number of slots per level of the wheel, as a power of 2. */
+#define TIMER_WHEEL_SLOTS2 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOTS2)
+
+/** Number of levels. Level N's slots are 64^N msec wide, so 5 levels
+ * cover about 12 days; later deadlines are reconsidered when the
+ * last level comes around. */
+#define TIMER_WHEEL_LEVELS 5
+
+/** A timer, embedded in whatever it's the timer for. */
+typedef struct timer_wheel_node {
+    struct timer_wheel_node *next;
+    struct timer_wheel_node **pprev;  ///< NULL when not scheduled
+    uint64_t deadline;                ///< msec
+    uint8_t level;
+    uint8_t slot;
+} timer_wheel_node;
+
+/** Hierarchical timing wheel with millisecond resolution. Scheduling
+ * and cancelling are O(1); timers far in the future are cascaded
+ * to finer levels as their deadline approaches. */
+struct timer_wheel {
+    uint64_t tick;              ///< next msec to process
+    size_t count;               ///< number of scheduled timers
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  ///< bitmap of non-empty slots
+    timer_wheel_node *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+/** Init an empty wheel, with time starting after NOW (in msec). */
+void TimerWheel_Init(struct timer_wheel *w, uint64_t now);
+
+/** Schedule N to expire DELAY msec after the time the wheel was last
+ * advanced to. If N is already scheduled, it is rescheduled. */
+void TimerWheel_Schedule(struct timer_wheel *w, timer_wheel_node *n, uint32_t delay);
+
+/** Cancel N, if it's scheduled. */
+void TimerWheel_Cancel(struct timer_wheel *w, timer_wheel_node *n);
+
+/** Is N scheduled? */
+bool TimerWheel_IsScheduled(const timer_wheel_node *n);
+
+/** Callback for an expired timer. The timer is no longer scheduled,
+ * so the callback may reschedule it. */
+typedef void (TimerWheel_Expire_cb)(timer_wheel_node *n, void *udata);
+
+/** Advance the wheel's time to NOW (in msec), calling CB for each timer
+ * that expires along the way. Returns the number of expired timers. */
+size_t TimerWheel_Advance(struct timer_wheel *w, uint64_t now,
+    TimerWheel_Expire_cb *cb, void *udata);
+
+/** Get how many msec until the wheel next needs to be advanced, or -1
+ * if no timers are scheduled. */
+int64_t TimerWheel_NextDelay(const struct timer_wheel *w);
+
+#endif
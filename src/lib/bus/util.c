@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
 
 #include "util.h"
 
@@ -45,3 +46,10 @@ bool Util_Timestamp(struct timeval *tv, bool relative) {
 #endif
     return (0 == gettimeofday(tv, NULL));
 }
+
+bool Util_SetNonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) { return false; }
+    if (flags & O_NONBLOCK) { return true; }
+    return (0 == fcntl(fd, F_SETFL, flags | O_NONBLOCK));
+}
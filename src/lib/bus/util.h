@@ -31,4 +31,7 @@ bool Util_IsResumableIOError(int errno_);
  * relative flag has no impact. */
 bool Util_Timestamp(struct timeval *tv, bool relative);
 
+/* Put FD in non-blocking mode. Returns false on failure. */
+bool Util_SetNonblocking(int fd);
+
 #endif
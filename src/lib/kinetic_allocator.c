@@ -18,6 +18,9 @@
 #include "kinetic_allocator.h"
 #include "kinetic_logger.h"
 #include "kinetic_memory.h"
+#include "kinetic_response_pool.h"
+#include "kinetic_arena.h"
+#include "kinetic_hmac.h"
 #include "kinetic_resourcewaiter.h"
 #include "kinetic_resourcewaiter_types.h"
 #include <stdlib.h>
@@ -39,26 +42,116 @@ KineticSession* KineticAllocator_NewSession(struct bus * b, KineticSessionConfig
     session->config = *config;
     memcpy(session->config.keyData, config->hmacKey.data, config->hmacKey.len);
     session->config.hmacKey.data = session->config.keyData;
+    if (session->config.hmacKey.len > 0) {
+        KineticHMAC_KeyInit(&session->hmacKey, session->config.hmacKey);
+    }
     strncpy(session->config.host, config->host, sizeof(session->config.host));
     session->timeoutSeconds = config->timeoutSeconds; // TODO: Eliminate this, since already in config?
     KineticResourceWaiter_Init(&session->connectionReady);
     session->messageBus = b;
     session->socket = KINETIC_SOCKET_INVALID;  // start with an invalid file descriptor
     session->terminationStatus = KINETIC_STATUS_SUCCESS;
+    pthread_mutex_init(&session->operationPool.mutex, NULL);
+    session->operationPool.max = (config->maxOutstandingOperations > 0
+        ? config->maxOutstandingOperations : KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION);
     return session;
 }
 
 void KineticAllocator_FreeSession(KineticSession* session)
 {
     if (session != NULL) {
+        KineticOperation* op = session->operationPool.free;
+        while (op != NULL) {
+            KineticOperation* next = op->nextFree;
+            KineticFree(op->request);
+            KineticFree(op);
+            op = next;
+        }
+        session->operationPool.free = NULL;
+        session->operationPool.count = 0;
+        pthread_mutex_destroy(&session->operationPool.mutex);
+        KineticHMAC_KeyClear(&session->hmacKey);
         KineticResourceWaiter_Destroy(&session->connectionReady);
         KineticFree(session);
     }
 }
 
-KineticResponse * KineticAllocator_NewKineticResponse(size_t const valueLength)
+void KineticAllocator_SetOperationPoolLimit(KineticSession* const session, uint32_t max)
+{
+    KINETIC_ASSERT(session != NULL);
+    KineticOperationPool* pool = &session->operationPool;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->max = max;
+    KineticOperation* extra = NULL;
+    while (pool->count > max) {
+        KineticOperation* op = pool->free;
+        pool->free = op->nextFree;
+        pool->count--;
+        op->nextFree = extra;
+        extra = op;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    while (extra != NULL) {
+        KineticOperation* next = extra->nextFree;
+        KineticFree(extra->request);
+        KineticFree(extra);
+        extra = next;
+    }
+}
+
+/* Take a cached operation, along with its request, from the session's
+ * pool. The operation is cleared, since fields such as pin and value are
+ * only set by the builder for their own kind of operation. The request
+ * is reset by KineticRequest_Init like a new one, and the body element
+ * it carries by its builder. */
+static KineticOperation* take_pooled_operation(KineticSession* const session)
 {
-    KineticResponse * response = KineticCalloc(1, sizeof(*response) + valueLength);
+    KineticOperationPool* pool = &session->operationPool;
+
+    pthread_mutex_lock(&pool->mutex);
+    KineticOperation* op = pool->free;
+    if (op != NULL) {
+        pool->free = op->nextFree;
+        pool->count--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (op != NULL) {
+        KineticRequest* request = op->request;
+        memset(op, 0, sizeof(*op));
+        op->request = request;
+    }
+    return op;
+}
+
+/* Cache an operation and its request in its session's pool, if there's
+ * room. Returns false if the caller should free them instead. */
+static bool pool_operation(KineticOperation* const operation)
+{
+    KineticSession* session = operation->session;
+    if (session == NULL || operation->request == NULL) { return false; }
+    KineticOperationPool* pool = &session->operationPool;
+
+    bool pooled = false;
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->count < pool->max) {
+        operation->nextFree = pool->free;
+        pool->free = operation;
+        pool->count++;
+        pooled = true;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return pooled;
+}
+
+KineticResponse * KineticAllocator_NewKineticResponse(KineticResponsePool * const pool,
+    size_t const valueLength)
+{
+    KineticResponse * response = (pool != NULL
+        ? KineticResponsePool_Alloc(pool, valueLength)
+        : KineticCalloc(1, sizeof(*response) + valueLength));
     if (response == NULL) {
         LOG0("Failed allocating new response!");
         return NULL;
@@ -70,13 +163,12 @@ void KineticAllocator_FreeKineticResponse(KineticResponse * response)
 {
     KINETIC_ASSERT(response != NULL);
 
-    if (response->command != NULL) {
-        protobuf_c_message_free_unpacked(&response->command->base, NULL);
+    KineticArena_Reset(&response->arena);
+    if (response->pool != NULL) {
+        KineticResponsePool_Free(response);
+    } else {
+        KineticFree(response);
     }
-    if (response->proto != NULL) {
-        protobuf_c_message_free_unpacked(&response->proto->base, NULL);
-    }
-    KineticFree(response);
 }
 
 KineticOperation* KineticAllocator_NewOperation(KineticSession* const session)
@@ -84,20 +176,23 @@ KineticOperation* KineticAllocator_NewOperation(KineticSession* const session)
     KINETIC_ASSERT(session != NULL);
 
     LOGF3("Allocating new operation on session %p", (void*)session);
-    KineticOperation* newOperation =
-        (KineticOperation*)KineticCalloc(1, sizeof(KineticOperation));
+    KineticOperation* newOperation = take_pooled_operation(session);
     if (newOperation == NULL) {
-        LOGF0("Failed allocating new operation on session %p", (void*)session);
-        return NULL;
+        newOperation = (KineticOperation*)KineticCalloc(1, sizeof(KineticOperation));
+        if (newOperation == NULL) {
+            LOGF0("Failed allocating new operation on session %p", (void*)session);
+            return NULL;
+        }
+        newOperation->request = (KineticRequest*)KineticCalloc(1, sizeof(KineticRequest));
+        if (newOperation->request == NULL) {
+            LOGF0("Failed allocating new PDU on session %p", (void*)session);
+            KineticFree(newOperation);
+            return NULL;
+        }
     }
     newOperation->session = session;
     newOperation->timeoutSeconds = session->timeoutSeconds; // TODO: use timeout in config throughput
-    newOperation->request = (KineticRequest*)KineticCalloc(1, sizeof(KineticRequest));
-    if (newOperation->request == NULL) {
-        LOGF0("Failed allocating new PDU on session %p", (void*)session);
-        KineticFree(newOperation);
-        return NULL;
-    }
+    newOperation->timeoutMsec = session->config.timeoutMsec;
     KineticRequest_Init(newOperation->request, session);
     return newOperation;
 }
@@ -106,14 +201,19 @@ void KineticAllocator_FreeOperation(KineticOperation* operation)
 {
     KINETIC_ASSERT(operation != NULL);
     LOGF3("Freeing operation %p on session %p", (void*)operation, (void*)operation->session);
-    if (operation->request != NULL) {
-        KineticFree(operation->request);
-        operation->request = NULL;
-    }
     if (operation->response != NULL) {
         KineticAllocator_FreeKineticResponse(operation->response);
         operation->response = NULL;
     }
+    if (operation->packedRequest != NULL) {
+        free(operation->packedRequest);
+        operation->packedRequest = NULL;
+    }
+    if (pool_operation(operation)) { return; }
+    if (operation->request != NULL) {
+        KineticFree(operation->request);
+        operation->request = NULL;
+    }
     KineticFree(operation);
 }
 
@@ -23,10 +23,15 @@
 KineticSession* KineticAllocator_NewSession(struct bus * b, KineticSessionConfig* config);
 void KineticAllocator_FreeSession(KineticSession* session);
 
+/* Cache up to MAX of the session's freed operations for reuse, such as
+ * the most it may have outstanding at once, freeing any beyond that. */
+void KineticAllocator_SetOperationPoolLimit(KineticSession* const session, uint32_t max);
+
 KineticOperation* KineticAllocator_NewOperation(KineticSession* const session);
 void KineticAllocator_FreeOperation(KineticOperation* operation);
 
-KineticResponse * KineticAllocator_NewKineticResponse(size_t const valueLength);
+KineticResponse * KineticAllocator_NewKineticResponse(KineticResponsePool * const pool,
+    size_t const valueLength);
 void KineticAllocator_FreeKineticResponse(KineticResponse * response);
 
 void KineticAllocator_FreeP2PProtobuf(Com__Seagate__Kinetic__Proto__Command__P2POperation* proto_p2pOp);
@@ -0,0 +1,103 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "kinetic_arena.h"
+#include "kinetic_logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void * arena_alloc(void * allocator_data, size_t size)
+{
+    return KineticArena_Alloc((KineticArena *)allocator_data, size);
+}
+
+/* Individual allocations are only freed when the arena is reset. */
+static void arena_free(void * allocator_data, void * pointer)
+{
+    (void)allocator_data;
+    (void)pointer;
+}
+
+void KineticArena_Init(KineticArena * const arena, size_t const sizeHint)
+{
+    KINETIC_ASSERT(arena != NULL);
+    arena->allocator = (ProtobufCAllocator) {
+        .alloc = arena_alloc,
+        .free = arena_free,
+        .allocator_data = arena,
+    };
+    arena->chunks = NULL;
+    arena->chunkSize = (sizeHint > KINETIC_ARENA_MIN_CHUNK_SIZE
+        ? sizeHint : KINETIC_ARENA_MIN_CHUNK_SIZE);
+}
+
+/* Get the padding needed to align the next allocation from CHUNK. */
+static size_t padding(KineticArenaChunk const * const chunk)
+{
+    uintptr_t next = (uintptr_t)&chunk->data[chunk->used];
+    return (KINETIC_ARENA_ALIGN - (next % KINETIC_ARENA_ALIGN)) % KINETIC_ARENA_ALIGN;
+}
+
+void * KineticArena_Alloc(KineticArena * const arena, size_t const size)
+{
+    KINETIC_ASSERT(arena != NULL);
+    KineticArenaChunk * chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < padding(chunk) + size) {
+        /* Later chunks only need to fit what the first one didn't. */
+        size_t chunkSize = (chunk == NULL ? arena->chunkSize : KINETIC_ARENA_MIN_CHUNK_SIZE);
+        if (chunkSize < size + KINETIC_ARENA_ALIGN) {
+            chunkSize = size + KINETIC_ARENA_ALIGN;
+        }
+        chunk = malloc(sizeof(*chunk) + chunkSize);
+        if (chunk == NULL) {
+            LOGF0("Failed allocating %zu byte arena chunk!", chunkSize);
+            return NULL;
+        }
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    chunk->used += padding(chunk);
+    void * pointer = &chunk->data[chunk->used];
+    chunk->used += size;
+    return pointer;
+}
+
+void KineticArena_Reset(KineticArena * const arena)
+{
+    KINETIC_ASSERT(arena != NULL);
+    KineticArenaChunk * chunk = arena->chunks;
+    while (chunk != NULL) {
+        KineticArenaChunk * next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
+
+void KineticArena_Move(KineticArena * const dst, KineticArena * const src)
+{
+    KINETIC_ASSERT(dst != NULL);
+    KINETIC_ASSERT(src != NULL);
+    KINETIC_ASSERT(dst->chunks == NULL);
+    KineticArena_Init(dst, src->chunkSize);
+    dst->chunks = src->chunks;
+    src->chunks = NULL;
+}
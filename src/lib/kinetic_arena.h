@@ -0,0 +1,60 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef _KINETIC_ARENA_H
+#define _KINETIC_ARENA_H
+
+#include "protobuf-c/protobuf-c.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Alignment of every allocation, enough for any protobuf-c field. */
+#define KINETIC_ARENA_ALIGN 16
+
+/* Minimum size of each chunk the arena allocates. */
+#define KINETIC_ARENA_MIN_CHUNK_SIZE 4096
+
+typedef struct _KineticArenaChunk {
+    struct _KineticArenaChunk * next;
+    size_t size;                    ///< bytes in data
+    size_t used;                    ///< bytes of data allocated, including padding
+    uint8_t data[];
+} KineticArenaChunk;
+
+/* A bump-pointer arena for unpacking protobufs. Allocations are carved
+ * out of malloc'd chunks and never freed individually; everything is
+ * freed at once by KineticArena_Reset. */
+typedef struct _KineticArena {
+    ProtobufCAllocator allocator;   ///< protobuf-c allocator backed by this arena
+    KineticArenaChunk * chunks;     ///< chunks in use, newest first
+    size_t chunkSize;               ///< size of the first chunk to allocate
+} KineticArena;
+
+/* Initialize an empty ARENA, whose first chunk will hold at least
+ * SIZE_HINT bytes. */
+void KineticArena_Init(KineticArena * const arena, size_t const sizeHint);
+
+void * KineticArena_Alloc(KineticArena * const arena, size_t const size);
+
+/* Free everything allocated from ARENA, leaving it empty. */
+void KineticArena_Reset(KineticArena * const arena);
+
+/* Move everything allocated from SRC into DST, leaving SRC empty.
+ * DST must be empty. */
+void KineticArena_Move(KineticArena * const dst, KineticArena * const src);
+
+#endif // _KINETIC_ARENA_H
@@ -19,6 +19,7 @@
 #include "kinetic_hmac.h"
 #include "kinetic.pb-c.h"
 #include "kinetic_logger.h"
+#include <string.h>
 
 KineticStatus KineticAuth_EnsureSslEnabled(KineticSessionConfig const * const config)
 {
@@ -46,13 +47,11 @@ KineticStatus KineticAuth_PopulateHmac(KineticSessionConfig const * const config
     msg->authtype = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH;
     msg->has_authtype = true;
 
-    // Configure HMAC support
-    ByteArray const * const hmacKey = &config->hmacKey;
-    KINETIC_ASSERT(hmacKey->len <= KINETIC_HMAC_MAX_LEN);  // NOCOMMIT
-    KINETIC_ASSERT(hmacKey->data != NULL);
-
     msg->hmacauth = &pdu->message.hmacAuth;
 
+    // Reserve space for the HMAC, which is computed over the command as
+    // it's packed (see KineticPDU_Pack)
+    memset(pdu->message.hmacData, 0, KINETIC_HMAC_SHA1_LEN);
     msg->hmacauth->hmac = (ProtobufCBinaryData) {
         .data = pdu->message.hmacData,
         .len = KINETIC_HMAC_SHA1_LEN,
@@ -62,11 +61,6 @@ KineticStatus KineticAuth_PopulateHmac(KineticSessionConfig const * const config
     msg->hmacauth->identity = config->identity;
     msg->hmacauth->has_identity = true;
 
-    // Populate with hashed HMAC
-    KineticHMAC hmac;
-    KineticHMAC_Init(&hmac, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&hmac, &pdu->message.message, config->hmacKey);
-
     return KINETIC_STATUS_SUCCESS;
 }
 
@@ -28,6 +28,7 @@
 #include "kinetic_request.h"
 #include "kinetic_acl.h"
 #include "kinetic_callbacks.h"
+#include "kinetic_tag.h"
 #include "kinetic_types_internal.h"
 
 #include <stdlib.h>
@@ -60,6 +61,12 @@ KineticStatus KineticBuilder_BuildPut(KineticOperation* const op,
         return KINETIC_STATUS_BUFFER_OVERRUN;
     }
 
+    if (entry->computeTag && entry->algorithm > 0) {
+        KineticStatus status = KineticTag_Compute(entry->algorithm,
+            ByteArray_Create(entry->value.array.data, entry->value.bytesUsed), &entry->tag);
+        if (status != KINETIC_STATUS_SUCCESS) { return status; }
+    }
+
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PUT;
     op->request->message.command.header->has_messagetype = true;
     op->entry = entry;
@@ -282,8 +289,9 @@ KineticStatus KineticBuilder_BuildGetLog(KineticOperation* const op,
     op->request->command->header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETLOG;
     op->request->command->header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->getlog = &op->request->message.getLog;
-    op->request->command->body->getlog->types = &op->request->message.getLogType;
+    com__seagate__kinetic__proto__command__get_log__init(&op->request->message.u.log.getLog);
+    op->request->command->body->getlog = &op->request->message.u.log.getLog;
+    op->request->command->body->getlog->types = &op->request->message.u.log.getLogType;
     op->request->command->body->getlog->types[0] = type;
     op->request->command->body->getlog->n_types = 1;
 
@@ -291,10 +299,11 @@ KineticStatus KineticBuilder_BuildGetLog(KineticOperation* const op,
         if (name.data == NULL || name.len == 0) {
             return KINETIC_STATUS_DEVICE_NAME_REQUIRED;
         }
-        op->request->message.getLogDevice.name.data = name.data;
-        op->request->message.getLogDevice.name.len = name.len;
-        op->request->message.getLogDevice.has_name = true;
-        op->request->command->body->getlog->device = &op->request->message.getLogDevice;
+        com__seagate__kinetic__proto__command__get_log__device__init(&op->request->message.u.log.getLogDevice);
+        op->request->message.u.log.getLogDevice.name.data = name.data;
+        op->request->message.u.log.getLogDevice.name.len = name.len;
+        op->request->message.u.log.getLogDevice.has_name = true;
+        op->request->command->body->getlog->device = &op->request->message.u.log.getLogDevice;
     }
 
     op->deviceInfo = info;
@@ -303,6 +312,14 @@ KineticStatus KineticBuilder_BuildGetLog(KineticOperation* const op,
     return KINETIC_STATUS_SUCCESS;
 }
 
+/* Admin and media operations can take much longer than the session's
+ * usual timeout, which would otherwise override their timeoutSeconds. */
+static void set_long_timeout(KineticOperation* const op, uint16_t timeoutSeconds)
+{
+    op->timeoutSeconds = timeoutSeconds;
+    op->timeoutMsec = 0;
+}
+
 KineticStatus KineticBuilder_BuildSetPin(KineticOperation* const op, ByteArray old_pin, ByteArray new_pin, bool lock)
 {
     KineticOperation_ValidateOperation(op);
@@ -310,28 +327,29 @@ KineticStatus KineticBuilder_BuildSetPin(KineticOperation* const op, ByteArray o
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__SECURITY;
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->security = &op->request->message.security;
+    com__seagate__kinetic__proto__command__security__init(&op->request->message.u.security);
+    op->request->command->body->security = &op->request->message.u.security;
 
     if (lock) {
-        op->request->message.security.oldlockpin = (ProtobufCBinaryData) {
+        op->request->message.u.security.oldlockpin = (ProtobufCBinaryData) {
             .data = old_pin.data, .len = old_pin.len };
-        op->request->message.security.has_oldlockpin = true;
-        op->request->message.security.newlockpin = (ProtobufCBinaryData) {
+        op->request->message.u.security.has_oldlockpin = true;
+        op->request->message.u.security.newlockpin = (ProtobufCBinaryData) {
             .data = new_pin.data, .len = new_pin.len };
-        op->request->message.security.has_newlockpin = true;
+        op->request->message.u.security.has_newlockpin = true;
     }
     else {
-        op->request->message.security.olderasepin = (ProtobufCBinaryData) {
+        op->request->message.u.security.olderasepin = (ProtobufCBinaryData) {
             .data = old_pin.data, .len = old_pin.len };
-        op->request->message.security.has_olderasepin = true;
-        op->request->message.security.newerasepin = (ProtobufCBinaryData) {
+        op->request->message.u.security.has_olderasepin = true;
+        op->request->message.u.security.newerasepin = (ProtobufCBinaryData) {
             .data = new_pin.data, .len = new_pin.len };
-        op->request->message.security.has_newerasepin = true;
+        op->request->message.u.security.has_newerasepin = true;
     }
 
     op->opCallback = &KineticCallbacks_Basic;
     op->request->pinAuth = false;
-    op->timeoutSeconds = KineticOperation_TimeoutSetPin;
+    set_long_timeout(op, KineticOperation_TimeoutSetPin);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -344,7 +362,8 @@ KineticStatus KineticBuilder_BuildErase(KineticOperation* const op, bool secure_
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP;
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->pinop = &op->request->message.pinOp;
+    com__seagate__kinetic__proto__command__pin_operation__init(&op->request->message.u.pinOp);
+    op->request->command->body->pinop = &op->request->message.u.pinOp;
     op->request->command->body->pinop->pinoptype = secure_erase ?
         COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__SECURE_ERASE_PINOP :
         COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__ERASE_PINOP;
@@ -352,7 +371,7 @@ KineticStatus KineticBuilder_BuildErase(KineticOperation* const op, bool secure_
 
     op->opCallback = &KineticCallbacks_Basic;
     op->request->pinAuth = true;
-    op->timeoutSeconds = KineticOperation_TimeoutErase;
+    set_long_timeout(op, KineticOperation_TimeoutErase);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -365,7 +384,8 @@ KineticStatus KineticBuilder_BuildLockUnlock(KineticOperation* const op, bool lo
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP;
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->pinop = &op->request->message.pinOp;
+    com__seagate__kinetic__proto__command__pin_operation__init(&op->request->message.u.pinOp);
+    op->request->command->body->pinop = &op->request->message.u.pinOp;
 
     op->request->command->body->pinop->pinoptype = lock ?
         COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__LOCK_PINOP :
@@ -374,7 +394,7 @@ KineticStatus KineticBuilder_BuildLockUnlock(KineticOperation* const op, bool lo
 
     op->opCallback = &KineticCallbacks_Basic;
     op->request->pinAuth = true;
-    op->timeoutSeconds = KineticOperation_TimeoutLockUnlock;
+    set_long_timeout(op, KineticOperation_TimeoutLockUnlock);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -387,7 +407,8 @@ KineticStatus KineticBuilder_BuildSetClusterVersion(KineticOperation* op, int64_
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
 
-    op->request->command->body->setup = &op->request->message.setup;
+    com__seagate__kinetic__proto__command__setup__init(&op->request->message.u.setup);
+    op->request->command->body->setup = &op->request->message.u.setup;
     op->request->command->body->setup->newclusterversion = new_cluster_version;
     op->request->command->body->setup->has_newclusterversion = true;
 
@@ -405,13 +426,14 @@ KineticStatus KineticBuilder_BuildSetACL(KineticOperation* const op,
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__SECURITY;
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->security = &op->request->message.security;
+    com__seagate__kinetic__proto__command__security__init(&op->request->message.u.security);
+    op->request->command->body->security = &op->request->message.u.security;
 
     op->request->command->body->security->n_acl = ACLs->ACL_count;
     op->request->command->body->security->acl = ACLs->ACLs;
 
     op->opCallback = &KineticCallbacks_SetACL;
-    op->timeoutSeconds = KineticOperation_TimeoutSetACL;
+    set_long_timeout(op, KineticOperation_TimeoutSetACL);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -421,7 +443,9 @@ static void initRangeAndPriority(KineticOperation* const op,
 {
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
-    op->request->command->body->security = &op->request->message.security;
+    com__seagate__kinetic__proto__command__security__init(&op->request->message.u.security);
+    op->request->command->body->security = &op->request->message.u.security;
+    com__seagate__kinetic__proto__command__range__init(&op->request->message.keyRange);
     op->request->command->body->range = &op->request->message.keyRange;
 
     char *data = media_operation->start_key == NULL ? "" : media_operation->start_key;
@@ -473,7 +497,7 @@ KineticStatus KineticBuilder_BuildMediaScan(KineticOperation* const op,
 
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__MEDIASCAN;
     initRangeAndPriority(op, mediascan_operation, priority);
-    op->timeoutSeconds = KineticOperation_TimeoutMediaScan;
+    set_long_timeout(op, KineticOperation_TimeoutMediaScan);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -485,7 +509,7 @@ KineticStatus KineticBuilder_BuildMediaOptimize(KineticOperation* const op,
 
     op->request->message.command.header->messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__MEDIAOPTIMIZE;
     initRangeAndPriority(op, mediaoptimize_operation, priority);
-    op->timeoutSeconds = KineticOperation_TimeoutMediaOptimize;
+    set_long_timeout(op, KineticOperation_TimeoutMediaOptimize);
 
     return KINETIC_STATUS_SUCCESS;
 }
@@ -549,7 +573,8 @@ KineticStatus KineticBuilder_BuildUpdateFirmware(KineticOperation* const op, con
     op->request->message.command.header->has_messagetype = true;
     op->request->command->body = &op->request->message.body;
 
-    op->request->command->body->setup = &op->request->message.setup;
+    com__seagate__kinetic__proto__command__setup__init(&op->request->message.u.setup);
+    op->request->command->body->setup = &op->request->message.u.setup;
     op->request->command->body->setup->firmwaredownload = true;
     op->request->command->body->setup->has_firmwaredownload = true;
 
@@ -25,9 +25,12 @@
 #include "kinetic_nbo.h"
 #include "kinetic_allocator.h"
 #include "kinetic_controller.h"
+#include "kinetic_callbacks.h"
 #include "bus.h"
-#include "kinetic_pdu_unpack.h"
+#include "kinetic_response.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 STATIC void log_cb(log_event_t event, int log_level, const char *msg, void *udata) {
@@ -36,6 +39,10 @@ STATIC void log_cb(log_event_t event, int log_level, const char *msg, void *udat
     KineticLogger_LogPrintf(log_level, "%s[%d] %s", event_str, log_level, msg);
 }
 
+static bool reserve_buf(socket_info *si, size_t len);
+static void release_buf(socket_info *si);
+static int64_t response_seq_id(KineticSession * session, socket_info *si);
+
 static bus_sink_cb_res_t reset_transfer(socket_info *si) {
     bus_sink_cb_res_t res = { /* prime pump with header size */
         .next_read = sizeof(KineticPDUHeader),
@@ -48,7 +55,8 @@ static bus_sink_cb_res_t reset_transfer(socket_info *si) {
     return res;
 }
 
-STATIC bool unpack_header(uint8_t const * const read_buf, size_t const read_size, KineticPDUHeader * const header)
+STATIC bool unpack_header(uint8_t const * const read_buf, size_t const read_size,
+    uint32_t max_protobuf_len, uint32_t max_value_len, KineticPDUHeader * const header)
 {
     if (read_size != sizeof(KineticPDUHeader)) {
         return false;
@@ -60,8 +68,11 @@ STATIC bool unpack_header(uint8_t const * const read_buf, size_t const read_size
     uint32_t valueLength = KineticNBO_ToHostU32(buf_header->valueLength);
     uint8_t versionPrefix = buf_header->versionPrefix;
 
-    if (protobufLength <= PDU_PROTO_MAX_LEN &&
-        valueLength <= PDU_PROTO_MAX_LEN)
+    if (max_protobuf_len == 0) { max_protobuf_len = PDU_PROTO_MAX_LEN; }
+    if (max_value_len == 0) { max_value_len = PDU_PROTO_MAX_LEN; }
+
+    if (protobufLength <= max_protobuf_len &&
+        valueLength <= max_value_len)
     {
         *header = (KineticPDUHeader){
             .versionPrefix = versionPrefix,
@@ -90,16 +101,37 @@ STATIC bus_sink_cb_res_t sink_cb(uint8_t *read_buf,
     }
     case STATE_AWAITING_HEADER:
     {
+        reserve_buf(si, PDU_HEADER_LEN);  // always fits in small_buf
         memcpy(&si->buf[si->accumulated], read_buf, read_size);
         si->accumulated += read_size;
 
         uint32_t remaining = PDU_HEADER_LEN - si->accumulated;
 
         if (remaining == 0) {
-            if (unpack_header(&si->buf[0], PDU_HEADER_LEN, &si->header))
+            if (unpack_header(&si->buf[0], PDU_HEADER_LEN,
+                    __atomic_load_n(&si->max_protobuf_len, __ATOMIC_RELAXED),
+                    __atomic_load_n(&si->max_value_len, __ATOMIC_RELAXED),
+                    &si->header))
             {
                 si->accumulated = 0;
                 si->unpack_status = UNPACK_ERROR_SUCCESS;
+                if (!reserve_buf(si, si->header.protobufLength)) {
+                    /* Skip over the message, and report the failure. */
+                    si->unpack_status = UNPACK_ERROR_PAYLOAD_MALLOC_FAIL;
+                    si->state = STATE_AWAITING_BODY;
+                    bus_sink_cb_res_t res = {
+                        .next_read = si->header.protobufLength + si->header.valueLength,
+                    };
+                    return res;
+                }
+                if (si->header.protobufLength > 0 && si->header.valueLength > 0) {
+                    /* Receive the protobuf first, to see where the value goes. */
+                    si->state = STATE_AWAITING_PROTOBUF;
+                    bus_sink_cb_res_t res = {
+                        .next_read = si->header.protobufLength,
+                    };
+                    return res;
+                }
                 si->state = STATE_AWAITING_BODY;
                 bus_sink_cb_res_t res = {
                     .next_read = si->header.protobufLength + si->header.valueLength,
@@ -125,11 +157,47 @@ STATIC bus_sink_cb_res_t sink_cb(uint8_t *read_buf,
         }
         break;
     }
-    case STATE_AWAITING_BODY:
+    case STATE_AWAITING_PROTOBUF:
     {
         memcpy(&si->buf[si->accumulated], read_buf, read_size);
         si->accumulated += read_size;
 
+        uint32_t remaining = si->header.protobufLength - si->accumulated;
+
+        if (remaining == 0) {
+            /* Have the bus match the response to its request, so the
+             * value can be received directly into the GET's entry. */
+            si->state = STATE_AWAITING_BODY;
+            int64_t seq_id = response_seq_id(session, si);
+            bus_sink_cb_res_t res = {
+                .next_read = si->header.valueLength,
+                .match = (seq_id != BUS_NO_SEQ_ID),
+                .seq_id = seq_id,
+            };
+            return res;
+        } else {
+            bus_sink_cb_res_t res = {
+                .next_read = remaining,
+            };
+            return res;
+        }
+        break;
+    }
+    case STATE_AWAITING_BODY:
+    {
+        if (si->unpack_status != UNPACK_ERROR_SUCCESS) {
+            /* Discarding the message, since it couldn't be buffered. */
+        } else if (si->value_dest != NULL) {
+            KINETIC_ASSERT(si->accumulated >= si->header.protobufLength);
+            memcpy(&si->value_dest[si->accumulated - si->header.protobufLength],
+                read_buf, read_size);
+        } else if (reserve_buf(si, si->header.protobufLength + si->header.valueLength)) {
+            memcpy(&si->buf[si->accumulated], read_buf, read_size);
+        } else {
+            si->unpack_status = UNPACK_ERROR_PAYLOAD_MALLOC_FAIL;
+        }
+        si->accumulated += read_size;
+
         uint32_t remaining = si->header.protobufLength + si->header.valueLength - si->accumulated;
 
         if (remaining == 0) {
@@ -155,6 +223,63 @@ STATIC bus_sink_cb_res_t sink_cb(uint8_t *read_buf,
     }
 }
 
+STATIC void match_cb(int64_t seq_id, void *msg_udata, void *socket_udata)
+{
+    KineticSession * session = (KineticSession*)socket_udata;
+    KINETIC_ASSERT(session);
+    socket_info *si = session->si;
+    KINETIC_ASSERT(si);
+    (void)seq_id;
+
+    KineticOperation * op = (KineticOperation*)msg_udata;
+    if (op == NULL) {
+        /* The operation has completed without this response (e.g. timed
+         * out), so any more of the value goes to the socket's buffer. */
+        si->value_dest = NULL;
+        return;
+    }
+    KINETIC_ASSERT(si->state == STATE_AWAITING_BODY);
+    KINETIC_ASSERT(si->accumulated == si->header.protobufLength);
+
+    if (op->opCallback != KineticCallbacks_Get ||
+        op->entry == NULL ||
+        op->entry->metadataOnly ||
+        ByteBuffer_IsNull(op->entry->value))
+    {
+        return;
+    }
+
+    /* If the value doesn't fit, receive it as usual and let
+     * KineticCallbacks_Get deal with it. */
+    ByteBuffer * value = &op->entry->value;
+    if (ByteBuffer_BytesRemaining(*value) < (long)si->header.valueLength) {
+        return;
+    }
+    si->value_dest = &value->array.data[value->bytesUsed];
+}
+
+/* Free the socket's large_buf once it has gone unused for a while. The
+ * bus keeps calling this while it returns true, i.e. while there's still
+ * a large_buf to free. */
+STATIC bool idle_cb(void *socket_udata)
+{
+    KineticSession * session = (KineticSession*)socket_udata;
+    KINETIC_ASSERT(session);
+    socket_info *si = session->si;
+    KINETIC_ASSERT(si);
+
+    if (si->large_buf == NULL) { return false; }
+    if (si->buf == si->large_buf ||
+        time(NULL) - si->large_buf_used < KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS)
+    {
+        return true;
+    }
+    free(si->large_buf);
+    si->large_buf = NULL;
+    si->large_buf_size = 0;
+    return false;
+}
+
 static void log_response_seq_id(int fd, int64_t seq_id) {
     #if KINETIC_LOGGER_LOG_SEQUENCE_ID
     struct timeval tv;
@@ -176,15 +301,26 @@ STATIC bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata) {
 
     if (si->unpack_status != UNPACK_ERROR_SUCCESS)
     {
+        release_buf(si);
         return (bus_unpack_cb_res_t) {
             .ok = false,
             .u.error.opaque_error_id = si->unpack_status,
         };
     }
 
-    KineticResponse * response = KineticAllocator_NewKineticResponse(si->header.valueLength);
+    /* If the value was received into the operation's entry, it doesn't
+     * need to be copied into the response. Only the response's sequence
+     * ID is scanned for here; it's left to the operation's completion to
+     * unpack it, so a large response doesn't hold up the listener. */
+    bool value_in_entry = (si->value_dest != NULL);
+    si->value_dest = NULL;
+    size_t value_len = value_in_entry ? 0 : si->header.valueLength;
+
+    KineticResponse * response = KineticAllocator_NewKineticResponse(
+        session->responsePool, value_len + si->header.protobufLength);
 
     if (response == NULL) {
+        release_buf(si);
         bus_unpack_cb_res_t res = {
             .ok = false,
             .u.error.opaque_error_id = UNPACK_ERROR_PAYLOAD_MALLOC_FAIL,
@@ -192,36 +328,14 @@ STATIC bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata) {
         return res;
     } else {
         response->header = si->header;
+        response->valueInEntry = value_in_entry && si->header.valueLength > 0;
+        memcpy(response->value, &si->buf[si->header.protobufLength], value_len);
+        response->protobuf = &response->value[value_len];
+        memcpy(response->protobuf, si->buf, si->header.protobufLength);
 
-        response->proto = KineticPDU_unpack_message(NULL, si->header.protobufLength, si->buf);
-        if (response->proto->has_commandbytes &&
-            response->proto->commandbytes.data != NULL &&
-            response->proto->commandbytes.len > 0)
-        {
-            response->command = KineticPDU_unpack_command(NULL,
-                response->proto->commandbytes.len, response->proto->commandbytes.data);
-        } else {
-            response->command = NULL;
-        }
-
-        if (response->header.valueLength > 0)
-        {
-            memcpy(response->value, &si->buf[si->header.protobufLength], si->header.valueLength);
-        }
-
-        int64_t seq_id = BUS_NO_SEQ_ID;
-        if (response->command != NULL &&
-            response->command->header != NULL)
-        {
-            if (response->proto->has_authtype &&
-                response->proto->authtype == COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__UNSOLICITEDSTATUS
-                && KineticSession_GetConnectionID(session) == 0)
-            {
-                /* Ignore the unsolicited status message on connect. */
-                seq_id = BUS_NO_SEQ_ID;
-            } else {
-                seq_id = response->command->header->acksequence;
-            }
+        int64_t seq_id = response_seq_id(session, si);
+        release_buf(si);
+        if (seq_id != BUS_NO_SEQ_ID) {
             log_response_seq_id(session->socket, seq_id);
         }
 
@@ -236,6 +350,77 @@ STATIC bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata) {
     }
 }
 
+/* Make sure SI's buffer can hold LEN bytes, keeping what it holds so
+ * far. Messages too large for small_buf go in large_buf, which is grown
+ * if needed. Returns false if allocation fails. */
+static bool reserve_buf(socket_info *si, size_t len)
+{
+    if (si->buf == NULL) {
+        si->buf = si->small_buf;
+        si->buf_size = sizeof(si->small_buf);
+    }
+    if (len <= si->buf_size) { return true; }
+
+    if (si->buf == si->small_buf && len <= si->large_buf_size) {
+        memcpy(si->large_buf, si->small_buf, sizeof(si->small_buf));
+        si->buf = si->large_buf;
+        si->buf_size = si->large_buf_size;
+        return true;
+    }
+
+    size_t size = (len + sizeof(si->small_buf) - 1) & ~(sizeof(si->small_buf) - 1);
+    uint8_t * buf = NULL;
+    if (si->buf == si->small_buf) {
+        /* Nothing in large_buf is needed, so don't copy it. */
+        free(si->large_buf);
+        si->large_buf = NULL;
+        si->large_buf_size = 0;
+        buf = malloc(size);
+        if (buf != NULL) { memcpy(buf, si->small_buf, sizeof(si->small_buf)); }
+    } else {
+        buf = realloc(si->large_buf, size);
+    }
+    if (buf == NULL) {
+        LOGF0("Failed allocating %zu byte receive buffer", size);
+        return false;
+    }
+    si->large_buf = buf;
+    si->large_buf_size = size;
+    si->buf = buf;
+    si->buf_size = size;
+    return true;
+}
+
+/* Go back to reassembling messages in small_buf, once the one in SI's
+ * buffer has been unpacked. large_buf is kept for the next large one,
+ * until idle_cb frees it. */
+static void release_buf(socket_info *si)
+{
+    if (si->buf == si->large_buf) {
+        si->large_buf_used = time(NULL);
+    }
+    si->buf = si->small_buf;
+    si->buf_size = sizeof(si->small_buf);
+}
+
+/* Get the sequence ID of the request the response in SI's buffer is
+ * for, or BUS_NO_SEQ_ID if it isn't for one. */
+static int64_t response_seq_id(KineticSession * session, socket_info *si)
+{
+    int64_t ackSequence = 0;
+    bool unsolicited = false;
+    if (!KineticResponse_ScanAckSequence(si->buf, si->header.protobufLength,
+            &ackSequence, &unsolicited))
+    {
+        return BUS_NO_SEQ_ID;
+    }
+    if (unsolicited && KineticSession_GetConnectionID(session) == 0) {
+        /* Ignore the unsolicited status message on connect. */
+        return BUS_NO_SEQ_ID;
+    }
+    return ackSequence;
+}
+
 bool KineticBus_Init(KineticClient * client, KineticClientConfig * config)
 {
     int log_level = config->logLevel;
@@ -245,9 +430,12 @@ bool KineticBus_Init(KineticClient * client, KineticClientConfig * config)
         .log_level = (log_level <= 1) ? 0 : log_level,
         .sink_cb = sink_cb,
         .unpack_cb = unpack_cb,
+        .match_cb = match_cb,
+        .idle_cb = idle_cb,
         .unexpected_msg_cb = KineticController_HandleUnexpectedResponse,
         .bus_udata = NULL,
         .listener_count = config->readerThreads,
+        .sender_count = config->writerThreads,
         .threadpool_cfg = {
             .max_threads = config->maxThreadpoolThreads,
         },
@@ -26,6 +26,7 @@
 #include "kinetic_logger.h"
 #include "kinetic_request.h"
 #include "kinetic_acl.h"
+#include "kinetic_tag.h"
 
 #include <stdlib.h>
 #include <errno.h>
@@ -75,6 +76,17 @@ KineticStatus KineticCallbacks_Put(KineticOperation* const operation, KineticSta
     return status;
 }
 
+/* Check a received value against the tag stored with it, unless it has
+ * no tag, or the tag's algorithm isn't one the client can compute. */
+static bool value_matches_tag(KineticEntry const * const entry, ByteArray const value)
+{
+    if (entry->tag.bytesUsed == 0 || KineticTag_Length(entry->algorithm) == 0) {
+        return true;
+    }
+    return KineticTag_Verify(entry->algorithm, value,
+        ByteArray_Create(entry->tag.array.data, entry->tag.bytesUsed));
+}
+
 KineticStatus KineticCallbacks_Get(KineticOperation* const operation, KineticStatus const status)
 {
     KINETIC_ASSERT(operation != NULL);
@@ -92,14 +104,33 @@ KineticStatus KineticCallbacks_Get(KineticOperation* const operation, KineticSta
             }
         }
 
-        if (!operation->entry->metadataOnly &&
-            !ByteBuffer_IsNull(operation->entry->value))
+        KineticEntry* entry = operation->entry;
+        size_t valueStart = entry->value.bytesUsed;
+        bool valueReceived = false;
+        if (operation->response->valueInEntry)
         {
-            ByteBuffer_AppendArray(&operation->entry->value, (ByteArray){
+            // The value was received in place, just account for it
+            entry->value.bytesUsed += operation->response->header.valueLength;
+            valueReceived = true;
+        }
+        else if (!entry->metadataOnly &&
+            !ByteBuffer_IsNull(entry->value))
+        {
+            valueReceived = NULL != ByteBuffer_AppendArray(&entry->value, (ByteArray){
                 .data = operation->response->value,
                 .len = operation->response->header.valueLength,
             });
         }
+
+        // Check the value against its tag, if requested. Tag-checked
+        // GETs are never completed inline, so this runs on a threadpool
+        // worker, not the listener.
+        if (entry->computeTag && valueReceived && !value_matches_tag(entry,
+                ByteArray_Create(&entry->value.array.data[valueStart],
+                    operation->response->header.valueLength))) {
+            LOGF0("Tag mismatch for GET value (algorithm %d)", entry->algorithm);
+            return KINETIC_STATUS_DATA_ERROR;
+        }
     }
 
     return status;
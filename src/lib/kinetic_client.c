@@ -23,10 +23,12 @@
 #include "kinetic_controller.h"
 #include "kinetic_operation.h"
 #include "kinetic_builder.h"
+#include "kinetic_device_info.h"
 #include "kinetic_logger.h"
 #include "kinetic_response.h"
 #include "kinetic_bus.h"
 #include "kinetic_memory.h"
+#include "kinetic_response_pool.h"
 #include <stdlib.h>
 #include <sys/time.h>
 
@@ -54,12 +56,23 @@ KineticClient * KineticClient_Init(KineticClientConfig *config)
     if (config->readerThreads == 0) {
         config->readerThreads = KINETIC_CLIENT_DEFAULT_READER_THREADS;
     }
+    if (config->writerThreads == 0) {
+        config->writerThreads = KINETIC_CLIENT_DEFAULT_WRITER_THREADS;
+    }
     if (config->maxThreadpoolThreads == 0) {
         config->maxThreadpoolThreads = KINETIC_CLIENT_DEFAULT_MAX_THREADPOOL_THREADS;
     }
 
+    client->responsePool = KineticResponsePool_Create();
+    if (client->responsePool == NULL) {
+        KineticFree(client);
+        KineticLogger_Close();
+        return NULL;
+    }
+
     bool success = KineticBus_Init(client, config);
     if (!success) {
+        KineticResponsePool_Destroy(client->responsePool);
         KineticFree(client);
         KineticLogger_Close();
         return NULL;
@@ -70,10 +83,49 @@ KineticClient * KineticClient_Init(KineticClientConfig *config)
 void KineticClient_Shutdown(KineticClient * const client)
 {
     KineticBus_Shutdown(client);
+    KineticResponsePool_Destroy(client->responsePool);
     KineticFree(client);
     KineticLogger_Close();
 }
 
+void KineticClient_GetResponsePoolStats(KineticClient const * const client,
+    KineticResponsePoolStats * const stats)
+{
+    KINETIC_ASSERT(client != NULL);
+    KineticResponsePool_GetStats(client->responsePool, stats);
+}
+
+/* Read the device's limits log, and allow as many operations in flight on
+ * the session, and responses as large, as the device says it can handle.
+ * If that fails (for instance, if the identity isn't permitted to read
+ * logs), the configured and default limits are kept. */
+static void apply_device_limits(KineticSession * const session)
+{
+    KineticOperation* operation = KineticAllocator_NewOperation(session);
+    if (operation == NULL) { return; }
+
+    KineticLogInfo* info = NULL;
+    KineticBuilder_BuildGetLog(operation,
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__GET_LOG__TYPE__LIMITS, BYTE_ARRAY_NONE, &info);
+    KineticStatus status = KineticController_ExecuteOperation(operation, NULL);
+    if (status != KINETIC_STATUS_SUCCESS || info == NULL || info->limits == NULL) {
+        LOGF0("Failed reading device limits (%s), keeping configured limit",
+            Kinetic_GetStatusDescription(status));
+    } else {
+        /* Reads and writes share one window, so fit the stricter limit. */
+        uint32_t limit = info->limits->maxOutstandingReadRequests;
+        uint32_t writes = info->limits->maxOutstandingWriteRequests;
+        if (limit == 0 || (writes > 0 && writes < limit)) { limit = writes; }
+        if (limit > 0) {
+            LOGF1("Allowing %u outstanding operations, per device limits", limit);
+            KineticSession_SetOutstandingOperationsLimit(session, limit);
+        }
+        KineticSession_SetMessageLimits(session,
+            info->limits->maxMessageSize, info->limits->maxValueSize);
+    }
+    if (info != NULL) { KineticLogInfo_Free(info); }
+}
+
 KineticStatus KineticClient_CreateSession(KineticSessionConfig* const config,
     KineticClient * const client, KineticSession** session)
 {
@@ -119,6 +171,8 @@ KineticStatus KineticClient_CreateSession(KineticSessionConfig* const config,
         return status;
     }
 
+    if (config->useDeviceLimits) { apply_device_limits(s); }
+
     *session = s;
 
     return status;
@@ -289,6 +343,117 @@ KineticStatus KineticClient_Delete(KineticSession* const session,
     return KineticController_ExecuteOperation(operation, closure);
 }
 
+typedef enum {
+    BATCH_PUT,
+    BATCH_GET,
+    BATCH_DELETE,
+} BATCH_COMMAND;
+
+static KineticStatus build_batch_operation(BATCH_COMMAND cmd,
+                                           KineticOperation* const operation,
+                                           KineticEntry* const entry)
+{
+    switch (cmd)
+    {
+    case BATCH_PUT:
+        return KineticBuilder_BuildPut(operation, entry);
+    case BATCH_GET:
+        return KineticBuilder_BuildGet(operation, entry);
+    case BATCH_DELETE:
+        return KineticBuilder_BuildDelete(operation, entry);
+    default:
+        KINETIC_ASSERT(false);
+        return KINETIC_STATUS_INVALID;
+    }
+}
+
+static KineticStatus handle_batch_command(BATCH_COMMAND cmd,
+                                          KineticSession* const session,
+                                          KineticEntry* const entries,
+                                          size_t count,
+                                          KineticStatus* const statuses,
+                                          KineticCompletionClosure* closure)
+{
+    KINETIC_ASSERT(session);
+    KINETIC_ASSERT(entries);
+    KINETIC_ASSERT(statuses);
+    KINETIC_ASSERT(count > 0);
+
+    // Validate every entry before building anything
+    for (size_t i = 0; i < count; i++) {
+        KineticEntry* entry = &entries[i];
+        if (cmd == BATCH_PUT && entry->value.array.len > 0) {
+            KINETIC_ASSERT(entry->value.array.data);
+        }
+        if (cmd == BATCH_GET) {
+            if (!has_key(entry)) {return KINETIC_STATUS_MISSING_KEY;}
+            if (!has_value_buffer(entry) && !entry->metadataOnly) {
+                return KINETIC_STATUS_MISSING_VALUE_BUFFER;
+            }
+        }
+    }
+
+    KineticOperation** operations = KineticCalloc(count, sizeof(*operations));
+    if (operations == NULL) {return KINETIC_STATUS_MEMORY_ERROR;}
+
+    // Initialize requests
+    KineticStatus status = KINETIC_STATUS_SUCCESS;
+    size_t built = 0;
+    while (built < count) {
+        KineticOperation* operation = KineticAllocator_NewOperation(session);
+        if (operation == NULL) {
+            status = KINETIC_STATUS_MEMORY_ERROR;
+            break;
+        }
+        KINETIC_ASSERT(operation->session == session);
+        status = build_batch_operation(cmd, operation, &entries[built]);
+        if (status != KINETIC_STATUS_SUCCESS) {
+            KineticAllocator_FreeOperation(operation);
+            break;
+        }
+        operations[built++] = operation;
+    }
+
+    // Execute the operations, which takes ownership of them
+    if (status == KINETIC_STATUS_SUCCESS) {
+        status = KineticController_ExecuteBatch(operations, count, statuses, closure);
+    } else {
+        for (size_t i = 0; i < built; i++) {
+            KineticAllocator_FreeOperation(operations[i]);
+        }
+    }
+
+    KineticFree(operations);
+    return status;
+}
+
+KineticStatus KineticClient_PutBatch(KineticSession* const session,
+                                     KineticEntry* const entries,
+                                     size_t count,
+                                     KineticStatus* const statuses,
+                                     KineticCompletionClosure* closure)
+{
+    return handle_batch_command(BATCH_PUT, session, entries, count, statuses, closure);
+}
+
+KineticStatus KineticClient_GetBatch(KineticSession* const session,
+                                     KineticEntry* const entries,
+                                     size_t count,
+                                     KineticStatus* const statuses,
+                                     KineticCompletionClosure* closure)
+{
+    return handle_batch_command(BATCH_GET, session, entries, count, statuses, closure);
+}
+
+KineticStatus KineticClient_DeleteBatch(KineticSession* const session,
+                                        KineticEntry* const entries,
+                                        size_t count,
+                                        KineticStatus* const statuses,
+                                        KineticCompletionClosure* closure)
+{
+    return handle_batch_command(BATCH_DELETE, session, entries, count, statuses, closure);
+}
+
 KineticStatus KineticClient_GetKeyRange(KineticSession* const session,
                                         KineticKeyRange* range,
                                         ByteBufferArray* keys,
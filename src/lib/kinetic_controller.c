@@ -21,6 +21,7 @@
 #include "kinetic_bus.h"
 #include "kinetic_response.h"
 #include "kinetic_auth.h"
+#include "kinetic_hmac.h"
 #include "kinetic_socket.h"
 #include "kinetic_allocator.h"
 #include "kinetic_resourcewaiter.h"
@@ -50,9 +51,50 @@ STATIC KineticCompletionClosure DefaultClosure(DefaultCallbackData * const data)
     return (KineticCompletionClosure) {
         .callback = DefaultCallback,
         .clientData = data,
+        .nonBlocking = true,
     };
 }
 
+static void DefaultCallbackData_Init(DefaultCallbackData * const data)
+{
+    pthread_mutex_init(&data->receiveCompleteMutex, NULL);
+    pthread_cond_init(&data->receiveComplete, NULL);
+    data->status = KINETIC_STATUS_INVALID;
+    data->completed = false;
+}
+
+static KineticStatus DefaultCallbackData_Wait(DefaultCallbackData * const data)
+{
+    pthread_mutex_lock(&data->receiveCompleteMutex);
+    while(data->completed == false) {
+        pthread_cond_wait(&data->receiveComplete, &data->receiveCompleteMutex);
+    }
+    KineticStatus status = data->status;
+    pthread_mutex_unlock(&data->receiveCompleteMutex);
+    return status;
+}
+
+static void DefaultCallbackData_Destroy(DefaultCallbackData * const data)
+{
+    pthread_cond_destroy(&data->receiveComplete);
+    pthread_mutex_destroy(&data->receiveCompleteMutex);
+}
+
+/* If a synchronous operation failed because the session has been
+ * terminated, disconnect it. */
+static KineticStatus check_session_on_failure(KineticSession * const session, KineticStatus status)
+{
+    if (status != KINETIC_STATUS_SUCCESS) {
+        if (KineticSession_GetTerminationStatus(session) != KINETIC_STATUS_SUCCESS) {
+            (void)KineticSession_Disconnect(session);
+            if (status == KINETIC_STATUS_SOCKET_ERROR) {
+                status = KINETIC_STATUS_SESSION_TERMINATED;
+            }
+        }
+    }
+    return status;
+}
+
 KineticStatus KineticController_ExecuteOperation(KineticOperation* operation, KineticCompletionClosure* const closure)
 {
     KINETIC_ASSERT(operation != NULL);
@@ -66,14 +108,11 @@ KineticStatus KineticController_ExecuteOperation(KineticOperation* operation, Ki
 
     if (closure != NULL) {
         operation->closure = *closure;
-        return KineticOperation_SendRequest(operation);
+        return KineticOperation_SubmitRequest(operation);
     }
     else {
         DefaultCallbackData data;
-        pthread_mutex_init(&data.receiveCompleteMutex, NULL);
-        pthread_cond_init(&data.receiveComplete, NULL);
-        data.status = KINETIC_STATUS_INVALID;
-        data.completed = false;
+        DefaultCallbackData_Init(&data);
 
         operation->closure = DefaultClosure(&data);
 
@@ -81,28 +120,147 @@ KineticStatus KineticController_ExecuteOperation(KineticOperation* operation, Ki
         status = KineticOperation_SendRequest(operation);
 
         if (status == KINETIC_STATUS_SUCCESS) {
-            pthread_mutex_lock(&data.receiveCompleteMutex);
-            while(data.completed == false) {
-                pthread_cond_wait(&data.receiveComplete, &data.receiveCompleteMutex);
-            }
-            status = data.status;
-            pthread_mutex_unlock(&data.receiveCompleteMutex);
+            status = DefaultCallbackData_Wait(&data);
         }
 
-        pthread_cond_destroy(&data.receiveComplete);
-        pthread_mutex_destroy(&data.receiveCompleteMutex);
+        DefaultCallbackData_Destroy(&data);
 
-        if (status != KINETIC_STATUS_SUCCESS) {
-            if (KineticSession_GetTerminationStatus(session) != KINETIC_STATUS_SUCCESS) {
-                (void)KineticSession_Disconnect(session);
-                if (status == KINETIC_STATUS_SOCKET_ERROR) {
-                    status = KINETIC_STATUS_SESSION_TERMINATED;
-                }
-            }
+        return check_session_on_failure(session, status);
+    }
+}
+
+/* Completion state shared by the operations of a batch. The last one
+ * to complete calls the user's closure and frees the batch. */
+typedef struct _KineticBatch KineticBatch;
+
+typedef struct {
+    KineticBatch* batch;
+    size_t index;
+} KineticBatchItem;
+
+struct _KineticBatch {
+    pthread_mutex_t mutex;
+    size_t remaining;
+    KineticStatus status;           ///< first failure, if any
+    KineticStatus* statuses;
+    KineticCompletionClosure closure;
+    KineticBatchItem items[];
+};
+
+static void BatchCallback(KineticCompletionData* kinetic_data, void* client_data)
+{
+    KineticBatchItem* item = client_data;
+    KineticBatch* batch = item->batch;
+
+    pthread_mutex_lock(&batch->mutex);
+    batch->statuses[item->index] = kinetic_data->status;
+    if (kinetic_data->status != KINETIC_STATUS_SUCCESS &&
+        batch->status == KINETIC_STATUS_SUCCESS) {
+        batch->status = kinetic_data->status;
+    }
+    bool last = (--batch->remaining == 0);
+    pthread_mutex_unlock(&batch->mutex);
+
+    if (last) {
+        KineticCompletionData completionData = {.status = batch->status};
+        if (batch->closure.callback != NULL) {
+            batch->closure.callback(&completionData, batch->closure.clientData);
+        }
+        pthread_mutex_destroy(&batch->mutex);
+        free(batch);
+    }
+}
+
+KineticStatus KineticController_ExecuteBatch(KineticOperation* const * operations, size_t count,
+    KineticStatus* statuses, KineticCompletionClosure* const closure)
+{
+    KINETIC_ASSERT(operations != NULL);
+    KINETIC_ASSERT(count > 0);
+    KINETIC_ASSERT(statuses != NULL);
+    KineticSession *session = operations[0]->session;
+    KINETIC_ASSERT(session != NULL);
+
+    KineticStatus status = KINETIC_STATUS_SUCCESS;
+    KineticBatch* batch = NULL;
+    bool* sent = NULL;
+    if (KineticSession_GetTerminationStatus(session) != KINETIC_STATUS_SUCCESS) {
+        status = KINETIC_STATUS_SESSION_TERMINATED;
+    } else {
+        batch = calloc(1, sizeof(*batch) + count * sizeof(batch->items[0]));
+        /* Kept apart from the batch, which the last completion frees. */
+        sent = calloc(count, sizeof(*sent));
+        if (batch == NULL || sent == NULL) { status = KINETIC_STATUS_MEMORY_ERROR; }
+    }
+    if (status != KINETIC_STATUS_SUCCESS) {
+        for (size_t i = 0; i < count; i++) {
+            KineticAllocator_FreeOperation(operations[i]);
         }
+        free(batch);
+        free(sent);
+        return status;
+    }
+
+    DefaultCallbackData data;
+    if (closure != NULL) {
+        batch->closure = *closure;
+    } else {
+        DefaultCallbackData_Init(&data);
+        batch->closure = DefaultClosure(&data);
+    }
+    pthread_mutex_init(&batch->mutex, NULL);
+    batch->remaining = count;
+    batch->status = KINETIC_STATUS_SUCCESS;
+    batch->statuses = statuses;
+    for (size_t i = 0; i < count; i++) {
+        batch->items[i] = (KineticBatchItem){.batch = batch, .index = i};
+        operations[i]->closure = (KineticCompletionClosure) {
+            .callback = BatchCallback,
+            .clientData = &batch->items[i],
+            .nonBlocking = batch->closure.nonBlocking,
+        };
+    }
+
+    status = KineticOperation_SendRequests(operations, count, sent);
 
+    size_t sentCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sent[i]) { sentCount++; }
+    }
+
+    if (sentCount == 0) {
+        /* Nothing is in flight, so fail the whole batch without
+         * calling the closure, like a rejected single operation. */
+        for (size_t i = 0; i < count; i++) {
+            KineticAllocator_FreeOperation(operations[i]);
+        }
+        pthread_mutex_destroy(&batch->mutex);
+        free(batch);
+    } else {
+        /* The ones that were sent will complete as usual; complete the
+         * rest with the reason they weren't sent. Their slots in the
+         * session's concurrent request limit were never taken, so this
+         * can't use KineticOperation_Complete. */
+        for (size_t i = 0; i < count; i++) {
+            if (sent[i]) { continue; }
+            KineticCompletionData completionData = {.status = status};
+            KineticCompletionClosure opClosure = operations[i]->closure;
+            KineticAllocator_FreeOperation(operations[i]);
+            opClosure.callback(&completionData, opClosure.clientData);
+        }
+        status = KINETIC_STATUS_SUCCESS;
+    }
+    free(sent);
+
+    if (closure != NULL) {
         return status;
     }
+
+    if (status == KINETIC_STATUS_SUCCESS) {
+        status = DefaultCallbackData_Wait(&data);
+    }
+    DefaultCallbackData_Destroy(&data);
+
+    return check_session_on_failure(session, status);
 }
 
 KineticStatus bus_to_kinetic_status(bus_send_status_t const status)
@@ -192,6 +350,13 @@ void KineticController_HandleUnexpectedResponse(void *msg,
 
     (void)bus_udata;
 
+    if (!KineticResponse_Unpack(response)) {
+        LOGF0("WARNING: Received malformed response! (fd: %d, protoLen: %u)",
+            session->socket, KineticResponse_GetProtobufLength(response));
+        KineticAllocator_FreeKineticResponse(response);
+        return;
+    }
+
     // Handle unsolicited status PDUs
     if (response->proto->authtype == COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__UNSOLICITEDSTATUS) {
         int64_t connectionID = KineticResponse_GetConnectionID(response);
@@ -238,6 +403,16 @@ void KineticController_HandleUnexpectedResponse(void *msg,
     }
 }
 
+/* Check the response's HMAC, if the session is configured to and the
+ * request was HMAC authenticated (responses to PIN operations aren't). */
+static bool response_hmac_ok(KineticOperation const * const op,
+    KineticResponse const * const response)
+{
+    KineticSession const * const session = op->session;
+    if (!session->config.verifyResponseHmac || op->pin != NULL) { return true; }
+    return KineticHMAC_Validate(response->proto, &session->hmacKey);
+}
+
 void KineticController_HandleResult(bus_msg_result_t *res, void *udata)
 {
     KineticOperation* op = udata;
@@ -249,13 +424,23 @@ void KineticController_HandleResult(bus_msg_result_t *res, void *udata)
     if (status == KINETIC_STATUS_SUCCESS) {
         KineticResponse * response = res->u.response.opaque_msg;
 
-        status = KineticResponse_GetStatus(response);
+        /* The listener only framed the response, so unpack it here. */
+        if (!KineticResponse_Unpack(response)) {
+            LOG0("Failed unpacking response!");
+            status = KINETIC_STATUS_INVALID;
+        } else {
+            status = KineticResponse_GetStatus(response);
+            if (!response_hmac_ok(op, response)) {
+                LOG0("Response HMAC did not validate!");
+                status = KINETIC_STATUS_HMAC_FAILURE;
+            }
+        }
 
         LOGF2("[PDU RX] pdu: %p, session: %p, bus: %p, "
             "fd: %6d, seq: %8lld, protoLen: %8u, valueLen: %8u, op: %p, status: %s",
             (void*)response,
             (void*)op->session, (void*)op->session->messageBus,
-            op->session->socket, response->command->header->acksequence,
+            op->session->socket, (long long)res->u.response.seq_id,
             KineticResponse_GetProtobufLength(response),
             KineticResponse_GetValueLength(response),
             (void*)op,
@@ -23,6 +23,8 @@
 
 KineticStatus KineticController_Init(KineticSession * const session);
 KineticStatus KineticController_ExecuteOperation(KineticOperation* operation, KineticCompletionClosure* closure);
+KineticStatus KineticController_ExecuteBatch(KineticOperation* const * operations, size_t count,
+    KineticStatus* statuses, KineticCompletionClosure* closure);
 
 void KineticController_HandleUnexpectedResponse(void *msg,
                                                 int64_t seq_id,
@@ -14,13 +14,26 @@
  *
  * See www.openkinetic.org for more project information
  */
-
 #include "kinetic_countingsemaphore.h"
 #include "kinetic_countingsemaphore_types.h"
 #include "kinetic_logger.h"
 #include <stdlib.h>
+#include <stdbool.h>
 #include <assert.h>
 
+/* The count is adjusted with atomic operations, so taking and giving only
+ * touch the mutex when a taker has to wait, or a giver has to wake one.
+ * Sequentially consistent ordering keeps that handoff safe: a waiter
+ * registers in num_waiting before its final check of the count, and a
+ * giver updates the count before checking num_waiting, so at least one
+ * of them sees the other. */
+#define ATOMIC_LOAD(P) __atomic_load_n(P, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(P, V) __atomic_store_n(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD_FETCH(P, V) __atomic_add_fetch(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB_FETCH(P, V) __atomic_sub_fetch(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS(P, OLD, NEW) \
+    __atomic_compare_exchange_n(P, OLD, NEW, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+
 KineticCountingSemaphore * KineticCountingSemaphore_Create(uint32_t counts)
 {
     KineticCountingSemaphore * sem = calloc(1, sizeof(KineticCountingSemaphore));
@@ -33,45 +46,102 @@ KineticCountingSemaphore * KineticCountingSemaphore_Create(uint32_t counts)
     return sem;
 }
 
-void KineticCountingSemaphore_Take(KineticCountingSemaphore * const sem) // WAIT
+/* Take up to MAX counts if any are available, without blocking.
+ * Returns the number taken. */
+static uint32_t try_take(KineticCountingSemaphore * const sem, uint32_t max)
 {
-    KINETIC_ASSERT(sem != NULL);
-    pthread_mutex_lock(&sem->mutex);
+    int64_t count = ATOMIC_LOAD(&sem->count);
+    while (count > 0) {
+        uint32_t taken = (count < max) ? (uint32_t)count : max;
+        if (ATOMIC_CAS(&sem->count, &count, count - taken)) {
+            return taken;
+        }
+    }
+    return 0;
+}
 
-    sem->num_waiting++;
+/* Wait until at least one count is available, then take up to MAX. */
+static uint32_t take_slow(KineticCountingSemaphore * const sem, uint32_t max)
+{
+    pthread_mutex_lock(&sem->mutex);
+    uint32_t waiting = ATOMIC_ADD_FETCH(&sem->num_waiting, 1);
+    LOGF3("Concurrent ops throttle -- waiting (waiting=%u)", waiting);
 
-    while (sem->count == 0) {
+    uint32_t taken;
+    while ((taken = try_take(sem, max)) == 0) {
         pthread_cond_wait(&sem->available, &sem->mutex);
     }
 
-    sem->num_waiting--;
-
-    uint32_t before = sem->count--;
-    uint32_t after = sem->count;
-    uint32_t waiting = sem->num_waiting;
+    waiting = ATOMIC_SUB_FETCH(&sem->num_waiting, 1);
 
+    /* Another waiter may be able to use what is left. */
+    if (waiting > 0 && ATOMIC_LOAD(&sem->count) > 0) {
+        pthread_cond_signal(&sem->available);
+    }
     pthread_mutex_unlock(&sem->mutex);
 
-    LOGF3("Concurrent ops throttle -- TAKE: %u => %u (waiting=%u)", before, after, waiting);
+    LOGF3("Concurrent ops throttle -- TAKE: %u (waiting=%u)", taken, waiting);
+    return taken;
 }
 
-void KineticCountingSemaphore_Give(KineticCountingSemaphore * const sem) // SIGNAL
+void KineticCountingSemaphore_Take(KineticCountingSemaphore * const sem) // WAIT
 {
     KINETIC_ASSERT(sem != NULL);
-    pthread_mutex_lock(&sem->mutex);
+    if (try_take(sem, 1) == 0) {
+        take_slow(sem, 1);
+    }
+}
+
+// Wait until at least one count is available, then take as many as are
+// available, up to MAX. Returns the number taken.
+uint32_t KineticCountingSemaphore_TakeUpTo(KineticCountingSemaphore * const sem, uint32_t max)
+{
+    KINETIC_ASSERT(sem != NULL);
+    KINETIC_ASSERT(max > 0);
+    uint32_t taken = try_take(sem, max);
+    if (taken == 0) {
+        taken = take_slow(sem, max);
+    }
+    return taken;
+}
 
-    if (sem->count == 0 && sem->num_waiting > 0) {
+void KineticCountingSemaphore_Give(KineticCountingSemaphore * const sem) // SIGNAL
+{
+    KINETIC_ASSERT(sem != NULL);
+    int64_t after = ATOMIC_ADD_FETCH(&sem->count, 1);
+    if (after > 0 && ATOMIC_LOAD(&sem->num_waiting) > 0) {
+        pthread_mutex_lock(&sem->mutex);
         pthread_cond_signal(&sem->available);
+        pthread_mutex_unlock(&sem->mutex);
     }
+}
 
-    uint32_t before = sem->count++;
-    uint32_t after = sem->count;
-    uint32_t waiting = sem->num_waiting;
+// Change the number of counts that may be taken at once. When shrinking,
+// counts already taken beyond the new MAX are absorbed as they are given
+// back, rather than blocking or revoking anything.
+void KineticCountingSemaphore_SetMax(KineticCountingSemaphore * const sem, uint32_t max)
+{
+    KINETIC_ASSERT(sem != NULL);
+    KINETIC_ASSERT(max > 0);
 
+    /* Serialize resizes, so the count and max agree once all are done. */
+    pthread_mutex_lock(&sem->mutex);
+    uint32_t before = sem->max;
+    int64_t delta = (int64_t)max - (int64_t)before;
+    int64_t after;
+    if (delta < 0) {
+        after = ATOMIC_ADD_FETCH(&sem->count, delta);
+        ATOMIC_STORE(&sem->max, max);
+    } else {
+        ATOMIC_STORE(&sem->max, max);
+        after = ATOMIC_ADD_FETCH(&sem->count, delta);
+    }
+    if (after > 0 && ATOMIC_LOAD(&sem->num_waiting) > 0) {
+        pthread_cond_broadcast(&sem->available);
+    }
     pthread_mutex_unlock(&sem->mutex);
 
-    LOGF3("Concurrent ops throttle -- GIVE: %u => %u (waiting=%u)", before, after, waiting);
-    KINETIC_ASSERT(sem->max >= after);
+    LOGF2("Concurrent ops throttle -- MAX: %u => %u", before, max);
 }
 
 void KineticCountingSemaphore_Destroy(KineticCountingSemaphore * const sem)
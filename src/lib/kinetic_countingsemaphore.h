@@ -24,7 +24,9 @@ typedef struct _KineticCountingSemaphore KineticCountingSemaphore;
 
 KineticCountingSemaphore * KineticCountingSemaphore_Create(uint32_t max);
 void KineticCountingSemaphore_Take(KineticCountingSemaphore * const sem);
+uint32_t KineticCountingSemaphore_TakeUpTo(KineticCountingSemaphore * const sem, uint32_t max);
 void KineticCountingSemaphore_Give(KineticCountingSemaphore * const sem);
+void KineticCountingSemaphore_SetMax(KineticCountingSemaphore * const sem, uint32_t max);
 void KineticCountingSemaphore_Destroy(KineticCountingSemaphore * const sem);
 
 #endif // _KINETIC_COUNTINGSEMAPHORE_H
@@ -24,7 +24,7 @@
 struct _KineticCountingSemaphore {
     pthread_mutex_t mutex;
     pthread_cond_t available;
-    uint32_t count;
+    int64_t count;      ///< negative while more are taken than max allows
     uint32_t max;
     uint32_t num_waiting;
 };
@@ -19,11 +19,52 @@
 #include "kinetic_nbo.h"
 #include "kinetic_logger.h"
 #include <string.h>
-#include <openssl/hmac.h>
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+
+/* SHA1 is deprecated as a low-level API in newer OpenSSL releases, but
+ * the EVP/HMAC interfaces don't allow keeping a precomputed key schedule. */
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
 
 static void KineticHMAC_Compute(KineticHMAC* hmac,
                                 const Com__Seagate__Kinetic__Proto__Message* proto,
-                                const ByteArray key);
+                                KineticHMACKey const * const key);
+
+void KineticHMAC_KeyInit(KineticHMACKey* hmacKey, const ByteArray key)
+{
+    KINETIC_ASSERT(hmacKey != NULL);
+    KINETIC_ASSERT(key.data != NULL || key.len == 0);
+
+    // Keys longer than a block are hashed first (RFC 2104).
+    uint8_t block[SHA_CBLOCK];
+    memset(block, 0, sizeof(block));
+    if (key.len > sizeof(block)) {
+        SHA1(key.data, key.len, block);
+    } else if (key.len > 0) {
+        memcpy(block, key.data, key.len);
+    }
+
+    uint8_t pad[SHA_CBLOCK];
+    for (size_t i = 0; i < sizeof(pad); i++) { pad[i] = block[i] ^ HMAC_IPAD; }
+    SHA1_Init(&hmacKey->inner);
+    SHA1_Update(&hmacKey->inner, pad, sizeof(pad));
+
+    for (size_t i = 0; i < sizeof(pad); i++) { pad[i] = block[i] ^ HMAC_OPAD; }
+    SHA1_Init(&hmacKey->outer);
+    SHA1_Update(&hmacKey->outer, pad, sizeof(pad));
+
+    OPENSSL_cleanse(block, sizeof(block));
+    OPENSSL_cleanse(pad, sizeof(pad));
+}
+
+void KineticHMAC_KeyClear(KineticHMACKey* hmacKey)
+{
+    KINETIC_ASSERT(hmacKey != NULL);
+    OPENSSL_cleanse(hmacKey, sizeof(*hmacKey));
+}
 
 void KineticHMAC_Init(KineticHMAC* hmac,
                       Com__Seagate__Kinetic__Proto__Command__Security__ACL__HMACAlgorithm algorithm)
@@ -43,13 +84,12 @@ void KineticHMAC_Init(KineticHMAC* hmac,
 
 void KineticHMAC_Populate(KineticHMAC* hmac,
                           Com__Seagate__Kinetic__Proto__Message* msg,
-                          const ByteArray key)
+                          KineticHMACKey const * const key)
 {
     KINETIC_ASSERT(hmac != NULL);
     KINETIC_ASSERT(hmac->data != NULL);
     KINETIC_ASSERT(msg != NULL);
-    KINETIC_ASSERT(key.data != NULL);
-    KINETIC_ASSERT(key.len > 0);
+    KINETIC_ASSERT(key != NULL);
     KINETIC_ASSERT(msg->hmacauth->hmac.data != NULL);
 
     KineticHMAC_Init(hmac, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
@@ -62,11 +102,10 @@ void KineticHMAC_Populate(KineticHMAC* hmac,
 }
 
 bool KineticHMAC_Validate(const Com__Seagate__Kinetic__Proto__Message* msg,
-                          const ByteArray key)
+                          KineticHMACKey const * const key)
 {
     KINETIC_ASSERT(msg != NULL);
-    KINETIC_ASSERT(key.data != NULL);
-    KINETIC_ASSERT(key.len > 0);
+    KINETIC_ASSERT(key != NULL);
 
     bool success = false;
     size_t i;
@@ -102,13 +141,13 @@ bool KineticHMAC_Validate(const Com__Seagate__Kinetic__Proto__Message* msg,
     return success;
 }
 
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-
 #define LOG_HMAC 0
 
+/* Compute the HMAC of the message's command bytes, prefixed with their
+ * length, starting from copies of the key's precomputed SHA1 states. */
 static void KineticHMAC_Compute(KineticHMAC* hmac,
                                 const Com__Seagate__Kinetic__Proto__Message* msg,
-                                const ByteArray key)
+                                KineticHMACKey const * const key)
 {
     KINETIC_ASSERT(hmac != NULL);
     KINETIC_ASSERT(hmac->data != NULL);
@@ -120,10 +159,8 @@ static void KineticHMAC_Compute(KineticHMAC* hmac,
 
     uint32_t lenNBO = KineticNBO_FromHostU32(msg->commandbytes.len);
 
-    HMAC_CTX ctx;
-    HMAC_CTX_init(&ctx);
 #if LOG_HMAC
-    fprintf(stderr, "\n\nUsing hmac key [%zd]: '%s' and length '", key.len, key.data);
+    fprintf(stderr, "\n\nUsing hmac length '");
     for (size_t i = 0; i < sizeof(uint32_t); i++) {
         fprintf(stderr, "%02x", ((uint8_t *)&lenNBO)[i]);
     }
@@ -136,9 +173,15 @@ static void KineticHMAC_Compute(KineticHMAC* hmac,
     fprintf(stderr, "\n\n");
 #endif
 
-    HMAC_Init_ex(&ctx, key.data, key.len, EVP_sha1(), NULL);
-    HMAC_Update(&ctx, (uint8_t*)&lenNBO, sizeof(uint32_t));
-    HMAC_Update(&ctx, msg->commandbytes.data, msg->commandbytes.len);
-    HMAC_Final(&ctx, hmac->data, &hmac->len);
-    HMAC_CTX_cleanup(&ctx);
+    uint8_t innerDigest[SHA_DIGEST_LENGTH];
+    SHA_CTX ctx = key->inner;
+    SHA1_Update(&ctx, &lenNBO, sizeof(uint32_t));
+    SHA1_Update(&ctx, msg->commandbytes.data, msg->commandbytes.len);
+    SHA1_Final(innerDigest, &ctx);
+
+    ctx = key->outer;
+    SHA1_Update(&ctx, innerDigest, sizeof(innerDigest));
+    SHA1_Final(hmac->data, &ctx);
+    hmac->len = SHA_DIGEST_LENGTH;
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
 }
@@ -24,11 +24,18 @@
 void KineticHMAC_Init(KineticHMAC* hmac,
                       Com__Seagate__Kinetic__Proto__Command__Security__ACL__HMACAlgorithm algorithm);
 
+/* Precompute the HMAC key schedule for KEY, for signing and validating
+ * any number of messages with it. */
+void KineticHMAC_KeyInit(KineticHMACKey* hmacKey, const ByteArray key);
+
+/* Wipe a key schedule that is no longer needed. */
+void KineticHMAC_KeyClear(KineticHMACKey* hmacKey);
+
 void KineticHMAC_Populate(KineticHMAC* hmac,
                           Com__Seagate__Kinetic__Proto__Message* msg,
-                          const ByteArray key);
+                          KineticHMACKey const * const key);
 
 bool KineticHMAC_Validate(const Com__Seagate__Kinetic__Proto__Message* msg,
-                          const ByteArray key);
+                          KineticHMACKey const * const key);
 
 #endif  // _KINETIC_HMAC_H
@@ -42,6 +42,7 @@ void KineticMessage_ConfigureKeyValue(KineticMessage* const message,
 
     // Enable command body and keyValue fields by pointing at
     // pre-allocated elements in message
+    com__seagate__kinetic__proto__command__key_value__init(&message->keyValue);
     message->command.body = &message->body;
     message->command.body->keyvalue = &message->keyValue;
 
@@ -88,6 +89,7 @@ void KineticMessage_ConfigureKeyRange(KineticMessage* const message,
 
     // Enable command body and keyValue fields by pointing at
     // pre-allocated elements in message
+    com__seagate__kinetic__proto__command__range__init(&message->keyRange);
     message->command.body = &message->body;
     message->command.body->range = &message->keyRange;
 
@@ -27,6 +27,7 @@
 #include "kinetic_request.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/time.h>
 #include <stdio.h>
@@ -36,6 +37,7 @@
 #ifdef TEST
 uint8_t * msg = NULL;
 size_t msgSize = 0;
+bus_send_ticket ticket;
 #endif
 
 void KineticOperation_ValidateOperation(KineticOperation* op)
@@ -48,7 +50,13 @@ void KineticOperation_ValidateOperation(KineticOperation* op)
     KINETIC_ASSERT(op->request->command->header->has_sequence);
 }
 
-static KineticStatus send_request_in_lock(KineticOperation* const op);
+static KineticStatus pack_request_in_lock(KineticOperation* const op,
+    uint8_t** msg, size_t* msgSize);
+static KineticStatus queue_request_in_lock(KineticOperation* const op,
+    uint8_t** msg, size_t* msgSize, bus_send_ticket* ticket);
+static KineticStatus queue_requests_in_lock(KineticOperation* const * ops,
+    size_t count, uint8_t** msgs, size_t* msgSizes,
+    bus_send_ticket* tickets, size_t* queued);
 
 KineticStatus KineticOperation_SendRequest(KineticOperation* const op)
 {
@@ -58,8 +66,109 @@ KineticStatus KineticOperation_SendRequest(KineticOperation* const op)
     if (!KineticRequest_LockSend(session)) {
         return KINETIC_STATUS_CONNECTION_ERROR;
     }
-    KineticStatus status = send_request_in_lock(op);
+    #ifndef TEST
+    uint8_t * msg = NULL;
+    size_t msgSize = 0;
+    bus_send_ticket ticket;
+    #endif
+    KineticStatus status = queue_request_in_lock(op, &msg, &msgSize, &ticket);
     KineticRequest_UnlockSend(session);
+
+    /* Write it outside of the lock, so requests queued by other threads
+     * in the meantime can go out in the same write. */
+    if (status == KINETIC_STATUS_SUCCESS) {
+        if (!KineticRequest_FlushRequest(session, &ticket)) {
+            LOGF0("Failed sending request on fd=%d", session->socket);
+            /* The request was rejected outright, so the usual
+             * asynchronous, callback-based error handling will not
+             * be used. */
+            KineticCountingSemaphore_Give(session->outstandingOperations);
+            status = KINETIC_STATUS_REQUEST_REJECTED;
+        }
+    }
+
+    if (msg != NULL) { free(msg); }
+    return status;
+}
+
+/* Queue the request without waiting for it to be written; the bus's
+ * sender thread writes it, and the result is delivered through the
+ * operation's closure, as usual. */
+KineticStatus KineticOperation_SubmitRequest(KineticOperation* const op)
+{
+    KineticSession *session = op->session;
+    KineticOperation_ValidateOperation(op);
+
+    if (!KineticRequest_LockSend(session)) {
+        return KINETIC_STATUS_CONNECTION_ERROR;
+    }
+    #ifndef TEST
+    uint8_t * msg = NULL;
+    size_t msgSize = 0;
+    #endif
+    KineticStatus status = queue_request_in_lock(op, &msg, &msgSize, NULL);
+    KineticRequest_UnlockSend(session);
+
+    /* Once queued, the operation owns the message. */
+    if (status != KINETIC_STATUS_SUCCESS && msg != NULL) { free(msg); }
+    return status;
+}
+
+/* Send the requests for COUNT operations on the same session, in order.
+ * They are queued BUS_MAX_BATCH at a time under the send lock, then
+ * written together outside of it, as for KineticOperation_SendRequest.
+ * On return, SENT[i] says whether each was queued up for delivery; those
+ * will be completed through their closures as usual. The rest were not
+ * sent, and the returned status says why. */
+KineticStatus KineticOperation_SendRequests(KineticOperation* const * ops,
+    size_t count, bool* sent)
+{
+    KINETIC_ASSERT(ops);
+    KINETIC_ASSERT(count > 0);
+    KINETIC_ASSERT(sent);
+    for (size_t i = 0; i < count; i++) { sent[i] = false; }
+
+    KineticSession *session = ops[0]->session;
+    for (size_t i = 0; i < count; i++) {
+        KineticOperation_ValidateOperation(ops[i]);
+        KINETIC_ASSERT(ops[i]->session == session);
+    }
+
+    LOGF3("\nSending %zu PDUs via fd=%d", count, session->socket);
+    KineticStatus status = KINETIC_STATUS_SUCCESS;
+    size_t base = 0;
+    while (base < count && status == KINETIC_STATUS_SUCCESS) {
+        uint8_t * msgs[BUS_MAX_BATCH] = {NULL};
+        size_t msgSizes[BUS_MAX_BATCH] = {0};
+        bus_send_ticket tickets[BUS_MAX_BATCH];
+        memset(tickets, 0, sizeof(tickets));
+        size_t want = count - base;
+        if (want > BUS_MAX_BATCH) { want = BUS_MAX_BATCH; }
+
+        if (!KineticRequest_LockSend(session)) {
+            return KINETIC_STATUS_CONNECTION_ERROR;
+        }
+        size_t queued = 0;
+        status = queue_requests_in_lock(&ops[base], want,
+            msgs, msgSizes, tickets, &queued);
+        KineticRequest_UnlockSend(session);
+
+        /* Write them outside of the lock; the first flush normally sends
+         * the whole chunk, along with anything other threads queued. */
+        for (size_t i = 0; i < queued; i++) {
+            sent[base + i] = KineticRequest_FlushRequest(session, &tickets[i]);
+            if (!sent[base + i]) {
+                LOGF0("Failed sending request on fd=%d", session->socket);
+                KineticCountingSemaphore_Give(session->outstandingOperations);
+                status = KINETIC_STATUS_REQUEST_REJECTED;
+            }
+        }
+
+        for (size_t i = 0; i < want; i++) {
+            if (msgs[i] != NULL) { free(msgs[i]); }
+        }
+        base += queued;
+    }
     return status;
 }
 
@@ -83,61 +192,107 @@ static void log_request_seq_id(int fd, int64_t seq_id, KineticMessageType mt)
     #endif
 }
 
-/* Send request.
- * Note: This whole function operates with op->session->sendMutex locked. */
-static KineticStatus send_request_in_lock(KineticOperation* const op)
+/* Bind the request's sequence ID, authenticate it, and pack it.
+ * Note: This must be called with op->session->sendMutex locked, so that
+ * requests are sent in sequence ID order. */
+static KineticStatus pack_request_in_lock(KineticOperation* const op,
+    uint8_t** msg, size_t* msgSize)
 {
-    LOGF3("\nSending PDU via fd=%d", op->session->socket);
     KineticRequest* request = op->request;
 
     int64_t seq_id = KineticSession_GetNextSequenceCount(op->session);
     KINETIC_ASSERT(request->message.header.sequence == KINETIC_SEQUENCE_NOT_YET_BOUND);
     request->message.header.sequence = seq_id;
 
-    size_t expectedLen = KineticRequest_PackCommand(request);
-    if (expectedLen == KINETIC_REQUEST_PACK_FAILURE) {
-        return KINETIC_STATUS_MEMORY_ERROR;
-    }
-    uint8_t * commandData = request->message.message.commandbytes.data;
-
     log_request_seq_id(op->session->socket, seq_id, (KineticMessageType)request->message.header.messagetype);
 
     KineticSession *session = op->session;
     KineticStatus status = KineticRequest_PopulateAuthentication(&session->config,
         op->request, op->pin);
     if (status != KINETIC_STATUS_SUCCESS) {
-        if (commandData) { free(commandData); }
         return status;
     }
 
-    #ifndef TEST
-    uint8_t * msg = NULL;
-    size_t msgSize = 0;
-    #endif
-    status = KineticRequest_PackMessage(op, &msg, &msgSize);
+    return KineticRequest_PackMessage(op, msg, msgSize);
+}
+
+/* Pack the request and queue it to be sent, tracked by TICKET (or by
+ * the bus's sender thread, if TICKET is NULL).
+ * Note: This whole function operates with op->session->sendMutex locked. */
+static KineticStatus queue_request_in_lock(KineticOperation* const op,
+    uint8_t** msg, size_t* msgSize, bus_send_ticket* ticket)
+{
+    LOGF3("\nSending PDU via fd=%d", op->session->socket);
+    KineticRequest* request = op->request;
+
+    KineticStatus status = pack_request_in_lock(op, msg, msgSize);
     if (status != KINETIC_STATUS_SUCCESS) {
-        if (commandData) { free(commandData); }
         return status;
     }
 
-    if (commandData) { free(commandData); }
     KineticCountingSemaphore * const sem = op->session->outstandingOperations;
     KineticCountingSemaphore_Take(sem);  // limit total concurrent requests
+    if (op->session->window != NULL) { gettimeofday(&op->sentTime, NULL); }
+
+    /* Without a ticket, the operation may complete (and be freed) as soon
+     * as it is queued, so it has to own the message beforehand. */
+    if (ticket == NULL) { op->packedRequest = *msg; }
 
-    if (!KineticRequest_SendRequest(op, msg, msgSize)) {
+    if (!KineticRequest_QueueRequest(op, *msg, *msgSize, ticket)) {
+        op->packedRequest = NULL;
         LOGF0("Failed queuing request %p for transmit on fd=%d w/seq=%lld",
-            (void*)request, op->session->socket, (long long)seq_id);
-        /* A false result from bus_send_request means that the request was
+            (void*)request, op->session->socket,
+            (long long)request->message.header.sequence);
+        /* A false result from Bus_QueueRequest means that the request was
          * rejected outright, so the usual asynchronous, callback-based
          * error handling for errors during the request or response will
          * not be used. */
         KineticCountingSemaphore_Give(sem);
-        status = KINETIC_STATUS_REQUEST_REJECTED;
-    } else {
-        status = KINETIC_STATUS_SUCCESS;
+        return KINETIC_STATUS_REQUEST_REJECTED;
     }
+    return KINETIC_STATUS_SUCCESS;
+}
 
-    if (msg != NULL) { free(msg); }
+/* Pack and queue up to COUNT requests (at most BUS_MAX_BATCH), as many
+ * as the concurrent request limit allows at once, rather than waiting for
+ * a slot per request. Only requests that got a slot are packed, so their
+ * sequence IDs stay in order. Sets QUEUED to how many were queued, each
+ * tracked by the matching entry of TICKETS.
+ * Note: This whole function operates with the session's sendMutex locked. */
+static KineticStatus queue_requests_in_lock(KineticOperation* const * ops,
+    size_t count, uint8_t** msgs, size_t* msgSizes,
+    bus_send_ticket* tickets, size_t* queued)
+{
+    KineticSession *session = ops[0]->session;
+    KineticCountingSemaphore * const sem = session->outstandingOperations;
+    KINETIC_ASSERT(count <= BUS_MAX_BATCH);
+
+    uint32_t taken = KineticCountingSemaphore_TakeUpTo(sem, count);
+    struct timeval now;
+    if (session->window != NULL) { gettimeofday(&now, NULL); }
+
+    KineticStatus status = KINETIC_STATUS_SUCCESS;
+    size_t n = 0;
+    while (n < taken) {
+        KineticOperation* const op = ops[n];
+        status = pack_request_in_lock(op, &msgs[n], &msgSizes[n]);
+        if (status != KINETIC_STATUS_SUCCESS) { break; }
+        if (session->window != NULL) { op->sentTime = now; }
+        if (!KineticRequest_QueueRequest(op, msgs[n], msgSizes[n], &tickets[n])) {
+            LOGF0("Failed queuing request %p for transmit on fd=%d w/seq=%lld",
+                (void*)op->request, session->socket,
+                (long long)op->request->message.header.sequence);
+            status = KINETIC_STATUS_REQUEST_REJECTED;
+            break;
+        }
+        n++;
+    }
+
+    /* Give back the slots of any requests that were not queued. */
+    for (size_t i = n; i < taken; i++) {
+        KineticCountingSemaphore_Give(sem);
+    }
+    *queued = n;
     return status;
 }
 
@@ -150,6 +305,15 @@ KineticStatus KineticOperation_GetStatus(const KineticOperation* const op)
     return status;
 }
 
+static uint64_t elapsed_usec(struct timeval const * const since)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t usec = (int64_t)(now.tv_sec - since->tv_sec) * 1000000
+        + (now.tv_usec - since->tv_usec);
+    return (usec > 0) ? (uint64_t)usec : 0;
+}
+
 void KineticOperation_Complete(KineticOperation* op, KineticStatus status)
 {
     KINETIC_ASSERT(op);
@@ -158,6 +322,11 @@ void KineticOperation_Complete(KineticOperation* op, KineticStatus status)
     // ExecuteOperation should ensure a callback exists (either a user supplied one, or the a default)
     KineticCompletionData completionData = {.status = status};
 
+    // Let the window adapt to how long this took, before releasing it
+    if (op->session->window != NULL) {
+        KineticWindow_Update(op->session->window, status, elapsed_usec(&op->sentTime));
+    }
+
     // Release this request so that others can be unblocked if at max (request PDUs throttled)
     KineticCountingSemaphore_Give(op->session->outstandingOperations);
 
@@ -22,6 +22,8 @@
 
 void KineticOperation_ValidateOperation(KineticOperation* op);
 KineticStatus KineticOperation_SendRequest(KineticOperation* const op);
+KineticStatus KineticOperation_SubmitRequest(KineticOperation* const op);
+KineticStatus KineticOperation_SendRequests(KineticOperation* const * ops, size_t count, bool* sent);
 KineticStatus KineticOperation_GetStatus(const KineticOperation* const op);
 void KineticOperation_Complete(KineticOperation* op, KineticStatus status);
 
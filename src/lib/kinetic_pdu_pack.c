@@ -0,0 +1,110 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "kinetic_pdu_pack.h"
+#include "kinetic_hmac.h"
+#include "kinetic_nbo.h"
+#include "kinetic_logger.h"
+#include <string.h>
+
+/* Key for the Message's commandBytes field (7), which is length-delimited
+ * (wire type 2). It's the message's last field, so protobuf-c packs
+ * everything else before it. */
+#define COMMAND_BYTES_KEY ((7 << 3) | 2)
+
+static size_t pack_varint(uint64_t value, uint8_t* out)
+{
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+size_t KineticPDU_PackedLength(KineticRequest* request)
+{
+    KINETIC_ASSERT(request != NULL);
+    Com__Seagate__Kinetic__Proto__Message* proto = &request->message.message;
+
+    // Only the length of commandBytes matters for sizing; the data is
+    // filled in when it's packed.
+    proto->commandbytes = (ProtobufCBinaryData) {
+        .data = NULL,
+        .len = com__seagate__kinetic__proto__command__get_packed_size(&request->message.command),
+    };
+    proto->has_commandbytes = true;
+
+    return PDU_HEADER_LEN + com__seagate__kinetic__proto__message__get_packed_size(proto);
+}
+
+void KineticPDU_Pack(KineticRequest* request, uint32_t valueLength,
+    KineticHMACKey const * const key, uint8_t* buf, size_t length)
+{
+    KINETIC_ASSERT(request != NULL);
+    KINETIC_ASSERT(buf != NULL);
+    KINETIC_ASSERT(length > PDU_HEADER_LEN);
+    Com__Seagate__Kinetic__Proto__Message* proto = &request->message.message;
+    KINETIC_ASSERT(proto->has_commandbytes);
+    size_t commandLength = proto->commandbytes.len;
+
+    // PDU header
+    size_t offset = 0;
+    buf[offset++] = 'F';
+    uint32_t nboProtoLength = KineticNBO_FromHostU32(length - PDU_HEADER_LEN);
+    memcpy(&buf[offset], &nboProtoLength, sizeof(nboProtoLength));
+    offset += sizeof(nboProtoLength);
+    uint32_t nboValueLength = KineticNBO_FromHostU32(valueLength);
+    memcpy(&buf[offset], &nboValueLength, sizeof(nboValueLength));
+    offset += sizeof(nboValueLength);
+
+    // The authentication fields, which precede commandBytes
+    Com__Seagate__Kinetic__Proto__Message head = *proto;
+    head.has_commandbytes = false;
+    offset += com__seagate__kinetic__proto__message__pack(&head, &buf[offset]);
+
+    // The HMAC is the last field of hmacAuth, so it ends what was just
+    // packed. Its space is filled in once the command is packed.
+    uint8_t* hmacDest = NULL;
+    if (proto->has_authtype
+     && proto->authtype == COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH) {
+        KINETIC_ASSERT(key != NULL);
+        KINETIC_ASSERT(proto->hmacauth != NULL);
+        KINETIC_ASSERT(proto->hmacauth->has_hmac);
+        KINETIC_ASSERT(proto->hmacauth->hmac.len == KINETIC_HMAC_SHA1_LEN);
+        KINETIC_ASSERT(proto->pinauth == NULL);
+        hmacDest = &buf[offset - KINETIC_HMAC_SHA1_LEN];
+    }
+
+    // commandBytes, with the command packed in place
+    buf[offset++] = COMMAND_BYTES_KEY;
+    offset += pack_varint(commandLength, &buf[offset]);
+    proto->commandbytes.data = &buf[offset];
+    size_t packedLength = com__seagate__kinetic__proto__command__pack(
+        &request->message.command, &buf[offset]);
+    KINETIC_ASSERT(packedLength == commandLength);
+    offset += commandLength;
+    KINETIC_ASSERT(offset == length);
+
+    if (hmacDest != NULL) {
+        KineticHMAC hmac;
+        KineticHMAC_Init(&hmac, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
+        KineticHMAC_Populate(&hmac, proto, key);
+        memcpy(hmacDest, proto->hmacauth->hmac.data, KINETIC_HMAC_SHA1_LEN);
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef KINETIC_PDU_PACK_H
+#define KINETIC_PDU_PACK_H
+
+#include "kinetic_types_internal.h"
+
+/* Get the length of the request's packed PDU: the header and the
+ * message, including the command as its commandBytes, but not the value.
+ * This sizes the request's commandBytes, so it must be called once the
+ * request is complete, before KineticPDU_Pack. */
+size_t KineticPDU_PackedLength(KineticRequest* request);
+
+/* Pack the request's PDU into BUF, which must be LENGTH bytes long, as
+ * returned by KineticPDU_PackedLength. The command is packed once,
+ * directly into its place in the message, and the request's commandBytes
+ * are left pointing at it. If the message is HMAC authenticated, the
+ * HMAC is then computed over the packed command using KEY and written
+ * into the space reserved for it, so no intermediate buffers are used. */
+void KineticPDU_Pack(KineticRequest* request, uint32_t valueLength,
+    KineticHMACKey const * const key, uint8_t* buf, size_t length);
+
+#endif
@@ -21,42 +21,15 @@
 #include "kinetic_logger.h"
 #include "kinetic_session.h"
 #include "kinetic_auth.h"
-#include "kinetic_nbo.h"
+#include "kinetic_pdu_pack.h"
 #include "kinetic_controller.h"
 #include "byte_array.h"
 #include "bus.h"
 
 #ifdef TEST
-uint8_t *cmdBuf = NULL;
 uint8_t *msg = NULL;
 #endif
 
-size_t KineticRequest_PackCommand(KineticRequest* request)
-{
-    size_t expectedLen = com__seagate__kinetic__proto__command__get_packed_size(&request->message.command);
-    #ifndef TEST
-    uint8_t *cmdBuf = (uint8_t*)malloc(expectedLen);
-    #endif
-    if (cmdBuf == NULL)
-    {
-        LOGF0("Failed to allocate command bytes: %zd", expectedLen);
-        return KINETIC_REQUEST_PACK_FAILURE;
-    }
-    request->message.message.commandbytes.data = cmdBuf;
-
-    size_t packedLen = com__seagate__kinetic__proto__command__pack(
-        &request->message.command, cmdBuf);
-    KINETIC_ASSERT(packedLen == expectedLen);
-    request->message.message.commandbytes.len = packedLen;
-    request->message.message.has_commandbytes = true;
-    KineticLogger_LogByteArray(3, "commandbytes", (ByteArray){
-        .data = request->message.message.commandbytes.data,
-        .len = request->message.message.commandbytes.len,
-    });
-
-    return packedLen;
-}
-
 KineticStatus KineticRequest_PopulateAuthentication(KineticSessionConfig *config,
     KineticRequest *request, ByteArray *pin)
 {
@@ -70,40 +43,27 @@ KineticStatus KineticRequest_PopulateAuthentication(KineticSessionConfig *config
 KineticStatus KineticRequest_PackMessage(KineticOperation *operation,
     uint8_t **out_msg, size_t *msgSize)
 {
-    // Configure PDU header
-    Com__Seagate__Kinetic__Proto__Message* proto = &operation->request->message.message;
-    KineticPDUHeader header = {
-        .versionPrefix = 'F',
-        .protobufLength = com__seagate__kinetic__proto__message__get_packed_size(proto)
-    };
-    header.valueLength = operation->value.len;
-    uint32_t nboProtoLength = KineticNBO_FromHostU32(header.protobufLength);
-    uint32_t nboValueLength = KineticNBO_FromHostU32(header.valueLength);
+    KineticRequest* request = operation->request;
+    size_t packedLen = KineticPDU_PackedLength(request);
 
-    // Allocate and pack protobuf message
-    size_t offset = 0;
+    // Allocate the message's only buffer, and pack directly into it
     #ifndef TEST
-    uint8_t *msg = malloc(PDU_HEADER_LEN + header.protobufLength + header.valueLength);
+    uint8_t *msg = malloc(packedLen);
     #endif
     if (msg == NULL) {
         LOG0("Failed to allocate outgoing message!");
         return KINETIC_STATUS_MEMORY_ERROR;
     }
-
-    // Pack header
-    KineticRequest* request = operation->request;
-    msg[offset] = header.versionPrefix;
-    offset += sizeof(header.versionPrefix);
-    memcpy(&msg[offset], &nboProtoLength, sizeof(nboProtoLength));
-    offset += sizeof(nboProtoLength);
-    memcpy(&msg[offset], &nboValueLength, sizeof(nboValueLength));
-    offset += sizeof(nboValueLength);
-    size_t len = com__seagate__kinetic__proto__message__pack(&request->message.message, &msg[offset]);
-    KINETIC_ASSERT(len == header.protobufLength);
-    offset += header.protobufLength;
+    KineticPDU_Pack(request, operation->value.len,
+        &operation->session->hmacKey, msg, packedLen);
 
     #ifndef TEST
     // Log protobuf per configuration
+    KineticPDUHeader header = {
+        .versionPrefix = 'F',
+        .protobufLength = packedLen - PDU_HEADER_LEN,
+        .valueLength = operation->value.len,
+    };
     LOGF2("[PDU TX] pdu: %p, session: %p, bus: %p, "
         "fd: %6d, seq: %8lld, protoLen: %8u, valueLen: %8u, op: %p, msgType: %02x",
         (void*)operation->request,
@@ -112,37 +72,77 @@ KineticStatus KineticRequest_PackMessage(KineticOperation *operation,
         header.protobufLength, header.valueLength,
         (void*)operation, request->message.header.messagetype);
     KineticLogger_LogHeader(3, &header);
-    KineticLogger_LogProtobuf(3, proto);
+    KineticLogger_LogProtobuf(3, &request->message.message);
     #endif
 
-    // Pack value payload, if supplied
-    if (header.valueLength > 0) {
-        memcpy(&msg[offset], operation->value.data, operation->value.len);
-        offset += operation->value.len;
-    }
-    KINETIC_ASSERT((PDU_HEADER_LEN + header.protobufLength + header.valueLength) == offset);
-
+    // The value payload is not copied; KineticRequest_QueueRequest
+    // sends it directly from operation->value.
     *out_msg = msg;
-    *msgSize = offset;
+    *msgSize = packedLen;
     return KINETIC_STATUS_SUCCESS;
 }
 
-bool KineticRequest_SendRequest(KineticOperation *operation,
-    uint8_t *msg, size_t msgSize)
+/* Can the operation be completed on the listener thread? Completion
+ * includes unpacking the response and running the operation's callback,
+ * so besides the closure, the operation itself has to be cheap to
+ * finish: PUT, DELETE, NOOP and FLUSHALLDATA, and GETs of small values
+ * that aren't checked against their tag. Everything else (tag-checked
+ * or large GETs, GETLOG, GETKEYRANGE, P2P, admin operations) is left to
+ * the threadpool, so it can't stall the listener's other sockets. */
+STATIC bool inline_completion(KineticOperation const * const operation)
+{
+    if (!operation->session->config.inlineCompletion ||
+        !operation->closure.nonBlocking) {
+        return false;
+    }
+
+    KineticEntry const * const entry = operation->entry;
+    switch (operation->request->message.header.messagetype) {
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PUT:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__DELETE:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__NOOP:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__FLUSHALLDATA:
+        return true;
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GET:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETNEXT:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETPREVIOUS:
+    case COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETVERSION:
+        return entry != NULL && !entry->computeTag &&
+            (entry->metadataOnly ||
+             entry->value.array.len <= KINETIC_INLINE_COMPLETION_MAX_VALUE_LEN);
+    default:
+        return false;
+    }
+}
+
+bool KineticRequest_QueueRequest(KineticOperation *operation,
+    uint8_t *msg, size_t msgSize, bus_send_ticket *ticket)
 {
     KINETIC_ASSERT(msg);
     KINETIC_ASSERT(msgSize > 0);
+    struct iovec iov[] = {
+        {.iov_base = msg, .iov_len = msgSize},
+        {.iov_base = operation->value.data, .iov_len = operation->value.len},
+    };
     bus_user_msg bus_msg = {
         .fd       = operation->session->socket,
         .type     = BUS_SOCKET_PLAIN,
         .seq_id   = operation->request->message.header.sequence,
-        .msg      = msg,
-        .msg_size = msgSize,
+        .msg_iov  = iov,
+        .msg_iovcnt = (operation->value.len > 0) ? 2 : 1,
         .cb       = KineticController_HandleResult,
         .udata    = operation,
+        .inline_cb = inline_completion(operation),
         .timeout_sec = operation->timeoutSeconds,
+        .timeout_msec = operation->timeoutMsec,
     };
-    return Bus_SendRequest(operation->session->messageBus, &bus_msg);
+    return Bus_QueueRequest(operation->session->messageBus, &bus_msg, ticket);
+}
+
+bool KineticRequest_FlushRequest(KineticSession *session, bus_send_ticket *ticket)
+{
+    KINETIC_ASSERT(session);
+    return Bus_FlushRequest(session->messageBus, ticket);
 }
 
 bool KineticRequest_LockSend(KineticSession* session)
@@ -19,33 +19,43 @@
 #define KINETIC_REQUEST_H
 
 #include "kinetic_types_internal.h"
-
-/* Special 'failed to pack' sentinel. */
-#define KINETIC_REQUEST_PACK_FAILURE ((size_t)-1)
-
-/* Pack the command into request->message.message.commandBytes.data.
- * Returns the allocated size,
- * or KINETIC_REQUEST_PACK_FAILURE on malloc failure. */
-size_t KineticRequest_PackCommand(KineticRequest* request);
+#include "bus_types.h"
 
 /* Populate the request's authentication info. If PIN is non-NULL,
  * use PIN authentication, otherwise use HMAC. */
 KineticStatus KineticRequest_PopulateAuthentication(KineticSessionConfig *config,
     KineticRequest *request, ByteArray *pin);
 
-/* Pack the header, command, and value (if any), allocating a buffer and
- * returning the buffer and its size in *msg and *msgSize.
+/* Pack the header and message, including the command and its HMAC (if
+ * any), into a single newly allocated buffer, returning the buffer and
+ * its size in *msg and *msgSize. The value (if any) is not
+ * copied into the buffer; it is sent from operation->value.
  * Returns KINETIC_STATUS_SUCCESS on success, or KINETIC_STATUS_MEMORY_ERROR
  * on allocation failure. */
 KineticStatus KineticRequest_PackMessage(KineticOperation *operation,
     uint8_t **msg, size_t *msgSize);
 
-/* Send the request. Returns whether the request was successfully queued
- * up for delivery, or whether it was rejected due to invalid arguments.
- * If this returns false, then the asynchronous result callback will
- * not be called. */
-bool KineticRequest_SendRequest(KineticOperation *operation,
-    uint8_t *msg, size_t msgSize);
+/* Queue the request to be sent, gathering the packed MSG and the
+ * operation's value (which must not change until the operation
+ * completes). Requests are sent in the order they are queued, so this
+ * must be called with the send lock held.
+ * Returns false if the request was rejected due to invalid arguments, in
+ * which case the asynchronous result callback will not be called.
+ * Otherwise, TICKET must be passed to KineticRequest_FlushRequest, and
+ * MSG must be kept until then. If TICKET is NULL, the bus's sender thread
+ * writes the request instead, and MSG must be kept until the operation
+ * completes. */
+bool KineticRequest_QueueRequest(KineticOperation *operation,
+    uint8_t *msg, size_t msgSize, bus_send_ticket *ticket);
+
+/* Wait until a queued request has been sent, writing it (and any others
+ * queued on the session) if no other thread is already. This should be
+ * called without the send lock held, so other threads can queue requests
+ * to be written along with it. The operation may complete before this
+ * returns, so it must not be touched afterward.
+ * Returns whether the request was queued up for delivery; if this returns
+ * false, then the asynchronous result callback will not be called. */
+bool KineticRequest_FlushRequest(KineticSession *session, bus_send_ticket *ticket);
 
 bool KineticRequest_LockSend(KineticSession* session);
 bool KineticRequest_UnlockSend(KineticSession* session);
@@ -26,7 +26,10 @@
 #include "kinetic_allocator.h"
 #include "kinetic_controller.h"
 #include "kinetic_pdu_unpack.h"
+#include "kinetic_arena.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 uint32_t KineticResponse_GetProtobufLength(KineticResponse * response)
@@ -97,3 +100,474 @@ Com__Seagate__Kinetic__Proto__Command__Range* KineticResponse_GetKeyRange(Kineti
     }
     return range;
 }
+
+/* If set, every response decoded by the fast path is also unpacked by
+ * protobuf-c, and the two are asserted to match. This is for debug builds
+ * (`make VALIDATE_DECODE=1`), since it costs more than either alone. */
+#ifndef KINETIC_VALIDATE_DECODE
+#define KINETIC_VALIDATE_DECODE 0
+#endif
+
+/* Protobuf wire types. Groups aren't used by kinetic. */
+enum {
+    WIRE_TYPE_VARINT = 0,
+    WIRE_TYPE_64BIT = 1,
+    WIRE_TYPE_LENGTH_DELIMITED = 2,
+    WIRE_TYPE_32BIT = 5,
+};
+
+/* A field read from a packed protobuf message. */
+typedef struct {
+    uint32_t number;
+    uint8_t type;
+    uint64_t value;             ///< value of a varint field
+    ProtobufCBinaryData bytes;  ///< contents of a length-delimited field
+} wire_field;
+
+static bool read_varint(uint8_t const ** pos, uint8_t const * end, uint64_t * value)
+{
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos == end) { return false; }
+        uint8_t b = *(*pos)++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Read the field at *POS into FIELD, advancing *POS past it. Returns
+ * false if it's malformed, or runs past END. */
+static bool read_field(uint8_t const ** pos, uint8_t const * end, wire_field * field)
+{
+    uint64_t tag, len;
+    if (!read_varint(pos, end, &tag) || (tag >> 3) > UINT32_MAX) { return false; }
+    field->number = (uint32_t)(tag >> 3);
+    field->type = tag & 0x7;
+
+    switch (field->type) {
+    case WIRE_TYPE_VARINT:
+        return read_varint(pos, end, &field->value);
+    case WIRE_TYPE_64BIT:
+        if (end - *pos < 8) { return false; }
+        *pos += 8;
+        return true;
+    case WIRE_TYPE_LENGTH_DELIMITED:
+        if (!read_varint(pos, end, &len) || len > (uint64_t)(end - *pos)) { return false; }
+        field->bytes = (ProtobufCBinaryData) {
+            .data = (uint8_t *)*pos,
+            .len = (size_t)len,
+        };
+        *pos += len;
+        return true;
+    case WIRE_TYPE_32BIT:
+        if (end - *pos < 4) { return false; }
+        *pos += 4;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Find the last occurrence of field NUMBER in the packed message DATA,
+ * as protobuf-c would unpack it, and check it has wire type TYPE.
+ * Returns false if the field isn't present, or the message is malformed. */
+static bool scan_field(uint8_t const * data, size_t len, uint32_t number,
+    uint8_t type, wire_field * found)
+{
+    uint8_t const * pos = data;
+    uint8_t const * const end = data + len;
+    bool present = false;
+
+    while (pos < end) {
+        wire_field field;
+        if (!read_field(&pos, end, &field)) { return false; }
+        if (field.number == number) {
+            *found = field;
+            present = true;
+        }
+    }
+    return present && found->type == type;
+}
+
+bool KineticResponse_ScanAckSequence(uint8_t const * protobuf, size_t len,
+    int64_t * ackSequence, bool * unsolicited)
+{
+    KINETIC_ASSERT(ackSequence);
+    KINETIC_ASSERT(unsolicited);
+
+    wire_field authType, command, header, ack;
+    *unsolicited = (scan_field(protobuf, len, 4, WIRE_TYPE_VARINT, &authType) &&
+        authType.value == COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__UNSOLICITEDSTATUS);
+
+    if (!scan_field(protobuf, len, 7, WIRE_TYPE_LENGTH_DELIMITED, &command) ||
+        !scan_field(command.bytes.data, command.bytes.len, 1, WIRE_TYPE_LENGTH_DELIMITED, &header))
+    {
+        return false;
+    }
+
+    /* Defaults to 0 if absent, as when unpacked. */
+    *ackSequence = (scan_field(header.bytes.data, header.bytes.len, 6, WIRE_TYPE_VARINT, &ack)
+        ? (int64_t)ack.value : 0);
+    return true;
+}
+
+/* The fast path decodes fields the way protobuf-c does: the last
+ * occurrence of a scalar field wins, enums keep the low 32 bits, and
+ * empty bytes fields are NULL. Anything it doesn't handle (an unknown
+ * field, a repeated message to merge, or a body other than keyValue)
+ * makes it give up, and the response is unpacked by protobuf-c. */
+
+static bool varint_field(wire_field const * field, protobuf_c_boolean * has)
+{
+    *has = true;
+    return field->type == WIRE_TYPE_VARINT;
+}
+
+static bool bytes_field(wire_field const * field, protobuf_c_boolean * has,
+    ProtobufCBinaryData * bytes)
+{
+    *has = true;
+    *bytes = (ProtobufCBinaryData) {
+        .data = (field->bytes.len > 0 ? field->bytes.data : NULL),
+        .len = field->bytes.len,
+    };
+    return field->type == WIRE_TYPE_LENGTH_DELIMITED;
+}
+
+static bool decode_hmac_auth(ProtobufCBinaryData const * data,
+    Com__Seagate__Kinetic__Proto__Message__HMACauth * hmacAuth)
+{
+    *hmacAuth = (Com__Seagate__Kinetic__Proto__Message__HMACauth)
+        COM__SEAGATE__KINETIC__PROTO__MESSAGE__HMACAUTH__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        bool ok = false;
+        switch (f.number) {
+        case 1:     // identity
+            ok = varint_field(&f, &hmacAuth->has_identity);
+            hmacAuth->identity = (int64_t)f.value;
+            break;
+        case 2:     // hmac
+            ok = bytes_field(&f, &hmacAuth->has_hmac, &hmacAuth->hmac);
+            break;
+        }
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+static bool decode_header(ProtobufCBinaryData const * data,
+    Com__Seagate__Kinetic__Proto__Command__Header * header)
+{
+    *header = (Com__Seagate__Kinetic__Proto__Command__Header)
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        bool ok = false;
+        switch (f.number) {
+        case 1:     // clusterVersion
+            ok = varint_field(&f, &header->has_clusterversion);
+            header->clusterversion = (int64_t)f.value;
+            break;
+        case 3:     // connectionID
+            ok = varint_field(&f, &header->has_connectionid);
+            header->connectionid = (int64_t)f.value;
+            break;
+        case 4:     // sequence
+            ok = varint_field(&f, &header->has_sequence);
+            header->sequence = (int64_t)f.value;
+            break;
+        case 6:     // ackSequence
+            ok = varint_field(&f, &header->has_acksequence);
+            header->acksequence = (int64_t)f.value;
+            break;
+        case 7:     // messageType
+            ok = varint_field(&f, &header->has_messagetype);
+            header->messagetype = (Com__Seagate__Kinetic__Proto__Command__MessageType)(int32_t)f.value;
+            break;
+        case 9:     // timeout
+            ok = varint_field(&f, &header->has_timeout);
+            header->timeout = (int64_t)f.value;
+            break;
+        case 10:    // earlyExit
+            ok = varint_field(&f, &header->has_earlyexit);
+            header->earlyexit = (f.value != 0);
+            break;
+        case 12:    // priority
+            ok = varint_field(&f, &header->has_priority);
+            header->priority = (Com__Seagate__Kinetic__Proto__Command__Priority)(int32_t)f.value;
+            break;
+        case 13:    // TimeQuanta
+            ok = varint_field(&f, &header->has_timequanta);
+            header->timequanta = (int64_t)f.value;
+            break;
+        }
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+static bool decode_key_value(ProtobufCBinaryData const * data,
+    Com__Seagate__Kinetic__Proto__Command__KeyValue * keyValue)
+{
+    *keyValue = (Com__Seagate__Kinetic__Proto__Command__KeyValue)
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__KEY_VALUE__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        bool ok = false;
+        switch (f.number) {
+        case 2:     // newVersion
+            ok = bytes_field(&f, &keyValue->has_newversion, &keyValue->newversion);
+            break;
+        case 3:     // key
+            ok = bytes_field(&f, &keyValue->has_key, &keyValue->key);
+            break;
+        case 4:     // dbVersion
+            ok = bytes_field(&f, &keyValue->has_dbversion, &keyValue->dbversion);
+            break;
+        case 5:     // tag
+            ok = bytes_field(&f, &keyValue->has_tag, &keyValue->tag);
+            break;
+        case 6:     // algorithm
+            ok = varint_field(&f, &keyValue->has_algorithm);
+            keyValue->algorithm = (Com__Seagate__Kinetic__Proto__Command__Algorithm)(int32_t)f.value;
+            break;
+        case 7:     // metadataOnly
+            ok = varint_field(&f, &keyValue->has_metadataonly);
+            keyValue->metadataonly = (f.value != 0);
+            break;
+        case 8:     // force
+            ok = varint_field(&f, &keyValue->has_force);
+            keyValue->force = (f.value != 0);
+            break;
+        case 9:     // synchronization
+            ok = varint_field(&f, &keyValue->has_synchronization);
+            keyValue->synchronization = (Com__Seagate__Kinetic__Proto__Command__Synchronization)(int32_t)f.value;
+            break;
+        }
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+static bool decode_body(ProtobufCBinaryData const * data, KineticResponseFields * fields)
+{
+    Com__Seagate__Kinetic__Proto__Command__Body * body = &fields->body;
+    *body = (Com__Seagate__Kinetic__Proto__Command__Body)
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__BODY__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        if (f.number != 1 ||    // keyValue
+            f.type != WIRE_TYPE_LENGTH_DELIMITED ||
+            body->keyvalue != NULL ||
+            !decode_key_value(&f.bytes, &fields->keyValue))
+        {
+            return false;
+        }
+        body->keyvalue = &fields->keyValue;
+    }
+    return true;
+}
+
+static bool decode_status(ProtobufCBinaryData const * data, KineticResponseFields * fields)
+{
+    Com__Seagate__Kinetic__Proto__Command__Status * status = &fields->status;
+    *status = (Com__Seagate__Kinetic__Proto__Command__Status)
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__STATUS__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        bool ok = false;
+        switch (f.number) {
+        case 1:     // code
+            ok = varint_field(&f, &status->has_code);
+            status->code = (Com__Seagate__Kinetic__Proto__Command__Status__StatusCode)(int32_t)f.value;
+            break;
+        case 2:     // statusMessage, which needs a terminating NUL
+            ok = (f.type == WIRE_TYPE_LENGTH_DELIMITED &&
+                f.bytes.len <= KINETIC_RESPONSE_STATUS_MESSAGE_MAX_LEN);
+            if (ok) {
+                memcpy(fields->statusMessage, f.bytes.data, f.bytes.len);
+                fields->statusMessage[f.bytes.len] = '\0';
+                status->statusmessage = fields->statusMessage;
+            }
+            break;
+        case 3:     // detailedMessage
+            ok = bytes_field(&f, &status->has_detailedmessage, &status->detailedmessage);
+            break;
+        }
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+static bool decode_command(ProtobufCBinaryData const * data, KineticResponseFields * fields)
+{
+    Com__Seagate__Kinetic__Proto__Command * command = &fields->command;
+    *command = (Com__Seagate__Kinetic__Proto__Command)
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    uint8_t const * pos = data->data;
+    uint8_t const * const end = pos + data->len;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f) || f.type != WIRE_TYPE_LENGTH_DELIMITED) { return false; }
+        switch (f.number) {
+        case 1:     // header
+            if (command->header != NULL || !decode_header(&f.bytes, &fields->header)) { return false; }
+            command->header = &fields->header;
+            break;
+        case 2:     // body
+            if (command->body != NULL || !decode_body(&f.bytes, fields)) { return false; }
+            command->body = &fields->body;
+            break;
+        case 3:     // status
+            if (command->status != NULL || !decode_status(&f.bytes, fields)) { return false; }
+            command->status = &fields->status;
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Decode RESPONSE's protobuf into its fields, if the fast path handles it. */
+static bool decode_fast(KineticResponse * response)
+{
+    KineticResponseFields * fields = &response->fields;
+    Com__Seagate__Kinetic__Proto__Message * message = &fields->message;
+    *message = (Com__Seagate__Kinetic__Proto__Message)
+        COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    uint8_t const * pos = response->protobuf;
+    uint8_t const * const end = pos + response->header.protobufLength;
+
+    while (pos < end) {
+        wire_field f;
+        if (!read_field(&pos, end, &f)) { return false; }
+        bool ok = false;
+        switch (f.number) {
+        case 4:     // authType
+            ok = varint_field(&f, &message->has_authtype);
+            message->authtype = (Com__Seagate__Kinetic__Proto__Message__AuthType)(int32_t)f.value;
+            break;
+        case 5:     // hmacAuth
+            ok = (f.type == WIRE_TYPE_LENGTH_DELIMITED &&
+                message->hmacauth == NULL &&
+                decode_hmac_auth(&f.bytes, &fields->hmacAuth));
+            message->hmacauth = &fields->hmacAuth;
+            break;
+        case 7:     // commandBytes
+            ok = bytes_field(&f, &message->has_commandbytes, &message->commandbytes);
+            break;
+        }
+        if (!ok) { return false; }
+    }
+
+    if (message->has_commandbytes && message->commandbytes.len > 0) {
+        if (!decode_command(&message->commandbytes, fields)) { return false; }
+        response->command = &fields->command;
+    } else {
+        response->command = NULL;
+    }
+    response->proto = message;
+    return true;
+}
+
+#if KINETIC_VALIDATE_DECODE
+static bool same_packed(ProtobufCMessage const * a, ProtobufCMessage const * b)
+{
+    size_t len = protobuf_c_message_get_packed_size(a);
+    if (len != protobuf_c_message_get_packed_size(b)) { return false; }
+    uint8_t * buf = malloc(2 * len);
+    KINETIC_ASSERT(buf != NULL);
+    protobuf_c_message_pack(a, buf);
+    protobuf_c_message_pack(b, &buf[len]);
+    bool same = (memcmp(buf, &buf[len], len) == 0);
+    free(buf);
+    return same;
+}
+
+/* Check the fast path decoded RESPONSE as protobuf-c does, by unpacking
+ * it again and comparing what each packs back into. */
+static void validate_decode(KineticResponse const * response)
+{
+    KineticArena arena;
+    KineticArena_Init(&arena, 0);
+    Com__Seagate__Kinetic__Proto__Message * proto = KineticPDU_unpack_message(
+        &arena.allocator, response->header.protobufLength, response->protobuf);
+    bool same = (proto != NULL && same_packed(&proto->base, &response->proto->base));
+    KINETIC_ASSERT(same);
+
+    Com__Seagate__Kinetic__Proto__Command * command = NULL;
+    if (proto != NULL && proto->has_commandbytes && proto->commandbytes.len > 0) {
+        command = KineticPDU_unpack_command(&arena.allocator,
+            proto->commandbytes.len, proto->commandbytes.data);
+    }
+    same = (command == NULL
+        ? response->command == NULL
+        : response->command != NULL && same_packed(&command->base, &response->command->base));
+    KINETIC_ASSERT(same);
+    (void)same;
+    KineticArena_Reset(&arena);
+}
+#endif
+
+bool KineticResponse_Unpack(KineticResponse * response)
+{
+    KINETIC_ASSERT(response);
+    if (response->proto != NULL) { return true; }
+
+    if (decode_fast(response)) {
+        #if KINETIC_VALIDATE_DECODE
+        validate_decode(response);
+        #endif
+        return true;
+    }
+    response->proto = NULL;
+    response->command = NULL;
+
+    /* Both are unpacked into one arena, freed along with the response.
+     * Unpacking copies the command bytes, and the message and command
+     * structs together take about as much again. */
+    uint32_t len = response->header.protobufLength;
+    KineticArena_Init(&response->arena, 2 * len + KINETIC_ARENA_MIN_CHUNK_SIZE);
+    ProtobufCAllocator * allocator = &response->arena.allocator;
+
+    response->proto = KineticPDU_unpack_message(allocator, len, response->protobuf);
+    if (response->proto == NULL) {
+        LOG0("Failed unpacking response protobuf!");
+        return false;
+    }
+    if (response->proto->has_commandbytes &&
+        response->proto->commandbytes.data != NULL &&
+        response->proto->commandbytes.len > 0)
+    {
+        response->command = KineticPDU_unpack_command(allocator,
+            response->proto->commandbytes.len, response->proto->commandbytes.data);
+    }
+    return true;
+}
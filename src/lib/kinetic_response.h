@@ -27,4 +27,20 @@ int64_t KineticResponse_GetConnectionID(KineticResponse * response);
 Com__Seagate__Kinetic__Proto__Command__KeyValue* KineticResponse_GetKeyValue(KineticResponse * response);
 Com__Seagate__Kinetic__Proto__Command__Range* KineticResponse_GetKeyRange(KineticResponse * response);
 
+/* Get the ackSequence of a packed response protobuf, without unpacking
+ * it, so the listener can route the response cheaply. UNSOLICITED is set
+ * if it's an unsolicited status. Returns false if the response has no
+ * command header, or is malformed. */
+bool KineticResponse_ScanAckSequence(uint8_t const * protobuf, size_t len,
+    int64_t * ackSequence, bool * unsolicited);
+
+/* Unpack the response's protobuf and command, unless already unpacked.
+ * This is left to the operation's completion, so it happens on a worker
+ * thread rather than the listener. Responses with at most a keyValue body
+ * (GET, PUT, DELETE, NOOP and the like) are decoded into response->fields
+ * without allocating; anything else is unpacked by protobuf-c. Returns
+ * false if the protobuf couldn't be unpacked; the command is left NULL if
+ * there isn't a valid one. */
+bool KineticResponse_Unpack(KineticResponse * response);
+
 #endif // _KINETIC_RESPONSE_H
@@ -0,0 +1,157 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "kinetic_response_pool.h"
+#include "kinetic_response_pool_types.h"
+#include "kinetic_types_internal.h"
+#include "kinetic_logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Size class for values too large to pool; these go straight to the heap. */
+#define UNPOOLED_CLASS KINETIC_RESPONSE_POOL_CLASSES
+
+static size_t class_capacity(uint8_t sizeClass)
+{
+    return (size_t)1 << (sizeClass + KINETIC_RESPONSE_POOL_MIN_CLASS2);
+}
+
+/* Get the smallest size class whose capacity fits VALUELENGTH, or
+ * UNPOOLED_CLASS if none do. */
+STATIC uint8_t size_class(size_t valueLength)
+{
+    if (valueLength <= class_capacity(0)) { return 0; }
+    unsigned bits = 64 - __builtin_clzll((unsigned long long)(valueLength - 1));
+    unsigned sizeClass = bits - KINETIC_RESPONSE_POOL_MIN_CLASS2;
+    return (sizeClass < KINETIC_RESPONSE_POOL_CLASSES ? sizeClass : UNPOOLED_CLASS);
+}
+
+static KineticResponsePoolClass * get_class(KineticResponsePool * const pool, uint8_t sizeClass)
+{
+    return (sizeClass == UNPOOLED_CLASS ? &pool->unpooled : &pool->classes[sizeClass]);
+}
+
+KineticResponsePool * KineticResponsePool_Create(void)
+{
+    KineticResponsePool * pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) { return NULL; }
+
+    for (uint8_t i = 0; i < KINETIC_RESPONSE_POOL_CLASSES; i++) {
+        KineticResponsePoolClass * c = &pool->classes[i];
+        pthread_mutex_init(&c->mutex, NULL);
+        size_t max = KINETIC_RESPONSE_POOL_CLASS_BYTES / class_capacity(i);
+        if (max > KINETIC_RESPONSE_POOL_CLASS_COUNT) { max = KINETIC_RESPONSE_POOL_CLASS_COUNT; }
+        c->max = (uint32_t)max;
+    }
+    pthread_mutex_init(&pool->unpooled.mutex, NULL);
+    return pool;
+}
+
+void KineticResponsePool_Destroy(KineticResponsePool * const pool)
+{
+    if (pool == NULL) { return; }
+    for (uint8_t i = 0; i < KINETIC_RESPONSE_POOL_CLASSES; i++) {
+        KineticResponsePoolClass * c = &pool->classes[i];
+        KineticResponse * response = c->free;
+        while (response) {
+            KineticResponse * next = response->nextFree;
+            free(response);
+            response = next;
+        }
+        pthread_mutex_destroy(&c->mutex);
+    }
+    pthread_mutex_destroy(&pool->unpooled.mutex);
+    free(pool);
+}
+
+KineticResponse * KineticResponsePool_Alloc(KineticResponsePool * const pool,
+    size_t const valueLength)
+{
+    KINETIC_ASSERT(pool != NULL);
+    uint8_t sizeClass = size_class(valueLength);
+    KineticResponsePoolClass * c = get_class(pool, sizeClass);
+
+    pthread_mutex_lock(&c->mutex);
+    KineticResponse * response = c->free;
+    if (response) {
+        c->free = response->nextFree;
+        c->count--;
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (response == NULL) {
+        size_t capacity = (sizeClass == UNPOOLED_CLASS
+            ? valueLength : class_capacity(sizeClass));
+        response = malloc(sizeof(*response) + capacity);
+        if (response == NULL) {
+            LOGF0("Failed allocating response with %zu byte value!", valueLength);
+            return NULL;
+        }
+    }
+
+    /* The value is always overwritten by the caller, so skip zeroing it. */
+    memset(response, 0, sizeof(*response));
+    response->pool = pool;
+    response->sizeClass = sizeClass;
+    return response;
+}
+
+void KineticResponsePool_Free(KineticResponse * const response)
+{
+    KINETIC_ASSERT(response != NULL);
+    KINETIC_ASSERT(response->pool != NULL);
+    KineticResponsePoolClass * c = get_class(response->pool, response->sizeClass);
+
+    pthread_mutex_lock(&c->mutex);
+    bool cache = (c->count < c->max);
+    if (cache) {
+        response->nextFree = c->free;
+        c->free = response;
+        c->count++;
+        c->recycled++;
+    } else {
+        c->released++;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (!cache) { free(response); }
+}
+
+void KineticResponsePool_GetStats(KineticResponsePool * const pool,
+    KineticResponsePoolStats * const stats)
+{
+    KINETIC_ASSERT(pool != NULL);
+    KINETIC_ASSERT(stats != NULL);
+    memset(stats, 0, sizeof(*stats));
+
+    for (uint8_t i = 0; i <= KINETIC_RESPONSE_POOL_CLASSES; i++) {
+        KineticResponsePoolClass * c = get_class(pool, i);
+        pthread_mutex_lock(&c->mutex);
+        stats->hits += c->hits;
+        stats->misses += c->misses;
+        stats->recycled += c->recycled;
+        stats->released += c->released;
+        if (i != UNPOOLED_CLASS) {
+            stats->cachedBytes += c->count * (sizeof(KineticResponse) + class_capacity(i));
+        }
+        pthread_mutex_unlock(&c->mutex);
+    }
+    stats->allocations = stats->hits + stats->misses;
+}
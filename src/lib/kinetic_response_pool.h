@@ -0,0 +1,54 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef _KINETIC_RESPONSE_POOL_H
+#define _KINETIC_RESPONSE_POOL_H
+
+#include "kinetic_types.h"
+#include <stddef.h>
+
+/* Responses are pooled in size classes by value capacity, from
+ * 64 bytes up to 1 MiB (the largest value a PDU can carry). */
+#define KINETIC_RESPONSE_POOL_MIN_CLASS2 6
+#define KINETIC_RESPONSE_POOL_CLASSES 15
+
+/* Max bytes of value capacity cached per size class, and max number of
+ * responses cached per size class. */
+#define KINETIC_RESPONSE_POOL_CLASS_BYTES (4 * 1024 * 1024)
+#define KINETIC_RESPONSE_POOL_CLASS_COUNT 256
+
+typedef struct _KineticResponsePool KineticResponsePool;
+struct _KineticResponse;
+
+KineticResponsePool * KineticResponsePool_Create(void);
+
+/* Free the pool and all cached responses. Every response allocated from
+ * the pool must have been freed first. */
+void KineticResponsePool_Destroy(KineticResponsePool * const pool);
+
+/* Allocate a response with room for a VALUELENGTH byte value. The
+ * response header is zeroed, but the value bytes are not. */
+struct _KineticResponse * KineticResponsePool_Alloc(KineticResponsePool * const pool,
+    size_t const valueLength);
+
+/* Return a response allocated by KineticResponsePool_Alloc to its pool. */
+void KineticResponsePool_Free(struct _KineticResponse * const response);
+
+void KineticResponsePool_GetStats(KineticResponsePool * const pool,
+    KineticResponsePoolStats * const stats);
+
+#endif // _KINETIC_RESPONSE_POOL_H
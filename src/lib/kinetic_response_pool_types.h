@@ -0,0 +1,41 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef _KINETIC_RESPONSE_POOL_TYPES_H
+#define _KINETIC_RESPONSE_POOL_TYPES_H
+
+#include "kinetic_response_pool.h"
+#include <pthread.h>
+#include <stdint.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+    struct _KineticResponse * free; ///< cached responses, linked through nextFree
+    uint32_t count;                 ///< number of cached responses
+    uint32_t max;                   ///< max number of cached responses
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t recycled;
+    uint64_t released;
+} KineticResponsePoolClass;
+
+struct _KineticResponsePool {
+    KineticResponsePoolClass classes[KINETIC_RESPONSE_POOL_CLASSES];
+    KineticResponsePoolClass unpooled;  ///< only used for counters
+};
+
+#endif // _KINETIC_RESPONSE_POOL_TYPES_H
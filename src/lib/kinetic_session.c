@@ -45,6 +45,7 @@ KineticStatus KineticSession_Create(KineticSession * const session, KineticClien
 
     session->connected = false;
     session->socket = KINETIC_SOCKET_INVALID;
+    session->responsePool = client->responsePool;
 
     // initialize session send mutex
     if (pthread_mutex_init(&session->sendMutex, NULL) != 0) {
@@ -52,13 +53,28 @@ KineticStatus KineticSession_Create(KineticSession * const session, KineticClien
         return KINETIC_STATUS_MEMORY_ERROR;
     }
 
-    session->outstandingOperations =
-        KineticCountingSemaphore_Create(KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION);
+    uint32_t window = session->config.maxOutstandingOperations;
+    if (window == 0) { window = KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION; }
+    session->outstandingOperations = KineticCountingSemaphore_Create(window);
     if (session->outstandingOperations == NULL) {
         LOG0("Failed creating session counting semaphore!");
         return KINETIC_STATUS_MEMORY_ERROR;
     }
 
+    session->window = NULL;
+    if (session->config.adaptiveWindow) {
+        uint32_t max = (window > KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS
+            ? window : KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS);
+        session->window = KineticWindow_Create(session->outstandingOperations, window, max);
+        if (session->window == NULL) {
+            LOG0("Failed creating session concurrency window!");
+            KineticCountingSemaphore_Destroy(session->outstandingOperations);
+            session->outstandingOperations = NULL;
+            return KINETIC_STATUS_MEMORY_ERROR;
+        }
+        KineticAllocator_SetOperationPoolLimit(session, max);
+    }
+
     return KINETIC_STATUS_SUCCESS;
 }
 
@@ -67,6 +83,7 @@ KineticStatus KineticSession_Destroy(KineticSession * const session)
     if (session == NULL) {
         return KINETIC_STATUS_SESSION_EMPTY;
     }
+    if (session->window != NULL) { KineticWindow_Destroy(session->window); }
     KineticCountingSemaphore_Destroy(session->outstandingOperations);
     KineticAllocator_FreeSession(session);
 
@@ -92,7 +109,7 @@ KineticStatus KineticSession_Connect(KineticSession * const session)
     session->connected = true;
 
     bus_socket_t socket_type = session->config.useSsl ? BUS_SOCKET_SSL : BUS_SOCKET_PLAIN;
-    session->si = calloc(1, sizeof(socket_info) + 2 * PDU_PROTO_MAX_LEN);
+    session->si = calloc(1, sizeof(socket_info));
     if (session->si == NULL) { return KINETIC_STATUS_MEMORY_ERROR; }
     bool success = Bus_RegisterSocket(session->messageBus, socket_type, session->socket, session);
     if (!success) {
@@ -114,6 +131,7 @@ KineticStatus KineticSession_Connect(KineticSession * const session)
 connection_error_cleanup:
 
     if (session->si != NULL) {
+        free(session->si->large_buf);
         free(session->si);
         session->si = NULL;
     }
@@ -137,6 +155,8 @@ KineticStatus KineticSession_Disconnect(KineticSession * const session)
     // Close the connection
     KineticSocket_Close(session->socket);
     Bus_ReleaseSocket(session->messageBus, session->socket, NULL);
+    // Free the buffer for large responses, if one was ever received
+    if (session->si != NULL) { free(session->si->large_buf); }
     free(session->si);
     session->si = NULL;
     session->socket = KINETIC_SOCKET_INVALID;
@@ -192,3 +212,34 @@ void KineticSession_SetConnectionID(KineticSession * const session, int64_t id)
     KINETIC_ASSERT(session);
     session->connectionID = id;
 }
+
+/* Allow up to LIMIT operations in flight at once, such as the device
+ * reports it can accept. An adaptive window starts out at LIMIT, and
+ * won't grow beyond it. The operation pool is resized to match. */
+void KineticSession_SetOutstandingOperationsLimit(KineticSession * const session, uint32_t limit)
+{
+    KINETIC_ASSERT(session);
+    KINETIC_ASSERT(limit > 0);
+    if (session->window != NULL) {
+        KineticWindow_SetLimit(session->window, limit);
+    } else {
+        KineticCountingSemaphore_SetMax(session->outstandingOperations, limit);
+    }
+    KineticAllocator_SetOperationPoolLimit(session, limit);
+}
+
+/* Accept responses with protobufs of up to MAX_PROTOBUF_LEN bytes and
+ * values of up to MAX_VALUE_LEN bytes, such as the device reports it can
+ * send. Either may be 0, to keep the current limit. */
+void KineticSession_SetMessageLimits(KineticSession * const session,
+    uint32_t max_protobuf_len, uint32_t max_value_len)
+{
+    KINETIC_ASSERT(session);
+    KINETIC_ASSERT(session->si);
+    if (max_protobuf_len > 0) {
+        __atomic_store_n(&session->si->max_protobuf_len, max_protobuf_len, __ATOMIC_RELAXED);
+    }
+    if (max_value_len > 0) {
+        __atomic_store_n(&session->si->max_value_len, max_value_len, __ATOMIC_RELAXED);
+    }
+}
@@ -31,5 +31,8 @@ int64_t KineticSession_GetClusterVersion(KineticSession const * const session);
 void KineticSession_SetClusterVersion(KineticSession * const session, int64_t cluster_version);
 int64_t KineticSession_GetConnectionID(KineticSession const * const session);
 void KineticSession_SetConnectionID(KineticSession * const session, int64_t id);
+void KineticSession_SetOutstandingOperationsLimit(KineticSession * const session, uint32_t limit);
+void KineticSession_SetMessageLimits(KineticSession * const session,
+    uint32_t max_protobuf_len, uint32_t max_value_len);
 
 #endif // _KINETIC_SESSION_H
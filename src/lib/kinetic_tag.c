@@ -0,0 +1,333 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "kinetic_tag.h"
+#include "kinetic_logger.h"
+#include <string.h>
+#include <pthread.h>
+#include <openssl/sha.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TAG_HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#define TAG_HAVE_ARM64 1
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+/* The one-shot SHA functions are deprecated in newer OpenSSL releases,
+ * but are still the cheapest way to digest a single buffer. */
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#define CRC32C_POLY 0x82F63B78u                     // reflected
+#define CRC64_POLY 0xC96C5795D7870F42ull            // reflected
+#define CRC64_POLY_NORMAL 0x42F0E1EBA9EA3693ull
+
+/* The CRC implementations below work on the raw (pre-inverted) CRC
+ * register. The software ones use slicing-by-8 tables. */
+typedef uint32_t crc32c_fn(uint32_t crc, uint8_t const * data, size_t len);
+typedef uint64_t crc64_fn(uint64_t crc, uint8_t const * data, size_t len);
+
+static uint32_t crc32c_table[8][256];
+static uint64_t crc64_table[8][256];
+
+static uint32_t crc32c_sw(uint32_t crc, uint8_t const * data, size_t len);
+static uint64_t crc64_sw(uint64_t crc, uint8_t const * data, size_t len);
+
+static crc32c_fn *crc32c_impl = crc32c_sw;
+static crc64_fn *crc64_impl = crc64_sw;
+static pthread_once_t tag_init_once = PTHREAD_ONCE_INIT;
+
+static uint64_t load_le64(uint8_t const * p)
+{
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24
+        | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, uint8_t const * data, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo = crc ^ (uint32_t)load_le64(data);
+        crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff]
+            ^ crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24]
+            ^ crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]]
+            ^ crc32c_table[1][data[6]] ^ crc32c_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint64_t crc64_sw(uint64_t crc, uint8_t const * data, size_t len)
+{
+    while (len >= 8) {
+        uint64_t x = crc ^ load_le64(data);
+        crc = crc64_table[7][x & 0xff] ^ crc64_table[6][(x >> 8) & 0xff]
+            ^ crc64_table[5][(x >> 16) & 0xff] ^ crc64_table[4][(x >> 24) & 0xff]
+            ^ crc64_table[3][(x >> 32) & 0xff] ^ crc64_table[2][(x >> 40) & 0xff]
+            ^ crc64_table[1][(x >> 48) & 0xff] ^ crc64_table[0][x >> 56];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = crc64_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if TAG_HAVE_X86
+/* CRC64 folding constants, x^n mod P bit-reflected, for folding a 128-bit
+ * block forward by 128, 256, 384 and 512 bits. Each pair is
+ * {x^(d-1) for the block's high-order half, x^(d-65) for its low-order half}. */
+static uint64_t crc64_fold[4][2];
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, uint8_t const * data, size_t len)
+{
+    while (len > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        len--;
+    }
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+/* Fold the 128-bit block X forward over the distance K was computed for,
+ * and add in the block D found there. */
+__attribute__((target("pclmul")))
+static inline __m128i crc64_fold_block(__m128i x, __m128i k, __m128i d)
+{
+    return _mm_xor_si128(_mm_xor_si128(
+        _mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), d);
+}
+
+/* Fold the data down to a single 128-bit block congruent to it mod P,
+ * four blocks at a time, then finish it and any tail with the tables. */
+__attribute__((target("pclmul")))
+static uint64_t crc64_pclmul(uint64_t crc, uint8_t const * data, size_t len)
+{
+    if (len < 128) { return crc64_sw(crc, data, len); }
+
+    const __m128i k1 = _mm_set_epi64x((long long)crc64_fold[0][1], (long long)crc64_fold[0][0]);
+    const __m128i k2 = _mm_set_epi64x((long long)crc64_fold[1][1], (long long)crc64_fold[1][0]);
+    const __m128i k3 = _mm_set_epi64x((long long)crc64_fold[2][1], (long long)crc64_fold[2][0]);
+    const __m128i k4 = _mm_set_epi64x((long long)crc64_fold[3][1], (long long)crc64_fold[3][0]);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i x0 = _mm_loadu_si128((__m128i const *)&data[0]);
+    __m128i x1 = _mm_loadu_si128((__m128i const *)&data[16]);
+    __m128i x2 = _mm_loadu_si128((__m128i const *)&data[32]);
+    __m128i x3 = _mm_loadu_si128((__m128i const *)&data[48]);
+    x0 = _mm_xor_si128(x0, _mm_cvtsi64_si128((long long)crc));
+    data += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x0 = crc64_fold_block(x0, k4, _mm_loadu_si128((__m128i const *)&data[0]));
+        x1 = crc64_fold_block(x1, k4, _mm_loadu_si128((__m128i const *)&data[16]));
+        x2 = crc64_fold_block(x2, k4, _mm_loadu_si128((__m128i const *)&data[32]));
+        x3 = crc64_fold_block(x3, k4, _mm_loadu_si128((__m128i const *)&data[48]));
+        data += 64;
+        len -= 64;
+    }
+
+    __m128i x = _mm_xor_si128(
+        _mm_xor_si128(crc64_fold_block(x0, k3, zero), crc64_fold_block(x1, k2, zero)),
+        crc64_fold_block(x2, k1, x3));
+    while (len >= 16) {
+        x = crc64_fold_block(x, k1, _mm_loadu_si128((__m128i const *)data));
+        data += 16;
+        len -= 16;
+    }
+
+    // The CRC of the remaining block, starting from 0, is the CRC so far.
+    uint8_t block[16];
+    _mm_storeu_si128((__m128i *)block, x);
+    crc = crc64_sw(0, block, sizeof(block));
+    return crc64_sw(crc, data, len);
+}
+
+/* x^n mod P, bit-reflected to match the CRC register. */
+static uint64_t crc64_xpow(unsigned n)
+{
+    uint64_t r = 1;
+    while (n-- > 0) {
+        uint64_t carry = r >> 63;
+        r <<= 1;
+        if (carry) { r ^= CRC64_POLY_NORMAL; }
+    }
+    uint64_t reflected = 0;
+    for (int i = 0; i < 64; i++) {
+        if (r & ((uint64_t)1 << i)) { reflected |= (uint64_t)1 << (63 - i); }
+    }
+    return reflected;
+}
+#endif
+
+#if TAG_HAVE_ARM64
+__attribute__((target("+crc")))
+static uint32_t crc32c_arm64(uint32_t crc, uint8_t const * data, size_t len)
+{
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        __asm__("crc32cx %w0, %w0, %x1" : "+r"(crc) : "r"(v));
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        uint32_t b = *data++;
+        __asm__("crc32cb %w0, %w0, %w1" : "+r"(crc) : "r"(b));
+    }
+    return crc;
+}
+#endif
+
+static void tag_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c32 = i;
+        uint64_t c64 = i;
+        for (int b = 0; b < 8; b++) {
+            c32 = (c32 & 1) ? (c32 >> 1) ^ CRC32C_POLY : c32 >> 1;
+            c64 = (c64 & 1) ? (c64 >> 1) ^ CRC64_POLY : c64 >> 1;
+        }
+        crc32c_table[0][i] = c32;
+        crc64_table[0][i] = c64;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t c32 = crc32c_table[t - 1][i];
+            uint64_t c64 = crc64_table[t - 1][i];
+            crc32c_table[t][i] = (c32 >> 8) ^ crc32c_table[0][c32 & 0xff];
+            crc64_table[t][i] = (c64 >> 8) ^ crc64_table[0][c64 & 0xff];
+        }
+    }
+
+    #if TAG_HAVE_X86
+    for (unsigned d = 1; d <= 4; d++) {
+        crc64_fold[d - 1][0] = crc64_xpow(128 * d + 63);
+        crc64_fold[d - 1][1] = crc64_xpow(128 * d - 1);
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) { crc32c_impl = crc32c_sse42; }
+    if (__builtin_cpu_supports("pclmul")) { crc64_impl = crc64_pclmul; }
+    #elif TAG_HAVE_ARM64
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) { crc32c_impl = crc32c_arm64; }
+    #endif
+}
+
+uint32_t KineticTag_CRC32C(uint32_t crc, uint8_t const * data, size_t len)
+{
+    KINETIC_ASSERT(data != NULL || len == 0);
+    pthread_once(&tag_init_once, tag_init);
+    return ~crc32c_impl(~crc, data, len);
+}
+
+uint64_t KineticTag_CRC64(uint64_t crc, uint8_t const * data, size_t len)
+{
+    KINETIC_ASSERT(data != NULL || len == 0);
+    pthread_once(&tag_init_once, tag_init);
+    return ~crc64_impl(~crc, data, len);
+}
+
+size_t KineticTag_Length(KineticAlgorithm algorithm)
+{
+    switch (algorithm) {
+    case KINETIC_ALGORITHM_CRC32: return sizeof(uint32_t);
+    case KINETIC_ALGORITHM_CRC64: return sizeof(uint64_t);
+    case KINETIC_ALGORITHM_SHA1: return SHA_DIGEST_LENGTH;
+    case KINETIC_ALGORITHM_SHA2: return SHA256_DIGEST_LENGTH;
+    default: return 0;
+    }
+}
+
+/* Compute a tag with a supported algorithm into OUT. */
+static void compute_tag(KineticAlgorithm algorithm, ByteArray const value, uint8_t * out)
+{
+    switch (algorithm) {
+    case KINETIC_ALGORITHM_CRC32: {
+        uint32_t crc = KineticTag_CRC32C(0, value.data, value.len);
+        for (int i = 0; i < 4; i++) { out[i] = (uint8_t)(crc >> (24 - 8 * i)); }
+        break;
+    }
+    case KINETIC_ALGORITHM_CRC64: {
+        uint64_t crc = KineticTag_CRC64(0, value.data, value.len);
+        for (int i = 0; i < 8; i++) { out[i] = (uint8_t)(crc >> (56 - 8 * i)); }
+        break;
+    }
+    case KINETIC_ALGORITHM_SHA1:
+        SHA1(value.data, value.len, out);
+        break;
+    case KINETIC_ALGORITHM_SHA2:
+        SHA256(value.data, value.len, out);
+        break;
+    default:
+        KINETIC_ASSERT(false);
+    }
+}
+
+KineticStatus KineticTag_Compute(KineticAlgorithm algorithm,
+    ByteArray const value, ByteBuffer * const tag)
+{
+    KINETIC_ASSERT(tag != NULL);
+    KINETIC_ASSERT(value.data != NULL || value.len == 0);
+
+    size_t len = KineticTag_Length(algorithm);
+    if (len == 0) {
+        LOGF1("Unsupported tag algorithm: %d", algorithm);
+        return KINETIC_STATUS_INVALID_REQUEST;
+    }
+    if (tag->array.data == NULL || tag->array.len < len) {
+        LOGF1("Tag buffer too small: %zu < %zu", tag->array.len, len);
+        return KINETIC_STATUS_BUFFER_OVERRUN;
+    }
+
+    compute_tag(algorithm, value, tag->array.data);
+    tag->bytesUsed = len;
+    return KINETIC_STATUS_SUCCESS;
+}
+
+bool KineticTag_Verify(KineticAlgorithm algorithm,
+    ByteArray const value, ByteArray const tag)
+{
+    KINETIC_ASSERT(value.data != NULL || value.len == 0);
+
+    size_t len = KineticTag_Length(algorithm);
+    if (len == 0 || tag.len != len || tag.data == NULL) { return false; }
+
+    uint8_t expected[SHA256_DIGEST_LENGTH];
+    compute_tag(algorithm, value, expected);
+    return memcmp(expected, tag.data, len) == 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#ifndef _KINETIC_TAG_H
+#define _KINETIC_TAG_H
+
+#include "kinetic_types_internal.h"
+
+/* Entry tags, for end-to-end integrity checking of values.
+ *
+ * KINETIC_ALGORITHM_CRC32 is CRC-32C (Castagnoli), and
+ * KINETIC_ALGORITHM_CRC64 is CRC-64/XZ (ECMA-182 polynomial, reflected).
+ * Both are stored big-endian. KINETIC_ALGORITHM_SHA1 and
+ * KINETIC_ALGORITHM_SHA2 are SHA-1 and SHA-256 digests.
+ * KINETIC_ALGORITHM_SHA3 is not supported. */
+
+/* Get the length of a tag computed with ALGORITHM, or 0 if it's not supported. */
+size_t KineticTag_Length(KineticAlgorithm algorithm);
+
+/* Compute VALUE's tag with ALGORITHM, replacing the contents of TAG.
+ * Returns KINETIC_STATUS_INVALID_REQUEST if the algorithm is not
+ * supported, or KINETIC_STATUS_BUFFER_OVERRUN if TAG is too small. */
+KineticStatus KineticTag_Compute(KineticAlgorithm algorithm,
+    ByteArray const value, ByteBuffer * const tag);
+
+/* Check whether TAG is VALUE's tag, computed with ALGORITHM.
+ * Returns false if the algorithm is not supported. */
+bool KineticTag_Verify(KineticAlgorithm algorithm,
+    ByteArray const value, ByteArray const tag);
+
+/* Raw CRC-32C and CRC-64/XZ update functions, using the fastest
+ * implementation the CPU supports. Start with CRC 0, and pass the result
+ * of each call to the next, to checksum data in pieces. */
+uint32_t KineticTag_CRC32C(uint32_t crc, uint8_t const * data, size_t len);
+uint64_t KineticTag_CRC64(uint64_t crc, uint8_t const * data, size_t len);
+
+#endif // _KINETIC_TAG_H
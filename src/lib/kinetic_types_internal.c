@@ -393,20 +393,15 @@ void KineticMessage_Init(KineticMessage* const message)
 {
     KINETIC_ASSERT(message != NULL);
 
+    // Body elements (keyValue, keyRange and the members of u) are only
+    // initialized by the builder or KineticMessage_Configure* call that
+    // uses them, so reusing a message doesn't rewrite all of them.
     com__seagate__kinetic__proto__message__init(&message->message);
     com__seagate__kinetic__proto__command__init(&message->command);
     com__seagate__kinetic__proto__message__hmacauth__init(&message->hmacAuth);
     com__seagate__kinetic__proto__message__pinauth__init(&message->pinAuth);
     com__seagate__kinetic__proto__command__header__init(&message->header);
-    com__seagate__kinetic__proto__command__status__init(&message->status);
     com__seagate__kinetic__proto__command__body__init(&message->body);
-    com__seagate__kinetic__proto__command__key_value__init(&message->keyValue);
-    com__seagate__kinetic__proto__command__range__init(&message->keyRange);
-    com__seagate__kinetic__proto__command__setup__init(&message->setup);
-    com__seagate__kinetic__proto__command__get_log__init(&message->getLog);
-    com__seagate__kinetic__proto__command__get_log__device__init(&message->getLogDevice);
-    com__seagate__kinetic__proto__command__security__init(&message->security);
-    com__seagate__kinetic__proto__command__pin_operation__init(&message->pinOp);
 }
 
 static void KineticMessage_HeaderInit(Com__Seagate__Kinetic__Proto__Command__Header* hdr, KineticSession const * const session)
@@ -428,9 +423,9 @@ void KineticRequest_Init(KineticRequest* request, KineticSession const * const s
 {
     KINETIC_ASSERT(request != NULL);
     KINETIC_ASSERT(session != NULL);
-    memset(request, 0, sizeof(KineticRequest));
     KineticMessage_Init(&(request->message));
     KineticMessage_HeaderInit(&(request->message.header), session);
     request->command = &request->message.command;
     request->command->header = &request->message.header;
+    request->pinAuth = false;
 }
@@ -21,19 +21,25 @@
 #include "kinetic_types.h"
 #include "kinetic.pb-c.h"
 #include "kinetic_countingsemaphore.h"
+#include "kinetic_window.h"
 #include "kinetic_resourcewaiter_types.h"
 #include "kinetic_resourcewaiter.h"
 #include "kinetic_acl.h"
+#include "kinetic_response_pool.h"
+#include "kinetic_arena.h"
 #include <netinet/in.h>
 #include <ifaddrs.h>
 #include <openssl/sha.h>
 #include <time.h>
+#include <sys/time.h>
 #include <pthread.h>
 
 #define KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION (10)
+#define KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS (128) /* unless the device reports its limits */
 #define KINETIC_SOCKET_DESCRIPTOR_INVALID (-1)
 #define KINETIC_CONNECTION_TIMEOUT_SECS (30) /* Java simulator may take longer than 10 seconds to respond */
 #define KINETIC_OPERATION_TIMEOUT_SECS (20)
+#define KINETIC_INLINE_COMPLETION_MAX_VALUE_LEN (4 * 1024) /* larger GETs complete on the threadpool */
 
 // Ensure __func__ is defined (for debugging)
 #if !defined __func__
@@ -52,6 +58,7 @@
 
 struct _KineticClient {
     struct bus *bus;
+    KineticResponsePool *responsePool;
 };
 
 enum unpack_error {
@@ -72,19 +79,70 @@ typedef struct __attribute__((__packed__)) _KineticPDUHeader {
 enum socket_state {
     STATE_UNINIT = 0,
     STATE_AWAITING_HEADER,
+    STATE_AWAITING_PROTOBUF,
     STATE_AWAITING_BODY,
 };
 
 #define KINETIC_SEQUENCE_NOT_YET_BOUND ((int64_t)-2)
 
+/* Size of each connection's reassembly buffer for typical messages. */
+#define KINETIC_SOCKET_INFO_BUF_SIZE (4 * 1024)
+
+/* How long a connection's buffer for large messages is kept unused. */
+#define KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS (30)
+
 typedef struct {
     enum socket_state state;
     KineticPDUHeader header;
     enum unpack_error unpack_status;
     size_t accumulated;
-    uint8_t buf[];
+
+    /* If the response has a value, its ackSequence is scanned from the
+     * protobuf before the value is received, so the value can be received
+     * directly into the buffer of the GET it's for. */
+    uint8_t * value_dest;       ///< where to receive the value, or NULL for buf
+
+    /* Messages are reassembled in small_buf, unless they are too large,
+     * in which case they go in large_buf. It's grown as needed, and kept
+     * for the next large message, until the bus's idle check finds it has
+     * gone unused for KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS, or the
+     * socket is released. */
+    uint32_t max_protobuf_len;  ///< largest protobuf accepted, or 0 for PDU_PROTO_MAX_LEN
+    uint32_t max_value_len;     ///< largest value accepted, or 0 for PDU_PROTO_MAX_LEN
+    uint8_t * buf;              ///< small_buf or large_buf, or NULL until first used
+    size_t buf_size;
+    uint8_t * large_buf;        ///< allocated on the first large message, or NULL
+    size_t large_buf_size;
+    time_t large_buf_used;      ///< when large_buf last held a message
+    uint8_t small_buf[KINETIC_SOCKET_INFO_BUF_SIZE];
 } socket_info;
 
+// Kinetic Message HMAC
+typedef struct _KineticHMAC {
+    Com__Seagate__Kinetic__Proto__Command__Security__ACL__HMACAlgorithm algorithm;
+    uint32_t len;
+    uint8_t data[KINETIC_HMAC_MAX_LEN];
+} KineticHMAC;
+
+// HMAC-SHA1 key schedule: the SHA1 states after hashing the key XOR'd
+// with the inner and outer pads. These only depend on the key, so they
+// are computed once per session and copied for each message.
+typedef struct _KineticHMACKey {
+    SHA_CTX inner;
+    SHA_CTX outer;
+} KineticHMACKey;
+
+/**
+ * @brief Operations (each with its request) released by a session, kept
+ * for reuse by its next operations.
+ */
+typedef struct _KineticOperationPool {
+    pthread_mutex_t mutex;
+    struct _KineticOperation * free;    ///< cached operations, linked through nextFree
+    uint32_t count;                     ///< number of cached operations
+    uint32_t max;                       ///< max number of cached operations, or 0 to disable
+} KineticOperationPool;
+
 /**
  * @brief An instance of a session with a Kinetic device.
  */
@@ -97,19 +155,16 @@ struct _KineticSession {
     int64_t         sequence;                           ///< increments for each request in a session
     struct bus *    messageBus;                         ///< pointer to message bus instance
     socket_info *   si;                                 ///< pointer to socket information
+    KineticResponsePool * responsePool;                 ///< client's pool for allocating responses
     pthread_mutex_t sendMutex;                          ///< mutex for locking around seq count acquisision, PDU packing, and transfer to threadpool
     KineticResourceWaiter connectionReady;              ///< connection ready status (set to true once connectionID recieved)
     KineticCountingSemaphore * outstandingOperations;   ///< counting semaphore to only allows the configured number of outstanding operation at a given time
+    KineticWindow * window;                             ///< adjusts outstandingOperations' max, if config.adaptiveWindow
     uint16_t timeoutSeconds;                            ///< Default response timeout
+    KineticOperationPool operationPool;                 ///< recycled operations, up to the outstanding operation limit
+    KineticHMACKey  hmacKey;                            ///< key schedule precomputed from config.hmacKey
 };
 
-// Kinetic Message HMAC
-typedef struct _KineticHMAC {
-    Com__Seagate__Kinetic__Proto__Command__Security__ACL__HMACAlgorithm algorithm;
-    uint32_t len;
-    uint8_t data[KINETIC_HMAC_MAX_LEN];
-} KineticHMAC;
-
 
 // Kinetic Device Message Request
 typedef struct _KineticMessage {
@@ -125,16 +180,21 @@ typedef struct _KineticMessage {
     Com__Seagate__Kinetic__Proto__Command                command;
     Com__Seagate__Kinetic__Proto__Command__Header         header;
     Com__Seagate__Kinetic__Proto__Command__Body           body;
-    Com__Seagate__Kinetic__Proto__Command__Status         status;
-    Com__Seagate__Kinetic__Proto__Command__Security       security;
-    Com__Seagate__Kinetic__Proto__Command__Security__ACL   acl;
     Com__Seagate__Kinetic__Proto__Command__KeyValue       keyValue;
     Com__Seagate__Kinetic__Proto__Command__Range          keyRange;
-    Com__Seagate__Kinetic__Proto__Command__Setup          setup;
-    Com__Seagate__Kinetic__Proto__Command__GetLog         getLog;
-    Com__Seagate__Kinetic__Proto__Command__GetLog__Type    getLogType;
-    Com__Seagate__Kinetic__Proto__Command__GetLog__Device  getLogDevice;
-    Com__Seagate__Kinetic__Proto__Command__PinOperation   pinOp;
+
+    // Body elements only used by one kind of request each, and only
+    // initialized by the builder for that request
+    union {
+        Com__Seagate__Kinetic__Proto__Command__Security       security;
+        Com__Seagate__Kinetic__Proto__Command__Setup          setup;
+        Com__Seagate__Kinetic__Proto__Command__PinOperation   pinOp;
+        struct {
+            Com__Seagate__Kinetic__Proto__Command__GetLog         getLog;
+            Com__Seagate__Kinetic__Proto__Command__GetLog__Type    getLogType;
+            Com__Seagate__Kinetic__Proto__Command__GetLog__Device  getLogDevice;
+        } log;
+    } u;
 } KineticMessage;
 
 // Kinetic PDU Header
@@ -158,11 +218,37 @@ struct _KineticRequest {
     bool pinAuth;
 };
 
+/* Longest status message a response can have and still be decoded by
+ * KineticResponse_Unpack's fast path. */
+#define KINETIC_RESPONSE_STATUS_MESSAGE_MAX_LEN 127
+
+/* A response's message and command, as decoded by KineticResponse_Unpack's
+ * fast path, which handles responses with at most a keyValue body without
+ * allocating. Bytes fields point into the response's packed protobuf. */
+typedef struct _KineticResponseFields
+{
+    Com__Seagate__Kinetic__Proto__Message message;
+    Com__Seagate__Kinetic__Proto__Message__HMACauth hmacAuth;
+    Com__Seagate__Kinetic__Proto__Command command;
+    Com__Seagate__Kinetic__Proto__Command__Header header;
+    Com__Seagate__Kinetic__Proto__Command__Body body;
+    Com__Seagate__Kinetic__Proto__Command__KeyValue keyValue;
+    Com__Seagate__Kinetic__Proto__Command__Status status;
+    char statusMessage[KINETIC_RESPONSE_STATUS_MESSAGE_MAX_LEN + 1];
+} KineticResponseFields;
+
 typedef struct _KineticResponse
 {
     KineticPDUHeader header;
-    Com__Seagate__Kinetic__Proto__Message* proto;
+    uint8_t* protobuf;          ///< packed protobuf, stored after the value
+    Com__Seagate__Kinetic__Proto__Message* proto;   ///< NULL until KineticResponse_Unpack
     Com__Seagate__Kinetic__Proto__Command* command;
+    KineticResponseFields fields;   ///< holds proto and command, if decoded by the fast path
+    KineticArena arena;         ///< holds proto and command otherwise
+    bool valueInEntry;          ///< value was received directly into the operation's entry
+    KineticResponsePool* pool;  ///< pool the response was allocated from, or NULL
+    struct _KineticResponse* nextFree;  ///< next cached response in the pool's free list
+    uint8_t sizeClass;          ///< pool size class, determining the value's capacity
     uint8_t value[];
 } KineticResponse;
 
@@ -177,6 +263,7 @@ struct _KineticOperation {
     KineticRequest* request;
     KineticResponse* response;
     uint16_t timeoutSeconds;
+    uint32_t timeoutMsec;                   ///< if non-zero, used instead of timeoutSeconds
     int64_t pendingClusterVersion;
     ByteArray* pin;
     KineticEntry* entry;
@@ -186,6 +273,9 @@ struct _KineticOperation {
     KineticOperationCallback opCallback;
     KineticCompletionClosure closure;
     ByteArray value;
+    uint8_t* packedRequest;                 ///< packed request submitted asynchronously, kept until freed
+    struct timeval sentTime;                ///< when queued for sending, if the session's window is adaptive
+    KineticOperation* nextFree;             ///< next cached operation in the session's pool
 };
 
 
@@ -0,0 +1,145 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include "kinetic_window.h"
+#include "kinetic_window_types.h"
+#include "kinetic_logger.h"
+#include <stdlib.h>
+
+/* The window of operations allowed in flight on a session is adjusted
+ * AIMD-style: it grows by one for each window's worth of completions
+ * while latency stays near the lowest seen, and is halved when an
+ * operation times out or the device reports that it is busy. */
+
+/* Weight of each new sample in the smoothed latency, as a shift. */
+#define LATENCY_SMOOTHING_SHIFT 3
+
+/* Latency up to this fraction above the baseline still counts as flat. */
+#define FLAT_LATENCY_SLACK_DIVISOR 2
+
+/* After this many windows' worth of completions without flat latency,
+ * the current latency becomes the new baseline. */
+#define REBASELINE_WINDOWS 8
+
+KineticWindow * KineticWindow_Create(KineticCountingSemaphore * const sem,
+    uint32_t size, uint32_t max)
+{
+    KINETIC_ASSERT(sem != NULL);
+    KINETIC_ASSERT(size > 0);
+    KINETIC_ASSERT(max >= size);
+    KineticWindow * window = calloc(1, sizeof(KineticWindow));
+    if (window == NULL) { return NULL; }
+    pthread_mutex_init(&window->mutex, NULL);
+    window->sem = sem;
+    window->size = size;
+    window->min = 1;
+    window->max = max;
+    window->sinceDecrease = size;  // allow backing off right away
+    return window;
+}
+
+static void set_size_in_lock(KineticWindow * const window, uint32_t size)
+{
+    if (size == window->size) { return; }
+    LOGF2("Concurrent ops window: %u => %u (latency=%lluus, base=%lluus)",
+        window->size, size, (unsigned long long)window->latencyUsec,
+        (unsigned long long)window->baseLatencyUsec);
+    window->size = size;
+    window->acked = 0;
+    KineticCountingSemaphore_SetMax(window->sem, size);
+}
+
+static void sample_latency_in_lock(KineticWindow * const window, uint64_t latencyUsec)
+{
+    if (window->latencyUsec == 0) {
+        window->latencyUsec = latencyUsec;
+    } else {
+        int64_t delta = (int64_t)latencyUsec - (int64_t)window->latencyUsec;
+        window->latencyUsec += delta / (1 << LATENCY_SMOOTHING_SHIFT);
+    }
+    if (window->baseLatencyUsec == 0 || window->latencyUsec < window->baseLatencyUsec) {
+        window->baseLatencyUsec = window->latencyUsec;
+    }
+}
+
+// Account for an operation completing with STATUS after LATENCYUSEC,
+// resizing the window as needed. Returns the window's size.
+uint32_t KineticWindow_Update(KineticWindow * const window,
+    KineticStatus status, uint64_t latencyUsec)
+{
+    KINETIC_ASSERT(window != NULL);
+    pthread_mutex_lock(&window->mutex);
+
+    if (window->sinceDecrease < UINT32_MAX) { window->sinceDecrease++; }
+
+    if (status == KINETIC_STATUS_OPERATION_TIMEDOUT ||
+        status == KINETIC_STATUS_DEVICE_BUSY) {
+        /* Back off once per window, since the other operations that were
+         * in flight alongside this one likely saw the same congestion. */
+        if (window->sinceDecrease > window->size) {
+            uint32_t size = window->size / 2;
+            if (size < window->min) { size = window->min; }
+            set_size_in_lock(window, size);
+            window->sinceDecrease = 0;
+            window->unflat = 0;
+            window->baseLatencyUsec = 0;
+        }
+    } else {
+        sample_latency_in_lock(window, latencyUsec);
+        uint64_t base = window->baseLatencyUsec;
+        if (window->latencyUsec <= base + base / FLAT_LATENCY_SLACK_DIVISOR) {
+            window->unflat = 0;
+            if (++window->acked >= window->size && window->size < window->max) {
+                set_size_in_lock(window, window->size + 1);
+            }
+        } else if (++window->unflat >= window->size * REBASELINE_WINDOWS) {
+            window->baseLatencyUsec = window->latencyUsec;
+            window->unflat = 0;
+        }
+    }
+
+    uint32_t size = window->size;
+    pthread_mutex_unlock(&window->mutex);
+    return size;
+}
+
+// Change the largest size the window may grow to, such as from the
+// device's reported limits, and start it out at that size.
+void KineticWindow_SetLimit(KineticWindow * const window, uint32_t max)
+{
+    KINETIC_ASSERT(window != NULL);
+    KINETIC_ASSERT(max >= window->min);
+    pthread_mutex_lock(&window->mutex);
+    window->max = max;
+    set_size_in_lock(window, max);
+    pthread_mutex_unlock(&window->mutex);
+}
+
+uint32_t KineticWindow_GetSize(KineticWindow * const window)
+{
+    KINETIC_ASSERT(window != NULL);
+    pthread_mutex_lock(&window->mutex);
+    uint32_t size = window->size;
+    pthread_mutex_unlock(&window->mutex);
+    return size;
+}
+
+void KineticWindow_Destroy(KineticWindow * const window)
+{
+    KINETIC_ASSERT(window != NULL);
+    pthread_mutex_destroy(&window->mutex);
+    free(window);
+}
@@ -0,0 +1,34 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#ifndef _KINETIC_WINDOW_H
+#define _KINETIC_WINDOW_H
+
+#include "kinetic_types.h"
+#include "kinetic_countingsemaphore.h"
+#include <stdint.h>
+
+typedef struct _KineticWindow KineticWindow;
+
+KineticWindow * KineticWindow_Create(KineticCountingSemaphore * const sem,
+    uint32_t size, uint32_t max);
+uint32_t KineticWindow_Update(KineticWindow * const window,
+    KineticStatus status, uint64_t latencyUsec);
+void KineticWindow_SetLimit(KineticWindow * const window, uint32_t max);
+uint32_t KineticWindow_GetSize(KineticWindow * const window);
+void KineticWindow_Destroy(KineticWindow * const window);
+
+#endif // _KINETIC_WINDOW_H
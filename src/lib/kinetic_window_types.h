@@ -0,0 +1,37 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#ifndef _KINETIC_WINDOW_TYPES_H
+#define _KINETIC_WINDOW_TYPES_H
+
+#include "kinetic_countingsemaphore.h"
+#include <pthread.h>
+#include <stdint.h>
+
+struct _KineticWindow {
+    pthread_mutex_t mutex;
+    KineticCountingSemaphore * sem;     ///< semaphore whose max is kept at size
+    uint32_t size;                      ///< operations allowed in flight
+    uint32_t min;
+    uint32_t max;
+    uint32_t acked;                     ///< flat completions since the last increase
+    uint32_t sinceDecrease;             ///< completions since the last decrease
+    uint32_t unflat;                    ///< consecutive completions above baseline
+    uint64_t latencyUsec;               ///< smoothed completion latency
+    uint64_t baseLatencyUsec;           ///< lowest smoothed latency, or 0 if unknown
+};
+
+#endif // _KINETIC_WINDOW_TYPES_H
@@ -0,0 +1,129 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "threadpool.h"
+
+/* Several producer threads schedule tasks while one worker is stuck on
+ * a slow task, so the tasks queued for that worker must be stolen by
+ * the others. Then check that every task either ran or was cleaned up
+ * by shutdown. */
+
+#define PRODUCERS 4
+#define TASKS_PER_PRODUCER 20000
+
+static size_t ran = 0;
+static size_t cleaned_up = 0;
+static size_t slow_running = 0;
+
+static void count_cb(void *udata) {
+    (void)udata;
+    __sync_fetch_and_add(&ran, 1);
+}
+
+static void cleanup_cb(void *udata) {
+    (void)udata;
+    __sync_fetch_and_add(&cleaned_up, 1);
+}
+
+static void slow_cb(void *udata) {
+    (void)udata;
+    __sync_fetch_and_add(&slow_running, 1);
+    sleep(2);
+    __sync_fetch_and_add(&ran, 1);
+}
+
+static void schedule(struct threadpool *t, struct threadpool_task *task) {
+    size_t pushback = 0;
+    while (!Threadpool_Schedule(t, task, &pushback)) {
+        usleep(100);
+    }
+}
+
+static void *producer(void *arg) {
+    struct threadpool *t = (struct threadpool *)arg;
+    struct threadpool_task task = {
+        .task = count_cb, .cleanup = cleanup_cb,
+    };
+    for (int i = 0; i < TASKS_PER_PRODUCER; i++) {
+        schedule(t, &task);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    uint16_t max_threads = 300;
+
+    char *max_threads_env = getenv("MAX_THREADS");
+    if (max_threads_env) { max_threads = atoi(max_threads_env); }
+
+    struct threadpool_config cfg = {
+        .task_ringbuf_size2 = 6,
+        .max_threads = max_threads,
+    };
+    struct threadpool *t = Threadpool_Init(&cfg);
+    assert(t);
+
+    /* This thread's preferred worker gets stuck on the slow task. */
+    struct threadpool_task slow = { .task = slow_cb, };
+    schedule(t, &slow);
+    while (__sync_fetch_and_add(&slow_running, 0) == 0) { usleep(1000); }
+
+    pthread_t producers[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        int res = pthread_create(&producers[i], NULL, producer, t);
+        assert(res == 0);
+    }
+    (void)producer(t);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+
+    size_t expected = (PRODUCERS + 1) * TASKS_PER_PRODUCER + 1;
+    while (__sync_fetch_and_add(&ran, 0) < expected) { usleep(1000); }
+
+    struct threadpool_info stats;
+    Threadpool_Stats(t, &stats);
+    printf("ran %zd tasks (at %d, dt %d, bl %zd)\n", ran,
+        stats.active_threads, stats.dormant_threads, stats.backlog_size);
+    assert(stats.backlog_size == 0);
+
+    /* Tasks still queued at shutdown are cleaned up instead. */
+    struct threadpool_task task = {
+        .task = count_cb, .cleanup = cleanup_cb,
+    };
+    size_t scheduled = 0;
+    for (int i = 0; i < 1000; i++) {
+        if (Threadpool_Schedule(t, &task, NULL)) { scheduled++; }
+    }
+
+    while (!Threadpool_Shutdown(t, false)) { usleep(10 * 1000); }
+    assert(!Threadpool_Schedule(t, &task, NULL));
+    size_t done = __sync_fetch_and_add(&ran, 0) + __sync_fetch_and_add(&cleaned_up, 0);
+    printf("%zd scheduled during shutdown: %zd ran, %zd cleaned up\n",
+        scheduled, ran - expected, cleaned_up);
+    assert(done == expected + scheduled);
+    Threadpool_Free(t);
+
+    return 0;
+}
@@ -15,29 +15,41 @@
  * See www.openkinetic.org for more project information
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE             /* for syscall(2) */
+#endif
+
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
-#include <err.h>
-#include <poll.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "threadpool_internals.h"
 
-#define MIN_DELAY 10 /* msec */
-#define DEFAULT_MAX_DELAY 10000 /* msec */
-#define INFINITE_DELAY -1 /* poll will only return upon an event */
+#if THREADPOOL_USE_FUTEX
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
 #define DEFAULT_TASK_RINGBUF_SIZE2 8
 #define DEFAULT_MAX_THREADS 8
 
-static void notify_new_task(struct threadpool *t);
+static bool deque_push(struct task_deque *d, struct threadpool_task *task);
+static bool deque_pop(struct task_deque *d, struct threadpool_task *task);
+static bool deque_steal(struct task_deque *d, struct threadpool_task *task);
+static bool inbox_push(struct task_inbox *q, struct threadpool_task *task);
+static bool inbox_pop(struct task_inbox *q, struct threadpool_task *task);
+static bool steal(struct threadpool *t, struct thread_info *ti,
+    struct threadpool_task *task);
+static void notify_new_task(struct threadpool *t, struct thread_info *target);
 static bool notify_shutdown(struct threadpool *t);
-static bool spawn(struct threadpool *t);
+static void park(struct threadpool *t, struct thread_info *ti);
+static bool unpark(struct thread_info *ti);
+static struct thread_info *spawn(struct threadpool *t);
 static void *thread_task(void *thread_info);
-static void commit_current_task(struct threadpool *t, struct marked_task *task, size_t wh);
-static void release_current_task(struct threadpool *t, struct marked_task *task, size_t rh);
 
 static void set_defaults(struct threadpool_config *cfg) {
     if (cfg->task_ringbuf_size2 == 0) {
@@ -56,40 +68,28 @@ struct threadpool *Threadpool_Init(struct threadpool_config *cfg) {
     if (cfg->max_threads < 1) { return NULL; }
 
     struct threadpool *t = NULL;
-    struct marked_task *tasks = NULL;
     struct thread_info *threads = NULL;
+    bool have_lock = false;
 
-    t = malloc(sizeof(*t));
+    t = calloc(1, sizeof(*t));
     if (t == NULL) { goto cleanup; }
 
-    size_t tasks_sz = (1 << cfg->task_ringbuf_size2) * sizeof(*tasks);
-    size_t threads_sz = cfg->max_threads * sizeof(struct thread_info);
-
-    tasks = malloc(tasks_sz);
-    if (tasks == NULL) { goto cleanup; }
-
-    threads = malloc(threads_sz);
+    /* Each worker's queues are allocated when it is started. */
+    threads = calloc(cfg->max_threads, sizeof(struct thread_info));
     if (threads == NULL) { goto cleanup; }
 
-    memset(t, 0, sizeof(*t));
-    memset(threads, 0, threads_sz);
+    if (0 != pthread_mutex_init(&t->spawn_lock, NULL)) { goto cleanup; }
+    have_lock = true;
+    if (0 != pthread_key_create(&t->thread_key, NULL)) { goto cleanup; }
 
-    /* Note: tasks is memset to a non-0 value so that the first slot,
-     * tasks[0].mark, will not match its ID and leave it in a
-     * prematurely commit-able state. */
-    memset(tasks, 0xFF, tasks_sz);
-
-    t->tasks = tasks;
     t->threads = threads;
-    t->task_ringbuf_size = 1 << cfg->task_ringbuf_size2;
     t->task_ringbuf_size2 = cfg->task_ringbuf_size2;
-    t->task_ringbuf_mask = t->task_ringbuf_size - 1;
     t->max_threads = cfg->max_threads;
     return t;
 
 cleanup:
+    if (have_lock) { pthread_mutex_destroy(&t->spawn_lock); }
     if (t) { free(t); }
-    if (tasks) { free(tasks); }
     if (threads) { free(threads); }
     return NULL;
 }
@@ -101,72 +101,92 @@ bool Threadpool_Schedule(struct threadpool *t, struct threadpool_task *task,
 
     /* New tasks must not be scheduled after the threadpool starts
      * shutting down. */
-    if (t->shutting_down) { return false; }
-
-    size_t queue_size = t->task_ringbuf_size - 1;
-    size_t mask = queue_size;
+    if (ATOMIC_LOAD(&t->shutting_down)) { return false; }
 
-    for (;;) {
-        size_t wh = t->task_reserve_head;
-        size_t rh = t->task_release_head;
+    uint16_t live = ATOMIC_LOAD(&t->live_threads);
+    if (live == 0) {
+        if (spawn(t) == NULL) { return false; }
+        live = ATOMIC_LOAD(&t->live_threads);
+    }
 
-        if (wh - rh >= queue_size - 1) {
-            if (pushback) { *pushback = wh - rh; }
-            //printf("FULL, %zd, %zd\n", wh - rh, t->task_commit_head - t->task_request_head);
-            return false;       /* full, cannot schedule */
+    /* Count the task before it is visible, so workers that can't find
+     * it yet don't park. */
+    size_t backlog = ATOMIC_ADD_FETCH(&t->backlog, 1) - 1;
+    if (pushback) { *pushback = backlog; }
+
+    struct thread_info *target = NULL;
+    uint16_t preferred = 0;
+    uintptr_t key = (uintptr_t)pthread_getspecific(t->thread_key);
+    if (key & WORKER_KEY_FLAG) {
+        struct thread_info *self = &t->threads[key & ~WORKER_KEY_FLAG];
+        if (deque_push(&self->deque, task)) {
+            /* This worker will get to it next, unless it already has
+             * other tasks waiting -- then let another worker steal. */
+            if (ATOMIC_LOAD(&self->deque.bottom) - ATOMIC_LOAD(&self->deque.top) <= 1) {
+                return true;
+            }
+            target = self;
         }
-        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&t->task_reserve_head, wh, wh + 1)) {
-            assert(t->task_reserve_head - t->task_release_head < queue_size);
-            struct marked_task *tbuf = &t->tasks[wh & mask];
-            tbuf->task = task->task;
-            tbuf->cleanup = task->cleanup;
-            tbuf->udata = task->udata;
-
-            commit_current_task(t, tbuf, wh);
-            notify_new_task(t);
-            if (pushback) { *pushback = wh - rh; }
-            return true;
+        preferred = self->id;
+    } else {
+        if (key == 0) {
+            key = (uintptr_t)__atomic_fetch_add(&t->next_hint, 1, __ATOMIC_RELAXED) + 1;
+            (void)pthread_setspecific(t->thread_key, (void *)key);
         }
+        preferred = (key - 1) % live;
     }
-}
 
-static void commit_current_task(struct threadpool *t, struct marked_task *task, size_t wh) {
-    size_t mask = t->task_ringbuf_mask;
-    task->mark = wh;
-    for (;;) {
-        size_t ch = t->task_commit_head;
-        task = &t->tasks[ch & mask];
-        if (ch != task->mark) { break; }
-        assert(ch < t->task_reserve_head);
-        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&t->task_commit_head, ch, ch + 1)) {
-            assert(t->task_request_head <= t->task_commit_head);
-        }
+    /* Use the preferred worker's inbox, or the next one with room. */
+    for (uint16_t i = 0; target == NULL && i < live; i++) {
+        struct thread_info *ti = &t->threads[(preferred + i) % live];
+        if (inbox_push(&ti->inbox, task)) { target = ti; }
     }
+
+    /* Every queue is full, so start another worker if possible. */
+    if (target == NULL) {
+        struct thread_info *ti = spawn(t);
+        if (ti && inbox_push(&ti->inbox, task)) { target = ti; }
+    }
+
+    if (target == NULL) {
+        ATOMIC_SUB_FETCH(&t->backlog, 1);
+        return false;       /* full, cannot schedule */
+    }
+
+    notify_new_task(t, target);
+    return true;
 }
 
 void Threadpool_Stats(struct threadpool *t, struct threadpool_info *info) {
     if (info) {
-        uint8_t at = 0;
-        for (int i = 0; i < t->live_threads; i++) {
+        uint16_t live = ATOMIC_LOAD(&t->live_threads);
+        uint16_t at = 0;
+        for (int i = 0; i < live; i++) {
             struct thread_info *ti = &t->threads[i];
-            if (ti->status == STATUS_AWAKE) { at++; }
+            if (ATOMIC_LOAD(&ti->status) == STATUS_AWAKE) { at++; }
         }
         info->active_threads = at;
 
-        info->dormant_threads = t->live_threads - at;
-        info->backlog_size = t->task_commit_head - t->task_request_head;
+        info->dormant_threads = live - at;
+        info->backlog_size = ATOMIC_LOAD(&t->backlog);
     }
 }
 
 bool Threadpool_Shutdown(struct threadpool *t, bool kill_all) {
-    t->shutting_down = true;
-    size_t mask = t->task_ringbuf_mask;
+    /* Set this with the spawn lock held, so every worker that is ever
+     * started is either already counted in live_threads or never
+     * starts. */
+    pthread_mutex_lock(&t->spawn_lock);
+    ATOMIC_STORE(&t->shutting_down, true);
+    pthread_mutex_unlock(&t->spawn_lock);
+
+    uint16_t live = ATOMIC_LOAD(&t->live_threads);
 
     if (kill_all) {
-        for (int i = 0; i < t->live_threads; i++) {
+        for (int i = 0; i < live; i++) {
             struct thread_info *ti = &t->threads[i];
-            if (ti->status < STATUS_SHUTDOWN) {
-                ti->status = STATUS_SHUTDOWN;
+            if (ATOMIC_LOAD(&ti->status) < STATUS_SHUTDOWN) {
+                ATOMIC_STORE(&ti->status, STATUS_SHUTDOWN);
                 int pcres = pthread_cancel(ti->t);
                 if (pcres != 0) {
                     /* If this fails, tolerate the failure that the
@@ -179,16 +199,11 @@ bool Threadpool_Shutdown(struct threadpool *t, bool kill_all) {
 
     notify_shutdown(t);
 
-    while (t->task_commit_head > t->task_request_head) {
-        size_t rh = t->task_request_head;
-
-        struct marked_task *tbuf = &t->tasks[rh & mask];
-        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&t->task_request_head, rh, rh + 1)) {
-            if (tbuf->cleanup) {
-                tbuf->cleanup(tbuf->udata);
-                tbuf->udata = NULL;
-            }
-            SPIN_ADJ(t->task_release_head, 1);
+    struct threadpool_task task;
+    while (steal(t, NULL, &task)) {
+        ATOMIC_SUB_FETCH(&t->backlog, 1);
+        if (task.cleanup) {
+            task.cleanup(task.udata);
         }
     }
 
@@ -196,95 +211,287 @@ bool Threadpool_Shutdown(struct threadpool *t, bool kill_all) {
 }
 
 void Threadpool_Free(struct threadpool *t) {
-    free(t->tasks);
-    t->tasks = NULL;
+    for (int i = 0; i < t->live_threads; i++) {
+        struct thread_info *ti = &t->threads[i];
+        free(ti->deque.slots);
+        free(ti->inbox.slots);
+#if !THREADPOOL_USE_FUTEX
+        pthread_cond_destroy(&ti->park_cond);
+        pthread_mutex_destroy(&ti->park_lock);
+#endif
+    }
     free(t->threads);
     t->threads = NULL;
+    pthread_key_delete(t->thread_key);
+    pthread_mutex_destroy(&t->spawn_lock);
     free(t);
 }
 
-static void notify_new_task(struct threadpool *t) {
-    for (int i = 0; i < t->live_threads; i++) {
-        struct thread_info *ti = &t->threads[i];
-        if (ti->status == STATUS_ASLEEP) {
-            ssize_t res = write(ti->parent_fd,
-                NOTIFY_MSG, NOTIFY_MSG_LEN);
-            if (NOTIFY_MSG_LEN == res) {
-                return;
-            } else if (res == -1) {
-                err(1, "write");
-            } else {
-                ;
+/* Push a task on the bottom of the owning worker's deque. */
+static bool deque_push(struct task_deque *d, struct threadpool_task *task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - top > d->mask) { return false; }  /* full */
+
+    struct deque_slot *slot = &d->slots[b & d->mask];
+    __atomic_store_n(&slot->task, task->task, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->cleanup, task->cleanup, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->udata, task->udata, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void read_deque_slot(struct deque_slot *slot, struct threadpool_task *task) {
+    task->task = __atomic_load_n(&slot->task, __ATOMIC_RELAXED);
+    task->cleanup = __atomic_load_n(&slot->cleanup, __ATOMIC_RELAXED);
+    task->udata = __atomic_load_n(&slot->udata, __ATOMIC_RELAXED);
+}
+
+/* Pop the most recently pushed task from the owning worker's deque.
+ * If it's the last one, race any thieves for it. */
+static bool deque_pop(struct task_deque *d, struct threadpool_task *task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (top > b) {              /* empty */
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    read_deque_slot(&d->slots[b & d->mask], task);
+    if (top < b) { return true; }
+
+    bool won = __atomic_compare_exchange_n(&d->top, &top, top + 1,
+        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+/* Steal the oldest task from another worker's deque. Returns false if
+ * it's empty or another thread got there first. */
+static bool deque_steal(struct task_deque *d, struct threadpool_task *task) {
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) { return false; }
+
+    read_deque_slot(&d->slots[top & d->mask], task);
+    return __atomic_compare_exchange_n(&d->top, &top, top + 1,
+        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool inbox_push(struct task_inbox *q, struct threadpool_task *task) {
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        struct inbox_slot *slot = &q->slots[pos & q->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->task = task->task;
+                slot->cleanup = task->cleanup;
+                slot->udata = task->udata;
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
             }
+        } else if (diff < 0) {
+            return false;       /* full */
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
         }
     }
+}
 
-    if (t->live_threads < t->max_threads) { /* spawn */
-        if (spawn(t)) {
-            SPIN_ADJ(t->live_threads, 1);
+static bool inbox_pop(struct task_inbox *q, struct threadpool_task *task) {
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        struct inbox_slot *slot = &q->slots[pos & q->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                task->task = slot->task;
+                task->cleanup = slot->cleanup;
+                task->udata = slot->udata;
+                __atomic_store_n(&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;       /* empty */
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
         }
-    } else {
-        /* all awake & busy, just keep out of the way & let them work */
     }
 }
 
+/* Take a task from any worker other than TI (which may be NULL). */
+static bool steal(struct threadpool *t, struct thread_info *ti,
+        struct threadpool_task *task) {
+    uint16_t live = ATOMIC_LOAD(&t->live_threads);
+    uint16_t start = (ti ? ti->id + 1 : 0);
+    for (uint16_t i = 0; i < live; i++) {
+        struct thread_info *victim = &t->threads[(start + i) % live];
+        if (victim == ti) { continue; }
+        if (deque_steal(&victim->deque, task)) { return true; }
+        if (inbox_pop(&victim->inbox, task)) { return true; }
+    }
+    return false;
+}
+
+/* Wake the worker the task was queued for, or else any parked worker
+ * so it can steal it. If every worker is busy, start another. */
+static void notify_new_task(struct threadpool *t, struct thread_info *target) {
+    if (unpark(target)) { return; }
+
+    if (ATOMIC_LOAD(&t->parked_threads) > 0) {
+        uint16_t live = ATOMIC_LOAD(&t->live_threads);
+        for (uint16_t i = 1; i < live; i++) {
+            if (unpark(&t->threads[(target->id + i) % live])) { return; }
+        }
+    }
+
+    (void)spawn(t);
+}
+
 static bool notify_shutdown(struct threadpool *t) {
     int done = 0;
+    uint16_t live = ATOMIC_LOAD(&t->live_threads);
 
-    for (int i = 0; i < t->live_threads; i++) {
+    for (int i = 0; i < live; i++) {
         struct thread_info *ti = &t->threads[i];
-        if (ti->status == STATUS_JOINED) {
+        thread_status_t status = ATOMIC_LOAD(&ti->status);
+        if (status == STATUS_JOINED) {
             done++;
-        } else if (ti->status == STATUS_SHUTDOWN) {
+        } else if (status == STATUS_SHUTDOWN) {
             void *v = NULL;
             int joinres = pthread_join(ti->t, &v);
             if (0 == joinres) {
-                ti->status = STATUS_JOINED;
+                ATOMIC_STORE(&ti->status, STATUS_JOINED);
                 done++;
             } else {
                 fprintf(stderr, "pthread_join: %d\n", joinres);
                 assert(joinres == ESRCH);
             }
         } else {
-            close(ti->parent_fd);
+            (void)unpark(ti);
         }
     }
 
-    return (done == t->live_threads);
+    return (done == live);
 }
 
-static bool spawn(struct threadpool *t) {
-    int id = t->live_threads;
-    if (id >= t->max_threads) { return false; }
-    struct thread_info *ti = &t->threads[id];
+/* Park the worker until a task is scheduled or the threadpool shuts
+ * down. The worker sets TI->parked before checking for work, and
+ * Threadpool_Schedule counts new work before checking TI->parked, so
+ * at least one of them sees the other. */
+static void park(struct threadpool *t, struct thread_info *ti) {
+    ATOMIC_ADD_FETCH(&t->parked_threads, 1);
+    ATOMIC_STORE(&ti->parked, 1);
 
-    struct thread_context *tc = malloc(sizeof(*tc));
-    if (tc == NULL) { return false; }
+    if (ATOMIC_LOAD(&t->backlog) > 0 || ATOMIC_LOAD(&t->shutting_down)) {
+        ATOMIC_STORE(&ti->parked, 0);
+    } else {
+        ATOMIC_BOOL_COMPARE_AND_SWAP(&ti->status, STATUS_AWAKE, STATUS_ASLEEP);
+#if THREADPOOL_USE_FUTEX
+        while (ATOMIC_LOAD(&ti->parked) == 1) {
+            (void)syscall(SYS_futex, &ti->parked, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+        }
+#else
+        pthread_mutex_lock(&ti->park_lock);
+        while (ATOMIC_LOAD(&ti->parked) == 1) {
+            pthread_cond_wait(&ti->park_cond, &ti->park_lock);
+        }
+        pthread_mutex_unlock(&ti->park_lock);
+#endif
+        ATOMIC_BOOL_COMPARE_AND_SWAP(&ti->status, STATUS_ASLEEP, STATUS_AWAKE);
+    }
 
-    int pipe_fds[2];
-    if (0 != pipe(pipe_fds)) {
-        printf("pipe(2) failure\n");
-        free(tc);
-        return false;
+    ATOMIC_SUB_FETCH(&t->parked_threads, 1);
+}
+
+/* Wake TI if it's parked. Returns whether it was. */
+static bool unpark(struct thread_info *ti) {
+    if (ATOMIC_LOAD(&ti->parked) == 0) { return false; }
+    if (ATOMIC_EXCHANGE(&ti->parked, 0) == 0) { return false; }
+#if THREADPOOL_USE_FUTEX
+    (void)syscall(SYS_futex, &ti->parked, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&ti->park_lock);
+    pthread_cond_signal(&ti->park_cond);
+    pthread_mutex_unlock(&ti->park_lock);
+#endif
+    return true;
+}
+
+static bool init_worker(struct threadpool *t, struct thread_info *ti, uint16_t id) {
+    size_t size = (size_t)1 << t->task_ringbuf_size2;
+    ti->deque.slots = calloc(size, sizeof(struct deque_slot));
+    ti->inbox.slots = calloc(size, sizeof(struct inbox_slot));
+    if (ti->deque.slots == NULL || ti->inbox.slots == NULL) { goto cleanup; }
+    ti->deque.mask = size - 1;
+    ti->inbox.mask = size - 1;
+    for (size_t i = 0; i < size; i++) { ti->inbox.slots[i].seq = i; }
+
+#if !THREADPOOL_USE_FUTEX
+    if (0 != pthread_mutex_init(&ti->park_lock, NULL)) { goto cleanup; }
+    if (0 != pthread_cond_init(&ti->park_cond, NULL)) {
+        pthread_mutex_destroy(&ti->park_lock);
+        goto cleanup;
     }
+#endif
 
-    ti->child_fd = pipe_fds[0];
-    ti->parent_fd = pipe_fds[1];
+    ti->id = id;
+    ti->status = STATUS_AWAKE;
+    return true;
 
-    *tc = (struct thread_context){ .t = t, .ti = ti };
+cleanup:
+    free(ti->deque.slots);
+    free(ti->inbox.slots);
+    memset(ti, 0, sizeof(*ti));
+    return false;
+}
+
+static struct thread_info *spawn(struct threadpool *t) {
+    if (ATOMIC_LOAD(&t->live_threads) >= t->max_threads) { return NULL; }
 
-    int res = pthread_create(&ti->t, NULL, thread_task, tc);
-    if (res == 0) {
-        ti->status = STATUS_AWAKE;
-        return true;
-    } else if (res == EAGAIN) {
-        close(pipe_fds[0]);
-        close(pipe_fds[1]);
+    struct thread_info *res = NULL;
+    pthread_mutex_lock(&t->spawn_lock);
+    uint16_t id = t->live_threads;
+    if (id >= t->max_threads || t->shutting_down) { goto done; }
+
+    struct thread_info *ti = &t->threads[id];
+    struct thread_context *tc = malloc(sizeof(*tc));
+    if (tc == NULL) { goto done; }
+    if (!init_worker(t, ti, id)) {
         free(tc);
-        return false;
+        goto done;
+    }
+
+    *tc = (struct thread_context){ .t = t, .ti = ti };
+
+    int pcres = pthread_create(&ti->t, NULL, thread_task, tc);
+    if (pcres == 0) {
+        ATOMIC_STORE(&t->live_threads, id + 1);
+        res = ti;
     } else {
-        assert(false);
+        assert(pcres == EAGAIN);
+        free(tc);
+        free(ti->deque.slots);
+        free(ti->inbox.slots);
+#if !THREADPOOL_USE_FUTEX
+        pthread_cond_destroy(&ti->park_cond);
+        pthread_mutex_destroy(&ti->park_lock);
+#endif
+        memset(ti, 0, sizeof(*ti));
     }
+
+done:
+    pthread_mutex_unlock(&t->spawn_lock);
+    return res;
 }
 
 static void *thread_task(void *arg) {
@@ -292,71 +499,24 @@ static void *thread_task(void *arg) {
     struct threadpool *t = tc->t;
     struct thread_info *ti = tc->ti;
 
-    size_t mask = t->task_ringbuf_mask;
-    struct pollfd pfd[1] = { { .fd=ti->child_fd, .events=POLLIN }, };
-    uint8_t read_buf[NOTIFY_MSG_LEN*32];
-
-    while (ti->status < STATUS_SHUTDOWN) {
-        if (t->task_request_head == t->task_commit_head) {
-            if (ti->status == STATUS_AWAKE) {
-                ti->status = STATUS_ASLEEP;
-            }
-            int res = poll(pfd, 1, -1);
-            if (res == 1) {
-                if (pfd[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
-                    /* TODO: HUP should be distinct from ERR -- hup is
-                     * intentional shutdown, ERR probably isn't. */
-                    ti->status = STATUS_SHUTDOWN;
-                    break;
-                } else if (pfd[0].revents & POLLIN) {
-                    if (ti->status == STATUS_ASLEEP) { ti->status = STATUS_AWAKE; }
-                    //SPIN_ADJ(t->active_threads, 1);
-                    ssize_t rres = read(ti->child_fd, read_buf, sizeof(read_buf));
-                    if (rres < 0) {
-                        assert(0);
-                    }
-                }
-            }
-        }
-
-        while (ti->status < STATUS_SHUTDOWN) {
-            size_t ch = t->task_commit_head;
-            size_t rh = t->task_request_head;
-            if (rh > ch - 1) {
-                break;          /* nothing to do */
-            }
-            if (ATOMIC_BOOL_COMPARE_AND_SWAP(&t->task_request_head, rh, rh + 1)) {
-                struct marked_task *ptask = &t->tasks[rh & mask];
-                assert(ptask->mark == rh);
-
-                struct marked_task task = {
-                    .task = ptask->task,
-                    .cleanup = ptask->cleanup,
-                    .udata = ptask->udata,
-                };
-
-                release_current_task(t, ptask, rh);
-                ptask = NULL;
-                task.task(task.udata);
-                break;
-            }
+    (void)pthread_setspecific(t->thread_key, (void *)(WORKER_KEY_FLAG | ti->id));
+
+    struct threadpool_task task;
+    while (!ATOMIC_LOAD(&t->shutting_down)) {
+        if (deque_pop(&ti->deque, &task)
+            || inbox_pop(&ti->inbox, &task)
+            || steal(t, ti, &task)) {
+            ATOMIC_SUB_FETCH(&t->backlog, 1);
+            task.task(task.udata);
+        } else if (ATOMIC_LOAD(&t->backlog) > 0) {
+            /* A task is still being queued, or a steal lost a race. */
+            sched_yield();
+        } else {
+            park(t, ti);
         }
     }
 
-    close(ti->child_fd);
+    ATOMIC_STORE(&ti->status, STATUS_SHUTDOWN);
     free(tc);
     return NULL;
 }
-
-static void release_current_task(struct threadpool *t, struct marked_task *task, size_t rh) {
-    size_t mask = t->task_ringbuf_mask;
-    task->mark = ~rh;
-    for (;;) {
-        size_t relh = t->task_release_head;
-        task = &t->tasks[relh & mask];
-        if (task->mark != ~relh) { break; }
-        if (ATOMIC_BOOL_COMPARE_AND_SWAP(&t->task_release_head, relh, relh + 1)) {
-            assert(relh < t->task_commit_head);
-        }
-    }
-}
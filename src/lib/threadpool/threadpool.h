@@ -30,9 +30,9 @@ struct threadpool;
 
 /** Configuration for thread pool. */
 struct threadpool_config {
-    uint8_t task_ringbuf_size2; //> log2(size) of task ring buffer
+    uint8_t task_ringbuf_size2; //> log2(size) of each worker's task queues
     size_t max_delay;           //> max delay, in msec. 0 => default
-    uint8_t max_threads;        //> max threads to alloc on demand
+    uint16_t max_threads;       //> max threads to alloc on demand
 };
 
 /** Callback for a task, with an arbitrary user-supplied pointer. */
@@ -51,8 +51,8 @@ struct threadpool_task {
 
 /** Statistics about the current state of the threadpool. */
 struct threadpool_info {
-    uint8_t active_threads;
-    uint8_t dormant_threads;
+    uint16_t active_threads;
+    uint16_t dormant_threads;
     size_t backlog_size;
 };
 
@@ -63,6 +63,12 @@ struct threadpool *Threadpool_Init(struct threadpool_config *cfg);
  * registered or not. If Threadpool_Shutdown has been called, this
  * function will always return false, due to API misuse.
  *
+ * Each worker has its own task queues, and idle workers steal tasks
+ * from busy ones. A task scheduled by a worker goes on that worker's
+ * own queue; each other thread is given a preferred worker the first
+ * time it schedules a task, so a listener's tasks keep going to the
+ * same worker unless it falls behind.
+ *
  * If *pushback is non-NULL, it will be set to the number of tasks
  * in the backlog, so code upstream can provide counterpressure.
  *
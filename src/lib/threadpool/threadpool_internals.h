@@ -21,21 +21,78 @@
 #include <pthread.h>
 #include "threadpool.h"
 
+/* Workers park on a futex on Linux, and on a condition variable
+ * elsewhere. */
+#ifdef __linux__
+#define THREADPOOL_USE_FUTEX 1
+#else
+#define THREADPOOL_USE_FUTEX 0
+#endif
+
 /** Current status of a worker thread. */
 typedef enum {
     STATUS_NONE,                //> undefined status
-    STATUS_ASLEEP,              //> thread is poll-sleeping to reduce CPU
+    STATUS_ASLEEP,              //> thread is parked to reduce CPU
     STATUS_AWAKE,               //> thread is active
     STATUS_SHUTDOWN,            //> thread has been notified about shutdown
     STATUS_JOINED,              //> thread has been pthread_join'd
 } thread_status_t;
 
+/** A slot in a worker's deque. The fields are accessed atomically,
+ * because a thief may read a slot the owner is overwriting, in which
+ * case the thief's CAS on top fails and it discards what it read. */
+struct deque_slot {
+    threadpool_task_cb *task;
+    threadpool_task_cleanup_cb *cleanup;
+    void *udata;
+};
+
+/** Chase-Lev work-stealing deque of tasks scheduled by a worker from
+ * within its own tasks. Only the owning worker pushes and pops at the
+ * bottom; other workers steal from the top. It does not grow -- when
+ * it's full, tasks go through the inbox instead. */
+struct task_deque {
+    int64_t top;                //> next slot to steal
+    int64_t bottom;             //> next slot to push
+    struct deque_slot *slots;
+    int64_t mask;
+};
+
+/** A slot in a worker's inbox, with a sequence number saying whether
+ * it's ready to be written or read (as in Vyukov's bounded MPMC queue). */
+struct inbox_slot {
+    size_t seq;
+    threadpool_task_cb *task;
+    threadpool_task_cleanup_cb *cleanup;
+    void *udata;
+};
+
+/** Bounded multi-producer, multi-consumer queue of tasks scheduled for
+ * a worker by threads outside the pool. The owner takes from it first,
+ * but idle workers steal from it too. */
+struct task_inbox {
+    size_t enqueue_pos;
+    size_t dequeue_pos;
+    struct inbox_slot *slots;
+    size_t mask;
+};
+
 /** Info retained by a thread while working. */
 struct thread_info {
     pthread_t t;                //> thread
-    int parent_fd;              //> alert pipe parent writes into
-    int child_fd;               //> alert pipe child reads from
     thread_status_t status;     //> current worker thread status
+    uint16_t id;                //> index in threadpool.threads
+
+    /* Set to 1 by the worker before it parks, and back to 0 by
+     * whichever thread unparks it. */
+    uint32_t parked;
+#if !THREADPOOL_USE_FUTEX
+    pthread_mutex_t park_lock;
+    pthread_cond_t park_cond;
+#endif
+
+    struct task_deque deque;    //> tasks scheduled by this worker
+    struct task_inbox inbox;    //> tasks scheduled by other threads
 };
 
 /** Thread_info, plus pointer back to main threadpool manager. */
@@ -44,63 +101,45 @@ struct thread_context {
     struct thread_info *ti;
 };
 
-/** A task, with an additional mark. */
-struct marked_task {
-    threadpool_task_cb *task;
-    threadpool_task_cleanup_cb *cleanup;
-    void *udata;
-    /* This mark is used to indicate which tasks can have the commit_head
-     * and release_head counters advanced past them.
-     *
-     * mark == (task_commit_head that points at tast): commit
-     * mark == ~(task_release_head that points at tast): release
-     *
-     * Any other value means it is in an intermediate state and should be
-     * retried later. */
-    size_t mark;
-};
-
 /** Internal threadpool state. */
 struct threadpool {
-    /* reserve -> commit -> request -> release */
-    size_t task_reserve_head;   //> reserved for write
-    size_t task_commit_head;    //> done with write
-    size_t task_request_head;   //> requested for read
-    size_t task_release_head;   //> done processing task, can be overwritten
-
-    struct marked_task *tasks;  //> ring buffer for tasks
+    /* Tasks that have been scheduled but not yet started, across all
+     * workers. This is incremented before a task is queued, so it is
+     * never less than the number of queued tasks, and idle workers
+     * don't park while it's nonzero. */
+    size_t backlog;
 
-    /* Size and mask. These can be derived from task_ringbuf_size2,
-     * but are cached to reduce CPU. */
-    size_t task_ringbuf_size;   //> size of ring buffer
-    size_t task_ringbuf_mask;   //> mask to fit counter within ring buffer
-    uint8_t task_ringbuf_size2; //> log2 of size of ring buffer
+    /* Log2 of the size of each worker's deque and inbox. */
+    uint8_t task_ringbuf_size2;
 
     bool shutting_down;         //> shutdown has been called
-    uint8_t live_threads;       //> currently live threads
-    uint8_t max_threads;        //> max number of threads to start
+    uint16_t live_threads;      //> currently live threads
+    uint16_t max_threads;       //> max number of threads to start
+    uint16_t parked_threads;    //> workers currently parked
+    uint16_t next_hint;         //> next preferred worker to hand out
     struct thread_info *threads;
+
+    /* Serializes starting new workers. */
+    pthread_mutex_t spawn_lock;
+
+    /* Per-thread scheduling state. For workers, the worker's id, with
+     * WORKER_KEY_FLAG set; for other threads, their preferred worker,
+     * plus one (so NULL means none has been assigned yet). */
+    pthread_key_t thread_key;
 };
 
+#define WORKER_KEY_FLAG ((uintptr_t)1 << (8 * sizeof(uintptr_t) - 1))
+
+#define ATOMIC_LOAD(P) __atomic_load_n(P, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(P, V) __atomic_store_n(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_EXCHANGE(P, V) __atomic_exchange_n(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD_FETCH(P, V) __atomic_add_fetch(P, V, __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB_FETCH(P, V) __atomic_sub_fetch(P, V, __ATOMIC_SEQ_CST)
+
 /* Do an atomic compare-and-swap, changing *PTR from OLD to NEW. Returns
  * true if the swap succeeded, false if it failed (generally because
  * another thread updated the memory first). */
 #define ATOMIC_BOOL_COMPARE_AND_SWAP(PTR, OLD, NEW)     \
     (__sync_bool_compare_and_swap(PTR, OLD, NEW))
 
-/* Message sent to wake up a thread. The message contents are currently unimportant. */
-#define NOTIFY_MSG "!"
-#define NOTIFY_MSG_LEN 1
-
-/* Spin attempting to atomically adjust F by ADJ until successful. */
-#define SPIN_ADJ(F, ADJ)                                                \
-    do {                                                                \
-        for (;;) {                                                      \
-            size_t v = F;                                               \
-            if (ATOMIC_BOOL_COMPARE_AND_SWAP(&F, v, v + ADJ)) {         \
-                break;                                                  \
-            }                                                           \
-        }                                                               \
-    } while (0)
-
 #endif
@@ -50,6 +50,49 @@ void test_kinetic_client_throughput_for_small_sized_objects(void)
     run_throghput_tests(200, 120);
 }
 
+void test_kinetic_client_throughput_for_noops(void)
+{
+    const size_t num_ops = 1000;
+    printf("\n"
+        "========================================\n"
+        "NOOP Throughput Test\n"
+        "========================================\n"
+        "Count:      %zu operations\n\n",
+        num_ops);
+
+    // NOOPs are blocking, so this measures the round-trip latency of the
+    // smallest request, with no value or key handling.
+    struct timeval start_time;
+    gettimeofday(&start_time, NULL);
+
+    for (size_t i = 0; i < num_ops; i++) {
+        KineticStatus status = KineticClient_NoOp(Fixture.session);
+        if (status != KINETIC_STATUS_SUCCESS) {
+            fprintf(stderr, "NOOP failed w/status: %s\n", Kinetic_GetStatusDescription(status));
+            TEST_FAIL();
+        }
+    }
+
+    struct timeval stop_time;
+    gettimeofday(&stop_time, NULL);
+    int64_t elapsed_us = ((stop_time.tv_sec - start_time.tv_sec) * 1000000)
+        + (stop_time.tv_usec - start_time.tv_usec);
+    float elapsed_ms = elapsed_us / 1000.0f;
+    float throughput = (num_ops * 1000.0f) / elapsed_ms;
+    fflush(stdout);
+    printf("\n"
+        "NOOP Performance:\n"
+        "----------------------------------------\n"
+        "count:      %zu operations\n"
+        "duration:   %.3f seconds\n"
+        "latency:    %.1f usec/op\n"
+        "throughput: %.2f ops/sec\n\n",
+        num_ops,
+        elapsed_ms / 1000.0f,
+        (float)elapsed_us / num_ops,
+        throughput);
+}
+
 static void op_finished(KineticCompletionData* kinetic_data, void* clientData);
 
 struct key_struct {
@@ -25,6 +25,8 @@
 #include "mock_bus_poll.h"
 #include "mock_syscall.h"
 #include "mock_send.h"
+#include "mock_send_queue.h"
+#include "mock_sender.h"
 #include "mock_listener.h"
 #include "mock_listener_task.h"
 #include "mock_threadpool.h"
@@ -101,7 +103,7 @@ void test_Bus_SendRequest_should_reject_send_on_unregistered_socket(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
 
-void test_Bus_SendRequest_should_reject_equal_sequence_IDs(void)
+void test_Bus_QueueRequest_should_expose_send_queue_rejection(void)
 {
     struct bus b = {
         .log_level = 0,
@@ -110,6 +112,7 @@ void test_Bus_SendRequest_should_reject_equal_sequence_IDs(void)
         .fd = 123,
         .seq_id = 3,
     };
+    bus_send_ticket ticket;
     test_box = calloc(1, sizeof(*test_box));
     TEST_ASSERT(test_box);
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
@@ -125,20 +128,30 @@ void test_Bus_SendRequest_should_reject_equal_sequence_IDs(void)
     value = &fake_ci;
     Yacht_Get_ExpectAndReturn(b.fd_set, msg.fd, &value, true);
 
-    TEST_ASSERT_FALSE(Bus_SendRequest(&b, &msg));
+    SendQueue_Push_ExpectAndReturn(&b, &fake_ci, test_box, &ticket, false);
+    TEST_ASSERT_FALSE(Bus_QueueRequest(&b, &msg, &ticket));
 
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
 
-void test_Bus_SendRequest_should_reject_lower_sequence_IDs(void)
+void test_Bus_QueueRequest_should_copy_the_message_segments_into_the_box(void)
 {
     struct bus b = {
         .log_level = 0,
     };
+    uint8_t header[9];
+    uint8_t body[100];
+    struct iovec iov[] = {
+        {.iov_base = header, .iov_len = sizeof(header)},
+        {.iov_base = body, .iov_len = sizeof(body)},
+    };
     bus_user_msg msg = {
         .fd = 123,
         .seq_id = 3,
+        .msg_iov = iov,
+        .msg_iovcnt = 2,
     };
+    bus_send_ticket ticket;
     test_box = calloc(1, sizeof(*test_box));
     TEST_ASSERT(test_box);
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
@@ -149,17 +162,25 @@ void test_Bus_SendRequest_should_reject_lower_sequence_IDs(void)
     TEST_ASSERT(b.fd_set);
 
     connection_info fake_ci = {
-        .largest_wr_seq_id_seen = msg.seq_id + 1,
+        .largest_wr_seq_id_seen = msg.seq_id - 1,
     };
     value = &fake_ci;
     Yacht_Get_ExpectAndReturn(b.fd_set, msg.fd, &value, true);
 
-    TEST_ASSERT_FALSE(Bus_SendRequest(&b, &msg));
+    SendQueue_Push_ExpectAndReturn(&b, &fake_ci, test_box, &ticket, true);
+    TEST_ASSERT_TRUE(Bus_QueueRequest(&b, &msg, &ticket));
+
+    // The caller's segment list may be gone by the time it's written
+    TEST_ASSERT_EQUAL_PTR(test_box->out_iov_buf, test_box->out_iov);
+    TEST_ASSERT_EQUAL(2, test_box->out_iovcnt);
+    TEST_ASSERT_EQUAL_PTR(body, test_box->out_iov[1].iov_base);
+    TEST_ASSERT_EQUAL(sizeof(header) + sizeof(body), test_box->out_msg_size);
 
+    free(test_box);
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
 
-void test_Bus_SendRequest_should_expose_callee_send_rejection(void)
+void test_Bus_QueueRequest_should_accept_a_request_nobody_will_wait_on(void)
 {
     struct bus b = {
         .log_level = 0,
@@ -183,13 +204,86 @@ void test_Bus_SendRequest_should_expose_callee_send_rejection(void)
     value = &fake_ci;
     Yacht_Get_ExpectAndReturn(b.fd_set, msg.fd, &value, true);
 
-    Send_DoBlockingSend_ExpectAndReturn(&b, test_box, false);
-    TEST_ASSERT_FALSE(Bus_SendRequest(&b, &msg));
+    SendQueue_Push_ExpectAndReturn(&b, &fake_ci, test_box, NULL, true);
+    TEST_ASSERT_TRUE(Bus_QueueRequest(&b, &msg, NULL));
+    TEST_ASSERT_EQUAL(0, fake_ci.refs);
 
+    free(test_box);
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
 
-void test_Bus_SendRequest_should_return_true_on_successful_delivery_queueing(void)
+void test_Bus_QueueRequest_should_keep_the_connection_until_the_ticket_is_flushed(void)
+{
+    struct bus b = {
+        .log_level = 0,
+    };
+    bus_user_msg msg = {
+        .fd = 123,
+        .seq_id = 3,
+    };
+    test_box = calloc(1, sizeof(*test_box));
+    TEST_ASSERT(test_box);
+    TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
+
+    struct yacht fake_yacht = { .size = 0, };
+    b.fd_set = &fake_yacht;
+
+    connection_info fake_ci = {
+        .largest_wr_seq_id_seen = msg.seq_id - 1,
+    };
+    value = &fake_ci;
+    Yacht_Get_ExpectAndReturn(b.fd_set, msg.fd, &value, true);
+
+    bus_send_ticket ticket;
+    SendQueue_Push_ExpectAndReturn(&b, &fake_ci, test_box, &ticket, true);
+    TEST_ASSERT_TRUE(Bus_QueueRequest(&b, &msg, &ticket));
+    TEST_ASSERT_EQUAL(1, fake_ci.refs);
+
+    // Bus_ReleaseSocket would wait here until the ticket is flushed
+    ticket.conn = &fake_ci;
+    SendQueue_Flush_ExpectAndReturn(&b, &fake_ci, &ticket, true);
+    TEST_ASSERT_TRUE(Bus_FlushRequest(&b, &ticket));
+    TEST_ASSERT_EQUAL(0, fake_ci.refs);
+
+    free(test_box);
+    TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
+}
+
+void test_Bus_FlushRequest_should_expose_callee_send_rejection(void)
+{
+    struct bus b = {
+        .log_level = 0,
+    };
+    connection_info fake_ci = {
+        .refs = 1,  // taken by Bus_QueueRequest
+    };
+    bus_send_ticket ticket = {
+        .conn = &fake_ci,
+    };
+
+    SendQueue_Flush_ExpectAndReturn(&b, &fake_ci, &ticket, false);
+    TEST_ASSERT_FALSE(Bus_FlushRequest(&b, &ticket));
+    TEST_ASSERT_EQUAL(0, fake_ci.refs);
+}
+
+void test_Bus_FlushRequest_should_return_true_on_successful_delivery_queueing(void)
+{
+    struct bus b = {
+        .log_level = 0,
+    };
+    connection_info fake_ci = {
+        .refs = 1,  // taken by Bus_QueueRequest
+    };
+    bus_send_ticket ticket = {
+        .conn = &fake_ci,
+    };
+
+    SendQueue_Flush_ExpectAndReturn(&b, &fake_ci, &ticket, true);
+    TEST_ASSERT_TRUE(Bus_FlushRequest(&b, &ticket));
+    TEST_ASSERT_EQUAL(0, fake_ci.refs);
+}
+
+void test_Bus_SendRequest_should_queue_and_flush_the_request(void)
 {
     struct bus b = {
         .log_level = 0,
@@ -213,9 +307,11 @@ void test_Bus_SendRequest_should_return_true_on_successful_delivery_queueing(voi
     value = &fake_ci;
     Yacht_Get_ExpectAndReturn(b.fd_set, msg.fd, &value, true);
 
-    Send_DoBlockingSend_ExpectAndReturn(&b, test_box, true);
+    SendQueue_Push_IgnoreAndReturn(true);
+    SendQueue_Flush_IgnoreAndReturn(true);
     TEST_ASSERT_TRUE(Bus_SendRequest(&b, &msg));
 
+    free(test_box);
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
 
@@ -234,6 +330,27 @@ void test_Bus_RegisterSocket_should_expose_memory_failures(void)
     TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_PLAIN, 4, NULL));
 }
 
+void test_Bus_RegisterSocket_should_expose_failure_to_make_the_socket_non_blocking(void)
+{
+    struct listener fake_listener;
+    struct listener *listeners[] = {
+        &fake_listener,
+    };
+    struct bus b = {
+        .listener_count = 1,
+        .listeners = listeners,
+    };
+    TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
+    fake_listener.bus = &b;
+    test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, false);
+
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
+    TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_PLAIN, 35, NULL));
+    TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
+}
+
 void test_Bus_RegisterSocket_should_expose_SSL_connection_failure(void)
 {
     struct listener fake_listener;
@@ -247,8 +364,11 @@ void test_Bus_RegisterSocket_should_expose_SSL_connection_failure(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     BusSSL_Connect_ExpectAndReturn(&b, 35, NULL);
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
     TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_SSL, 35, NULL));
     TEST_ASSERT_EQUAL(0, pthread_mutex_destroy(&b.fd_set_lock));
 }
@@ -266,10 +386,13 @@ void test_Bus_RegisterSocket_should_expose_hash_table_failure(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     struct yacht fake_yacht = { .size = 0, };
     b.fd_set = &fake_yacht;
     Yacht_Set_ExpectAndReturn(b.fd_set, 35, test_ci, &old_value, false);
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
     TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_PLAIN, 35, NULL));
 }
 
@@ -286,11 +409,14 @@ void test_Bus_RegisterSocket_should_expose_Listener_AddSocket_failure(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     struct yacht fake_yacht = { .size = 0, };
     b.fd_set = &fake_yacht;
     Yacht_Set_ExpectAndReturn(b.fd_set, 35, test_ci, &old_value, true);
     Listener_AddSocket_ExpectAndReturn(&fake_listener, test_ci, &completion_pipe, false);
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
 
     TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_PLAIN, 35, NULL));
 }
@@ -308,6 +434,8 @@ void test_Bus_RegisterSocket_should_expose_poll_error(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     struct yacht fake_yacht = { .size = 0, };
     b.fd_set = &fake_yacht;
@@ -315,6 +443,7 @@ void test_Bus_RegisterSocket_should_expose_poll_error(void)
     Listener_AddSocket_ExpectAndReturn(&fake_listener, test_ci, &completion_pipe, true);
     completion_pipe = 123;
     BusPoll_OnCompletion_ExpectAndReturn(&b, 123, false);
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
 
     TEST_ASSERT_FALSE(Bus_RegisterSocket(&b, BUS_SOCKET_PLAIN, 35, NULL));
 }
@@ -332,6 +461,8 @@ void test_Bus_RegisterSocket_should_successfully_add_plain_socket(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     struct yacht fake_yacht = { .size = 0, };
     b.fd_set = &fake_yacht;
@@ -357,6 +488,8 @@ void test_Bus_RegisterSocket_should_successfully_add_SSL_socket(void)
     TEST_ASSERT_EQUAL(0, pthread_mutex_init(&b.fd_set_lock, NULL));
     fake_listener.bus = &b;
     test_ci = calloc(1, sizeof(*test_ci));
+    SendQueue_Init_Expect(&test_ci->send_queue, NULL);
+    Util_SetNonblocking_ExpectAndReturn(35, true);
 
     SSL fake_ssl;
     BusSSL_Connect_ExpectAndReturn(&b, 35, &fake_ssl);
@@ -467,7 +600,10 @@ void test_Bus_ReleaseSocket_should_expose_SSL_disconnection_failure(void)
     old_value = test_ci;
     test_ci->ssl = &fake_ssl;
 
+    SendQueue_Close_Expect(&b, &test_ci->send_queue);
     BusSSL_Disconnect_ExpectAndReturn(&b, test_ci->ssl, false);
+    SendQueue_GetStats_Ignore();
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
 
     void *old_udata = NULL;
     TEST_ASSERT_FALSE(Bus_ReleaseSocket(&b, fd, &old_udata));
@@ -498,6 +634,9 @@ void test_Bus_ReleaseSocket_should_return_true_on_successful_socket_disconnectio
     struct yacht fake_yacht = { .size = 0, };
     b.fd_set = &fake_yacht;
     Yacht_Remove_ExpectAndReturn(b.fd_set, fd, &old_value, true);
+    SendQueue_Close_Expect(&b, &test_ci->send_queue);
+    SendQueue_GetStats_Ignore();
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
 
     void *old_udata = NULL;
     TEST_ASSERT_TRUE(Bus_ReleaseSocket(&b, fd, &old_udata));
@@ -532,7 +671,10 @@ void test_Bus_ReleaseSocket_should_return_true_on_successful_SSL_socket_disconne
     old_value = test_ci;
     test_ci->ssl = &fake_ssl;
 
+    SendQueue_Close_Expect(&b, &test_ci->send_queue);
     BusSSL_Disconnect_ExpectAndReturn(&b, test_ci->ssl, true);
+    SendQueue_GetStats_Ignore();
+    SendQueue_Destroy_Expect(&b, &test_ci->send_queue);
 
     void *old_udata = NULL;
     TEST_ASSERT_TRUE(Bus_ReleaseSocket(&b, fd, &old_udata));
@@ -745,3 +887,58 @@ void test_Bus_Free_should_free_bus(void)
     BusSSL_CtxFree_Expect(b);
     Bus_Free(b);
 }
+
+static bus_msg_result_t inline_result;
+static void *inline_udata = NULL;
+static int inline_calls = 0;
+
+static void inline_cb(bus_msg_result_t *res, void *udata)
+{
+    inline_result = *res;
+    inline_udata = udata;
+    inline_calls++;
+}
+
+void test_Bus_ProcessBoxedMessage_should_call_inline_callback_directly_on_success(void)
+{
+    struct bus b = {
+        .log_level = 0,
+    };
+    boxed_msg *box = calloc(1, sizeof(*box));
+    box->cb = inline_cb;
+    box->udata = &b;
+    box->inline_cb = true;
+    box->result.status = BUS_SEND_SUCCESS;
+    box->result.u.response.seq_id = 123;
+    inline_calls = 0;
+
+    size_t backpressure = 99;
+    TEST_ASSERT_TRUE(Bus_ProcessBoxedMessage(&b, box, &backpressure));
+
+    TEST_ASSERT_EQUAL(1, inline_calls);
+    TEST_ASSERT_EQUAL_PTR(&b, inline_udata);
+    TEST_ASSERT_EQUAL(BUS_SEND_SUCCESS, inline_result.status);
+    TEST_ASSERT_EQUAL(123, inline_result.u.response.seq_id);
+    TEST_ASSERT_EQUAL(0, backpressure);
+}
+
+void test_Bus_ProcessBoxedMessage_should_hand_inline_callback_failures_to_the_threadpool(void)
+{
+    struct threadpool fake_threadpool = {
+        .max_threads = 8,
+    };
+    struct bus b = {
+        .log_level = 0,
+        .threadpool = &fake_threadpool,
+    };
+    boxed_msg *box = calloc(1, sizeof(*box));
+    box->cb = inline_cb;
+    box->inline_cb = true;
+    box->result.status = BUS_SEND_RX_TIMEOUT;
+    inline_calls = 0;
+
+    Threadpool_Schedule_IgnoreAndReturn(true);
+    TEST_ASSERT_TRUE(Bus_ProcessBoxedMessage(&b, box, NULL));
+    TEST_ASSERT_EQUAL(0, inline_calls);
+    free(box);
+}
@@ -19,6 +19,7 @@
 #include "listener.h"
 #include "listener_internal.h"
 #include "atomic.h"
+#include "timer_wheel.h"
 
 #include <errno.h>
 
@@ -30,6 +31,9 @@
 #include "mock_listener_cmd.h"
 #include "mock_listener_io.h"
 #include "mock_listener_task.h"
+#ifdef BUS_USE_IO_URING
+#include "mock_listener_uring.h"
+#endif
 
 struct bus *b = NULL;
 boxed_msg *box = NULL;
@@ -44,7 +48,7 @@ static struct listener Listener = {
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
     .result.status = BUS_SEND_REQUEST_COMPLETE,
 };
 
@@ -147,18 +151,18 @@ void test_Listener_Shutdown_should_add_ADD_SOCKET_msg_to_queue(void) {
 void test_Listener_HoldResponse_should_enqueue_HOLD_RESPONSE_msg(void) {
     int socket = 7;
     int64_t seq_id = 12345;
-    int16_t timeout_sec = 9;
+    uint32_t timeout_msec = 9000;
     listener_msg msg;
     ListenerHelper_GetFreeMsg_ExpectAndReturn(l, &msg);
-    int notify_fd = -1;
-    ListenerHelper_PushMessage_ExpectAndReturn(l, &msg, &notify_fd, true);
-    msg.pipes[1] = 123;
-    TEST_ASSERT_TRUE(Listener_HoldResponse(l, socket, seq_id, timeout_sec, &notify_fd));
+    uint16_t backpressure = 0;
+    ListenerTask_GetBackpressure_ExpectAndReturn(l, 0x1234);
+    ListenerHelper_PushRXMessage_ExpectAndReturn(l, &msg, true);
+    TEST_ASSERT_TRUE(Listener_HoldResponse(l, socket, seq_id, timeout_msec, &backpressure));
     TEST_ASSERT_EQUAL(MSG_HOLD_RESPONSE, msg.type);
     TEST_ASSERT_EQUAL(socket, msg.u.hold.fd);
     TEST_ASSERT_EQUAL(seq_id, msg.u.hold.seq_id);
-    TEST_ASSERT_EQUAL(123, msg.u.hold.notify_fd);
-    TEST_ASSERT_EQUAL(timeout_sec, msg.u.hold.timeout_sec);
+    TEST_ASSERT_EQUAL(timeout_msec, msg.u.hold.timeout_msec);
+    TEST_ASSERT_EQUAL(0x1234, backpressure);
 }
 
 void test_Listener_ExpectResponse_should_enqueue_EXPECT_RESPONSE_msg(void) {
@@ -170,7 +174,7 @@ void test_Listener_ExpectResponse_should_enqueue_EXPECT_RESPONSE_msg(void) {
     ListenerHelper_GetFreeMsg_ExpectAndReturn(l, &msg);
     uint16_t backpressure = 0;
     ListenerTask_GetBackpressure_ExpectAndReturn(l, 0x4321);
-    ListenerHelper_PushMessage_ExpectAndReturn(l, &msg, NULL, true);
+    ListenerHelper_PushRXMessage_ExpectAndReturn(l, &msg, true);
 
     TEST_ASSERT_TRUE(Listener_ExpectResponse(l, &box, &backpressure));
     TEST_ASSERT_EQUAL(MSG_EXPECT_RESPONSE, msg.type);
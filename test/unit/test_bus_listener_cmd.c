@@ -20,6 +20,7 @@
 #include "listener_cmd_internal.h"
 #include "listener_internal.h"
 #include "atomic.h"
+#include "timer_wheel.h"
 
 #include <errno.h>
 
@@ -31,6 +32,9 @@
 #include "mock_listener_helper.h"
 #include "mock_listener_io.h"
 #include "mock_listener_task.h"
+#ifdef BUS_USE_IO_URING
+#include "mock_listener_uring.h"
+#endif
 
 struct bus *b = NULL;
 boxed_msg *box = NULL;
@@ -49,7 +53,7 @@ static struct listener Listener;
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
     .result.status = BUS_SEND_REQUEST_COMPLETE,
 };
 
@@ -62,6 +66,7 @@ void setUp(void) {
     l->bus = &B;
     l->tracked_fds = 0;
     l->inactive_fds = 0;
+    TimerWheel_Init(&l->timers, 0);
     box = &Box;
 }
 
@@ -227,6 +232,150 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_ADD_SOCKET_co
     TEST_ASSERT_EQUAL(2, l->fds[3 + INCOMING_MSG_PIPE].fd);
 }
 
+#if BUS_HAVE_EPOLL
+void test_ListenerCmd_CheckIncomingMessages_should_register_added_socket_with_epoll(void) {
+    connection_info *ci = calloc(1, sizeof(*ci));
+    *(int *)&ci->fd = 91;
+
+    listener_msg msg = {
+        .type = MSG_ADD_SOCKET,
+        .u.add_socket = {
+            .info = ci,
+            .notify_fd = 7,
+        },
+    };
+
+    l->fds[INCOMING_MSG_PIPE_ID].fd = 5;
+    l->fds[INCOMING_MSG_PIPE_ID].revents = POLLIN;
+    l->read_buf = malloc(256);
+    memcpy(&l->msgs[0], &msg, sizeof(msg));
+    cmd_buf[0] = 0;
+    int res = 1;
+    l->poll_backend = BUS_POLL_BACKEND_EPOLL;
+    l->epoll_fd = 9;
+
+    /* The socket is registered with epoll before it's tracked. */
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.ptr = ci,
+    };
+    syscall_read_ExpectAndReturn(l->fds[INCOMING_MSG_PIPE_ID].fd, cmd_buf, sizeof(cmd_buf), 1);
+    ListenerTask_GrowReadBuf_ExpectAndReturn(l, 31, true);
+    syscall_epoll_ctl_ExpectAndReturn(9, EPOLL_CTL_ADD, 91, &ev, 0);
+    expect_notify_caller(l, 7);
+    ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
+    ListenerCmd_CheckIncomingMessages(l, &res);
+
+    TEST_ASSERT_EQUAL(ci, l->fd_info[0]);
+    TEST_ASSERT_EQUAL(1, l->tracked_fds);
+}
+
+void test_ListenerCmd_CheckIncomingMessages_should_unregister_removed_socket_from_epoll(void) {
+    listener_msg msg = {
+        .id = 4,
+        .type = MSG_REMOVE_SOCKET,
+        .pipes = {7, 8},
+        .u.remove_socket = {
+            .fd = 50,
+            .notify_fd = 100,
+        },
+    };
+    setup_command(&msg, NULL);
+
+    l->tracked_fds = 1;
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 50;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    connection_info *ci0 = calloc(1, sizeof(*ci0));
+    l->fd_info[0] = ci0;
+
+    /* The socket also has events pending from the same wakeup. */
+    l->poll_backend = BUS_POLL_BACKEND_EPOLL;
+    l->epoll_fd = 9;
+    l->epoll_ready = 2;
+    l->epoll_events[0].events = POLLIN;
+    l->epoll_events[0].data.ptr = NULL;
+    l->epoll_events[1].events = POLLIN;
+    l->epoll_events[1].data.ptr = ci0;
+
+    syscall_epoll_ctl_ExpectAndReturn(9, EPOLL_CTL_DEL, 50, NULL, 0);
+    expect_notify_caller(l, 100);
+
+    int res = 1;
+    ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
+    ListenerCmd_CheckIncomingMessages(l, &res);
+
+    TEST_ASSERT_EQUAL(0, l->tracked_fds);
+    TEST_ASSERT_EQUAL(POLLIN, l->epoll_events[0].events);
+    TEST_ASSERT_EQUAL(0, l->epoll_events[1].events);
+    free(ci0);
+}
+#endif
+
+#if BUS_HAVE_IO_URING
+void test_ListenerCmd_CheckIncomingMessages_should_start_receiving_on_added_socket_with_io_uring(void) {
+    connection_info *ci = calloc(1, sizeof(*ci));
+    *(int *)&ci->fd = 91;
+
+    listener_msg msg = {
+        .type = MSG_ADD_SOCKET,
+        .u.add_socket = {
+            .info = ci,
+            .notify_fd = 7,
+        },
+    };
+
+    l->fds[INCOMING_MSG_PIPE_ID].fd = 5;
+    l->fds[INCOMING_MSG_PIPE_ID].revents = POLLIN;
+    l->read_buf = malloc(256);
+    memcpy(&l->msgs[0], &msg, sizeof(msg));
+    cmd_buf[0] = 0;
+    int res = 1;
+    l->poll_backend = BUS_POLL_BACKEND_IO_URING;
+
+    /* The first receive is sized by the sink callback. */
+    syscall_read_ExpectAndReturn(l->fds[INCOMING_MSG_PIPE_ID].fd, cmd_buf, sizeof(cmd_buf), 1);
+    ListenerTask_GrowReadBuf_ExpectAndReturn(l, 31, true);
+    ListenerUring_AddSocket_ExpectAndReturn(l, ci, true);
+    expect_notify_caller(l, 7);
+    ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
+    ListenerCmd_CheckIncomingMessages(l, &res);
+
+    TEST_ASSERT_EQUAL(31, ci->to_read_size);
+    TEST_ASSERT_EQUAL(ci, l->fd_info[0]);
+    TEST_ASSERT_EQUAL(1, l->tracked_fds);
+}
+
+void test_ListenerCmd_CheckIncomingMessages_should_stop_receiving_on_removed_socket_with_io_uring(void) {
+    listener_msg msg = {
+        .id = 4,
+        .type = MSG_REMOVE_SOCKET,
+        .pipes = {7, 8},
+        .u.remove_socket = {
+            .fd = 50,
+            .notify_fd = 100,
+        },
+    };
+    setup_command(&msg, NULL);
+
+    l->tracked_fds = 1;
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 50;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    connection_info *ci0 = calloc(1, sizeof(*ci0));
+    l->fd_info[0] = ci0;
+    l->poll_backend = BUS_POLL_BACKEND_IO_URING;
+
+    ListenerUring_RemoveSocket_Expect(l, ci0);
+    expect_notify_caller(l, 100);
+
+    int res = 1;
+    ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
+    ListenerCmd_CheckIncomingMessages(l, &res);
+
+    TEST_ASSERT_EQUAL(0, l->tracked_fds);
+    free(ci0);
+}
+#endif
+
 void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_REMOVE_SOCKET_command_freeing_single_fd(void) {
     listener_msg msg = {
         .id = 4,
@@ -444,15 +593,13 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_NULL_info_failure_case
         .u.hold = {
             .fd = 23,
             .seq_id = 12345,
-            .timeout_sec = 9,
-            .notify_fd = 123,
+            .timeout_msec = 9000,
         },
     };
 
     setup_command(&msg, NULL_INFO);
 
     int res = 1;
-    expect_notify_caller(l, 123);
     ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
     ListenerCmd_CheckIncomingMessages(l, &res);
     TEST_ASSERT_EQUAL(0, res);
@@ -466,8 +613,7 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_HOLD_RESPONSE
         .u.hold = {
             .fd = 23,
             .seq_id = 12345,
-            .timeout_sec = 9,
-            .notify_fd = 456,
+            .timeout_msec = 9000,
         },
     };
 
@@ -477,13 +623,14 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_HOLD_RESPONSE
     setup_command(&msg, &info);
 
     int res = 1;
-    expect_notify_caller(l, 456);
+    ListenerHelper_IndexRXInfo_Expect(l, &info, 23, 12345);
     ListenerTask_ReleaseMsg_Expect(l, &l->msgs[0]);
     ListenerCmd_CheckIncomingMessages(l, &res);
     TEST_ASSERT_EQUAL(0, res);
 
     TEST_ASSERT_EQUAL(RIS_HOLD, info.state);
-    TEST_ASSERT_EQUAL(9, info.timeout_sec);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&info.timer));
+    TEST_ASSERT_EQUAL(9000, info.timer.deadline);
     TEST_ASSERT_EQUAL(23, info.u.hold.fd);
     TEST_ASSERT_EQUAL(false, info.u.hold.has_result);
 }
@@ -508,7 +655,6 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_EXPECT_comman
 
     rx_info_t hold_info = {
         .state = RIS_HOLD,
-        .timeout_sec = 9,
         .u.hold = {
             .fd = 23,
             .has_result = true,
@@ -552,7 +698,6 @@ void test_ListenerCmd_CheckIncomingMessages_should_immediately_fail_incoming_EXP
 
     rx_info_t hold_info = {
         .state = RIS_HOLD,
-        .timeout_sec = 9,
         .u.hold = {
             .fd = 23,
             .has_result = true,
@@ -585,7 +730,6 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_EXPECT_comman
 
     rx_info_t hold_info = {
         .state = RIS_HOLD,
-        .timeout_sec = 9,
         .u.hold = {
             .fd = 23,
             .has_result = false,
@@ -603,7 +747,8 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_EXPECT_comman
     TEST_ASSERT_EQUAL(box, hold_info.u.expect.box);
     TEST_ASSERT_EQUAL(RX_ERROR_NONE, hold_info.u.expect.error);
     TEST_ASSERT_EQUAL(false, hold_info.u.expect.has_result);
-    TEST_ASSERT_EQUAL(11, hold_info.timeout_sec);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&hold_info.timer));
+    TEST_ASSERT_EQUAL(11000, hold_info.timer.deadline);
 }
 
 void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_SHUTDOWN_command(void) {
@@ -623,3 +768,66 @@ void test_ListenerCmd_CheckIncomingMessages_should_handle_incoming_SHUTDOWN_comm
     TEST_ASSERT_EQUAL(0, res);
     TEST_ASSERT_EQUAL(123, l->shutdown_notify_fd);
 }
+
+void test_ListenerCmd_CheckIncomingMessages_should_skip_doorbell_and_process_RX_queue(void) {
+    l->fds[INCOMING_MSG_PIPE_ID].fd = 5;
+    l->fds[INCOMING_MSG_PIPE_ID].revents = POLLIN;
+
+    listener_msg *msg = &l->msgs[3];
+    msg->type = MSG_HOLD_RESPONSE;
+    msg->u.hold.fd = 23;
+    msg->u.hold.seq_id = 12345;
+    msg->u.hold.timeout_msec = 9000;
+    msg->next = NULL;
+    l->rx_queue = msg;
+
+    rx_info_t info = {
+        .state = RIS_INACTIVE,
+    };
+
+    cmd_buf[0] = LISTENER_DOORBELL_ID;
+    syscall_read_ExpectAndReturn(l->fds[INCOMING_MSG_PIPE_ID].fd, cmd_buf, sizeof(cmd_buf), 1);
+    ListenerHelper_GetFreeRXInfo_ExpectAndReturn(l, &info);
+    ListenerHelper_IndexRXInfo_Expect(l, &info, 23, 12345);
+    ListenerTask_ReleaseMsg_Expect(l, msg);
+
+    int res = 1;
+    ListenerCmd_CheckIncomingMessages(l, &res);
+    TEST_ASSERT_EQUAL(0, res);
+    TEST_ASSERT_EQUAL(NULL, l->rx_queue);
+    TEST_ASSERT_EQUAL(RIS_HOLD, info.state);
+}
+
+void test_ListenerCmd_ProcessRXQueue_should_process_messages_in_the_order_they_were_pushed(void) {
+    rx_info_t infos[3];
+    memset(infos, 0, sizeof(infos));
+
+    /* Pushed as 0, 1, 2, so the stack is 2 -> 1 -> 0. */
+    for (int i = 0; i < 3; i++) {
+        listener_msg *msg = &l->msgs[i];
+        msg->type = MSG_HOLD_RESPONSE;
+        msg->u.hold.fd = 23;
+        msg->u.hold.seq_id = 100 + i;
+        msg->u.hold.timeout_msec = 9000;
+        msg->next = l->rx_queue;
+        l->rx_queue = msg;
+        infos[i].state = RIS_INACTIVE;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        ListenerHelper_GetFreeRXInfo_ExpectAndReturn(l, &infos[i]);
+        ListenerHelper_IndexRXInfo_Expect(l, &infos[i], 23, 100 + i);
+        ListenerTask_ReleaseMsg_Expect(l, &l->msgs[i]);
+    }
+
+    ListenerCmd_ProcessRXQueue(l);
+    TEST_ASSERT_EQUAL(NULL, l->rx_queue);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(100 + i, infos[i].u.hold.seq_id);
+    }
+}
+
+void test_ListenerCmd_ProcessRXQueue_should_do_nothing_when_queue_is_empty(void) {
+    l->rx_queue = NULL;
+    ListenerCmd_ProcessRXQueue(l);
+}
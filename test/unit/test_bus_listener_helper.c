@@ -46,8 +46,18 @@ extern size_t backpressure;
 extern int poll_res;
 extern uint8_t msg_buf[sizeof(uint8_t)];
 
+static int match_calls = 0;
+
+static void match_cb(int64_t seq_id, void *msg_udata, void *socket_udata) {
+    match_calls++;
+    last_seq_id = seq_id;
+    last_msg = msg_udata;
+    last_socket_udata = socket_udata;
+}
+
 static struct bus B = {
     .log_level = 0,
+    .match_cb = match_cb,
 };
 static struct listener Listener = {
     .bus = &B,
@@ -55,7 +65,7 @@ static struct listener Listener = {
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
 };
 
 void setUp(void)
@@ -68,13 +78,17 @@ void setUp(void)
     l->upstream_backpressure = 0;
     for (int i = 0; i < MAX_PENDING_MESSAGES; i++) {
         l->rx_info[i].state = RIS_INACTIVE;
+        l->rx_info[i].index_next = NULL;
+        l->rx_info[i].match = NULL;
         *(int *)&l->rx_info[i].id = i;
     }
+    memset(l->rx_info_index, 0, sizeof(l->rx_info_index));
 
     last_msg = NULL;
     last_seq_id = BUS_NO_SEQ_ID;
     last_bus_udata = NULL;
     last_socket_udata = NULL;
+    match_calls = 0;
 }
 
 void tearDown(void) {}
@@ -141,6 +155,36 @@ void test_ListenerHelper_PushMessage_should_expose_errors(void)
     TEST_ASSERT_FALSE(ListenerHelper_PushMessage(l, msg, &reply_fd));
 }
 
+void test_ListenerHelper_PushRXMessage_should_queue_message_and_ring_doorbell_when_queue_was_empty(void)
+{
+    l->commit_pipe = 100;
+    l->rx_queue = NULL;
+    listener_msg *msg = &l->msgs[9];
+    msg->type = MSG_HOLD_RESPONSE;
+    memset(msg_buf, 0xFF, sizeof(msg_buf));
+
+    syscall_write_ExpectAndReturn(l->commit_pipe, msg_buf, sizeof(msg_buf), sizeof(msg_buf));
+
+    TEST_ASSERT_TRUE(ListenerHelper_PushRXMessage(l, msg));
+    TEST_ASSERT_EQUAL(msg, l->rx_queue);
+    TEST_ASSERT_EQUAL(NULL, msg->next);
+    TEST_ASSERT_EQUAL(LISTENER_DOORBELL_ID, msg_buf[0]);
+}
+
+void test_ListenerHelper_PushRXMessage_should_not_ring_doorbell_when_queue_was_not_empty(void)
+{
+    l->commit_pipe = 100;
+    listener_msg *first = &l->msgs[8];
+    first->next = NULL;
+    l->rx_queue = first;
+    listener_msg *msg = &l->msgs[9];
+    msg->type = MSG_EXPECT_RESPONSE;
+
+    TEST_ASSERT_TRUE(ListenerHelper_PushRXMessage(l, msg));
+    TEST_ASSERT_EQUAL(msg, l->rx_queue);
+    TEST_ASSERT_EQUAL(first, msg->next);
+}
+
 void test_ListenerHelper_GetFreeRXInfo_should_return_a_free_RX_INFO(void)
 {
     struct rx_info_t *head = &l->rx_info[123];
@@ -160,23 +204,155 @@ void test_ListenerHelper_GetFreeRXInfo_should_expose_errors(void)
     TEST_ASSERT_EQUAL(NULL, ListenerHelper_GetFreeRXInfo(l));
 }
 
+void test_ListenerHelper_IndexRXInfo_should_make_info_findable_by_sequence_id(void)
+{
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_HOLD;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
+    TEST_ASSERT_EQUAL(75, info->index_fd);
+    TEST_ASSERT_EQUAL(12345, info->index_seq_id);
+    TEST_ASSERT_EQUAL(info, ListenerHelper_FindInfoBySequenceID(l, 75, 12345));
+}
+
+void test_ListenerHelper_UnindexRXInfo_should_remove_info_from_index(void)
+{
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_HOLD;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
+    ListenerHelper_UnindexRXInfo(l, info);
+    TEST_ASSERT_EQUAL(NULL, info->index_next);
+    TEST_ASSERT_EQUAL(NULL, ListenerHelper_FindInfoBySequenceID(l, 75, 12345));
+}
+
+void test_ListenerHelper_UnindexRXInfo_should_keep_other_infos_in_the_same_chain(void)
+{
+    for (int i = 0; i < MAX_PENDING_MESSAGES; i++) {
+        l->rx_info[i].state = RIS_HOLD;
+        ListenerHelper_IndexRXInfo(l, &l->rx_info[i], 75, i);
+    }
+
+    /* Enough infos that some of them must share chains. */
+    for (int i = 0; i < MAX_PENDING_MESSAGES; i += 2) {
+        ListenerHelper_UnindexRXInfo(l, &l->rx_info[i]);
+    }
+
+    for (int i = 0; i < MAX_PENDING_MESSAGES; i++) {
+        rx_info_t *exp = (i & 1) ? &l->rx_info[i] : NULL;
+        TEST_ASSERT_EQUAL(exp, ListenerHelper_FindInfoBySequenceID(l, 75, i));
+    }
+}
+
 void test_ListenerHelper_FindInfoBySequenceID_should_find_info_by_sequence_id(void)
 {
-    l->rx_info_max_used = 100;
     struct rx_info_t *info = &l->rx_info[95];
     info->state = RIS_HOLD;
     info->u.hold.fd = 75;
     info->u.hold.seq_id = 12345;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
     TEST_ASSERT_EQUAL(info, ListenerHelper_FindInfoBySequenceID(l, 75, 12345));
 }
 
+void test_ListenerHelper_FindInfoBySequenceID_should_find_EXPECT_info_by_sequence_id(void)
+{
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_EXPECT;
+    info->u.expect.box = box;
+    ListenerHelper_IndexRXInfo(l, info, box->fd, box->out_seq_id);
+    TEST_ASSERT_EQUAL(info, ListenerHelper_FindInfoBySequenceID(l, box->fd, box->out_seq_id));
+}
+
+void test_ListenerHelper_FindInfoBySequenceID_should_skip_EXPECT_info_whose_box_was_released(void)
+{
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_EXPECT;
+    info->u.expect.box = NULL;
+    ListenerHelper_IndexRXInfo(l, info, box->fd, box->out_seq_id);
+    TEST_ASSERT_EQUAL(NULL, ListenerHelper_FindInfoBySequenceID(l, box->fd, box->out_seq_id));
+}
+
 void test_ListenerHelper_FindInfoBySequenceID_should_return_NULL_for_not_found(void)
 {
-    l->rx_info_max_used = 100;
     struct rx_info_t *info = &l->rx_info[95];
     info->state = RIS_HOLD;
     info->u.hold.fd = 75;
     info->u.hold.seq_id = 12345;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
     TEST_ASSERT_EQUAL(NULL, ListenerHelper_FindInfoBySequenceID(l, 75, 12346));
     TEST_ASSERT_EQUAL(NULL, ListenerHelper_FindInfoBySequenceID(l, 74, 12345));
 }
+
+void test_ListenerHelper_MatchRXInfo_should_pass_the_requests_udata_to_the_match_callback(void)
+{
+    int socket_udata = 0;
+    int msg_udata = 0;
+    connection_info ci = {
+        .fd = 75,
+        .udata = &socket_udata,
+    };
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_EXPECT;
+    info->u.expect.box = box;
+    box->udata = &msg_udata;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
+
+    ListenerHelper_MatchRXInfo(l, &ci, info);
+
+    TEST_ASSERT_EQUAL_PTR(info, ci.match);
+    TEST_ASSERT_EQUAL_PTR(&ci, info->match);
+    TEST_ASSERT_EQUAL(1, match_calls);
+    TEST_ASSERT_EQUAL(12345, last_seq_id);
+    TEST_ASSERT_EQUAL_PTR(&msg_udata, last_msg);
+    TEST_ASSERT_EQUAL_PTR(&socket_udata, last_socket_udata);
+    box->udata = NULL;
+}
+
+void test_ListenerHelper_UnmatchRXInfo_should_forget_the_match_without_revoking_it(void)
+{
+    connection_info ci = {
+        .fd = 75,
+    };
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_EXPECT;
+    ci.match = info;
+    info->match = &ci;
+
+    ListenerHelper_UnmatchRXInfo(l, &ci, false);
+
+    TEST_ASSERT_NULL(ci.match);
+    TEST_ASSERT_NULL(info->match);
+    TEST_ASSERT_EQUAL(0, match_calls);
+}
+
+void test_ListenerHelper_UnmatchRXInfo_should_revoke_the_match(void)
+{
+    int socket_udata = 0;
+    connection_info ci = {
+        .fd = 75,
+        .udata = &socket_udata,
+    };
+    struct rx_info_t *info = &l->rx_info[95];
+    info->state = RIS_EXPECT;
+    ListenerHelper_IndexRXInfo(l, info, 75, 12345);
+    ci.match = info;
+    info->match = &ci;
+
+    ListenerHelper_UnmatchRXInfo(l, &ci, true);
+
+    TEST_ASSERT_NULL(ci.match);
+    TEST_ASSERT_NULL(info->match);
+    TEST_ASSERT_EQUAL(1, match_calls);
+    TEST_ASSERT_EQUAL(12345, last_seq_id);
+    TEST_ASSERT_NULL(last_msg);
+    TEST_ASSERT_EQUAL_PTR(&socket_udata, last_socket_udata);
+}
+
+void test_ListenerHelper_UnmatchRXInfo_should_do_nothing_without_a_match(void)
+{
+    connection_info ci = {
+        .fd = 75,
+    };
+
+    ListenerHelper_UnmatchRXInfo(l, &ci, true);
+
+    TEST_ASSERT_EQUAL(0, match_calls);
+}
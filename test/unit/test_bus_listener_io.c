@@ -20,6 +20,7 @@
 #include "listener_internal.h"
 #include "listener_internal_types.h"
 #include "atomic.h"
+#include "timer_wheel.h"
 
 #include <errno.h>
 
@@ -31,6 +32,9 @@
 #include "mock_listener_helper.h"
 #include "mock_listener_cmd.h"
 #include "mock_listener_task.h"
+#ifdef BUS_USE_IO_URING
+#include "mock_listener_uring.h"
+#endif
 
 struct bus *b = NULL;
 boxed_msg *box = NULL;
@@ -42,6 +46,8 @@ static bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata);
 static void unexpected_msg_cb(void *msg,
     int64_t seq_id, void *bus_udata, void *socket_udata);
 static void error_cb(bus_unpack_cb_res_t result, void *socket_udata);
+static void match_cb(int64_t seq_id, void *msg_udata, void *socket_udata);
+static bool idle_cb(void *socket_udata);
 
 static struct bus B = {
     .log_level = 0,
@@ -56,15 +62,19 @@ static struct listener Listener = {
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
     .result.status = BUS_SEND_REQUEST_COMPLETE,
 };
 
 struct test_progress_info {
     size_t to_read;
     size_t read;
+    size_t more_msgs;   // expect this many more messages after the first
+    size_t match_at;    // ask for the request to be matched after this many bytes
 };
 
+static int unexpected_msgs = 0;
+
 void setUp(void) {
     b = &B;
     memset(&Listener, 0, sizeof(Listener));
@@ -76,7 +86,11 @@ void setUp(void) {
         rx_info_t *info = &l->rx_info[i];
         info->state = RIS_INACTIVE;
     }
+    TimerWheel_Init(&l->timers, 0);
     Box.out_seq_id = 12345;
+    unexpected_msgs = 0;
+    B.match_cb = NULL;
+    B.idle_cb = NULL;
 
     box = &Box;
 }
@@ -114,6 +128,38 @@ void test_ListenerIO_AttemptRecv_should_handle_hangups_single_fd(void) {
     TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, info1->u.hold.error);
 }
 
+void test_ListenerIO_AttemptRecv_should_schedule_failure_notification_for_EXPECT_on_hangup(void) {
+    boxed_msg expect_box = {
+        .fd = 5,
+        .out_seq_id = 12345,
+    };
+    rx_info_t *info1 = &l->rx_info[1];
+    info1->state = RIS_EXPECT;
+    info1->u.expect.box = &expect_box;
+    TimerWheel_Schedule(&l->timers, &info1->timer, 10000);
+
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLHUP;
+
+    connection_info ci0 = {
+        .fd = 5,
+    };
+    l->fd_info[0] = &ci0;
+
+    l->tracked_fds = 1;
+    l->inactive_fds = 0;
+    l->rx_info_max_used = 1;
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    /* EXPECT message should be marked with error, and its timer moved
+     * up so the client is notified without waiting for the timeout. */
+    TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, info1->u.expect.error);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&info1->timer));
+    TEST_ASSERT_EQUAL(0, info1->timer.deadline);
+}
+
 void test_ListenerIO_AttemptRecv_should_handle_hangups(void) {
     rx_info_t *info1 = &l->rx_info[1];
     info1->state = RIS_HOLD;
@@ -160,6 +206,188 @@ void test_ListenerIO_AttemptRecv_should_handle_hangups(void) {
     TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, info2->u.hold.error);
 }
 
+#if BUS_HAVE_EPOLL
+void test_ListenerIO_AttemptRecv_should_only_visit_sockets_reported_ready_by_epoll(void) {
+    struct test_progress_info progress_info = {
+        .to_read = 123,
+    };
+    connection_info ci0 = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+    };
+    connection_info ci1 = {
+        .fd = 6,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+        .udata = &progress_info,
+    };
+    for (int i = 0; i < 2; i++) {
+        l->fds[i + INCOMING_MSG_PIPE].fd = 5 + i;
+        l->fds[i + INCOMING_MSG_PIPE].events = POLLIN;
+    }
+    l->fd_info[0] = &ci0;
+    l->fd_info[1] = &ci1;
+    l->tracked_fds = 2;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    l->poll_backend = BUS_POLL_BACKEND_EPOLL;
+    l->epoll_fd = 9;
+    l->epoll_ready = 2;
+    l->epoll_events[0].events = 0;  // command pipe, already handled
+    l->epoll_events[0].data.ptr = NULL;
+    l->epoll_events[1].events = POLLIN;
+    l->epoll_events[1].data.ptr = &ci1;
+
+    /* Only the ready socket (6) should be read. */
+    syscall_read_ExpectAndReturn(ci1.fd, l->read_buf, l->read_buf_size, ci1.to_read_size);
+    rx_info_t unpack_res_info = {
+        .state = RIS_EXPECT,
+    };
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci1.fd, 12345, &unpack_res_info);
+    ListenerTask_AttemptDelivery_Expect(l, &unpack_res_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(true, unpack_res_info.u.expect.has_result);
+    TEST_ASSERT_EQUAL(123, ci0.to_read_size);
+    free(l->read_buf);
+}
+
+void test_ListenerIO_AttemptRecv_should_unregister_hung_up_sockets_from_epoll(void) {
+    rx_info_t *info1 = &l->rx_info[1];
+    info1->state = RIS_HOLD;
+    info1->u.hold.fd = 5;
+
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    connection_info ci0 = {
+        .fd = 5,
+    };
+    l->fd_info[0] = &ci0;
+    l->tracked_fds = 1;
+    l->rx_info_max_used = 1;
+
+    l->poll_backend = BUS_POLL_BACKEND_EPOLL;
+    l->epoll_fd = 9;
+    l->epoll_ready = 1;
+    l->epoll_events[0].events = POLLHUP;
+    l->epoll_events[0].data.ptr = &ci0;
+
+    syscall_epoll_ctl_ExpectAndReturn(9, EPOLL_CTL_DEL, 5, NULL, 0);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(1, l->inactive_fds);
+    TEST_ASSERT_EQUAL(0, l->fds[0 + INCOMING_MSG_PIPE].events);
+    TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, ci0.error);
+    TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, info1->u.hold.error);
+}
+#endif
+
+#if BUS_HAVE_IO_URING
+void test_ListenerIO_AttemptRecv_should_sink_data_received_by_io_uring(void) {
+    struct test_progress_info progress_info = {
+        .to_read = 123,
+    };
+    connection_info ci0 = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+        .udata = &progress_info,
+    };
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fd_info[0] = &ci0;
+    l->tracked_fds = 1;
+    l->read_buf_size = 256;
+    l->poll_backend = BUS_POLL_BACKEND_IO_URING;
+
+    /* The data is already in the ring's buffer, so there's no read. */
+    uint8_t ring_buf[123];
+    listener_uring_completion c = {
+        .ci = &ci0,
+        .res = 123,
+        .buf = ring_buf,
+        .has_buf = true,
+    };
+    ListenerUring_NextCompletion_ExpectAndReturn(l, &c);
+    rx_info_t unpack_res_info = {
+        .state = RIS_EXPECT,
+    };
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci0.fd, 12345, &unpack_res_info);
+    ListenerTask_AttemptDelivery_Expect(l, &unpack_res_info);
+    ListenerUring_Rearm_Expect(l, &c);
+    ListenerUring_NextCompletion_ExpectAndReturn(l, NULL);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(true, unpack_res_info.u.expect.has_result);
+    TEST_ASSERT_EQUAL(123, progress_info.read);
+}
+
+void test_ListenerIO_AttemptRecv_should_rearm_io_uring_socket_when_out_of_buffers(void) {
+    connection_info ci0 = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+    };
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fd_info[0] = &ci0;
+    l->tracked_fds = 1;
+    l->poll_backend = BUS_POLL_BACKEND_IO_URING;
+
+    listener_uring_completion c = {
+        .ci = &ci0,
+        .res = -ENOBUFS,
+    };
+    ListenerUring_NextCompletion_ExpectAndReturn(l, &c);
+    ListenerUring_Rearm_Expect(l, &c);
+    ListenerUring_NextCompletion_ExpectAndReturn(l, NULL);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(0, ci0.error);
+    TEST_ASSERT_EQUAL(0, l->inactive_fds);
+}
+
+void test_ListenerIO_AttemptRecv_should_stop_receiving_on_io_uring_socket_after_hangup(void) {
+    rx_info_t *info1 = &l->rx_info[1];
+    info1->state = RIS_HOLD;
+    info1->u.hold.fd = 5;
+
+    connection_info ci0 = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+    };
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fd_info[0] = &ci0;
+    l->tracked_fds = 1;
+    l->rx_info_max_used = 1;
+    l->poll_backend = BUS_POLL_BACKEND_IO_URING;
+
+    listener_uring_completion c = {
+        .ci = &ci0,
+        .res = 0,
+    };
+    ListenerUring_NextCompletion_ExpectAndReturn(l, &c);
+    ListenerUring_Release_Expect(l, &c);
+    ListenerUring_NextCompletion_ExpectAndReturn(l, NULL);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(1, l->inactive_fds);
+    TEST_ASSERT_EQUAL(0, l->fds[0 + INCOMING_MSG_PIPE].events);
+    TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, ci0.error);
+    TEST_ASSERT_EQUAL(RX_ERROR_POLLHUP, info1->u.hold.error);
+}
+#endif
+
 void test_ListenerIO_AttemptRecv_should_handle_socket_errors(void) {
     rx_info_t *info1 = &l->rx_info[1];
     info1->state = RIS_HOLD;
@@ -215,14 +443,21 @@ static bus_sink_cb_res_t sink_cb(uint8_t *read_buf,
 
     assert(socket_udata);
     struct test_progress_info *pi = (struct test_progress_info *)socket_udata;
+    TEST_ASSERT(pi->read + read_size <= pi->to_read);
     pi->read += read_size;
     if (pi->read == pi->to_read) {
         result = the_result;
+        if (pi->more_msgs > 0) {
+            pi->more_msgs--;
+            pi->read = 0;
+        }
     }
     size_t next_read = pi->to_read - pi->read;
     bus_sink_cb_res_t res = {
         .next_read = next_read,
         .full_msg_buffer = result,
+        .match = (pi->match_at > 0 && pi->read == pi->match_at),
+        .seq_id = 12345,
     };
     (void)read_buf;
     (void)read_size;
@@ -246,6 +481,7 @@ static bus_unpack_cb_res_t unpack_cb(void *msg, void *socket_udata) {
 
 static void unexpected_msg_cb(void *msg,
         int64_t seq_id, void *bus_udata, void *socket_udata) {
+    unexpected_msgs++;
     (void)msg;
     (void)seq_id;
     (void)bus_udata;
@@ -257,6 +493,17 @@ static void error_cb(bus_unpack_cb_res_t result, void *socket_udata) {
     (void)socket_udata;
 }
 
+static void match_cb(int64_t seq_id, void *msg_udata, void *socket_udata) {
+    (void)seq_id;
+    (void)msg_udata;
+    (void)socket_udata;
+}
+
+static bool idle_cb(void *socket_udata) {
+    (void)socket_udata;
+    return false;
+}
+
 void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack_message(void) {
     l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
     l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
@@ -282,7 +529,7 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     box->fd = 5;
     info->u.expect.box = box;
 
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, ci.to_read_size);
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, ci.to_read_size);
 
     rx_info_t unpack_res_info = {
         .state = RIS_EXPECT,
@@ -299,6 +546,42 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     TEST_ASSERT_EQUAL(the_result, unpack_res_info.u.expect.result.u.success.msg);
 }
 
+void test_ListenerIO_AttemptRecv_should_schedule_an_idle_check_after_unpacking_a_message(void) {
+    B.idle_cb = idle_cb;
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 123,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+        .udata = &progress_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+    l->rx_info_max_used = 1;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, ci.to_read_size);
+
+    rx_info_t unpack_res_info = {
+        .state = RIS_EXPECT,
+    };
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, &unpack_res_info);
+    ListenerTask_AttemptDelivery_Expect(l, &unpack_res_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_TRUE(ci.idle_check);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&l->idle_timer));
+    TEST_ASSERT_EQUAL(LISTENER_IDLE_CHECK_MSEC, TimerWheel_NextDelay(&l->timers));
+}
+
 void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack_message_in_hold_state(void) {
     l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
     l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
@@ -323,7 +606,7 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     info->state = RIS_HOLD;
     box->fd = 5;
 
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, ci.to_read_size);
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, ci.to_read_size);
 
     rx_info_t unpack_res_info = {
         .state = RIS_HOLD,
@@ -363,8 +646,13 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     box->fd = 5;
     info->u.expect.box = box;
 
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, ci.to_read_size - 1);
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, 1, 1);
+    /* A short read drains the socket, so the rest is read once
+     * it's reported ready again. */
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, ci.to_read_size - 1);
+    ListenerIO_AttemptRecv(l, 1);
+    TEST_ASSERT_EQUAL(1, ci.to_read_size);
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 1);
 
     rx_info_t unpack_res_info = {
         .state = RIS_EXPECT,
@@ -381,6 +669,197 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     TEST_ASSERT_EQUAL(the_result, unpack_res_info.u.expect.result.u.success.msg);
 }
 
+void test_ListenerIO_AttemptRecv_should_only_read_once_per_poll_even_if_the_buffer_fills(void) {
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 123,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 123,
+        .udata = &progress_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+    l->rx_info_max_used = 1;
+
+    l->read_buf = calloc(100, sizeof(uint8_t));
+    l->read_buf_size = 100;
+
+    rx_info_t *info = &l->rx_info[0];
+    info->state = RIS_EXPECT;
+    box->fd = 5;
+    info->u.expect.box = box;
+
+    /* There may be more on the socket, but it waits for the next poll,
+     * so one busy connection can't hold up the listener. */
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 100);
+    ListenerIO_AttemptRecv(l, 1);
+    TEST_ASSERT_EQUAL(23, ci.to_read_size);
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 23);
+
+    rx_info_t unpack_res_info = {
+        .state = RIS_EXPECT,
+    };
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, &unpack_res_info);
+    ListenerTask_AttemptDelivery_Expect(l, &unpack_res_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(RX_ERROR_READY_FOR_DELIVERY, unpack_res_info.u.expect.error);
+    TEST_ASSERT_EQUAL(true, unpack_res_info.u.expect.has_result);
+    TEST_ASSERT_EQUAL(12345, unpack_res_info.u.expect.result.u.success.seq_id);
+}
+
+void test_ListenerIO_AttemptRecv_should_unpack_several_messages_from_a_single_read(void) {
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 40,
+        .more_msgs = 3,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 40,
+        .udata = &progress_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    /* Three whole messages, and the start of a fourth. */
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 3 * 40 + 15);
+    for (int i = 0; i < 3; i++) {
+        ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, NULL);
+    }
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(3, unexpected_msgs);
+    TEST_ASSERT_EQUAL(15, progress_info.read);
+    TEST_ASSERT_EQUAL(25, ci.to_read_size);
+    free(l->read_buf);
+}
+
+void test_ListenerIO_AttemptRecv_should_match_request_when_the_sink_asks_for_it(void) {
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 100,
+        .match_at = 30,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 100,
+        .udata = &progress_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+    B.match_cb = match_cb;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    rx_info_t expect_info = {
+        .state = RIS_EXPECT,
+    };
+    expect_info.u.expect.box = box;
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 30);
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, &expect_info);
+    ListenerHelper_MatchRXInfo_Expect(l, &ci, &expect_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(70, ci.to_read_size);
+    free(l->read_buf);
+}
+
+void test_ListenerIO_AttemptRecv_should_not_match_request_that_has_not_been_sent(void) {
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 100,
+        .match_at = 30,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 100,
+        .udata = &progress_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+    B.match_cb = match_cb;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    rx_info_t hold_info = {
+        .state = RIS_HOLD,
+    };
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 30);
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, &hold_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_NULL(ci.match);
+    TEST_ASSERT_EQUAL(70, ci.to_read_size);
+    free(l->read_buf);
+}
+
+void test_ListenerIO_AttemptRecv_should_unmatch_request_once_its_response_is_complete(void) {
+    l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
+    l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
+    l->fds[0 + INCOMING_MSG_PIPE].revents = POLLIN;
+    struct test_progress_info progress_info = {
+        .to_read = 100,
+        .read = 30,
+    };
+    rx_info_t matched_info = {
+        .state = RIS_EXPECT,
+    };
+    connection_info ci = {
+        .fd = 5,
+        .type = BUS_SOCKET_PLAIN,
+        .to_read_size = 70,
+        .udata = &progress_info,
+        .match = &matched_info,
+    };
+    l->fd_info[0] = &ci;
+    l->tracked_fds = 1;
+    B.match_cb = match_cb;
+
+    l->read_buf = calloc(256, sizeof(uint8_t));
+    l->read_buf_size = 256;
+
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, 70);
+    ListenerHelper_UnmatchRXInfo_Expect(l, &ci, false);
+
+    rx_info_t unpack_res_info = {
+        .state = RIS_EXPECT,
+    };
+    ListenerHelper_FindInfoBySequenceID_ExpectAndReturn(l, ci.fd, 12345, &unpack_res_info);
+    ListenerTask_AttemptDelivery_Expect(l, &unpack_res_info);
+
+    ListenerIO_AttemptRecv(l, 1);
+
+    TEST_ASSERT_EQUAL(RX_ERROR_READY_FOR_DELIVERY, unpack_res_info.u.expect.error);
+    free(l->read_buf);
+}
+
 void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack_message_on_EINTR_followed_by_successful_read(void) {
     l->fds[0 + INCOMING_MSG_PIPE].fd = 5;
     l->fds[0 + INCOMING_MSG_PIPE].events = POLLIN;
@@ -407,10 +886,10 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     info->u.expect.box = box;
 
     errno = EINTR;
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, -1);
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, -1);
     Util_IsResumableIOError_ExpectAndReturn(EINTR, true);
 
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, ci.to_read_size);
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, ci.to_read_size);
 
     rx_info_t unpack_res_info = {
         .state = RIS_EXPECT,
@@ -453,7 +932,7 @@ void test_ListenerIO_AttemptRecv_should_handle_socket_hangup_during_read(void) {
     box->fd = 5;
     info->u.expect.box = box;
 
-    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, ci.to_read_size, -1);
+    syscall_read_ExpectAndReturn(ci.fd, l->read_buf, l->read_buf_size, -1);
     errno = ECONNRESET;
     Util_IsResumableIOError_ExpectAndReturn(errno, false);
     ListenerIO_AttemptRecv(l, 1);
@@ -490,7 +969,7 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     box->fd = 5;
     info->u.expect.box = box;
 
-    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, ci.to_read_size, ci.to_read_size);
+    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, l->read_buf_size, ci.to_read_size);
 
     rx_info_t unpack_res_info = {
         .state = RIS_EXPECT,
@@ -534,9 +1013,9 @@ void test_ListenerIO_AttemptRecv_should_handle_successful_socket_read_and_unpack
     box->fd = 5;
     info->u.expect.box = box;
 
-    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, ci.to_read_size, ci.to_read_size - 1);
+    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, l->read_buf_size, ci.to_read_size - 1);
 
-    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, 1, 1);
+    syscall_SSL_read_ExpectAndReturn(ci.ssl, l->read_buf, l->read_buf_size, 1);
 
     rx_info_t unpack_res_info = {
         .state = RIS_EXPECT,
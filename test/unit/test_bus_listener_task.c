@@ -20,6 +20,7 @@
 #include "listener_task_internal.h"
 #include "listener_internal.h"
 #include "atomic.h"
+#include "timer_wheel.h"
 
 #include <errno.h>
 
@@ -31,6 +32,9 @@
 #include "mock_listener_helper.h"
 #include "mock_listener_io.h"
 #include "mock_listener_cmd.h"
+#ifdef BUS_USE_IO_URING
+#include "mock_listener_uring.h"
+#endif
 
 struct bus *b = NULL;
 boxed_msg *box = NULL;
@@ -54,7 +58,7 @@ static struct listener Listener = {
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
 };
 
 void setUp(void)
@@ -62,7 +66,6 @@ void setUp(void)
     b = &B;
     l = &Listener;
     l->shutdown_notify_fd = LISTENER_NO_FD;
-    l->is_idle = false;
     l->tracked_fds = 0;
     l->inactive_fds = 0;
     l->read_buf = NULL;
@@ -70,10 +73,16 @@ void setUp(void)
     l->msgs_in_use = 0;
     l->rx_info_in_use = 0;
     l->upstream_backpressure = 0;
+    l->poll_backend = BUS_POLL_BACKEND_POLL;
     for (int i = 0; i < MAX_PENDING_MESSAGES; i++) {
         l->rx_info[i].state = RIS_INACTIVE;
         *(int *)&l->rx_info[i].id = i;
+        memset(&l->rx_info[i].timer, 0, sizeof(l->rx_info[i].timer));
+        l->rx_info[i].match = NULL;
     }
+    TimerWheel_Init(&l->timers, 0);
+    memset(&l->idle_timer, 0, sizeof(l->idle_timer));
+    b->idle_cb = NULL;
 
     last_msg = NULL;
     last_seq_id = BUS_NO_SEQ_ID;
@@ -101,32 +110,69 @@ void test_ListenerTask_MainLoop_should_block_when_there_is_nothing_to_do(void)
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
         -1, 0);
 
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(true, l->is_idle);
 }
 
-void test_ListenerTask_MainLoop_should_step_timeouts_once_a_second(void)
+#if BUS_HAVE_EPOLL
+void test_ListenerTask_MainLoop_should_wait_with_epoll_and_pass_on_command_pipe_events(void)
 {
-    l->rx_info_max_used = 2;
+    connection_info ci = {
+        .fd = 5,
+    };
+    l->poll_backend = BUS_POLL_BACKEND_EPOLL;
+    l->epoll_fd = 9;
+    l->epoll_events[0].events = EPOLLIN | EPOLLHUP;
+    l->epoll_events[0].data.ptr = &ci;
+    l->epoll_events[1].events = EPOLLIN;
+    l->epoll_events[1].data.ptr = NULL;  // command pipe
+
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    syscall_epoll_wait_ExpectAndReturn(9, l->epoll_events, MAX_FDS + 1, -1, 2);
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    ListenerCmd_CheckIncomingMessages_Expect(l, &poll_res);
+    ListenerIO_AttemptRecv_Expect(l, 2);
+
+    ListenerTask_MainLoop((void *)l);
+
+    TEST_ASSERT_EQUAL(2, l->epoll_ready);
+    TEST_ASSERT_EQUAL(POLLIN, l->fds[INCOMING_MSG_PIPE_ID].revents);
+    TEST_ASSERT_EQUAL(POLLIN | POLLHUP, l->epoll_events[0].events);
+    TEST_ASSERT_EQUAL(0, l->epoll_events[1].events);
+}
+#endif
+
+void test_ListenerTask_MainLoop_should_wait_until_the_next_timeout(void)
+{
+    l->rx_info_max_used = 1;
     rx_info_t *info0 = &l->rx_info[0];
     info0->state = RIS_HOLD;
-    info0->timeout_sec = 2;
+    info0->u.hold.has_result = false;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 20);
 
     rx_info_t *info1 = &l->rx_info[1];
     info1->state = RIS_EXPECT;
     info1->u.expect.error = RX_ERROR_NONE;
-    info1->timeout_sec = 6;
     info1->u.expect.box = box;
+    TimerWheel_Schedule(&l->timers, &info1->timer, 50);
 
     Util_Timestamp_ExpectAndReturn(&now, true, true);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        20, 0);
+    ListenerTask_MainLoop((void *)l);
+    TEST_ASSERT_EQUAL(RIS_HOLD, info0->state);
+    TEST_ASSERT_EQUAL(RIS_EXPECT, info1->state);
 
+    // HOLD times out, then wait for the EXPECT's timeout
+    now.tv_usec = 20 * 1000;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    Util_Timestamp_ExpectAndReturn(&cur, false, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
+    syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
+        30, 0);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
-    TEST_ASSERT_EQUAL(1, info0->timeout_sec);
-    TEST_ASSERT_EQUAL(5, info1->timeout_sec);
+    TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
+    TEST_ASSERT_EQUAL(RIS_EXPECT, info1->state);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&info0->timer));
 }
 
 void test_ListenerTask_MainLoop_should_expire_timeouts(void)
@@ -134,25 +180,27 @@ void test_ListenerTask_MainLoop_should_expire_timeouts(void)
     l->rx_info_max_used = 1;
     rx_info_t *info0 = &l->rx_info[0];
     info0->state = RIS_HOLD;
-    info0->timeout_sec = 1;
     info0->u.hold.has_result = false;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 500);
 
     rx_info_t *info1 = &l->rx_info[1];
     info1->state = RIS_EXPECT;
     info1->u.expect.error = RX_ERROR_NONE;
-    info1->timeout_sec = 1;
     info1->u.expect.box = box;
+    TimerWheel_Schedule(&l->timers, &info1->timer, 1000);
 
+    now.tv_sec = 1;
     Util_Timestamp_ExpectAndReturn(&now, true, true);
     Util_Timestamp_ExpectAndReturn(&cur, false, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
     Util_Timestamp_ExpectAndReturn(&cur, false, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info1);
 
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
 
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(BUS_SEND_RX_TIMEOUT, box->result.status);
 
     TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
@@ -160,6 +208,91 @@ void test_ListenerTask_MainLoop_should_expire_timeouts(void)
     TEST_ASSERT_EQUAL(0, l->rx_info_max_used);
 }
 
+void test_ListenerTask_MainLoop_should_not_expire_released_timeouts(void)
+{
+    l->rx_info_max_used = 0;
+    rx_info_t *info0 = &l->rx_info[0];
+    info0->state = RIS_EXPECT;
+    info0->u.expect.error = RX_ERROR_DONE;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 0);
+
+    now.tv_usec = 1000;
+    info0->u.expect.box = NULL;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 1000);
+
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
+    ListenerTask_ReleaseRXInfo(l, info0);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&info0->timer));
+
+    now.tv_sec = 1;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
+        -1, 0);
+    ListenerTask_MainLoop((void *)l);
+}
+
+static int idle_cb_calls = 0;
+static bool idle_cb_res = false;
+static bool idle_cb(void *socket_udata) {
+    last_socket_udata = socket_udata;
+    idle_cb_calls++;
+    return idle_cb_res;
+}
+
+void test_ListenerTask_MainLoop_should_call_idle_cb_for_sockets_due_an_idle_check(void)
+{
+    b->idle_cb = idle_cb;
+    idle_cb_calls = 0;
+    connection_info ci0 = { .fd = 5, .udata = (void *)&ci0, .idle_check = true, };
+    connection_info ci1 = { .fd = 6, .idle_check = false, };
+    l->fd_info[0] = &ci0;
+    l->fd_info[1] = &ci1;
+    l->tracked_fds = 2;
+    TimerWheel_Schedule(&l->timers, &l->idle_timer, LISTENER_IDLE_CHECK_MSEC);
+
+    // The socket still holds something, so it's checked again later
+    idle_cb_res = true;
+    now.tv_sec = 1;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
+        LISTENER_IDLE_CHECK_MSEC, 0);
+    ListenerTask_MainLoop((void *)l);
+    TEST_ASSERT_EQUAL(1, idle_cb_calls);
+    TEST_ASSERT_EQUAL_PTR(&ci0, last_socket_udata);
+    TEST_ASSERT_TRUE(ci0.idle_check);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&l->idle_timer));
+
+    // Now it's released everything, so the check stops
+    idle_cb_res = false;
+    now.tv_sec = 2;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
+        -1, 0);
+    ListenerTask_MainLoop((void *)l);
+    TEST_ASSERT_EQUAL(2, idle_cb_calls);
+    TEST_ASSERT_FALSE(ci0.idle_check);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&l->idle_timer));
+}
+
+void test_ListenerTask_ReleaseRXInfo_should_revoke_match_of_response_still_being_received(void)
+{
+    l->rx_info_max_used = 0;
+    rx_info_t *info0 = &l->rx_info[0];
+    info0->state = RIS_EXPECT;
+    info0->u.expect.error = RX_ERROR_DONE;
+    info0->u.expect.box = NULL;
+    connection_info ci = {
+        .fd = 5,
+        .match = info0,
+    };
+    info0->match = &ci;
+
+    ListenerHelper_UnmatchRXInfo_Expect(l, &ci, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
+    ListenerTask_ReleaseRXInfo(l, info0);
+    TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
+}
+
 static void unexpected_msg_cb(void *msg,
         int64_t seq_id, void *bus_udata, void *socket_udata) {
     last_msg = msg;
@@ -178,7 +311,7 @@ void test_ListenerTask_MainLoop_should_properly_free_HOLD_message_with_payload(v
     l->rx_info_max_used = 1;
     rx_info_t *info0 = &l->rx_info[0];
     info0->state = RIS_HOLD;
-    info0->timeout_sec = 1;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 1000);
     int hold_msg_fd = 123;
     info0->u.hold.fd = hold_msg_fd;
     info0->u.hold.has_result = true;
@@ -192,14 +325,15 @@ void test_ListenerTask_MainLoop_should_properly_free_HOLD_message_with_payload(v
 
     l->fd_info[0] = &ci;
 
+    now.tv_sec = 1;
     Util_Timestamp_ExpectAndReturn(&now, true, true);
     Util_Timestamp_ExpectAndReturn(&cur, false, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
 
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
 
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(BUS_SEND_RX_TIMEOUT, box->result.status);
 
     TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
@@ -219,23 +353,26 @@ void test_ListenerTask_MainLoop_should_retry_delivery_of_messages_that_are_ready
     info0->u.expect.box = box;
     box->result.status = BUS_SEND_SUCCESS;
     info0->u.expect.error = RX_ERROR_READY_FOR_DELIVERY;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 0);
+
+    now.tv_usec = 1000;
 
     // fail delivery the first retry
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, false);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        LISTENER_RETRY_DELAY_MSEC, 0);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(RX_ERROR_READY_FOR_DELIVERY, info0->u.expect.error);
 
     // successfully deliver
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    now.tv_usec += LISTENER_RETRY_DELAY_MSEC * 1000;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
 }
 
@@ -249,19 +386,20 @@ void test_ListenerTask_MainLoop_should_retry_and_clean_up_DONE_messages(void)
     box->result.status = BUS_SEND_SUCCESS;
     info0->u.expect.error = RX_ERROR_DONE;
 
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, false);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        LISTENER_RETRY_DELAY_MSEC, 0);
     ListenerTask_MainLoop((void *)l);
 
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    now.tv_usec += LISTENER_RETRY_DELAY_MSEC * 1000;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
 
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
 }
 
@@ -277,7 +415,7 @@ void test_ListenerTask_MainLoop_should_not_poll_inactive_fds(void)
     Util_Timestamp_ExpectAndReturn(&now, true, true);
 
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds - l->inactive_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
     ListenerTask_MainLoop((void *)l);
 }
 
@@ -290,33 +428,54 @@ void test_ListenerTask_MainLoop_should_retry_and_expire_errored_messages(void)
     info0->u.expect.box = box;
     box->result.status = BUS_SEND_SUCCESS;
     info0->u.expect.error = RX_ERROR_POLLHUP;
+    TimerWheel_Schedule(&l->timers, &info0->timer, 0);
 
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    now.tv_usec = 1000;
+
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, false);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        LISTENER_RETRY_DELAY_MSEC, 0);
     ListenerTask_MainLoop((void *)l);
 
-    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    now.tv_usec += LISTENER_RETRY_DELAY_MSEC * 1000;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     Bus_ProcessBoxedMessage_ExpectAndReturn(l->bus, box, &backpressure, true);
+    ListenerHelper_UnindexRXInfo_Expect(l, info0);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
-        LISTENER_TASK_TIMEOUT_DELAY, 0);
+        -1, 0);
     ListenerTask_MainLoop((void *)l);
-    TEST_ASSERT_EQUAL(false, l->is_idle);
     TEST_ASSERT_EQUAL(RIS_INACTIVE, info0->state);
     TEST_ASSERT_EQUAL(BUS_SEND_RX_FAILURE, box->result.status);
 }
 
 void test_ListenerTask_MainLoop_should_check_commands(void) {
-    l->is_idle = true;
     poll_res = 1;
     Util_Timestamp_ExpectAndReturn(&cur, true, true);
     syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
         -1, poll_res);
+    Util_Timestamp_ExpectAndReturn(&cur, true, true);
+    ListenerCmd_CheckIncomingMessages_Expect(l, &poll_res);
+    ListenerIO_AttemptRecv_Expect(l, poll_res);
+
+    ListenerTask_MainLoop((void *)l);
+}
+
+void test_ListenerTask_MainLoop_should_advance_timers_after_waiting_before_checking_commands(void) {
+    poll_res = 1;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+    syscall_poll_ExpectAndReturn(l->fds, l->tracked_fds + INCOMING_MSG_PIPE,
+        -1, poll_res);
+
+    /* Blocked with no timers for a minute; timeouts scheduled by the
+     * incoming commands must start from the current time. */
+    now.tv_sec = 60;
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
     ListenerCmd_CheckIncomingMessages_Expect(l, &poll_res);
     ListenerIO_AttemptRecv_Expect(l, poll_res);
 
     ListenerTask_MainLoop((void *)l);
+    TEST_ASSERT_EQUAL(60 * 1000 + 1, l->timers.tick);
 }
 
 void test_ListenerTask_ReleaseMsg_should_repool_listener_messages(void)
@@ -23,7 +23,6 @@
 #include <errno.h>
 
 #include "mock_bus.h"
-#include "mock_bus_poll.h"
 #include "mock_bus_inward.h"
 #include "mock_listener.h"
 #include "mock_send_helper.h"
@@ -37,7 +36,7 @@ extern struct pollfd fds[1];
 extern size_t backpressure;
 extern int poll_errno;
 extern int write_errno;
-extern int completion_pipe;
+extern uint16_t hold_backpressure;
 
 struct bus *b = NULL;
 boxed_msg *box = NULL;
@@ -56,7 +55,7 @@ static struct listener Listener = {
 static boxed_msg Box = {
     .fd = 1,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
 };
 
 void setUp(void) {
@@ -79,11 +78,13 @@ void test_Send_DoBlockingSend_should_reject_message_on_timestamp_failure(void) {
 static void expect_notify_listener(bool ok) {
     Bus_GetListenerForSocket_ExpectAndReturn(b, box->fd, l);
     for (int i = 0; i < SEND_NOTIFY_LISTENER_RETRIES; i++) {
-        completion_pipe = 41;
+        hold_backpressure = 0;
         Listener_HoldResponse_ExpectAndReturn(l, box->fd,
-            box->out_seq_id, box->timeout_sec + 5, &completion_pipe, ok);
+            box->out_seq_id, box->timeout_msec + SEND_HOLD_TIMEOUT_SLACK_MSEC,
+            &hold_backpressure, ok);
         if (ok) {
-            BusPoll_OnCompletion_ExpectAndReturn(b, completion_pipe, true);
+            Bus_BackpressureDelay_Expect(b, hold_backpressure,
+                LISTENER_BACKPRESSURE_SHIFT);
             return;
         }
         syscall_poll_ExpectAndReturn(NULL, 0, SEND_NOTIFY_LISTENER_RETRY_DELAY, 0);
@@ -181,3 +182,69 @@ void test_Send_DoBlockingSend_should_return_true_and_status_set_by_callee_if_wri
     TEST_ASSERT_TRUE(Send_DoBlockingSend(b, box));
     TEST_ASSERT_EQUAL(BUS_SEND_RX_TIMEOUT, box->result.status);
 }
+
+static boxed_msg Box2 = {
+    .fd = 1,
+    .out_seq_id = 12346,
+    .timeout_msec = 11000,
+};
+
+static void expect_hold(boxed_msg *hbox) {
+    Bus_GetListenerForSocket_ExpectAndReturn(b, hbox->fd, l);
+    hold_backpressure = 0;
+    Listener_HoldResponse_ExpectAndReturn(l, hbox->fd,
+        hbox->out_seq_id, hbox->timeout_msec + SEND_HOLD_TIMEOUT_SLACK_MSEC,
+        &hold_backpressure, true);
+    Bus_BackpressureDelay_Expect(b, hold_backpressure,
+        LISTENER_BACKPRESSURE_SHIFT);
+}
+
+void test_Send_DoBlockingSendBatch_should_reject_all_messages_on_timestamp_failure(void) {
+    boxed_msg *boxes[] = {box, &Box2};
+    Util_Timestamp_ExpectAndReturn(&start, true, false);
+    TEST_ASSERT_EQUAL(0, Send_DoBlockingSendBatch(b, boxes, 2));
+}
+
+void test_Send_DoBlockingSendBatch_should_hold_all_messages_then_write_them_together(void) {
+    boxed_msg *boxes[] = {box, &Box2};
+    box->out_sent_size = 0;
+    Box2.out_sent_size = 0;
+    Util_Timestamp_ExpectAndReturn(&start, true, true);
+    expect_hold(box);
+    expect_hold(&Box2);
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+
+    syscall_poll_ExpectAndReturn(fds, 1, 11 * 1000, 1);
+    fds[0].revents |= POLLOUT;
+
+    size_t completed = 0;
+    size_t both_completed = 2;
+    SendHelper_HandleWriteBatch_ExpectAndReturn(b, boxes, 2, &completed, SHHW_DONE);
+    SendHelper_HandleWriteBatch_ReturnThruPtr_completed(&both_completed);
+
+    TEST_ASSERT_EQUAL(2, Send_DoBlockingSendBatch(b, boxes, 2));
+}
+
+void test_Send_DoBlockingSendBatch_should_fail_unsent_messages_on_poll_IO_error(void) {
+    boxed_msg *boxes[] = {box, &Box2};
+    box->out_sent_size = 0;
+    Box2.out_sent_size = 0;
+    Util_Timestamp_ExpectAndReturn(&start, true, true);
+    expect_hold(box);
+    expect_hold(&Box2);
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+
+    syscall_poll_ExpectAndReturn(fds, 1, 11 * 1000, -1);
+    poll_errno = EIO;
+
+    backpressure = 0;
+    Bus_ProcessBoxedMessage_ExpectAndReturn(b, box, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+    Bus_ProcessBoxedMessage_ExpectAndReturn(b, &Box2, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    TEST_ASSERT_EQUAL(2, Send_DoBlockingSendBatch(b, boxes, 2));
+    TEST_ASSERT_EQUAL(BUS_SEND_TX_FAILURE, box->result.status);
+    TEST_ASSERT_EQUAL(BUS_SEND_TX_FAILURE, Box2.result.status);
+    poll_errno = 0;
+}
@@ -36,6 +36,8 @@ struct listener *l = NULL;
 
 extern struct timeval done;
 extern uint16_t backpressure;
+extern struct iovec iov[BUS_MAX_IOV];
+extern struct iovec batch_iov[SEND_BATCH_MAX_IOV];
 
 static struct bus B = {
     .log_level = 0,
@@ -49,7 +51,7 @@ static uint8_t default_out_msg[] = "default_out_msg";
 static boxed_msg Box = {
     .fd = 5,
     .out_seq_id = 12345,
-    .timeout_sec = 11,
+    .timeout_msec = 11000,
     .ssl = BUS_NO_SSL,
     .out_msg_size = sizeof(default_out_msg),
 };
@@ -61,6 +63,8 @@ void setUp(void) {
 
     backpressure = 0;
     memset(&done, 0, sizeof(done));
+    box->out_iov = NULL;
+    box->out_iovcnt = 0;
 }
 
 void tearDown(void) {}
@@ -246,3 +250,134 @@ void test_SendHelper_HandleWrite_should_yield_TX_FAILURE_on_ERROR_SSL_from_SSL(v
     SendHelper_HandleWrite_res res = SendHelper_HandleWrite(b, box);
     TEST_ASSERT_EQUAL(SHHW_ERROR, res);
 }
+
+static uint8_t header_seg[] = "header";
+static uint8_t value_seg[] = "value";
+static struct iovec out_iov[] = {
+    {.iov_base = header_seg, .iov_len = sizeof(header_seg)},
+    {.iov_base = value_seg, .iov_len = sizeof(value_seg)},
+};
+
+void test_SendHelper_HandleWrite_should_gather_segments_with_writev_over_plain_socket(void) {
+    box->ssl = BUS_NO_SSL;
+    box->out_iov = out_iov;
+    box->out_iovcnt = 2;
+    box->out_msg_size = sizeof(header_seg) + sizeof(value_seg);
+    box->out_sent_size = 0;
+
+    syscall_writev_ExpectAndReturn(5, iov, 2, box->out_msg_size);
+    Util_Timestamp_ExpectAndReturn(&done, true, true);
+    Bus_GetListenerForSocket_ExpectAndReturn(b, box->fd, l);
+    backpressure = 0x1234;
+    Listener_ExpectResponse_ExpectAndReturn(l, box, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0x1234, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    SendHelper_HandleWrite_res res = SendHelper_HandleWrite(b, box);
+    TEST_ASSERT_EQUAL(SHHW_DONE, res);
+    TEST_ASSERT_EQUAL(header_seg, iov[0].iov_base);
+    TEST_ASSERT_EQUAL(sizeof(header_seg), iov[0].iov_len);
+    TEST_ASSERT_EQUAL(value_seg, iov[1].iov_base);
+    TEST_ASSERT_EQUAL(sizeof(value_seg), iov[1].iov_len);
+    box->out_msg_size = sizeof(default_out_msg);
+}
+
+void test_SendHelper_HandleWrite_should_resume_writev_after_partial_write(void) {
+    box->ssl = BUS_NO_SSL;
+    box->out_iov = out_iov;
+    box->out_iovcnt = 2;
+    box->out_msg_size = sizeof(header_seg) + sizeof(value_seg);
+    box->out_sent_size = 0;
+
+    // Write all of the first segment and part of the second
+    syscall_writev_ExpectAndReturn(5, iov, 2, sizeof(header_seg) + 2);
+    SendHelper_HandleWrite_res res = SendHelper_HandleWrite(b, box);
+    TEST_ASSERT_EQUAL(SHHW_OK, res);
+    TEST_ASSERT_EQUAL(sizeof(header_seg) + 2, box->out_sent_size);
+
+    // Write the rest
+    syscall_writev_ExpectAndReturn(5, iov, 1, sizeof(value_seg) - 2);
+    Util_Timestamp_ExpectAndReturn(&done, true, true);
+    Bus_GetListenerForSocket_ExpectAndReturn(b, box->fd, l);
+    backpressure = 0x1234;
+    Listener_ExpectResponse_ExpectAndReturn(l, box, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0x1234, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    res = SendHelper_HandleWrite(b, box);
+    TEST_ASSERT_EQUAL(SHHW_DONE, res);
+    TEST_ASSERT_EQUAL(&value_seg[2], iov[0].iov_base);
+    TEST_ASSERT_EQUAL(sizeof(value_seg) - 2, iov[0].iov_len);
+    box->out_msg_size = sizeof(default_out_msg);
+}
+
+void test_SendHelper_HandleWrite_should_write_one_segment_at_a_time_over_SSL_socket(void) {
+    SSL fake_ssl;
+    box->ssl = &fake_ssl;
+    box->out_iov = out_iov;
+    box->out_iovcnt = 2;
+    box->out_msg_size = sizeof(header_seg) + sizeof(value_seg);
+    box->out_sent_size = 0;
+
+    syscall_SSL_write_ExpectAndReturn(&fake_ssl, header_seg, sizeof(header_seg), sizeof(header_seg));
+    SendHelper_HandleWrite_res res = SendHelper_HandleWrite(b, box);
+    TEST_ASSERT_EQUAL(SHHW_OK, res);
+
+    syscall_SSL_write_ExpectAndReturn(&fake_ssl, value_seg, sizeof(value_seg), sizeof(value_seg));
+    Util_Timestamp_ExpectAndReturn(&done, true, true);
+    Bus_GetListenerForSocket_ExpectAndReturn(b, box->fd, l);
+    backpressure = 0x1234;
+    Listener_ExpectResponse_ExpectAndReturn(l, box, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0x1234, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    res = SendHelper_HandleWrite(b, box);
+    TEST_ASSERT_EQUAL(SHHW_DONE, res);
+    box->out_msg_size = sizeof(default_out_msg);
+}
+
+void test_SendHelper_HandleWriteBatch_should_gather_boxes_into_one_writev_and_finish_those_fully_written(void) {
+    static uint8_t second_msg[] = "second_msg";
+    boxed_msg box2 = {
+        .fd = 5,
+        .out_seq_id = 12346,
+        .ssl = BUS_NO_SSL,
+        .out_msg = second_msg,
+        .out_msg_size = sizeof(second_msg),
+    };
+    boxed_msg *boxes[] = {box, &box2};
+    box->ssl = BUS_NO_SSL;
+    box->out_iov = out_iov;
+    box->out_iovcnt = 2;
+    box->out_msg_size = sizeof(header_seg) + sizeof(value_seg);
+    box->out_sent_size = 0;
+    box->result.status = BUS_SEND_UNDEFINED;
+    size_t completed = 0;
+
+    // Write all of the first box and part of the second
+    syscall_writev_ExpectAndReturn(5, batch_iov, 3, box->out_msg_size + 3);
+    Util_Timestamp_ExpectAndReturn(&done, true, true);
+    Bus_GetListenerForSocket_ExpectAndReturn(b, box->fd, l);
+    Listener_ExpectResponse_ExpectAndReturn(l, box, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    SendHelper_HandleWrite_res res = SendHelper_HandleWriteBatch(b, boxes, 2, &completed);
+    TEST_ASSERT_EQUAL(SHHW_OK, res);
+    TEST_ASSERT_EQUAL(1, completed);
+    TEST_ASSERT_EQUAL(header_seg, batch_iov[0].iov_base);
+    TEST_ASSERT_EQUAL(value_seg, batch_iov[1].iov_base);
+    TEST_ASSERT_EQUAL(second_msg, batch_iov[2].iov_base);
+    TEST_ASSERT_EQUAL(sizeof(second_msg), batch_iov[2].iov_len);
+    TEST_ASSERT_EQUAL(3, box2.out_sent_size);
+
+    // Write the rest of the second
+    syscall_writev_ExpectAndReturn(5, batch_iov, 1, sizeof(second_msg) - 3);
+    Util_Timestamp_ExpectAndReturn(&done, true, true);
+    Bus_GetListenerForSocket_ExpectAndReturn(b, box2.fd, l);
+    Listener_ExpectResponse_ExpectAndReturn(l, &box2, &backpressure, true);
+    Bus_BackpressureDelay_Expect(b, 0, LISTENER_EXPECT_BACKPRESSURE_SHIFT);
+
+    res = SendHelper_HandleWriteBatch(b, &boxes[1], 1, &completed);
+    TEST_ASSERT_EQUAL(SHHW_DONE, res);
+    TEST_ASSERT_EQUAL(1, completed);
+    TEST_ASSERT_EQUAL(&second_msg[3], batch_iov[0].iov_base);
+    TEST_ASSERT_EQUAL(BUS_SEND_REQUEST_COMPLETE, box2.result.status);
+    box->out_msg_size = sizeof(default_out_msg);
+}
@@ -0,0 +1,456 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "send_queue.h"
+#include "bus_internal_types.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "mock_send.h"
+#include "mock_send_helper.h"
+#include "mock_sender.h"
+#include "mock_util.h"
+
+extern struct timeval now;
+
+static struct bus B = {
+    .log_level = 0,
+};
+static connection_info *CI = NULL;
+
+static boxed_msg *new_box(int64_t seq_id)
+{
+    boxed_msg *box = calloc(1, sizeof(*box));
+    TEST_ASSERT(box);
+    box->fd = 5;
+    box->out_seq_id = seq_id;
+    box->out_msg_size = 100;
+    return box;
+}
+
+void setUp(void)
+{
+    CI = calloc(1, sizeof(*CI));
+    TEST_ASSERT(CI);
+    CI->largest_wr_seq_id_seen = BUS_NO_SEQ_ID;
+    SendQueue_Init(&CI->send_queue, NULL);
+}
+
+void tearDown(void)
+{
+    SendQueue_Destroy(&B, &CI->send_queue);
+    free(CI);
+    CI = NULL;
+}
+
+void test_SendQueue_Push_should_reject_equal_sequence_IDs(void)
+{
+    boxed_msg box = {.fd = 5, .out_seq_id = 3};
+    bus_send_ticket ticket;
+    CI->largest_wr_seq_id_seen = 3;
+
+    TEST_ASSERT_FALSE(SendQueue_Push(&B, CI, &box, &ticket));
+    TEST_ASSERT_NULL(CI->send_queue.head);
+}
+
+void test_SendQueue_Push_should_reject_lower_sequence_IDs(void)
+{
+    boxed_msg box = {.fd = 5, .out_seq_id = 3};
+    bus_send_ticket ticket;
+    CI->largest_wr_seq_id_seen = 4;
+
+    TEST_ASSERT_FALSE(SendQueue_Push(&B, CI, &box, &ticket));
+    TEST_ASSERT_NULL(CI->send_queue.head);
+}
+
+void test_SendQueue_Push_should_queue_requests_in_order(void)
+{
+    boxed_msg box1 = {.fd = 5, .out_seq_id = 3};
+    boxed_msg box2 = {.fd = 5, .out_seq_id = 4};
+    bus_send_ticket ticket1;
+    bus_send_ticket ticket2;
+
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, &box1, &ticket1));
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, &box2, &ticket2));
+
+    TEST_ASSERT_EQUAL(4, CI->largest_wr_seq_id_seen);
+    TEST_ASSERT_EQUAL_PTR(&box1, CI->send_queue.head);
+    TEST_ASSERT_EQUAL_PTR(&box2, box1.next);
+    TEST_ASSERT_EQUAL_PTR(&box2, CI->send_queue.tail);
+    TEST_ASSERT_EQUAL_PTR(CI, ticket1.conn);
+    TEST_ASSERT_FALSE(ticket1.done);
+
+    CI->send_queue.head = NULL;
+    CI->send_queue.tail = NULL;
+}
+
+void test_SendQueue_Flush_should_send_a_lone_request_by_itself(void)
+{
+    boxed_msg *box = new_box(3);
+    bus_send_ticket ticket;
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, box, &ticket));
+
+    Send_DoBlockingSend_ExpectAndReturn(&B, box, true);
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &ticket));
+    TEST_ASSERT_TRUE(ticket.done);
+    TEST_ASSERT_NULL(CI->send_queue.head);
+
+    bus_socket_stats stats;
+    SendQueue_GetStats(CI, &stats);
+    TEST_ASSERT_EQUAL(1, stats.requests);
+    TEST_ASSERT_EQUAL(1, stats.writes);
+
+    free(box);
+}
+
+void test_SendQueue_Flush_should_gather_all_queued_requests_into_one_write(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4), new_box(5)};
+    bus_send_ticket tickets[3];
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[i], &tickets[i]));
+    }
+
+    Send_DoBlockingSendBatch_ExpectAndReturn(&B, boxes, 3, 3);
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[0]));
+
+    // Already sent along with the first
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[1]));
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[2]));
+
+    bus_socket_stats stats;
+    SendQueue_GetStats(CI, &stats);
+    TEST_ASSERT_EQUAL(3, stats.requests);
+    TEST_ASSERT_EQUAL(1, stats.writes);
+    TEST_ASSERT_TRUE(stats.coalescing > 2.99 && stats.coalescing < 3.01);
+
+    for (int i = 0; i < 3; i++) { free(boxes[i]); }
+}
+
+void test_SendQueue_Flush_should_free_and_reject_requests_the_sender_does_not_accept(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    bus_send_ticket tickets[2];
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[i], &tickets[i]));
+    }
+
+    Send_DoBlockingSendBatch_ExpectAndReturn(&B, boxes, 2, 1);
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[0]));
+    TEST_ASSERT_FALSE(SendQueue_Flush(&B, CI, &tickets[1]));
+
+    free(boxes[0]);  // the second was freed by the queue
+}
+
+void test_SendQueue_Flush_should_not_gather_past_the_byte_budget(void)
+{
+    boxed_msg *big = new_box(3);
+    boxed_msg *next = new_box(4);
+    big->out_msg_size = SEND_QUEUE_MAX_BYTES;
+    bus_send_ticket tickets[2];
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, big, &tickets[0]));
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, next, &tickets[1]));
+
+    Send_DoBlockingSend_ExpectAndReturn(&B, big, true);
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[0]));
+    TEST_ASSERT_FALSE(tickets[1].done);
+
+    Send_DoBlockingSend_ExpectAndReturn(&B, next, true);
+    TEST_ASSERT_TRUE(SendQueue_Flush(&B, CI, &tickets[1]));
+
+    free(big);
+    free(next);
+}
+
+void test_SendQueue_Push_should_schedule_requests_nobody_waits_on_with_the_sender(void)
+{
+    struct sender fake_sender;
+    boxed_msg box1 = {.fd = 5, .out_seq_id = 3};
+    boxed_msg box2 = {.fd = 5, .out_seq_id = 4};
+    CI->send_queue.sender = &fake_sender;
+
+    Sender_Schedule_Expect(&fake_sender, &CI->send_queue);
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, &box1, NULL));
+    TEST_ASSERT_TRUE(CI->send_queue.scheduled);
+
+    // Already scheduled
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, &box2, NULL));
+    TEST_ASSERT_EQUAL_PTR(&box2, CI->send_queue.tail);
+
+    CI->send_queue.head = NULL;
+    CI->send_queue.tail = NULL;
+    Sender_Unschedule_Expect(&fake_sender, &CI->send_queue);
+}
+
+static void start_async(boxed_msg **boxes, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        boxes[i]->tv_send_start = (struct timeval){ .tv_sec = 10 };
+        boxes[i]->timeout_msec = 1000;
+        TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[i], NULL));
+    }
+    CI->send_queue.scheduled = true;
+
+    Send_HoldBatch_ExpectAndReturn(&B, boxes, count, count);
+    TEST_ASSERT_TRUE(SendQueue_StartAsync(&B, &CI->send_queue));
+    TEST_ASSERT_FALSE(CI->send_queue.scheduled);
+    TEST_ASSERT_TRUE(CI->send_queue.writing);
+    TEST_ASSERT_NULL(CI->send_queue.head);
+}
+
+static void expect_write(boxed_msg **boxes, size_t count,
+        size_t *completed, SendHelper_HandleWrite_res res)
+{
+    static size_t none_completed = 0;
+    SendHelper_HandleWriteBatch_ExpectAndReturn(&B, boxes, count, &none_completed, res);
+    SendHelper_HandleWriteBatch_ReturnThruPtr_completed(completed);
+}
+
+static void expect_time(time_t sec, suseconds_t usec)
+{
+    now = (struct timeval){ .tv_sec = sec, .tv_usec = usec };
+    Util_Timestamp_ExpectAndReturn(&now, true, true);
+}
+
+void test_SendQueue_WriteAsync_should_write_the_batch_and_give_up_the_queue_once_it_is_empty(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    start_async(boxes, 2);
+    TEST_ASSERT_EQUAL(5, SendQueue_AsyncFd(&CI->send_queue));
+
+    size_t completed = 2;
+    expect_write(boxes, 2, &completed, SHHW_DONE);
+    TEST_ASSERT_EQUAL(-1, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+    TEST_ASSERT_FALSE(CI->send_queue.writing);
+
+    bus_socket_stats stats;
+    SendQueue_GetStats(CI, &stats);
+    TEST_ASSERT_EQUAL(2, stats.requests);
+    TEST_ASSERT_EQUAL(1, stats.writes);
+
+    free(boxes[0]);
+    free(boxes[1]);
+}
+
+void test_SendQueue_WriteAsync_should_keep_a_partly_written_batch_until_the_socket_is_writable_again(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    start_async(boxes, 2);
+
+    size_t completed = 1;
+    expect_write(boxes, 2, &completed, SHHW_OK);
+    expect_time(10, 250000);
+    TEST_ASSERT_EQUAL(750, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+    TEST_ASSERT_EQUAL(1, CI->send_queue.batch_sent);
+
+    // Not writable yet, so only the timeout is checked
+    expect_time(10, 500000);
+    TEST_ASSERT_EQUAL(500, SendQueue_WriteAsync(&B, &CI->send_queue, 0));
+
+    completed = 1;
+    expect_write(&boxes[1], 1, &completed, SHHW_DONE);
+    TEST_ASSERT_EQUAL(-1, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+
+    free(boxes[0]);
+    free(boxes[1]);
+}
+
+void test_SendQueue_WriteAsync_should_start_the_next_batch_when_more_was_queued(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    start_async(boxes, 1);
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[1], NULL));
+
+    size_t completed = 1;
+    expect_write(boxes, 1, &completed, SHHW_DONE);
+    Send_HoldBatch_ExpectAndReturn(&B, &boxes[1], 1, 1);
+    TEST_ASSERT_EQUAL(0, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+    TEST_ASSERT_TRUE(CI->send_queue.writing);
+
+    expect_write(&boxes[1], 1, &completed, SHHW_DONE);
+    TEST_ASSERT_EQUAL(-1, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+
+    free(boxes[0]);
+    free(boxes[1]);
+}
+
+void test_SendQueue_WriteAsync_should_fail_the_unsent_requests_on_timeout(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    start_async(boxes, 2);
+
+    size_t completed = 0;
+    expect_write(boxes, 2, &completed, SHHW_OK);
+    expect_time(11, 0);
+    Send_HandleFailure_Expect(&B, boxes[0], BUS_SEND_TX_TIMEOUT);
+    Send_HandleFailure_Expect(&B, boxes[1], BUS_SEND_TX_TIMEOUT);
+    TEST_ASSERT_EQUAL(-1, SendQueue_WriteAsync(&B, &CI->send_queue, POLLOUT));
+    TEST_ASSERT_FALSE(CI->send_queue.writing);
+
+    free(boxes[0]);
+    free(boxes[1]);
+}
+
+void test_SendQueue_WriteAsync_should_fail_the_unsent_requests_on_hangup(void)
+{
+    boxed_msg *box = new_box(3);
+    start_async(&box, 1);
+
+    Send_HandleFailure_Expect(&B, box, BUS_SEND_TX_FAILURE);
+    TEST_ASSERT_EQUAL(-1, SendQueue_WriteAsync(&B, &CI->send_queue, POLLHUP));
+
+    free(box);
+}
+
+void test_SendQueue_StartAsync_should_report_requests_the_listener_does_not_accept(void)
+{
+    boxed_msg *boxes[] = {new_box(3), new_box(4)};
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[0], NULL));
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, boxes[1], NULL));
+
+    Send_HoldBatch_ExpectAndReturn(&B, boxes, 2, 0);
+    Send_HandleFailure_Expect(&B, boxes[0], BUS_SEND_TX_FAILURE);
+    Send_HandleFailure_Expect(&B, boxes[1], BUS_SEND_TX_FAILURE);
+    TEST_ASSERT_FALSE(SendQueue_StartAsync(&B, &CI->send_queue));
+    TEST_ASSERT_NULL(CI->send_queue.head);
+    TEST_ASSERT_FALSE(CI->send_queue.writing);
+
+    free(boxes[0]);
+    free(boxes[1]);
+}
+
+void test_SendQueue_StartAsync_should_leave_the_queue_to_an_active_writer(void)
+{
+    boxed_msg box = {.fd = 5, .out_seq_id = 3};
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, &box, NULL));
+    CI->send_queue.writing = true;
+
+    TEST_ASSERT_FALSE(SendQueue_StartAsync(&B, &CI->send_queue));
+    TEST_ASSERT_EQUAL_PTR(&box, CI->send_queue.head);
+
+    CI->send_queue.writing = false;
+    CI->send_queue.head = NULL;
+    CI->send_queue.tail = NULL;
+}
+
+void test_SendQueue_Destroy_should_fail_requests_that_were_never_written(void)
+{
+    boxed_msg *box = new_box(3);
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, box, NULL));
+
+    Send_HandleFailure_Expect(&B, box, BUS_SEND_TX_FAILURE);
+    SendQueue_Destroy(&B, &CI->send_queue);
+    SendQueue_Init(&CI->send_queue, NULL);  // for tearDown
+
+    free(box);
+}
+
+void test_SendQueue_Close_should_finish_requests_that_are_not_being_flushed_yet(void)
+{
+    boxed_msg *box = new_box(3);
+    bus_send_ticket ticket;
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, box, &ticket));
+
+    SendQueue_Close(&B, &CI->send_queue);
+    TEST_ASSERT_TRUE(ticket.done);
+    TEST_ASSERT_NULL(CI->send_queue.head);
+
+    // Flushing it afterward doesn't wait for anything
+    TEST_ASSERT_FALSE(SendQueue_Flush(&B, CI, &ticket));
+}
+
+void test_SendQueue_Push_should_reject_requests_once_the_queue_is_closing(void)
+{
+    boxed_msg box = {.fd = 5, .out_seq_id = 3};
+    bus_send_ticket ticket;
+    CI->send_queue.closing = true;
+
+    TEST_ASSERT_FALSE(SendQueue_Push(&B, CI, &box, &ticket));
+    TEST_ASSERT_NULL(CI->send_queue.head);
+    TEST_ASSERT_EQUAL(BUS_NO_SEQ_ID, CI->largest_wr_seq_id_seen);
+
+    CI->send_queue.closing = false;
+}
+
+typedef struct {
+    pthread_t thread;
+    bus_send_ticket *ticket;
+    bool accepted;
+} flusher;
+
+static void *flush_request(void *arg)
+{
+    flusher *f = (flusher *)arg;
+    f->accepted = SendQueue_Flush(&B, CI, f->ticket);
+    return NULL;
+}
+
+static void *destroy_queue(void *arg)
+{
+    (void)arg;
+    SendQueue_Destroy(&B, &CI->send_queue);
+    return NULL;
+}
+
+/* Wait until PRED holds for the queue, checking it with the lock held. */
+static void wait_for_queue(bool (*pred)(send_queue *q))
+{
+    send_queue *q = &CI->send_queue;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        bool done = pred(q);
+        pthread_mutex_unlock(&q->lock);
+        if (done) { return; }
+        poll(NULL, 0, 1);
+    }
+}
+
+static bool has_waiter(send_queue *q) { return q->waiters == 1; }
+static bool is_closing(send_queue *q) { return q->closing; }
+
+void test_SendQueue_Destroy_should_wait_for_the_writer_and_wake_threads_flushing_unsent_requests(void)
+{
+    boxed_msg *box = new_box(3);
+    bus_send_ticket ticket;
+    TEST_ASSERT_TRUE(SendQueue_Push(&B, CI, box, &ticket));
+
+    // Another thread is writing, so the flush waits for it
+    CI->send_queue.writing = true;
+    flusher f = {.ticket = &ticket};
+    TEST_ASSERT_EQUAL(0, pthread_create(&f.thread, NULL, flush_request, &f));
+    wait_for_queue(has_waiter);
+
+    pthread_t destroyer;
+    TEST_ASSERT_EQUAL(0, pthread_create(&destroyer, NULL, destroy_queue, NULL));
+    wait_for_queue(is_closing);
+
+    // The writer finishes, without having gotten to the request
+    pthread_mutex_lock(&CI->send_queue.lock);
+    CI->send_queue.writing = false;
+    pthread_cond_broadcast(&CI->send_queue.sent);
+    pthread_mutex_unlock(&CI->send_queue.lock);
+
+    TEST_ASSERT_EQUAL(0, pthread_join(destroyer, NULL));
+    TEST_ASSERT_EQUAL(0, pthread_join(f.thread, NULL));
+    TEST_ASSERT_TRUE(ticket.done);
+    TEST_ASSERT_FALSE(f.accepted);
+
+    SendQueue_Init(&CI->send_queue, NULL);  // for tearDown
+}
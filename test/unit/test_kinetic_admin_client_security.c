@@ -27,6 +27,7 @@
 #include "mock_kinetic_operation.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_resourcewaiter.h"
 #include "mock_kinetic_auth.h"
@@ -26,6 +26,10 @@
 #include "byte_array.h"
 #include "mock_protobuf-c.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
+#include "kinetic_response_pool_types.h"
+#include "mock_kinetic_arena.h"
+#include "mock_kinetic_hmac.h"
 #include <stdlib.h>
 #include <pthread.h>
 
@@ -83,11 +87,29 @@ void test_KineticAllocator_NewSession_should_return_a_session_with_termination_s
     KineticResourceWaiter_Init_Expect(&Session.connectionReady);
     KineticSession* session = KineticAllocator_NewSession(&MessageBus, &Config);
     TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, session->terminationStatus);
+    TEST_ASSERT_EQUAL(KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION, session->operationPool.max);
     TEST_ASSERT_FALSE(session->connected);
 }
 
+void test_KineticAllocator_NewSession_should_precompute_the_HMAC_key_schedule(void)
+{
+    KineticSessionConfig config = {
+        .hmacKey = ByteArray_CreateWithCString("asdfasdf"),
+    };
+    KineticCalloc_ExpectAndReturn(1, sizeof(KineticSession), &Session);
+    KineticHMAC_KeyInit_Expect(&Session.hmacKey,
+        ByteArray_Create(Session.config.keyData, config.hmacKey.len));
+    KineticResourceWaiter_Init_Expect(&Session.connectionReady);
+
+    KineticSession* session = KineticAllocator_NewSession(&MessageBus, &config);
+
+    TEST_ASSERT_EQUAL_PTR(&Session, session);
+    TEST_ASSERT_EQUAL_PTR(Session.config.keyData, Session.config.hmacKey.data);
+}
+
 void test_KineticAllocator_FreeSession_should_destroy_waiter_and_free_session(void)
 {
+    KineticHMAC_KeyClear_Expect(&Session.hmacKey);
     KineticResourceWaiter_Destroy_Expect(&Session.connectionReady);
     KineticFree_Expect(&Session);
     KineticAllocator_FreeSession(&Session);
@@ -96,35 +118,46 @@ void test_KineticAllocator_FreeSession_should_destroy_waiter_and_free_session(vo
 void test_KineticAllocator_NewKineticResponse_should_return_null_if_calloc_return_null(void)
 {
     KineticCalloc_ExpectAndReturn(1, sizeof(KineticResponse) + 1234, NULL);
-    KineticResponse * response = KineticAllocator_NewKineticResponse(1234);
+    KineticResponse * response = KineticAllocator_NewKineticResponse(NULL, 1234);
     TEST_ASSERT_NULL(response);
 }
 
-void test_KineticAllocator_FreeKineticResponse_should_free_the_command_if_its_not_null(void)
+void test_KineticAllocator_NewKineticResponse_should_allocate_from_the_pool_if_given_one(void)
 {
-    Com__Seagate__Kinetic__Proto__Command command;
+    KineticResponsePool pool;
+    KineticResponse rsp = { .pool = &pool };
 
-    KineticResponse rsp = { .command = &command};
-    protobuf_c_message_free_unpacked_Expect(&command.base, NULL);
+    KineticResponsePool_Alloc_ExpectAndReturn(&pool, 1234, &rsp);
+    KineticResponse * response = KineticAllocator_NewKineticResponse(&pool, 1234);
+    TEST_ASSERT_EQUAL_PTR(&rsp, response);
+}
 
-    KineticFree_Expect(&rsp);
+void test_KineticAllocator_NewKineticResponse_should_return_null_if_the_pool_returns_null(void)
+{
+    KineticResponsePool pool;
 
-    KineticAllocator_FreeKineticResponse(&rsp);
+    KineticResponsePool_Alloc_ExpectAndReturn(&pool, 1234, NULL);
+    KineticResponse * response = KineticAllocator_NewKineticResponse(&pool, 1234);
+    TEST_ASSERT_NULL(response);
 }
 
-void test_KineticAllocator_FreeKineticResponse_should_free_the_proto_if_its_not_null(void)
+void test_KineticAllocator_FreeKineticResponse_should_return_pooled_responses_to_their_pool(void)
 {
+    KineticResponsePool pool;
     Com__Seagate__Kinetic__Proto__Message proto;
 
-    KineticResponse rsp = { .proto = &proto};
-    protobuf_c_message_free_unpacked_Expect(&proto.base, NULL);
+    KineticResponse rsp = {
+        .proto = &proto,
+        .pool = &pool,
+    };
+    KineticArena_Reset_Expect(&rsp.arena);
 
-    KineticFree_Expect(&rsp);
+    KineticResponsePool_Free_Expect(&rsp);
 
     KineticAllocator_FreeKineticResponse(&rsp);
 }
 
-void test_KineticAllocator_FreeKineticResponse_should_free_the_proto_and_command_if_they_are_not_null(void)
+void test_KineticAllocator_FreeKineticResponse_should_free_the_proto_and_command_with_their_arena(void)
 {
     Com__Seagate__Kinetic__Proto__Message proto;
     Com__Seagate__Kinetic__Proto__Command command;
@@ -133,8 +166,7 @@ void test_KineticAllocator_FreeKineticResponse_should_free_the_proto_and_command
         .proto = &proto,
         .command = &command
     };
-    protobuf_c_message_free_unpacked_Expect(&command.base, NULL);
-    protobuf_c_message_free_unpacked_Expect(&proto.base, NULL);
+    KineticArena_Reset_Expect(&rsp.arena);
 
     KineticFree_Expect(&rsp);
 
@@ -166,6 +198,7 @@ void test_KineticAllocator_NewOperation_should_return_null_and_free_operation_if
 void test_KineticAllocator_NewOperation_should_initialize_operation_and_request(void)
 {
     Session.timeoutSeconds = 423;
+    Session.config.timeoutMsec = 250;
     KineticOperation op = {.session = NULL};
     KineticRequest request;
 
@@ -180,6 +213,7 @@ void test_KineticAllocator_NewOperation_should_initialize_operation_and_request(
     TEST_ASSERT_EQUAL_PTR(&request, operation->request);
     TEST_ASSERT_NULL(operation->response);
     TEST_ASSERT_EQUAL(423, operation->timeoutSeconds);
+    TEST_ASSERT_EQUAL(250, operation->timeoutMsec);
 }
 
 void test_KineticAllocator_FreeOperation_should_free_request_if_it_is_not_NULL(void)
@@ -202,12 +236,145 @@ void test_KineticAllocator_FreeOperation_should_free_response_if_its_not_null(vo
 
     KineticOperation op = { .response = &response };
 
+    KineticArena_Reset_Expect(&response.arena);
     KineticFree_Expect(&response);
     KineticFree_Expect(&op);
 
     KineticAllocator_FreeOperation(&op);
 }
 
+void test_KineticAllocator_FreeOperation_should_free_an_asynchronously_submitted_request_before_caching(void)
+{
+    KineticRequest request;
+    KineticOperation op = {
+        .session = &Session,
+        .request = &request,
+        .packedRequest = malloc(100),
+    };
+    Session.operationPool.max = 1;
+
+    KineticAllocator_FreeOperation(&op);
+
+    TEST_ASSERT_NULL(op.packedRequest);
+    TEST_ASSERT_EQUAL_PTR(&op, Session.operationPool.free);
+}
+
+void test_KineticAllocator_FreeOperation_should_cache_operation_and_request_in_the_session_pool(void)
+{
+    KineticRequest request;
+    KineticOperation op = { .session = &Session, .request = &request };
+    Session.operationPool.max = 1;
+
+    KineticAllocator_FreeOperation(&op);
+
+    TEST_ASSERT_EQUAL_PTR(&op, Session.operationPool.free);
+    TEST_ASSERT_EQUAL(1, Session.operationPool.count);
+}
+
+void test_KineticAllocator_FreeOperation_should_free_operation_and_request_if_the_session_pool_is_full(void)
+{
+    KineticRequest request;
+    KineticOperation cached = { .session = &Session };
+    KineticOperation op = { .session = &Session, .request = &request };
+    Session.operationPool.max = 1;
+    Session.operationPool.free = &cached;
+    Session.operationPool.count = 1;
+
+    KineticFree_Expect(&request);
+    KineticFree_Expect(&op);
+
+    KineticAllocator_FreeOperation(&op);
+
+    TEST_ASSERT_EQUAL_PTR(&cached, Session.operationPool.free);
+    TEST_ASSERT_EQUAL(1, Session.operationPool.count);
+}
+
+void test_KineticAllocator_NewOperation_should_reuse_a_cached_operation_and_its_request(void)
+{
+    Session.timeoutSeconds = 17;
+    KineticRequest request;
+    KineticOperation op = {
+        .session = &Session,
+        .request = &request,
+        .opCallback = (KineticOperationCallback)1,
+        .pin = (ByteArray*)1,
+    };
+    Session.operationPool.max = 1;
+    Session.operationPool.free = &op;
+    Session.operationPool.count = 1;
+
+    KineticRequest_Init_Expect(&request, &Session);
+    KineticOperation * operation = KineticAllocator_NewOperation(&Session);
+
+    TEST_ASSERT_EQUAL_PTR(&op, operation);
+    TEST_ASSERT_EQUAL_PTR(&request, operation->request);
+    TEST_ASSERT_EQUAL_PTR(&Session, operation->session);
+    TEST_ASSERT_NULL(operation->opCallback);
+    TEST_ASSERT_NULL(operation->pin);
+    TEST_ASSERT_NULL(operation->nextFree);
+    TEST_ASSERT_EQUAL(17, operation->timeoutSeconds);
+    TEST_ASSERT_NULL(Session.operationPool.free);
+    TEST_ASSERT_EQUAL(0, Session.operationPool.count);
+}
+
+void test_KineticAllocator_SetOperationPoolLimit_should_let_the_pool_grow(void)
+{
+    KineticRequest request;
+    KineticOperation cached = { .session = &Session };
+    KineticOperation op = { .session = &Session, .request = &request };
+    Session.operationPool.max = 1;
+    Session.operationPool.free = &cached;
+    Session.operationPool.count = 1;
+
+    KineticAllocator_SetOperationPoolLimit(&Session, 2);
+    KineticAllocator_FreeOperation(&op);
+
+    TEST_ASSERT_EQUAL_PTR(&op, Session.operationPool.free);
+    TEST_ASSERT_EQUAL(2, Session.operationPool.count);
+}
+
+void test_KineticAllocator_SetOperationPoolLimit_should_free_cached_operations_beyond_a_lower_limit(void)
+{
+    KineticRequest requests[2];
+    KineticOperation ops[2] = {
+        { .request = &requests[0], .nextFree = &ops[1] },
+        { .request = &requests[1], .nextFree = NULL },
+    };
+    Session.operationPool.max = 2;
+    Session.operationPool.free = &ops[0];
+    Session.operationPool.count = 2;
+
+    KineticFree_Expect(&requests[0]);
+    KineticFree_Expect(&ops[0]);
+
+    KineticAllocator_SetOperationPoolLimit(&Session, 1);
+
+    TEST_ASSERT_EQUAL(1, Session.operationPool.max);
+    TEST_ASSERT_EQUAL(1, Session.operationPool.count);
+    TEST_ASSERT_EQUAL_PTR(&ops[1], Session.operationPool.free);
+}
+
+void test_KineticAllocator_FreeSession_should_free_cached_operations(void)
+{
+    KineticRequest requests[2];
+    KineticOperation ops[2] = {
+        { .request = &requests[0], .nextFree = &ops[1] },
+        { .request = &requests[1], .nextFree = NULL },
+    };
+    Session.operationPool.free = &ops[0];
+    Session.operationPool.count = 2;
+
+    KineticFree_Expect(&requests[0]);
+    KineticFree_Expect(&ops[0]);
+    KineticFree_Expect(&requests[1]);
+    KineticFree_Expect(&ops[1]);
+    KineticHMAC_KeyClear_Expect(&Session.hmacKey);
+    KineticResourceWaiter_Destroy_Expect(&Session.connectionReady);
+    KineticFree_Expect(&Session);
+
+    KineticAllocator_FreeSession(&Session);
+}
+
 void test_KineticAllocator_FreeP2PProtobuf_should_free_protobuf_message_P2P_operation_tree(void)
 {
     TEST_IGNORE_MESSAGE("TODO: Need to test P2P protobuf free");
@@ -0,0 +1,138 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "unity_helper.h"
+#include "kinetic_arena.h"
+#include "kinetic_logger.h"
+#include "kinetic.pb-c.h"
+#include "protobuf-c/protobuf-c.h"
+#include <string.h>
+
+static KineticArena Arena;
+
+void setUp(void)
+{
+    KineticLogger_Init("stdout", 3);
+    KineticArena_Init(&Arena, 0);
+}
+
+void tearDown(void)
+{
+    KineticArena_Reset(&Arena);
+    KineticLogger_Close();
+}
+
+static size_t chunk_count(KineticArena const * const arena)
+{
+    size_t count = 0;
+    for (KineticArenaChunk * c = arena->chunks; c != NULL; c = c->next) { count++; }
+    return count;
+}
+
+static bool in_chunk(KineticArenaChunk const * const chunk, void const * const p, size_t size)
+{
+    uint8_t const * const b = (uint8_t const *)p;
+    return b >= chunk->data && b + size <= &chunk->data[chunk->used];
+}
+
+void test_KineticArena_Init_should_not_allocate_until_needed(void)
+{
+    TEST_ASSERT_NULL(Arena.chunks);
+    TEST_ASSERT_EQUAL(KINETIC_ARENA_MIN_CHUNK_SIZE, Arena.chunkSize);
+    TEST_ASSERT_EQUAL_PTR(&Arena, Arena.allocator.allocator_data);
+}
+
+void test_KineticArena_Alloc_should_bump_aligned_pointers_out_of_one_chunk(void)
+{
+    uint8_t * a = KineticArena_Alloc(&Arena, 3);
+    uint8_t * b = KineticArena_Alloc(&Arena, 40);
+    uint8_t * c = Arena.allocator.alloc(Arena.allocator.allocator_data, 8);
+
+    TEST_ASSERT_EQUAL(1, chunk_count(&Arena));
+    TEST_ASSERT_EQUAL(0, (uintptr_t)a % KINETIC_ARENA_ALIGN);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)b % KINETIC_ARENA_ALIGN);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)c % KINETIC_ARENA_ALIGN);
+    TEST_ASSERT(b >= a + 3);
+    TEST_ASSERT(c >= b + 40);
+    TEST_ASSERT(in_chunk(Arena.chunks, a, 3));
+    TEST_ASSERT(in_chunk(Arena.chunks, c, 8));
+
+    /* Freeing individual allocations does nothing. */
+    Arena.allocator.free(Arena.allocator.allocator_data, b);
+    memset(b, 0xff, 40);
+}
+
+void test_KineticArena_Alloc_should_size_the_first_chunk_from_the_hint(void)
+{
+    KineticArena_Init(&Arena, 3 * KINETIC_ARENA_MIN_CHUNK_SIZE);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_NOT_NULL(KineticArena_Alloc(&Arena, KINETIC_ARENA_MIN_CHUNK_SIZE - KINETIC_ARENA_ALIGN));
+    }
+    TEST_ASSERT_EQUAL(1, chunk_count(&Arena));
+}
+
+void test_KineticArena_Alloc_should_add_chunks_as_needed(void)
+{
+    uint8_t * small = KineticArena_Alloc(&Arena, 100);
+    uint8_t * big = KineticArena_Alloc(&Arena, 10 * KINETIC_ARENA_MIN_CHUNK_SIZE);
+    TEST_ASSERT_EQUAL(2, chunk_count(&Arena));
+    TEST_ASSERT(in_chunk(Arena.chunks, big, 10 * KINETIC_ARENA_MIN_CHUNK_SIZE));
+    TEST_ASSERT(in_chunk(Arena.chunks->next, small, 100));
+    memset(big, 0, 10 * KINETIC_ARENA_MIN_CHUNK_SIZE);
+
+    KineticArena_Reset(&Arena);
+    TEST_ASSERT_NULL(Arena.chunks);
+}
+
+void test_KineticArena_Move_should_transfer_all_chunks(void)
+{
+    KineticArena dst;
+    memset(&dst, 0, sizeof(dst));
+    void * p = KineticArena_Alloc(&Arena, 100);
+
+    KineticArena_Move(&dst, &Arena);
+
+    TEST_ASSERT_NULL(Arena.chunks);
+    TEST_ASSERT_EQUAL(1, chunk_count(&dst));
+    TEST_ASSERT(in_chunk(dst.chunks, p, 100));
+    TEST_ASSERT_EQUAL_PTR(&dst, dst.allocator.allocator_data);
+
+    KineticArena_Reset(&dst);
+}
+
+void test_KineticArena_should_hold_everything_protobuf_c_unpacks(void)
+{
+    Com__Seagate__Kinetic__Proto__Command__Header header = COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    header.has_acksequence = true;
+    header.acksequence = 1234;
+    Com__Seagate__Kinetic__Proto__Command command = COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.header = &header;
+
+    uint8_t buf[256];
+    size_t len = com__seagate__kinetic__proto__command__pack(&command, buf);
+
+    Com__Seagate__Kinetic__Proto__Command * unpacked =
+        com__seagate__kinetic__proto__command__unpack(&Arena.allocator, len, buf);
+
+    TEST_ASSERT_NOT_NULL(unpacked);
+    TEST_ASSERT_NOT_NULL(unpacked->header);
+    TEST_ASSERT_EQUAL(1234, unpacked->header->acksequence);
+    TEST_ASSERT_EQUAL(1, chunk_count(&Arena));
+    TEST_ASSERT(in_chunk(Arena.chunks, unpacked, sizeof(*unpacked)));
+    TEST_ASSERT(in_chunk(Arena.chunks, unpacked->header, sizeof(*unpacked->header)));
+}
@@ -115,6 +115,8 @@ void test_KineticAuth_PopulateHmac_should_add_and_populate_HMAC_authentication(v
     TEST_ASSERT_EQUAL(KINETIC_HMAC_SHA1_LEN, Request.message.message.hmacauth->hmac.len);
     TEST_ASSERT_EQUAL_PTR(Request.message.hmacData, Request.message.hmacAuth.hmac.data);
     TEST_ASSERT_EQUAL(KINETIC_HMAC_SHA1_LEN, Request.message.hmacAuth.hmac.len);
+    uint8_t reserved[KINETIC_HMAC_SHA1_LEN] = {0};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(reserved, Request.message.hmacData, sizeof(reserved));
     TEST_ASSERT_TRUE(Request.message.hmacAuth.has_identity);
     TEST_ASSERT_EQUAL(1, Request.message.hmacAuth.identity);
 }
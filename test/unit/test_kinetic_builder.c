@@ -25,10 +25,14 @@
 #include "kinetic_builder.h"
 #include "kinetic_memory.h"
 #include "kinetic_allocator.h"
+#include "kinetic_arena.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_resourcewaiter.h"
 #include "mock_kinetic_callbacks.h"
 #include "mock_kinetic_operation.h"
 #include "mock_kinetic_message.h"
+#include "mock_kinetic_hmac.h"
+#include "mock_kinetic_tag.h"
 
 static KineticSession Session;
 static KineticRequest Request;
@@ -139,6 +143,9 @@ void test_KineticBuilder_BuildPut_should_build_and_execute_a_PUT_operation_to_cr
     };
 
     KineticOperation_ValidateOperation_Expect(&Operation);
+    KineticTag_Compute_ExpectAndReturn(KINETIC_ALGORITHM_SHA1,
+        ByteArray_Create(entry.value.array.data, entry.value.bytesUsed), &entry.tag,
+        KINETIC_STATUS_SUCCESS);
     KineticMessage_ConfigureKeyValue_Expect(&Operation.request->message, &entry);
 
     // Build the operation
@@ -157,6 +164,29 @@ void test_KineticBuilder_BuildPut_should_build_and_execute_a_PUT_operation_to_cr
     TEST_ASSERT_NULL(Operation.response);
 }
 
+void test_KineticBuilder_BuildPut_should_fail_if_the_tag_cannot_be_calculated(void)
+{
+    ByteArray value = ByteArray_CreateWithCString("Luke, I am your father");
+    ByteArray key = ByteArray_CreateWithCString("foobar");
+    ByteArray tag = ByteArray_CreateWithCString("some_tag");
+
+    KineticEntry entry = {
+        .key = ByteBuffer_CreateWithArray(key),
+        .tag = ByteBuffer_CreateWithArray(tag),
+        .algorithm = KINETIC_ALGORITHM_SHA1,
+        .value = ByteBuffer_CreateWithArray(value),
+        .computeTag = true,
+    };
+
+    KineticOperation_ValidateOperation_Expect(&Operation);
+    KineticTag_Compute_ExpectAndReturn(KINETIC_ALGORITHM_SHA1,
+        ByteArray_Create(entry.value.array.data, entry.value.bytesUsed), &entry.tag,
+        KINETIC_STATUS_BUFFER_OVERRUN);
+
+    KineticStatus status = KineticBuilder_BuildPut(&Operation, &entry);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_BUFFER_OVERRUN, status);
+}
+
 uint8_t ValueData[KINETIC_OBJ_SIZE];
 
 void test_KineticBuilder_BuildGet_should_build_a_GET_operation(void)
@@ -578,7 +608,7 @@ void test_KineticBuilder_BuildGetLog_should_build_a_GetLog_request(void)
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETLOG,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.getLog, Request.command->body->getlog);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.log.getLog, Request.command->body->getlog);
     TEST_ASSERT_NOT_NULL(Request.command->body->getlog->types);
     TEST_ASSERT_EQUAL(1, Request.command->body->getlog->n_types);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__GET_LOG__TYPE__STATISTICS,
@@ -604,12 +634,12 @@ void test_KineticBuilder_BuildGetLog_should_build_a_GetLog_request_to_retrieve_d
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GETLOG,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.getLog, Request.command->body->getlog);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.log.getLog, Request.command->body->getlog);
     TEST_ASSERT_NOT_NULL(Request.command->body->getlog->types);
     TEST_ASSERT_EQUAL(1, Request.command->body->getlog->n_types);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__GET_LOG__TYPE__DEVICE,
         Request.command->body->getlog->types[0]);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.getLogDevice, Request.command->body->getlog->device);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.log.getLogDevice, Request.command->body->getlog->device);
     TEST_ASSERT_TRUE(Request.command->body->getlog->device->has_name);
     TEST_ASSERT_EQUAL_PTR(nameData, Request.command->body->getlog->device->name.data);
     TEST_ASSERT_EQUAL(strlen(nameData), Request.command->body->getlog->device->name.len);
@@ -668,7 +698,7 @@ void test_KineticBuilder_BuildSetPin_should_build_a_SECURITY_operation_to_set_ne
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__SECURITY,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.security, Request.command->body->security);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.security, Request.command->body->security);
     TEST_ASSERT_TRUE(Request.command->body->security->has_oldlockpin);
     TEST_ASSERT_EQUAL_PTR(oldPinData, Request.command->body->security->oldlockpin.data);
     TEST_ASSERT_EQUAL(oldPin.len, Request.command->body->security->oldlockpin.len);
@@ -697,7 +727,7 @@ void test_KineticBuilder_BuildSetPin_should_build_a_SECURITY_operation_to_set_ne
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__SECURITY,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.security, Request.command->body->security);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.security, Request.command->body->security);
     TEST_ASSERT_TRUE(Request.command->body->security->has_olderasepin);
     TEST_ASSERT_EQUAL_PTR(oldPinData, Request.command->body->security->olderasepin.data);
     TEST_ASSERT_EQUAL(oldPin.len, Request.command->body->security->olderasepin.len);
@@ -726,8 +756,8 @@ void test_KineticBuilder_BuildErase_should_build_a_SECURE_ERASE_operation_with_P
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.pinOp, Request.command->body->pinop);
-    TEST_ASSERT_TRUE(&Request.message.pinOp.has_pinoptype);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.pinOp, Request.command->body->pinop);
+    TEST_ASSERT_TRUE(&Request.message.u.pinOp.has_pinoptype);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__SECURE_ERASE_PINOP,
         Request.command->body->pinop->pinoptype);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_Basic, Operation.opCallback);
@@ -740,6 +770,7 @@ void test_KineticBuilder_BuildErase_should_build_an_INSTANT_ERASE_operation_with
     char pinData[] = "abc123";
     ByteArray pin = ByteArray_Create(pinData, strlen(pinData));
 
+    Operation.timeoutMsec = 500;
     KineticOperation_ValidateOperation_Expect(&Operation);
 
     KineticBuilder_BuildErase(&Operation, false, &pin);
@@ -751,13 +782,14 @@ void test_KineticBuilder_BuildErase_should_build_an_INSTANT_ERASE_operation_with
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.pinOp, Request.command->body->pinop);
-    TEST_ASSERT_TRUE(&Request.message.pinOp.has_pinoptype);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.pinOp, Request.command->body->pinop);
+    TEST_ASSERT_TRUE(&Request.message.u.pinOp.has_pinoptype);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__ERASE_PINOP,
         Request.command->body->pinop->pinoptype);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_Basic, Operation.opCallback);
     TEST_ASSERT_NULL(Operation.response);
     TEST_ASSERT_EQUAL(KineticOperation_TimeoutErase, Operation.timeoutSeconds);
+    TEST_ASSERT_EQUAL(0, Operation.timeoutMsec);
 }
 
 void test_KineticBuilder_BuildLockUnlock_should_build_a_LOCK_operation_with_PIN_auth(void)
@@ -776,8 +808,8 @@ void test_KineticBuilder_BuildLockUnlock_should_build_a_LOCK_operation_with_PIN_
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.pinOp, Request.command->body->pinop);
-    TEST_ASSERT_TRUE(&Request.message.pinOp.has_pinoptype);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.pinOp, Request.command->body->pinop);
+    TEST_ASSERT_TRUE(&Request.message.u.pinOp.has_pinoptype);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__LOCK_PINOP,
         Request.command->body->pinop->pinoptype);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_Basic, Operation.opCallback);
@@ -801,8 +833,8 @@ void test_KineticBuilder_BuildLockUnlock_should_build_an_UNLOCK_operation_with_P
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__PINOP,
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
-    TEST_ASSERT_EQUAL_PTR(&Request.message.pinOp, Request.command->body->pinop);
-    TEST_ASSERT_TRUE(&Request.message.pinOp.has_pinoptype);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.pinOp, Request.command->body->pinop);
+    TEST_ASSERT_TRUE(&Request.message.u.pinOp.has_pinoptype);
     TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__PIN_OPERATION__PIN_OP_TYPE__UNLOCK_PINOP,
         Request.command->body->pinop->pinoptype);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_Basic, Operation.opCallback);
@@ -824,11 +856,11 @@ void test_KineticBuilder_BuildSetClusterVersion_should_build_a_SET_CLUSTER_VERSI
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
 
-    TEST_ASSERT_EQUAL_PTR(&Request.message.setup, Request.command->body->setup);
-    TEST_ASSERT_EQUAL_INT64(1776, Request.message.setup.newclusterversion);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.setup, Request.command->body->setup);
+    TEST_ASSERT_EQUAL_INT64(1776, Request.message.u.setup.newclusterversion);
     TEST_ASSERT_EQUAL_INT64(1776, Operation.pendingClusterVersion);
-    TEST_ASSERT_TRUE(Request.message.setup.has_newclusterversion);
-    TEST_ASSERT_FALSE(Request.message.setup.has_firmwaredownload);
+    TEST_ASSERT_TRUE(Request.message.u.setup.has_newclusterversion);
+    TEST_ASSERT_FALSE(Request.message.u.setup.has_firmwaredownload);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_SetClusterVersion, Operation.opCallback);
 }
 
@@ -861,6 +893,26 @@ void test_KineticBuilder_BuildSetACL_should_build_a_SECURITY_operation(void)
     TEST_ASSERT_EQUAL(KineticOperation_TimeoutSetACL, Operation.timeoutSeconds);
 }
 
+void test_KineticBuilder_BuildSetACL_should_not_carry_over_PINs_from_a_reused_request(void)
+{
+    struct ACL ACLs = {
+        .ACL_count = 1,
+        .ACL_ceil = 1,
+        .ACLs = NULL,
+    };
+    // Left in the request by a previous SetPin operation
+    Request.message.u.security.has_oldlockpin = true;
+    Request.message.u.security.has_newlockpin = true;
+    KineticRequest_Init(&Request, &Session);
+
+    KineticOperation_ValidateOperation_Expect(&Operation);
+
+    KineticBuilder_BuildSetACL(&Operation, &ACLs);
+
+    TEST_ASSERT_FALSE(Request.command->body->security->has_oldlockpin);
+    TEST_ASSERT_FALSE(Request.command->body->security->has_newlockpin);
+}
+
 void test_KineticBuilder_BuildUpdateFirmware_should_build_a_FIRMWARE_DOWNLOAD_operation(void)
 {
     const char* path = "test/support/data/dummy_fw.slod";
@@ -883,9 +935,9 @@ void test_KineticBuilder_BuildUpdateFirmware_should_build_a_FIRMWARE_DOWNLOAD_op
         Request.message.command.header->messagetype);
     TEST_ASSERT_EQUAL_PTR(&Request.message.body, Request.command->body);
 
-    TEST_ASSERT_EQUAL_PTR(&Request.message.setup, Request.command->body->setup);
-    TEST_ASSERT_TRUE(Request.message.setup.firmwaredownload);
-    TEST_ASSERT_TRUE(Request.message.setup.has_firmwaredownload);
+    TEST_ASSERT_EQUAL_PTR(&Request.message.u.setup, Request.command->body->setup);
+    TEST_ASSERT_TRUE(Request.message.u.setup.firmwaredownload);
+    TEST_ASSERT_TRUE(Request.message.u.setup.has_firmwaredownload);
     TEST_ASSERT_EQUAL_PTR(&KineticCallbacks_UpdateFirmware, Operation.opCallback);
 
     TEST_ASSERT_NOT_NULL(Operation.value.data);
@@ -20,6 +20,8 @@
 #include "kinetic_types.h"
 #include "kinetic_types_internal.h"
 #include "kinetic_bus.h"
+#include "kinetic_arena.h"
+#include "kinetic_response.h"
 #include "kinetic_nbo.h"
 #include "kinetic.pb-c.h"
 #include "kinetic_logger.h"
@@ -30,6 +32,8 @@
 #include "mock_kinetic_controller.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_pdu_unpack.h"
+#include "mock_kinetic_callbacks.h"
+#include "kinetic_response_pool_types.h"
 #include "mock_bus.h"
 #include "mock_bus_inward.h"
 #include "byte_array.h"
@@ -43,10 +47,11 @@ static uint32_t ClusterVersion = 7;
 static KineticRequest Request;
 static KineticResponse Response;
 static KineticSession Session;
+static KineticResponsePool ResponsePool;
 static uint8_t ValueBuffer[KINETIC_OBJ_SIZE];
 static ByteArray Value = {.data = ValueBuffer, .len = sizeof(ValueBuffer)};
 
-#define SI_BUF_SIZE (sizeof(socket_info) + 2 * PDU_PROTO_MAX_LEN)
+#define SI_BUF_SIZE (sizeof(socket_info))
 static uint8_t si_buf[SI_BUF_SIZE];
 
 void setUp(void)
@@ -55,6 +60,7 @@ void setUp(void)
     Session = (KineticSession) {
         .connected = true,
         .socket = 456,
+        .responsePool = &ResponsePool,
         .config = (KineticSessionConfig) {
             .port = 1234,
             .host = "valid-host.com",
@@ -66,6 +72,9 @@ void setUp(void)
     ByteArray_FillWithDummyData(Value);
 
     memset(si_buf, 0, SI_BUF_SIZE);
+    socket_info *si = (socket_info *)si_buf;
+    si->buf = si->small_buf;
+    si->buf_size = sizeof(si->small_buf);
 }
 
 void tearDown(void)
@@ -74,15 +83,40 @@ void tearDown(void)
     KineticLogger_Close();
 }
 
-bool unpack_header(uint8_t const * const read_buf,
-    size_t const read_size, KineticPDUHeader * const header);
+/* Pack a response to request ACK_SEQUENCE into BUF, returning its length. */
+static size_t pack_response(uint8_t * buf, size_t size, int64_t ackSequence)
+{
+    Com__Seagate__Kinetic__Proto__Command__Header header =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    header.has_acksequence = true;
+    header.acksequence = ackSequence;
+    Com__Seagate__Kinetic__Proto__Command command =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.header = &header;
+    uint8_t command_buf[32];
+    TEST_ASSERT(com__seagate__kinetic__proto__command__get_packed_size(&command) <= sizeof(command_buf));
+
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    msg.has_authtype = true;
+    msg.authtype = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH;
+    msg.has_commandbytes = true;
+    msg.commandbytes = (ProtobufCBinaryData) {
+        .len = com__seagate__kinetic__proto__command__pack(&command, command_buf),
+        .data = command_buf,
+    };
+    TEST_ASSERT(com__seagate__kinetic__proto__message__get_packed_size(&msg) <= size);
+    return com__seagate__kinetic__proto__message__pack(&msg, buf);
+}
+
+bool unpack_header(uint8_t const * const read_buf, size_t const read_size,
+    uint32_t max_protobuf_len, uint32_t max_value_len, KineticPDUHeader * const header);
 
 void test_unpack_header_should_fail_if_the_header_is_the_wrong_size(void)
 {
     KineticPDUHeader header = {0};
     KineticPDUHeader header_out = {0};
-    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header) - 1, &header_out));
-    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header) + 1, &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header) - 1, 0, 0, &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header) + 1, 0, 0, &header_out));
 }
 
 void test_unpack_header_should_reject_header_with_excessively_large_sizes(void)
@@ -91,11 +125,26 @@ void test_unpack_header_should_reject_header_with_excessively_large_sizes(void)
     KineticPDUHeader header_out = {0};
 
     header.protobufLength = PDU_PROTO_MAX_LEN + 1;
-    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header), &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header), 0, 0, &header_out));
 
     header.protobufLength = PDU_PROTO_MAX_LEN;
     header.valueLength = PDU_PROTO_MAX_LEN + 1;
-    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header), &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header), 0, 0, &header_out));
+}
+
+void test_unpack_header_should_reject_header_with_sizes_beyond_the_given_limits(void)
+{
+    KineticPDUHeader header = {0};
+    KineticPDUHeader header_out = {0};
+
+    header.protobufLength = KineticNBO_FromHostU32(1000);
+    header.valueLength = KineticNBO_FromHostU32(PDU_PROTO_MAX_LEN + 1);
+    TEST_ASSERT_TRUE(unpack_header((uint8_t *)&header, sizeof(header),
+        1000, 2 * PDU_PROTO_MAX_LEN, &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header),
+        999, 2 * PDU_PROTO_MAX_LEN, &header_out));
+    TEST_ASSERT_FALSE(unpack_header((uint8_t *)&header, sizeof(header),
+        1000, PDU_PROTO_MAX_LEN, &header_out));
 }
 
 void test_unpack_header_should_unpack_header_fields_from_read_buf(void)
@@ -107,7 +156,7 @@ void test_unpack_header_should_unpack_header_fields_from_read_buf(void)
     };
     KineticPDUHeader header_out = {0};
 
-    TEST_ASSERT(unpack_header(read_buf, sizeof(header_out), &header_out));
+    TEST_ASSERT(unpack_header(read_buf, sizeof(header_out), 0, 0, &header_out));
     TEST_ASSERT_EQUAL(0xa0, header_out.versionPrefix);
     TEST_ASSERT_EQUAL(0x12345, header_out.protobufLength);
     TEST_ASSERT_EQUAL(0x23456, header_out.valueLength);
@@ -156,7 +205,7 @@ void test_sink_cb_should_expose_invalid_header_error(void)
     TEST_ASSERT_EQUAL(STATE_AWAITING_HEADER, si->state);
 }
 
-void test_sink_cb_should_transition_to_awaiting_body_state_with_good_header(void)
+void test_sink_cb_should_transition_to_awaiting_protobuf_state_with_good_header(void)
 {
     socket_info *si = (socket_info *)si_buf;
     *si = (socket_info){
@@ -171,8 +220,31 @@ void test_sink_cb_should_transition_to_awaiting_body_state_with_good_header(void
     };
 
     bus_sink_cb_res_t res = sink_cb(read_buf, sizeof(read_buf), &Session);
-    TEST_ASSERT_EQUAL(123 + 456, res.next_read);
+    TEST_ASSERT_EQUAL(123, res.next_read);
+    TEST_ASSERT_EQUAL(NULL, res.full_msg_buffer);
+    TEST_ASSERT_EQUAL(STATE_AWAITING_PROTOBUF, si->state);
+    TEST_ASSERT_EQUAL(0, si->accumulated);
+    TEST_ASSERT_EQUAL(UNPACK_ERROR_SUCCESS, si->unpack_status);
+}
+
+void test_sink_cb_should_transition_to_awaiting_body_state_with_good_header_and_no_value(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    *si = (socket_info){
+        .state = STATE_AWAITING_HEADER,
+        .accumulated = 0,
+    };
+    Session.si = si;
+    uint8_t read_buf[] = {
+        0xa0,                       // version prefix
+        0x00, 0x00, 0x00, 0x7b,     // protobuf length
+        0x00, 0x00, 0x00, 0x00,     // value length
+    };
+
+    bus_sink_cb_res_t res = sink_cb(read_buf, sizeof(read_buf), &Session);
+    TEST_ASSERT_EQUAL(123, res.next_read);
     TEST_ASSERT_EQUAL(NULL, res.full_msg_buffer);
+    TEST_ASSERT_FALSE(res.match);
     TEST_ASSERT_EQUAL(STATE_AWAITING_BODY, si->state);
     TEST_ASSERT_EQUAL(0, si->accumulated);
     TEST_ASSERT_EQUAL(UNPACK_ERROR_SUCCESS, si->unpack_status);
@@ -208,6 +280,43 @@ void test_sink_cb_should_accumulate_partially_recieved_header(void)
     TEST_ASSERT_EQUAL(UNPACK_ERROR_SUCCESS, si->unpack_status);
 }
 
+void test_sink_cb_should_scan_protobuf_and_ask_for_request_to_be_matched_before_the_value(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    uint8_t buf[64];
+    size_t len = pack_response(buf, sizeof(buf), 0x12345678);
+    si->state = STATE_AWAITING_PROTOBUF;
+    si->header.protobufLength = len;
+    si->header.valueLength = 0x03;
+    Session.si = si;
+
+    /* The listener doesn't unpack the protobuf; that's left to a worker. */
+    bus_sink_cb_res_t res = sink_cb(buf, len, &Session);
+
+    TEST_ASSERT_EQUAL(STATE_AWAITING_BODY, si->state);
+    TEST_ASSERT_EQUAL(len, si->accumulated);
+    TEST_ASSERT_EQUAL(3, res.next_read);
+    TEST_ASSERT_EQUAL(NULL, res.full_msg_buffer);
+    TEST_ASSERT_TRUE(res.match);
+    TEST_ASSERT_EQUAL(0x12345678, res.seq_id);
+}
+
+void test_sink_cb_should_not_ask_for_unroutable_response_to_be_matched(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    si->state = STATE_AWAITING_PROTOBUF;
+    si->header.protobufLength = 0x02;
+    si->header.valueLength = 0x03;
+    Session.si = si;
+    uint8_t buf[] = {0xaa, 0xbb};
+
+    bus_sink_cb_res_t res = sink_cb(buf, sizeof(buf), &Session);
+
+    TEST_ASSERT_EQUAL(STATE_AWAITING_BODY, si->state);
+    TEST_ASSERT_EQUAL(3, res.next_read);
+    TEST_ASSERT_FALSE(res.match);
+}
+
 void test_sink_cb_should_accumulate_partially_received_body(void)
 {
     /* Include trailing memory for si's .buf[]. */
@@ -280,90 +389,331 @@ void test_unpack_cb_should_expose_alloc_failure(void)
         },
     };
 
-    KineticAllocator_NewKineticResponse_ExpectAndReturn(8, NULL);
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, 8, NULL);
     bus_unpack_cb_res_t res = unpack_cb((void*)&si, &Session);
     TEST_ASSERT_FALSE(res.ok);
     TEST_ASSERT_EQUAL(UNPACK_ERROR_PAYLOAD_MALLOC_FAIL, res.u.error.opaque_error_id);
 }
 
-void test_unpack_cb_should_skip_empty_commands(void)
+void test_unpack_cb_should_not_route_responses_without_a_command(void)
 {
-    /* Include trailing memory for si's .buf[]. */
     Session.socket = 123;
     socket_info *si = (socket_info *)si_buf;
     si->state = STATE_AWAITING_HEADER;
     si->unpack_status = UNPACK_ERROR_SUCCESS,
-    si->header.protobufLength = 0x01;
+    si->header.protobufLength = 0x02;
     si->header.valueLength = 0x01;
-    si->header.protobufLength = 0x01;
-    si->buf[0] = 0x00;
-    si->buf[1] = 0xee;
+    si->buf[0] = 0x20;  // authType: HMACAUTH
+    si->buf[1] = 0x01;
+    si->buf[2] = 0xee;
 
-    uint8_t response_buf[sizeof(KineticResponse) + 128];
+    uint8_t response_buf[sizeof(KineticResponse) + 3];
     memset(response_buf, 0, sizeof(response_buf));
     KineticResponse *response = (KineticResponse *)response_buf;
 
-    KineticAllocator_NewKineticResponse_ExpectAndReturn(1, response);
-
-    Com__Seagate__Kinetic__Proto__Message Proto;
-    memset(&Proto, 0, sizeof(Proto));
-    Proto.has_commandbytes = false;
-
-    KineticPDU_unpack_message_ExpectAndReturn(NULL, si->header.protobufLength,
-        si->buf, &Proto);
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, 3, response);
 
     bus_unpack_cb_res_t res = unpack_cb(si, &Session);
 
+    TEST_ASSERT(res.ok);
+    TEST_ASSERT_EQUAL(response, res.u.success.msg);
+    TEST_ASSERT_EQUAL(BUS_NO_SEQ_ID, res.u.success.seq_id);
     TEST_ASSERT_EQUAL(0xee, response->value[0]);
+    TEST_ASSERT_EQUAL_PTR(&response->value[1], response->protobuf);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(si->buf, response->protobuf, 2);
+}
+
+void test_unpack_cb_should_route_response_by_ack_sequence_and_leave_it_packed(void)
+{
+    Session.socket = 123;
+    socket_info *si = (socket_info *)si_buf;
+    size_t len = pack_response(si->buf, si->buf_size, 0x12345678);
+    si->state = STATE_AWAITING_HEADER;
+    si->unpack_status = UNPACK_ERROR_SUCCESS,
+    si->header.protobufLength = len;
+    si->header.valueLength = 0x01;
+    si->buf[len] = 0xee;
+
+    uint8_t response_buf[sizeof(KineticResponse) + 64];
+    memset(response_buf, 0, sizeof(response_buf));
+    KineticResponse *response = (KineticResponse *)response_buf;
+
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, 1 + len, response);
+
+    bus_unpack_cb_res_t res = unpack_cb(si, &Session);
 
     TEST_ASSERT(res.ok);
     TEST_ASSERT_EQUAL(response, res.u.success.msg);
+    TEST_ASSERT_EQUAL(0x12345678, res.u.success.seq_id);
+    TEST_ASSERT_EQUAL(0xee, response->value[0]);
+    TEST_ASSERT_EQUAL_PTR(&response->value[1], response->protobuf);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(si->buf, response->protobuf, len);
+    TEST_ASSERT_NULL(response->proto);
+    TEST_ASSERT_NULL(response->command);
 }
 
-void test_unpack_cb_should_unpack_command_bytes(void)
+void test_unpack_cb_should_ignore_unsolicited_status_on_connect(void)
 {
     Session.socket = 123;
     socket_info *si = (socket_info *)si_buf;
+    size_t len = pack_response(si->buf, si->buf_size, 0);
+    si->buf[1] = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__UNSOLICITEDSTATUS;
     si->state = STATE_AWAITING_HEADER;
     si->unpack_status = UNPACK_ERROR_SUCCESS,
-    si->header.protobufLength = 0x01;
-    si->header.valueLength = 0x08;
+    si->header.protobufLength = len;
+    si->header.valueLength = 0;
+
+    uint8_t response_buf[sizeof(KineticResponse) + 64];
+    memset(response_buf, 0, sizeof(response_buf));
+    KineticResponse *response = (KineticResponse *)response_buf;
+
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, len, response);
+    KineticSession_GetConnectionID_ExpectAndReturn(&Session, 0);
+
+    bus_unpack_cb_res_t res = unpack_cb(si, &Session);
+
+    TEST_ASSERT(res.ok);
+    TEST_ASSERT_EQUAL(BUS_NO_SEQ_ID, res.u.success.seq_id);
+}
+
+void match_cb(int64_t seq_id, void *msg_udata, void *socket_udata);
+
+static socket_info *start_value(KineticOperation *op, KineticEntry *entry,
+    uint8_t *value_buf, size_t value_buf_size)
+{
+    socket_info *si = (socket_info *)si_buf;
+    si->state = STATE_AWAITING_BODY;
+    si->unpack_status = UNPACK_ERROR_SUCCESS;
     si->header.protobufLength = 0x02;
-    si->buf[0] = 0x00;
-    si->buf[1] = 0x01;
-    si->buf[2] = 0xee;
+    si->header.valueLength = 0x03;
+    si->accumulated = 2;
+    Session.si = si;
+
+    *entry = (KineticEntry) {
+        .value = ByteBuffer_Create(value_buf, value_buf_size, 1),
+    };
+    *op = (KineticOperation) {
+        .session = &Session,
+        .entry = entry,
+        .opCallback = KineticCallbacks_Get,
+    };
+    return si;
+}
 
-    uint8_t response_buf[sizeof(KineticResponse) + 1];
+void test_match_cb_should_receive_value_directly_into_GET_entry(void)
+{
+    KineticOperation op;
+    KineticEntry entry;
+    uint8_t value_buf[8];
+    memset(value_buf, 0, sizeof(value_buf));
+    socket_info *si = start_value(&op, &entry, value_buf, sizeof(value_buf));
+    uint8_t buf[] = {0xaa, 0xbb, 0xcc};
+
+    match_cb(0x12345678, &op, &Session);
+    TEST_ASSERT_EQUAL_PTR(&value_buf[1], si->value_dest);
+
+    bus_sink_cb_res_t res = sink_cb(buf, sizeof(buf), &Session);
+    TEST_ASSERT_EQUAL(si, res.full_msg_buffer);
+    TEST_ASSERT_EQUAL_MEMORY(buf, &value_buf[1], sizeof(buf));
+
+    /* The value isn't copied into the response, just the protobuf. */
+    uint8_t response_buf[sizeof(KineticResponse) + 2];
     memset(response_buf, 0, sizeof(response_buf));
     KineticResponse *response = (KineticResponse *)response_buf;
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, 2, response);
+
+    bus_unpack_cb_res_t ures = unpack_cb(si, &Session);
+    TEST_ASSERT(ures.ok);
+    TEST_ASSERT_EQUAL(response, ures.u.success.msg);
+    TEST_ASSERT_TRUE(response->valueInEntry);
+    TEST_ASSERT_EQUAL_PTR(&response->value[0], response->protobuf);
+    TEST_ASSERT_NULL(si->value_dest);
+}
 
-    KineticAllocator_NewKineticResponse_ExpectAndReturn(8, response);
+void test_match_cb_should_not_receive_value_into_entry_too_small_for_it(void)
+{
+    KineticOperation op;
+    KineticEntry entry;
+    uint8_t value_buf[3];
+    socket_info *si = start_value(&op, &entry, value_buf, sizeof(value_buf));
 
-    Com__Seagate__Kinetic__Proto__Message Proto;
-    memset(&Proto, 0, sizeof(Proto));
-    Proto.has_commandbytes = true;
-    Proto.commandbytes.data = (uint8_t *)"data";
-    Proto.commandbytes.len = 4;
+    match_cb(0x12345678, &op, &Session);
+    TEST_ASSERT_NULL(si->value_dest);
+}
 
-    KineticPDU_unpack_message_ExpectAndReturn(NULL, si->header.protobufLength,
-        si->buf, &Proto);
+void test_match_cb_should_not_receive_value_into_entry_of_metadata_only_GET(void)
+{
+    KineticOperation op;
+    KineticEntry entry;
+    uint8_t value_buf[8];
+    socket_info *si = start_value(&op, &entry, value_buf, sizeof(value_buf));
+    entry.metadataOnly = true;
+
+    match_cb(0x12345678, &op, &Session);
+    TEST_ASSERT_NULL(si->value_dest);
+}
 
-    Com__Seagate__Kinetic__Proto__Command Command;
-    memset(&Command, 0, sizeof(Command));
-    Com__Seagate__Kinetic__Proto__Command__Header Header;
-    memset(&Header, 0, sizeof(Header));
-    Command.header = &Header;
-    response->header.valueLength = 1;
-    Header.acksequence = 0x12345678;
+void test_match_cb_should_not_receive_value_into_entry_of_other_operations(void)
+{
+    KineticOperation op;
+    KineticEntry entry;
+    uint8_t value_buf[8];
+    socket_info *si = start_value(&op, &entry, value_buf, sizeof(value_buf));
+    op.opCallback = KineticCallbacks_Put;
+
+    match_cb(0x12345678, &op, &Session);
+    TEST_ASSERT_NULL(si->value_dest);
+}
 
-    KineticPDU_unpack_command_ExpectAndReturn(NULL, Proto.commandbytes.len,
-        Proto.commandbytes.data, &Command);
+void test_match_cb_should_stop_receiving_into_entry_when_revoked(void)
+{
+    KineticOperation op;
+    KineticEntry entry;
+    uint8_t value_buf[8];
+    memset(value_buf, 0, sizeof(value_buf));
+    socket_info *si = start_value(&op, &entry, value_buf, sizeof(value_buf));
+    uint8_t buf[] = {0xaa, 0xbb, 0xcc};
 
-    bus_unpack_cb_res_t res = unpack_cb(si, &Session);
+    match_cb(0x12345678, &op, &Session);
+    bus_sink_cb_res_t res = sink_cb(buf, 1, &Session);
+    TEST_ASSERT_EQUAL(2, res.next_read);
+    TEST_ASSERT_EQUAL(0xaa, value_buf[1]);
 
-    TEST_ASSERT_EQUAL(0xee, response->value[0]);
+    match_cb(0x12345678, NULL, &Session);
+    TEST_ASSERT_NULL(si->value_dest);
 
-    TEST_ASSERT(res.ok);
-    TEST_ASSERT_EQUAL(response, res.u.success.msg);
-    TEST_ASSERT_EQUAL(0x12345678, res.u.success.seq_id);
+    res = sink_cb(&buf[1], 2, &Session);
+    TEST_ASSERT_EQUAL(si, res.full_msg_buffer);
+    TEST_ASSERT_EQUAL(0x00, value_buf[2]);
+    TEST_ASSERT_EQUAL(0xbb, si->buf[3]);
+    TEST_ASSERT_EQUAL(0xcc, si->buf[4]);
+}
+
+void test_sink_cb_should_buffer_large_messages_separately_and_keep_the_buffer_for_the_next_one(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    *si = (socket_info){
+        .state = STATE_AWAITING_HEADER,
+    };
+    Session.si = si;
+    uint32_t protobufLength = 3 * sizeof(si->small_buf) + 1;
+    KineticPDUHeader header = {
+        .versionPrefix = 0xa0,
+        .protobufLength = KineticNBO_FromHostU32(protobufLength),
+        .valueLength = 0,
+    };
+
+    bus_sink_cb_res_t res = sink_cb((uint8_t *)&header, sizeof(header), &Session);
+    TEST_ASSERT_EQUAL(protobufLength, res.next_read);
+    TEST_ASSERT_EQUAL(STATE_AWAITING_BODY, si->state);
+    TEST_ASSERT_TRUE(si->buf != si->small_buf);
+    TEST_ASSERT_EQUAL(4 * sizeof(si->small_buf), si->buf_size);
+
+    uint8_t *body = calloc(1, protobufLength);
+    TEST_ASSERT_NOT_NULL(body);
+    body[protobufLength - 1] = 0xee;
+    res = sink_cb(body, protobufLength, &Session);
+    TEST_ASSERT_EQUAL(si, res.full_msg_buffer);
+    TEST_ASSERT_EQUAL(0xee, si->buf[protobufLength - 1]);
+
+    KineticResponse *response = calloc(1, sizeof(KineticResponse) + protobufLength);
+    TEST_ASSERT_NOT_NULL(response);
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, protobufLength, response);
+
+    bus_unpack_cb_res_t ures = unpack_cb(si, &Session);
+    TEST_ASSERT(ures.ok);
+    TEST_ASSERT_EQUAL(0xee, response->protobuf[protobufLength - 1]);
+    TEST_ASSERT_EQUAL_PTR(si->small_buf, si->buf);
+    TEST_ASSERT_EQUAL(sizeof(si->small_buf), si->buf_size);
+    uint8_t *large_buf = si->large_buf;
+    TEST_ASSERT_NOT_NULL(large_buf);
+
+    // The next large message reuses the same buffer
+    res = sink_cb((uint8_t *)&header, sizeof(header), &Session);
+    TEST_ASSERT_EQUAL(protobufLength, res.next_read);
+    TEST_ASSERT_EQUAL_PTR(large_buf, si->buf);
+    TEST_ASSERT_EQUAL(4 * sizeof(si->small_buf), si->buf_size);
+
+    free(si->large_buf);
+    free(response);
+    free(body);
+}
+
+/* Receive and unpack a message with a PROTOBUF_LEN byte protobuf. */
+static void receive_message(socket_info *si, uint32_t protobufLength, KineticResponse *response)
+{
+    KineticPDUHeader header = {
+        .versionPrefix = 0xa0,
+        .protobufLength = KineticNBO_FromHostU32(protobufLength),
+        .valueLength = 0,
+    };
+    bus_sink_cb_res_t res = sink_cb((uint8_t *)&header, sizeof(header), &Session);
+    TEST_ASSERT_EQUAL(protobufLength, res.next_read);
+
+    uint8_t *body = calloc(1, protobufLength);
+    TEST_ASSERT_NOT_NULL(body);
+    res = sink_cb(body, protobufLength, &Session);
+    TEST_ASSERT_EQUAL(si, res.full_msg_buffer);
+    free(body);
+
+    KineticAllocator_NewKineticResponse_ExpectAndReturn(&ResponsePool, protobufLength, response);
+    bus_unpack_cb_res_t ures = unpack_cb(si, &Session);
+    TEST_ASSERT(ures.ok);
+}
+
+void test_idle_cb_should_keep_the_large_buffer_while_it_is_in_use(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    *si = (socket_info){
+        .state = STATE_AWAITING_HEADER,
+    };
+    Session.si = si;
+
+    // Nothing to release
+    TEST_ASSERT_FALSE(idle_cb(&Session));
+
+    // Still reassembling a message in it, however long ago it was last used
+    uint8_t *large_buf = malloc(2 * sizeof(si->small_buf));
+    TEST_ASSERT_NOT_NULL(large_buf);
+    si->large_buf = large_buf;
+    si->large_buf_size = 2 * sizeof(si->small_buf);
+    si->buf = large_buf;
+    si->large_buf_used = time(NULL) - KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS;
+    TEST_ASSERT_TRUE(idle_cb(&Session));
+    TEST_ASSERT_EQUAL_PTR(large_buf, si->large_buf);
+
+    free(large_buf);
+}
+
+void test_idle_cb_should_release_the_large_buffer_after_it_has_gone_unused(void)
+{
+    socket_info *si = (socket_info *)si_buf;
+    *si = (socket_info){
+        .state = STATE_AWAITING_HEADER,
+    };
+    Session.si = si;
+    uint32_t largeLength = 3 * sizeof(si->small_buf) + 1;
+    KineticResponse *response = calloc(1, sizeof(KineticResponse) + largeLength);
+    TEST_ASSERT_NOT_NULL(response);
+
+    receive_message(si, largeLength, response);
+    TEST_ASSERT_NOT_NULL(si->large_buf);
+    TEST_ASSERT(time(NULL) - si->large_buf_used < KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS);
+
+    // Recently used, so it's kept, and the bus should check back later
+    TEST_ASSERT_TRUE(idle_cb(&Session));
+    TEST_ASSERT_NOT_NULL(si->large_buf);
+
+    // A small message doesn't free it either
+    receive_message(si, 16, response);
+    TEST_ASSERT_NOT_NULL(si->large_buf);
+
+    // Once it's gone unused long enough, it's freed with no further message
+    si->large_buf_used -= KINETIC_SOCKET_INFO_LARGE_BUF_IDLE_SECS;
+    TEST_ASSERT_FALSE(idle_cb(&Session));
+    TEST_ASSERT_NULL(si->large_buf);
+    TEST_ASSERT_EQUAL(0, si->large_buf_size);
+    TEST_ASSERT_EQUAL_PTR(si->small_buf, si->buf);
+
+    free(response);
 }
@@ -33,12 +33,108 @@
 #include "mock_kinetic_request.h"
 #include "mock_kinetic_acl.h"
 #include "kinetic_callbacks.h"
+#include "kinetic_tag.h"
+#include <string.h>
 
 void test_kinetic_callbacks_needs_testing(void)
 {
     TEST_IGNORE_MESSAGE("TODO: Test operation callbacks.");
 }
 
+void test_KineticCallbacks_Get_should_copy_value_from_response_into_entry(void)
+{
+    KineticSession session;
+    uint8_t value_buf[16];
+    KineticEntry entry = {
+        .value = ByteBuffer_Create(value_buf, sizeof(value_buf), 0),
+    };
+    uint8_t response_buf[sizeof(KineticResponse) + 4];
+    memset(response_buf, 0, sizeof(response_buf));
+    KineticResponse *response = (KineticResponse *)response_buf;
+    response->header.valueLength = 4;
+    memcpy(response->value, "abcd", 4);
+    KineticOperation op = {
+        .session = &session,
+        .entry = &entry,
+        .response = response,
+    };
+
+    KineticResponse_GetKeyValue_ExpectAndReturn(response, NULL);
+
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS,
+        KineticCallbacks_Get(&op, KINETIC_STATUS_SUCCESS));
+    TEST_ASSERT_EQUAL(4, entry.value.bytesUsed);
+    TEST_ASSERT_EQUAL_MEMORY("abcd", value_buf, 4);
+}
+
+void test_KineticCallbacks_Get_should_account_for_value_received_directly_into_entry(void)
+{
+    KineticSession session;
+    uint8_t value_buf[16];
+    KineticEntry entry = {
+        .value = ByteBuffer_Create(value_buf, sizeof(value_buf), 2),
+    };
+    KineticResponse response = {
+        .header.valueLength = 4,
+        .valueInEntry = true,
+    };
+    KineticOperation op = {
+        .session = &session,
+        .entry = &entry,
+        .response = &response,
+    };
+
+    KineticResponse_GetKeyValue_ExpectAndReturn(&response, NULL);
+
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS,
+        KineticCallbacks_Get(&op, KINETIC_STATUS_SUCCESS));
+    TEST_ASSERT_EQUAL(6, entry.value.bytesUsed);
+}
+
+static KineticStatus get_tagged_value(KineticAlgorithm algorithm, bool corrupt)
+{
+    KineticSession session;
+    uint8_t value_buf[16];
+    uint8_t tag_buf[20];
+    KineticEntry entry = {
+        .value = ByteBuffer_Create(value_buf, sizeof(value_buf), 0),
+        .tag = ByteBuffer_Create(tag_buf, sizeof(tag_buf), 0),
+        .algorithm = algorithm,
+        .computeTag = true,
+    };
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, KineticTag_Compute(algorithm,
+        ByteArray_CreateWithCString("abcd"), &entry.tag));
+
+    uint8_t response_buf[sizeof(KineticResponse) + 4];
+    memset(response_buf, 0, sizeof(response_buf));
+    KineticResponse *response = (KineticResponse *)response_buf;
+    response->header.valueLength = 4;
+    memcpy(response->value, corrupt ? "abce" : "abcd", 4);
+    KineticOperation op = {
+        .session = &session,
+        .entry = &entry,
+        .response = response,
+    };
+
+    KineticResponse_GetKeyValue_ExpectAndReturn(response, NULL);
+
+    return KineticCallbacks_Get(&op, KINETIC_STATUS_SUCCESS);
+}
+
+void test_KineticCallbacks_Get_should_accept_value_matching_its_tag(void)
+{
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        get_tagged_value(KINETIC_ALGORITHM_CRC32, false));
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        get_tagged_value(KINETIC_ALGORITHM_SHA1, false));
+}
+
+void test_KineticCallbacks_Get_should_return_DATA_ERROR_if_value_does_not_match_its_tag(void)
+{
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_DATA_ERROR,
+        get_tagged_value(KINETIC_ALGORITHM_CRC64, true));
+}
+
 // void test_KineticBuilder_GetLogCallback_should_copy_returned_device_info_into_dynamically_allocated_info_structure(void)
 // {
 //     // KineticRequest response;
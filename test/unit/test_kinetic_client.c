@@ -29,11 +29,14 @@
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_session.h"
 #include "mock_kinetic_controller.h"
+#include "mock_kinetic_device_info.h"
 #include "mock_kinetic_message.h"
 #include "mock_kinetic_bus.h"
 #include "protobuf-c/protobuf-c.h"
 #include "mock_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
+#include "kinetic_response_pool_types.h"
 #include <stdio.h>
 
 static KineticSession Session;
@@ -41,6 +44,7 @@ static const int64_t ClusterVersion = 1234;
 static const int64_t Identity = 47;
 static ByteArray HmacKey;
 static struct bus MessageBus;
+static KineticResponsePool ResponsePool;
 
 void setUp(void)
 {
@@ -71,11 +75,13 @@ void test_KineticClient_Init_should_initialize_the_message_bus_and_return_a_new_
     };
 
     KineticCalloc_ExpectAndReturn(1, sizeof(KineticClient), &client);
+    KineticResponsePool_Create_ExpectAndReturn(&ResponsePool);
     KineticBus_Init_ExpectAndReturn(&client, &config, true);
 
     KineticClient * result = KineticClient_Init(&config);
 
     TEST_ASSERT_EQUAL(&client, result);
+    TEST_ASSERT_EQUAL_PTR(&ResponsePool, client.responsePool);
 }
 
 void test_KineticClient_Init_should_return_null_if_calloc_returns_null(void)
@@ -101,13 +107,58 @@ void test_KineticClient_Init_should_free_client_if_bus_init_fails(void)
         .logLevel = 3,
     };
     KineticCalloc_ExpectAndReturn(1, sizeof(KineticClient), &client);
+    KineticResponsePool_Create_ExpectAndReturn(&ResponsePool);
     KineticBus_Init_ExpectAndReturn(&client, &config, false);
+    KineticResponsePool_Destroy_Expect(&ResponsePool);
     KineticFree_Expect(&client);
 
     KineticClient * result = KineticClient_Init(&config);
     TEST_ASSERT_NULL(result);
 }
 
+void test_KineticClient_Init_should_free_client_if_response_pool_creation_fails(void)
+{
+    KineticClient client;
+
+    KineticClientConfig config = {
+        .logFile = "stdout",
+        .logLevel = 3,
+    };
+    KineticCalloc_ExpectAndReturn(1, sizeof(KineticClient), &client);
+    KineticResponsePool_Create_ExpectAndReturn(NULL);
+    KineticFree_Expect(&client);
+
+    KineticClient * result = KineticClient_Init(&config);
+    TEST_ASSERT_NULL(result);
+}
+
+void test_KineticClient_Shutdown_should_shut_down_the_bus_and_destroy_the_response_pool(void)
+{
+    KineticClient client = {
+        .bus = &MessageBus,
+        .responsePool = &ResponsePool,
+    };
+
+    KineticBus_Shutdown_Expect(&client);
+    KineticResponsePool_Destroy_Expect(&ResponsePool);
+    KineticFree_Expect(&client);
+
+    KineticClient_Shutdown(&client);
+}
+
+void test_KineticClient_GetResponsePoolStats_should_delegate_to_the_response_pool(void)
+{
+    KineticClient client = {
+        .bus = &MessageBus,
+        .responsePool = &ResponsePool,
+    };
+    KineticResponsePoolStats stats;
+
+    KineticResponsePool_GetStats_Expect(&ResponsePool, &stats);
+
+    KineticClient_GetResponsePoolStats(&client, &stats);
+}
+
 static void ConnectSession(void)
 {
     KineticClient client;
@@ -138,6 +189,64 @@ void test_KineticClient_CreateSession_should_configure_a_session_and_connect_to_
     ConnectSession();
 }
 
+static void ConnectSessionUsingDeviceLimits(KineticLogInfo* info, KineticStatus getLogStatus)
+{
+    KineticClient client;
+    client.bus = &MessageBus;
+    HmacKey = ByteArray_CreateWithCString("some hmac key");
+    KineticSessionConfig config = {
+        .host = "localhost",
+        .port = KINETIC_PORT,
+        .clusterVersion = ClusterVersion,
+        .identity = Identity,
+        .hmacKey = HmacKey,
+        .useDeviceLimits = true,
+    };
+    Session.config = config;
+    KineticSession* session;
+    KineticOperation operation;
+    KineticLogInfo* noInfo = NULL;
+
+    KineticAllocator_NewSession_ExpectAndReturn(&MessageBus, &config, &Session);
+    KineticSession_Create_ExpectAndReturn(&Session, &client, KINETIC_STATUS_SUCCESS);
+    KineticSession_Connect_ExpectAndReturn(&Session, KINETIC_STATUS_SUCCESS);
+    KineticAllocator_NewOperation_ExpectAndReturn(&Session, &operation);
+    KineticBuilder_BuildGetLog_ExpectAndReturn(&operation,
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__GET_LOG__TYPE__LIMITS, BYTE_ARRAY_NONE,
+        &noInfo, KINETIC_STATUS_SUCCESS);
+    KineticBuilder_BuildGetLog_ReturnThruPtr_info(&info);
+    KineticController_ExecuteOperation_ExpectAndReturn(&operation, NULL, getLogStatus);
+    if (getLogStatus == KINETIC_STATUS_SUCCESS) {
+        KineticSession_SetOutstandingOperationsLimit_Expect(&Session, 24);
+        KineticSession_SetMessageLimits_Expect(&Session, 2 * 1024 * 1024, 1024 * 1024);
+    }
+    if (info != NULL) {
+        KineticLogInfo_Free_Expect(info);
+    }
+
+    KineticStatus status = KineticClient_CreateSession(&config, &client, &session);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_EQUAL_PTR(&Session, session);
+}
+
+void test_KineticClient_CreateSession_should_apply_the_device_limits_if_configured(void)
+{
+    KineticLogInfo_Limits limits = {
+        .maxOutstandingReadRequests = 32,
+        .maxOutstandingWriteRequests = 24,
+        .maxMessageSize = 2 * 1024 * 1024,
+        .maxValueSize = 1024 * 1024,
+    };
+    KineticLogInfo info = {.limits = &limits};
+
+    ConnectSessionUsingDeviceLimits(&info, KINETIC_STATUS_SUCCESS);
+}
+
+void test_KineticClient_CreateSession_should_keep_the_configured_limit_if_the_device_limits_are_unavailable(void)
+{
+    ConnectSessionUsingDeviceLimits(NULL, KINETIC_STATUS_NOT_AUTHORIZED);
+}
+
 void test_KineticClient_CreateSession_should_return_KINETIC_STATUS_SESSION_EMPTY_upon_NULL_session_config(void)
 {
     KineticStatus status = KineticClient_CreateSession(NULL, NULL, NULL);
@@ -25,6 +25,7 @@
 #include "mock_kinetic_controller.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_resourcewaiter.h"
 
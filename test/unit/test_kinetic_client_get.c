@@ -25,6 +25,7 @@
 #include "mock_kinetic_controller.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_resourcewaiter.h"
 
@@ -123,3 +124,20 @@ void test_KineticClient_Get_should_execute_GET_operation_and_retrieve_only_metad
 
     TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
 }
+
+void test_KineticClient_GetBatch_should_get_error_MISSING_KEY_before_building_anything_if_an_entry_has_no_key(void)
+{
+    uint8_t KeyData[64];
+    ByteArray Key = ByteArray_Create(KeyData, sizeof(KeyData));
+    ByteBuffer KeyBuffer = ByteBuffer_CreateWithArray(Key);
+    ByteBuffer_AppendDummyData(&KeyBuffer, Key.len);
+    KineticEntry entries[] = {
+        {.key = KeyBuffer, .metadataOnly = true},
+        {.metadataOnly = true},
+    };
+    KineticStatus statuses[2];
+
+    KineticStatus status = KineticClient_GetBatch(&Session, entries, 2, statuses, NULL);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_MISSING_KEY, status);
+}
@@ -27,6 +27,7 @@
 #include "mock_kinetic_auth.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_acl.h"
 #include "kinetic_logger.h"
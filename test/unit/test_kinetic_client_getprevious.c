@@ -24,6 +24,7 @@
 #include "mock_kinetic_controller.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "kinetic_logger.h"
 #include "kinetic.pb-c.h"
@@ -24,6 +24,7 @@
 #include "mock_kinetic_operation.h"
 #include "mock_kinetic_bus.h"
 #include "mock_kinetic_memory.h"
+#include "mock_kinetic_response_pool.h"
 #include "mock_kinetic_allocator.h"
 #include "kinetic_logger.h"
 #include "kinetic.pb-c.h"
@@ -93,3 +94,58 @@ void test_KineticClient_Put_should_return_BUFFER_OVERRUN_if_object_value_too_lon
 
     TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_BUFFER_OVERRUN, status);
 }
+
+void test_KineticClient_PutBatch_should_build_every_PUT_and_execute_them_as_one_batch(void)
+{
+    ByteArray value = ByteArray_CreateWithCString("Four score, and seven years ago");
+    KineticEntry entries[] = {
+        {.value = ByteBuffer_CreateWithArray(value)},
+        {.value = ByteBuffer_CreateWithArray(value)},
+    };
+    KineticStatus statuses[2];
+    KineticOperation operations[2];
+    operations[0].session = &Session;
+    operations[1].session = &Session;
+    KineticOperation* ops[2];
+
+    KineticCalloc_ExpectAndReturn(2, sizeof(KineticOperation*), ops);
+    KineticAllocator_NewOperation_ExpectAndReturn(&Session, &operations[0]);
+    KineticBuilder_BuildPut_ExpectAndReturn(&operations[0], &entries[0], KINETIC_STATUS_SUCCESS);
+    KineticAllocator_NewOperation_ExpectAndReturn(&Session, &operations[1]);
+    KineticBuilder_BuildPut_ExpectAndReturn(&operations[1], &entries[1], KINETIC_STATUS_SUCCESS);
+    KineticController_ExecuteBatch_ExpectAndReturn(ops, 2, statuses, NULL, KINETIC_STATUS_SUCCESS);
+    KineticFree_Expect(ops);
+
+    KineticStatus status = KineticClient_PutBatch(&Session, entries, 2, statuses, NULL);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_EQUAL_PTR(&operations[0], ops[0]);
+    TEST_ASSERT_EQUAL_PTR(&operations[1], ops[1]);
+}
+
+void test_KineticClient_PutBatch_should_free_built_operations_and_not_send_if_a_build_fails(void)
+{
+    ByteArray value = ByteArray_CreateWithCString("Four score, and seven years ago");
+    KineticEntry entries[] = {
+        {.value = ByteBuffer_CreateWithArray(value)},
+        {.value = ByteBuffer_CreateWithArray(value)},
+    };
+    KineticStatus statuses[2];
+    KineticOperation operations[2];
+    operations[0].session = &Session;
+    operations[1].session = &Session;
+    KineticOperation* ops[2];
+
+    KineticCalloc_ExpectAndReturn(2, sizeof(KineticOperation*), ops);
+    KineticAllocator_NewOperation_ExpectAndReturn(&Session, &operations[0]);
+    KineticBuilder_BuildPut_ExpectAndReturn(&operations[0], &entries[0], KINETIC_STATUS_SUCCESS);
+    KineticAllocator_NewOperation_ExpectAndReturn(&Session, &operations[1]);
+    KineticBuilder_BuildPut_ExpectAndReturn(&operations[1], &entries[1], KINETIC_STATUS_BUFFER_OVERRUN);
+    KineticAllocator_FreeOperation_Expect(&operations[1]);
+    KineticAllocator_FreeOperation_Expect(&operations[0]);
+    KineticFree_Expect(ops);
+
+    KineticStatus status = KineticClient_PutBatch(&Session, entries, 2, statuses, NULL);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_BUFFER_OVERRUN, status);
+}
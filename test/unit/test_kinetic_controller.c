@@ -28,6 +28,7 @@
 #include "mock_kinetic_operation.h"
 #include "mock_kinetic_allocator.h"
 #include "mock_kinetic_resourcewaiter.h"
+#include "mock_kinetic_hmac.h"
 #include <pthread.h>
 
 void setUp(void)
@@ -56,7 +57,7 @@ void test_KineticController_ExecuteOperation_should_carry_out_an_operation_with_
     KineticCompletionClosure closure;
 
     KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
-    KineticOperation_SendRequest_ExpectAndReturn(&operation, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SubmitRequest_ExpectAndReturn(&operation, KINETIC_STATUS_SUCCESS);
 
     KineticStatus status = KineticController_ExecuteOperation(&operation, &closure);
 
@@ -74,7 +75,7 @@ void test_KineticController_ExecuteOperation_should_carry_out_an_operation_with_
     KineticCompletionClosure closure;
 
     KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
-    KineticOperation_SendRequest_ExpectAndReturn(&operation, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SubmitRequest_ExpectAndReturn(&operation, KINETIC_STATUS_SUCCESS);
 
     KineticStatus status = KineticController_ExecuteOperation(&operation, &closure);
 
@@ -108,9 +109,233 @@ void test_KineticController_ExecuteOperation_should_carry_out_an_operation_with_
     KineticCompletionClosure closure;
 
     KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
-    KineticOperation_SendRequest_ExpectAndReturn(&operation, KINETIC_STATUS_OPERATION_INVALID);
+    KineticOperation_SubmitRequest_ExpectAndReturn(&operation, KINETIC_STATUS_OPERATION_INVALID);
 
     KineticStatus status = KineticController_ExecuteOperation(&operation, &closure);
 
     TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_OPERATION_INVALID, status);
 }
+
+static int BatchCallbacks;
+static KineticStatus BatchStatus;
+
+static void batch_callback(KineticCompletionData* kinetic_data, void* client_data)
+{
+    (void)client_data;
+    BatchCallbacks++;
+    BatchStatus = kinetic_data->status;
+}
+
+void test_KineticController_ExecuteBatch_should_call_closure_once_after_last_operation_completes(void)
+{
+    KineticSession session = {.connected = true};
+    KineticRequest requests[2];
+    KineticOperation operations[2] = {
+        {.session = &session, .request = &requests[0]},
+        {.session = &session, .request = &requests[1]},
+    };
+    KineticOperation* ops[] = {&operations[0], &operations[1]};
+    KineticStatus statuses[2];
+    KineticCompletionClosure closure = {.callback = batch_callback};
+    bool noneSent[2] = {false, false};
+    bool allSent[2] = {true, true};
+    BatchCallbacks = 0;
+
+    KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SendRequests_ExpectAndReturn(ops, 2, noneSent, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SendRequests_ReturnArrayThruPtr_sent(allSent, 2);
+
+    KineticStatus status = KineticController_ExecuteBatch(ops, 2, statuses, &closure);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+
+    KineticCompletionData done = {.status = KINETIC_STATUS_NOT_FOUND};
+    operations[1].closure.callback(&done, operations[1].closure.clientData);
+    TEST_ASSERT_EQUAL(0, BatchCallbacks);
+
+    done.status = KINETIC_STATUS_SUCCESS;
+    operations[0].closure.callback(&done, operations[0].closure.clientData);
+    TEST_ASSERT_EQUAL(1, BatchCallbacks);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_NOT_FOUND, BatchStatus);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, statuses[0]);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_NOT_FOUND, statuses[1]);
+}
+
+void test_KineticController_ExecuteBatch_should_let_operations_complete_inline_only_if_closure_is_nonblocking(void)
+{
+    KineticSession session = {.connected = true};
+    KineticRequest requests[2];
+    KineticOperation operations[2] = {
+        {.session = &session, .request = &requests[0]},
+        {.session = &session, .request = &requests[1]},
+    };
+    KineticOperation* ops[] = {&operations[0], &operations[1]};
+    KineticStatus statuses[2];
+    bool noneSent[2] = {false, false};
+    bool allSent[2] = {true, true};
+    KineticCompletionData done = {.status = KINETIC_STATUS_SUCCESS};
+
+    for (int nonBlocking = 0; nonBlocking < 2; nonBlocking++) {
+        KineticCompletionClosure closure = {
+            .callback = batch_callback,
+            .nonBlocking = nonBlocking,
+        };
+        KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
+        KineticOperation_SendRequests_ExpectAndReturn(ops, 2, noneSent, KINETIC_STATUS_SUCCESS);
+        KineticOperation_SendRequests_ReturnArrayThruPtr_sent(allSent, 2);
+
+        KineticStatus status = KineticController_ExecuteBatch(ops, 2, statuses, &closure);
+        TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+        TEST_ASSERT_EQUAL(nonBlocking, operations[0].closure.nonBlocking);
+        TEST_ASSERT_EQUAL(nonBlocking, operations[1].closure.nonBlocking);
+
+        operations[0].closure.callback(&done, operations[0].closure.clientData);
+        operations[1].closure.callback(&done, operations[1].closure.clientData);
+    }
+}
+
+void test_KineticController_ExecuteBatch_should_free_operations_and_not_call_closure_if_none_are_sent(void)
+{
+    KineticSession session = {.connected = true};
+    KineticRequest requests[2];
+    KineticOperation operations[2] = {
+        {.session = &session, .request = &requests[0]},
+        {.session = &session, .request = &requests[1]},
+    };
+    KineticOperation* ops[] = {&operations[0], &operations[1]};
+    KineticStatus statuses[2];
+    KineticCompletionClosure closure = {.callback = batch_callback};
+    bool noneSent[2] = {false, false};
+    BatchCallbacks = 0;
+
+    KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SendRequests_ExpectAndReturn(ops, 2, noneSent, KINETIC_STATUS_REQUEST_REJECTED);
+    KineticAllocator_FreeOperation_Expect(&operations[0]);
+    KineticAllocator_FreeOperation_Expect(&operations[1]);
+
+    KineticStatus status = KineticController_ExecuteBatch(ops, 2, statuses, &closure);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_REQUEST_REJECTED, status);
+    TEST_ASSERT_EQUAL(0, BatchCallbacks);
+}
+
+void test_KineticController_ExecuteBatch_should_complete_only_the_operations_that_were_not_sent(void)
+{
+    KineticSession session = {.connected = true};
+    KineticRequest requests[3];
+    KineticOperation operations[3] = {
+        {.session = &session, .request = &requests[0]},
+        {.session = &session, .request = &requests[1]},
+        {.session = &session, .request = &requests[2]},
+    };
+    KineticOperation* ops[] = {&operations[0], &operations[1], &operations[2]};
+    KineticStatus statuses[3];
+    KineticCompletionClosure closure = {.callback = batch_callback};
+    bool noneSent[3] = {false, false, false};
+    bool someSent[3] = {true, false, true};
+    BatchCallbacks = 0;
+
+    KineticSession_GetTerminationStatus_ExpectAndReturn(&session, KINETIC_STATUS_SUCCESS);
+    KineticOperation_SendRequests_ExpectAndReturn(ops, 3, noneSent, KINETIC_STATUS_REQUEST_REJECTED);
+    KineticOperation_SendRequests_ReturnArrayThruPtr_sent(someSent, 3);
+    KineticAllocator_FreeOperation_Expect(&operations[1]);
+
+    KineticStatus status = KineticController_ExecuteBatch(ops, 3, statuses, &closure);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_REQUEST_REJECTED, statuses[1]);
+
+    KineticCompletionData done = {.status = KINETIC_STATUS_SUCCESS};
+    operations[0].closure.callback(&done, operations[0].closure.clientData);
+    operations[2].closure.callback(&done, operations[2].closure.clientData);
+    TEST_ASSERT_EQUAL(1, BatchCallbacks);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_REQUEST_REJECTED, BatchStatus);
+}
+
+static void handle_result(KineticSession * session, bool hmacValid, KineticStatus expectedStatus)
+{
+    KineticRequest request;
+    KineticOperation operation = {
+        .session = session,
+        .request = &request,
+    };
+    Com__Seagate__Kinetic__Proto__Message proto = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    Com__Seagate__Kinetic__Proto__Command__Header header = COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    Com__Seagate__Kinetic__Proto__Command command = COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.header = &header;
+    KineticResponse response = {
+        .proto = &proto,
+        .command = &command,
+    };
+    bus_msg_result_t res = {
+        .status = BUS_SEND_SUCCESS,
+        .u.response.opaque_msg = &response,
+    };
+
+    KineticResponse_Unpack_ExpectAndReturn(&response, true);
+    KineticResponse_GetStatus_ExpectAndReturn(&response, KINETIC_STATUS_SUCCESS);
+    if (session->config.verifyResponseHmac) {
+        KineticHMAC_Validate_ExpectAndReturn(&proto, &session->hmacKey, hmacValid);
+    }
+    KineticResponse_GetProtobufLength_ExpectAndReturn(&response, 0);
+    KineticResponse_GetValueLength_ExpectAndReturn(&response, 0);
+    KineticOperation_Complete_Expect(&operation, expectedStatus);
+
+    KineticController_HandleResult(&res, &operation);
+}
+
+void test_KineticController_HandleResult_should_not_check_response_HMAC_unless_configured_to(void)
+{
+    KineticSession session = {.connected = true};
+
+    handle_result(&session, false, KINETIC_STATUS_SUCCESS);
+}
+
+void test_KineticController_HandleResult_should_accept_response_with_valid_HMAC(void)
+{
+    KineticSession session = {.connected = true, .config.verifyResponseHmac = true};
+
+    handle_result(&session, true, KINETIC_STATUS_SUCCESS);
+}
+
+void test_KineticController_HandleResult_should_fail_response_with_invalid_HMAC(void)
+{
+    KineticSession session = {.connected = true, .config.verifyResponseHmac = true};
+
+    handle_result(&session, false, KINETIC_STATUS_HMAC_FAILURE);
+}
+
+void test_KineticController_HandleResult_should_fail_response_that_cannot_be_unpacked(void)
+{
+    KineticSession session = {.connected = true, .config.verifyResponseHmac = true};
+    KineticRequest request;
+    KineticOperation operation = {
+        .session = &session,
+        .request = &request,
+    };
+    KineticResponse response;
+    memset(&response, 0, sizeof(response));
+    bus_msg_result_t res = {
+        .status = BUS_SEND_SUCCESS,
+        .u.response.seq_id = 3,
+        .u.response.opaque_msg = &response,
+    };
+
+    KineticResponse_Unpack_ExpectAndReturn(&response, false);
+    KineticResponse_GetProtobufLength_ExpectAndReturn(&response, 0);
+    KineticResponse_GetValueLength_ExpectAndReturn(&response, 0);
+    KineticOperation_Complete_Expect(&operation, KINETIC_STATUS_INVALID);
+
+    KineticController_HandleResult(&res, &operation);
+    TEST_ASSERT_EQUAL_PTR(&response, operation.response);
+}
+
+void test_KineticController_HandleUnexpectedResponse_should_drop_response_that_cannot_be_unpacked(void)
+{
+    KineticSession session = {.connected = true, .socket = 7};
+    KineticResponse response;
+    memset(&response, 0, sizeof(response));
+
+    KineticResponse_Unpack_ExpectAndReturn(&response, false);
+    KineticResponse_GetProtobufLength_ExpectAndReturn(&response, 0);
+    KineticAllocator_FreeKineticResponse_Expect(&response);
+
+    KineticController_HandleUnexpectedResponse(&response, BUS_NO_SEQ_ID, NULL, &session);
+}
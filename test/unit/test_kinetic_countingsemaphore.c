@@ -55,3 +55,101 @@ void test_kinetic_countingsemaphore_should_be_thread_safe(void)
 
     KineticCountingSemaphore_Destroy(sem);
 }
+
+void test_kinetic_countingsemaphore_TakeUpTo_should_take_what_is_available_up_to_max(void)
+{
+    KineticCountingSemaphore* sem = KineticCountingSemaphore_Create(MAX_COUNT);
+
+    TEST_ASSERT_EQUAL(2, KineticCountingSemaphore_TakeUpTo(sem, 2));
+    TEST_ASSERT_EQUAL(1, KineticCountingSemaphore_TakeUpTo(sem, 5));
+    KineticCountingSemaphore_Give(sem);
+    KineticCountingSemaphore_Give(sem);
+    TEST_ASSERT_EQUAL(2, KineticCountingSemaphore_TakeUpTo(sem, 5));
+    KineticCountingSemaphore_Give(sem);
+    KineticCountingSemaphore_Give(sem);
+    KineticCountingSemaphore_Give(sem);
+
+    KineticCountingSemaphore_Destroy(sem);
+}
+
+void test_kinetic_countingsemaphore_SetMax_should_allow_more_to_be_taken_when_grown(void)
+{
+    KineticCountingSemaphore* sem = KineticCountingSemaphore_Create(2);
+
+    TEST_ASSERT_EQUAL(2, KineticCountingSemaphore_TakeUpTo(sem, 5));
+    KineticCountingSemaphore_SetMax(sem, 5);
+    TEST_ASSERT_EQUAL(5, sem->max);
+    TEST_ASSERT_EQUAL(3, KineticCountingSemaphore_TakeUpTo(sem, 5));
+    for (int i = 0; i < 5; i++) { KineticCountingSemaphore_Give(sem); }
+    TEST_ASSERT_EQUAL(5, sem->count);
+
+    KineticCountingSemaphore_Destroy(sem);
+}
+
+void test_kinetic_countingsemaphore_SetMax_should_absorb_counts_taken_beyond_a_smaller_max(void)
+{
+    KineticCountingSemaphore* sem = KineticCountingSemaphore_Create(MAX_COUNT);
+
+    TEST_ASSERT_EQUAL(MAX_COUNT, KineticCountingSemaphore_TakeUpTo(sem, MAX_COUNT));
+    KineticCountingSemaphore_SetMax(sem, 1);
+    TEST_ASSERT_EQUAL(1 - MAX_COUNT, sem->count);
+
+    KineticCountingSemaphore_Give(sem);
+    KineticCountingSemaphore_Give(sem);
+    TEST_ASSERT_EQUAL(0, sem->count);
+    KineticCountingSemaphore_Give(sem);
+    TEST_ASSERT_EQUAL(1, sem->count);
+    TEST_ASSERT_EQUAL(1, KineticCountingSemaphore_TakeUpTo(sem, MAX_COUNT));
+    KineticCountingSemaphore_Give(sem);
+
+    KineticCountingSemaphore_Destroy(sem);
+}
+
+#define ROUNDS 20000
+
+static uint32_t InFlight = 0;
+static uint32_t MaxInFlight = 0;
+
+static void* take_and_give(void* args)
+{
+    worker_args* worker = args;
+    for (int i = 0; i < ROUNDS; i++) {
+        uint32_t taken = 1;
+        if (i & 1) {
+            taken = KineticCountingSemaphore_TakeUpTo(worker->sem, 2);
+        } else {
+            KineticCountingSemaphore_Take(worker->sem);
+        }
+        uint32_t now = __sync_add_and_fetch(&InFlight, taken);
+        uint32_t seen = __sync_fetch_and_add(&MaxInFlight, 0);
+        while (now > seen) {
+            uint32_t prev = __sync_val_compare_and_swap(&MaxInFlight, seen, now);
+            if (prev == seen) { break; }
+            seen = prev;
+        }
+        __sync_sub_and_fetch(&InFlight, taken);
+        for (uint32_t t = 0; t < taken; t++) {
+            KineticCountingSemaphore_Give(worker->sem);
+        }
+    }
+    return NULL;
+}
+
+void test_kinetic_countingsemaphore_should_never_allow_more_than_max_to_be_taken_at_once(void)
+{
+    KineticCountingSemaphore* sem = KineticCountingSemaphore_Create(MAX_COUNT);
+
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        workers[i].sem = sem;
+        TEST_ASSERT_EQUAL(0, pthread_create(&workers[i].threadID, NULL, take_and_give, &workers[i]));
+    }
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_join(workers[i].threadID, NULL));
+    }
+
+    TEST_ASSERT_TRUE(MaxInFlight <= MAX_COUNT);
+    TEST_ASSERT_EQUAL(MAX_COUNT, sem->count);
+    TEST_ASSERT_EQUAL(0, sem->num_waiting);
+
+    KineticCountingSemaphore_Destroy(sem);
+}
@@ -85,6 +85,8 @@ void test_KineticHMAC_Populate_should_compute_and_populate_the_SHA1_HMAC_for_the
     uint8_t data[KINETIC_HMAC_MAX_LEN];
     ProtobufCBinaryData hmac = {.len = KINETIC_HMAC_MAX_LEN, .data = data};
     const ByteArray key = ByteArray_CreateWithCString("1234567890ABCDEFGHIJK");
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
     uint8_t commandBytes[123];
     ByteArray commandArray = ByteArray_Create(commandBytes, sizeof(commandBytes));
     ByteArray_FillWithDummyData(commandArray);
@@ -99,7 +101,7 @@ void test_KineticHMAC_Populate_should_compute_and_populate_the_SHA1_HMAC_for_the
     msg.hmacauth = &hmacAuth;
 
     KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&actual, &msg, key);
+    KineticHMAC_Populate(&actual, &msg, &hmacKey);
 
     TEST_ASSERT_TRUE(msg.hmacauth->has_hmac);
     TEST_ASSERT_EQUAL_PTR(hmac.data, msg.hmacauth->hmac.data);
@@ -129,6 +131,8 @@ void test_KineticHMAC_Validate_should_return_true_if_the_HMAC_for_the_supplied_m
     uint8_t data[KINETIC_HMAC_MAX_LEN];
     ProtobufCBinaryData hmac = {.len = KINETIC_HMAC_MAX_LEN, .data = data};
     const ByteArray key = ByteArray_CreateWithCString("1234567890ABCDEFGHIJK");
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
     proto.has_commandbytes = true;
     uint8_t packedCmd[128];
     size_t packedLen = com__seagate__kinetic__proto__command__pack(&command, packedCmd);
@@ -142,9 +146,9 @@ void test_KineticHMAC_Validate_should_return_true_if_the_HMAC_for_the_supplied_m
     proto.has_authtype = true;
 
     KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&actual, &proto, key);
+    KineticHMAC_Populate(&actual, &proto, &hmacKey);
 
-    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, &hmacKey));
 }
 
 void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_value_of_the_supplied_message_and_key_is_incorrect(void)
@@ -160,6 +164,8 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_value_of_the_supp
     uint8_t data[KINETIC_HMAC_MAX_LEN];
     ProtobufCBinaryData hmac = {.len = KINETIC_HMAC_MAX_LEN, .data = data};
     const ByteArray key = ByteArray_CreateWithCString("1234567890ABCDEFGHIJK");
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
     proto.has_commandbytes = true;
     uint8_t packedCmd[128];
     size_t packedLen = com__seagate__kinetic__proto__command__pack(&command, packedCmd);
@@ -173,14 +179,14 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_value_of_the_supp
     proto.has_authtype = true;
 
     KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&actual, &proto, key);
+    KineticHMAC_Populate(&actual, &proto, &hmacKey);
 
-    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, &hmacKey));
 
     // Bork the HMAC
     hmacAuth.hmac.data[3]++;
 
-    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, &hmacKey));
 }
 
 void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_length_of_the_supplied_message_and_key_is_incorrect(void)
@@ -196,6 +202,8 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_length_of_the_sup
     uint8_t data[KINETIC_HMAC_MAX_LEN];
     ProtobufCBinaryData hmac = {.len = KINETIC_HMAC_MAX_LEN, .data = data};
     const ByteArray key = ByteArray_CreateWithCString("1234567890ABCDEFGHIJK");
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
     proto.has_commandbytes = true;
     uint8_t packedCmd[128];
     size_t packedLen = com__seagate__kinetic__proto__command__pack(&command, packedCmd);
@@ -209,14 +217,14 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_length_of_the_sup
     proto.has_authtype = true;
 
     KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&actual, &proto, key);
+    KineticHMAC_Populate(&actual, &proto, &hmacKey);
 
-    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, &hmacKey));
 
     // Bork the HMAC
     hmacAuth.hmac.len--;
 
-    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, &hmacKey));
 }
 
 void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_presence_is_false_for_the_supplied_message_and_key_is_incorrect(void)
@@ -232,6 +240,8 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_presence_is_false
     uint8_t data[KINETIC_HMAC_MAX_LEN];
     ProtobufCBinaryData hmac = {.len = KINETIC_HMAC_MAX_LEN, .data = data};
     const ByteArray key = ByteArray_CreateWithCString("1234567890ABCDEFGHIJK");
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
     proto.has_commandbytes = true;
     uint8_t packedCmd[128];
     size_t packedLen = com__seagate__kinetic__proto__command__pack(&command, packedCmd);
@@ -245,12 +255,85 @@ void test_KineticHMAC_Validate_should_return_false_if_the_HMAC_presence_is_false
     proto.has_authtype = true;
 
     KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
-    KineticHMAC_Populate(&actual, &proto, key);
+    KineticHMAC_Populate(&actual, &proto, &hmacKey);
 
-    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&proto, &hmacKey));
 
     // Bork the HMAC
     hmacAuth.has_hmac = false;
 
-    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, key));
+    TEST_ASSERT_FALSE(KineticHMAC_Validate(&proto, &hmacKey));
+}
+
+static void assert_HMAC_matches_OpenSSL(const char* keyString)
+{
+    KineticHMAC actual;
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    Com__Seagate__Kinetic__Proto__Message__HMACauth hmacAuth = COM__SEAGATE__KINETIC__PROTO__MESSAGE__HMACAUTH__INIT;
+    uint8_t data[KINETIC_HMAC_MAX_LEN];
+    const ByteArray key = ByteArray_CreateWithCString((char*)keyString);
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, key);
+    uint8_t commandBytes[300];
+    ByteArray commandArray = ByteArray_Create(commandBytes, sizeof(commandBytes));
+    ByteArray_FillWithDummyData(commandArray);
+
+    msg.commandbytes = (ProtobufCBinaryData) {.data = commandBytes, .len = sizeof(commandBytes)};
+    msg.has_commandbytes = true;
+    hmacAuth.hmac = (ProtobufCBinaryData) {.data = data, .len = sizeof(data)};
+    msg.hmacauth = &hmacAuth;
+
+    KineticHMAC_Init(&actual, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
+    KineticHMAC_Populate(&actual, &msg, &hmacKey);
+
+    // The HMAC covers the command bytes, prefixed with their length in network byte order
+    uint8_t input[sizeof(uint32_t) + sizeof(commandBytes)];
+    uint32_t lenNBO = KineticNBO_FromHostU32(sizeof(commandBytes));
+    memcpy(input, &lenNBO, sizeof(lenNBO));
+    memcpy(&input[sizeof(lenNBO)], commandBytes, sizeof(commandBytes));
+    uint8_t expected[EVP_MAX_MD_SIZE];
+    unsigned int expectedLen = 0;
+    HMAC(EVP_sha1(), key.data, (int)key.len, input, sizeof(input), expected, &expectedLen);
+
+    TEST_ASSERT_EQUAL(KINETIC_HMAC_SHA1_LEN, expectedLen);
+    TEST_ASSERT_EQUAL(expectedLen, msg.hmacauth->hmac.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, msg.hmacauth->hmac.data, expectedLen);
+}
+
+void test_KineticHMAC_Populate_should_match_OpenSSL_HMAC_SHA1_for_the_same_key(void)
+{
+    assert_HMAC_matches_OpenSSL("asdfasdf");
+}
+
+void test_KineticHMAC_Populate_should_match_OpenSSL_HMAC_SHA1_for_keys_longer_than_a_SHA1_block(void)
+{
+    assert_HMAC_matches_OpenSSL(
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+        "this part makes the key longer than a 64 byte block");
+}
+
+void test_KineticHMAC_KeyInit_should_allow_the_same_key_to_sign_repeatedly(void)
+{
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    Com__Seagate__Kinetic__Proto__Message__HMACauth hmacAuth = COM__SEAGATE__KINETIC__PROTO__MESSAGE__HMACAUTH__INIT;
+    uint8_t data[KINETIC_HMAC_MAX_LEN];
+    uint8_t commandBytes[] = {1, 2, 3, 4, 5};
+    KineticHMACKey hmacKey;
+    KineticHMAC_KeyInit(&hmacKey, ByteArray_CreateWithCString("asdfasdf"));
+
+    msg.commandbytes = (ProtobufCBinaryData) {.data = commandBytes, .len = sizeof(commandBytes)};
+    msg.has_commandbytes = true;
+    hmacAuth.hmac = (ProtobufCBinaryData) {.data = data, .len = sizeof(data)};
+    msg.hmacauth = &hmacAuth;
+
+    KineticHMAC first, second;
+    KineticHMAC_Init(&first, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
+    KineticHMAC_Populate(&first, &msg, &hmacKey);
+    KineticHMAC_Init(&second, COM__SEAGATE__KINETIC__PROTO__COMMAND__SECURITY__ACL__HMACALGORITHM__HmacSHA1);
+    KineticHMAC_Populate(&second, &msg, &hmacKey);
+
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(first.data, second.data, KINETIC_HMAC_SHA1_LEN);
+    msg.has_authtype = true;
+    msg.authtype = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH;
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&msg, &hmacKey));
 }
@@ -28,6 +28,7 @@
 #include "mock_kinetic_session.h"
 #include "mock_kinetic_response.h"
 #include "mock_kinetic_countingsemaphore.h"
+#include "mock_kinetic_window.h"
 #include "mock_kinetic_request.h"
 
 static KineticSession Session;
@@ -36,6 +37,7 @@ static KineticOperation Operation;
 
 extern uint8_t * msg;
 extern size_t msgSize;
+extern bus_send_ticket ticket;
 
 void setUp(void)
 {
@@ -67,59 +69,64 @@ void test_KineticOperation_SendRequest_should_error_out_on_lock_failure(void)
 }
 
 
-void test_KineticOperation_SendRequest_should_return_MEMORY_ERROR_on_command_pack_failure(void)
+void test_KineticOperation_SendRequest_should_return_error_status_on_authentication_failure(void)
 {
     KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
     KineticSession *session = Operation.session;
     KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
 
-    KineticRequest_PackCommand_ExpectAndReturn(Operation.request, KINETIC_REQUEST_PACK_FAILURE);
+    KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+        Operation.request, NULL, KINETIC_STATUS_HMAC_REQUIRED);
     KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
 
     KineticStatus status = KineticOperation_SendRequest(&Operation);
-    TEST_ASSERT_EQUAL(KINETIC_STATUS_MEMORY_ERROR, status);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_HMAC_REQUIRED, status);
 }
 
-void test_KineticOperation_SendRequest_should_return_error_status_on_authentication_failure(void)
+void test_KineticOperation_SendRequest_should_return_error_status_on_PackMessage_failure(void)
 {
     KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
     KineticSession *session = Operation.session;
     KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
 
-    KineticRequest_PackCommand_ExpectAndReturn(Operation.request, 100);
     KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
-        Operation.request, NULL, KINETIC_STATUS_HMAC_REQUIRED);
+        Operation.request, NULL, KINETIC_STATUS_SUCCESS);
+
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &msg, &msgSize,
+        KINETIC_STATUS_MEMORY_ERROR);
     KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
 
     KineticStatus status = KineticOperation_SendRequest(&Operation);
-    TEST_ASSERT_EQUAL(KINETIC_STATUS_HMAC_REQUIRED, status);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_MEMORY_ERROR, status);
 }
 
-void test_KineticOperation_SendRequest_should_return_error_status_on_PackMessage_failure(void)
+void test_KineticOperation_SendRequest_should_return_REQUEST_REJECTED_if_QueueRequest_fails(void)
 {
     KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
     KineticSession *session = Operation.session;
     KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
 
-    KineticRequest_PackCommand_ExpectAndReturn(Operation.request, 100);
     KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
         Operation.request, NULL, KINETIC_STATUS_SUCCESS);
 
-    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &msg, &msgSize,
-        KINETIC_STATUS_MEMORY_ERROR);
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &msg, &msgSize, KINETIC_STATUS_SUCCESS);
+
+    KineticCountingSemaphore_Take_Expect(Operation.session->outstandingOperations);
+
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, msg, msgSize, &ticket, false);
+    KineticCountingSemaphore_Give_Expect(Operation.session->outstandingOperations);
     KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
 
     KineticStatus status = KineticOperation_SendRequest(&Operation);
-    TEST_ASSERT_EQUAL(KINETIC_STATUS_MEMORY_ERROR, status);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_REQUEST_REJECTED, status);
 }
 
-void test_KineticOperation_SendRequest_should_return_REQUEST_REJECTED_if_SendRequest_fails(void)
+void test_KineticOperation_SendRequest_should_return_REQUEST_REJECTED_if_FlushRequest_fails(void)
 {
     KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
     KineticSession *session = Operation.session;
     KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
 
-    KineticRequest_PackCommand_ExpectAndReturn(Operation.request, 100);
     KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
         Operation.request, NULL, KINETIC_STATUS_SUCCESS);
 
@@ -127,9 +134,10 @@ void test_KineticOperation_SendRequest_should_return_REQUEST_REJECTED_if_SendReq
 
     KineticCountingSemaphore_Take_Expect(Operation.session->outstandingOperations);
 
-    KineticRequest_SendRequest_ExpectAndReturn(&Operation, msg, msgSize, false);
-    KineticCountingSemaphore_Give_Expect(Operation.session->outstandingOperations);
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, msg, msgSize, &ticket, true);
     KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
+    KineticRequest_FlushRequest_ExpectAndReturn(session, &ticket, false);
+    KineticCountingSemaphore_Give_Expect(Operation.session->outstandingOperations);
 
     KineticStatus status = KineticOperation_SendRequest(&Operation);
     TEST_ASSERT_EQUAL(KINETIC_STATUS_REQUEST_REJECTED, status);
@@ -141,7 +149,6 @@ void test_KineticOperation_SendRequest_should_acquire_and_increment_sequence_cou
     KineticSession *session = Operation.session;
     KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
 
-    KineticRequest_PackCommand_ExpectAndReturn(Operation.request, 100);
     KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
         Operation.request, NULL, KINETIC_STATUS_SUCCESS);
 
@@ -149,11 +156,196 @@ void test_KineticOperation_SendRequest_should_acquire_and_increment_sequence_cou
 
     KineticCountingSemaphore_Take_Expect(Operation.session->outstandingOperations);
 
-    KineticRequest_SendRequest_ExpectAndReturn(&Operation, msg, msgSize, true);
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, msg, msgSize, &ticket, true);
     KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
+    KineticRequest_FlushRequest_ExpectAndReturn(session, &ticket, true);
 
     KineticStatus status = KineticOperation_SendRequest(&Operation);
     TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, status);
 }
 
 
+
+void test_KineticOperation_SubmitRequest_should_queue_the_request_without_waiting_for_it_to_be_written(void)
+{
+    KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
+    KineticSession *session = Operation.session;
+    KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
+
+    KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+        Operation.request, NULL, KINETIC_STATUS_SUCCESS);
+
+    msg = malloc(100);
+    msgSize = 100;
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &msg, &msgSize, KINETIC_STATUS_SUCCESS);
+
+    KineticCountingSemaphore_Take_Expect(Operation.session->outstandingOperations);
+
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, msg, msgSize, NULL, true);
+    KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
+
+    KineticStatus status = KineticOperation_SubmitRequest(&Operation);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, status);
+
+    // Kept until the operation is freed
+    TEST_ASSERT_EQUAL_PTR(msg, Operation.packedRequest);
+    free(msg);
+    msg = NULL;
+    msgSize = 0;
+}
+
+void test_KineticOperation_SubmitRequest_should_return_REQUEST_REJECTED_if_QueueRequest_fails(void)
+{
+    KineticRequest_LockSend_ExpectAndReturn(Operation.session, true);
+    KineticSession *session = Operation.session;
+    KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
+
+    KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+        Operation.request, NULL, KINETIC_STATUS_SUCCESS);
+
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &msg, &msgSize, KINETIC_STATUS_SUCCESS);
+
+    KineticCountingSemaphore_Take_Expect(Operation.session->outstandingOperations);
+
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, msg, msgSize, NULL, false);
+    KineticCountingSemaphore_Give_Expect(Operation.session->outstandingOperations);
+    KineticRequest_UnlockSend_ExpectAndReturn(Operation.session, true);
+
+    KineticStatus status = KineticOperation_SubmitRequest(&Operation);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_REQUEST_REJECTED, status);
+    TEST_ASSERT_NULL(Operation.packedRequest);
+}
+
+void test_KineticOperation_SendRequests_should_queue_requests_in_one_lock_and_flush_them_outside_it(void)
+{
+    KineticRequest request2;
+    KineticRequest_Init(&request2, &Session);
+    KineticOperation operation2 = {
+        .session = &Session,
+        .request = &request2,
+    };
+    KineticOperation* ops[] = {&Operation, &operation2};
+    KineticSession *session = Operation.session;
+    // Freed by SendRequests once they are sent
+    uint8_t * packed[] = {malloc(100), malloc(200)};
+    size_t packedSizes[] = {100, 200};
+    uint8_t * noMsg = NULL;
+    size_t noSize = 0;
+    bus_send_ticket noTicket = {0};
+    bool sent[2] = {false, false};
+
+    KineticRequest_LockSend_ExpectAndReturn(session, true);
+    KineticCountingSemaphore_TakeUpTo_ExpectAndReturn(session->outstandingOperations, 2, 2);
+    for (int i = 0; i < 2; i++) {
+        KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345 + i);
+        KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+            ops[i]->request, NULL, KINETIC_STATUS_SUCCESS);
+        KineticRequest_PackMessage_ExpectAndReturn(ops[i], &noMsg, &noSize, KINETIC_STATUS_SUCCESS);
+        KineticRequest_PackMessage_ReturnThruPtr_msg(&packed[i]);
+        KineticRequest_PackMessage_ReturnThruPtr_msgSize(&packedSizes[i]);
+        KineticRequest_QueueRequest_ExpectAndReturn(ops[i], packed[i], packedSizes[i],
+            &noTicket, true);
+    }
+    KineticRequest_UnlockSend_ExpectAndReturn(session, true);
+    KineticRequest_FlushRequest_ExpectAndReturn(session, &noTicket, true);
+    KineticRequest_FlushRequest_ExpectAndReturn(session, &noTicket, true);
+
+    KineticStatus status = KineticOperation_SendRequests(ops, 2, sent);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_TRUE(sent[0]);
+    TEST_ASSERT_TRUE(sent[1]);
+    TEST_ASSERT_EQUAL(12346, request2.message.header.sequence);
+}
+
+void test_KineticOperation_SendRequests_should_stop_at_and_report_a_PackMessage_failure(void)
+{
+    KineticRequest request2;
+    KineticRequest_Init(&request2, &Session);
+    KineticOperation operation2 = {
+        .session = &Session,
+        .request = &request2,
+    };
+    KineticOperation* ops[] = {&Operation, &operation2};
+    KineticSession *session = Operation.session;
+    uint8_t * noMsg = NULL;
+    size_t noSize = 0;
+    bool sent[2] = {true, true};
+
+    KineticRequest_LockSend_ExpectAndReturn(session, true);
+    KineticCountingSemaphore_TakeUpTo_ExpectAndReturn(session->outstandingOperations, 2, 2);
+    KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
+    KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+        Operation.request, NULL, KINETIC_STATUS_SUCCESS);
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &noMsg, &noSize,
+        KINETIC_STATUS_MEMORY_ERROR);
+    KineticCountingSemaphore_Give_Expect(session->outstandingOperations);
+    KineticCountingSemaphore_Give_Expect(session->outstandingOperations);
+    KineticRequest_UnlockSend_ExpectAndReturn(session, true);
+
+    KineticStatus status = KineticOperation_SendRequests(ops, 2, sent);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_MEMORY_ERROR, status);
+    TEST_ASSERT_FALSE(sent[0]);
+    TEST_ASSERT_FALSE(sent[1]);
+}
+
+void test_KineticOperation_SendRequests_should_report_a_rejected_flush_and_release_its_slot(void)
+{
+    KineticOperation* ops[] = {&Operation};
+    KineticSession *session = Operation.session;
+    uint8_t * packed = malloc(100);
+    size_t packedSize = 100;
+    uint8_t * noMsg = NULL;
+    size_t noSize = 0;
+    bus_send_ticket noTicket = {0};
+    bool sent[1] = {true};
+
+    KineticRequest_LockSend_ExpectAndReturn(session, true);
+    KineticCountingSemaphore_TakeUpTo_ExpectAndReturn(session->outstandingOperations, 1, 1);
+    KineticSession_GetNextSequenceCount_ExpectAndReturn(session, 12345);
+    KineticRequest_PopulateAuthentication_ExpectAndReturn(&session->config,
+        Operation.request, NULL, KINETIC_STATUS_SUCCESS);
+    KineticRequest_PackMessage_ExpectAndReturn(&Operation, &noMsg, &noSize, KINETIC_STATUS_SUCCESS);
+    KineticRequest_PackMessage_ReturnThruPtr_msg(&packed);
+    KineticRequest_PackMessage_ReturnThruPtr_msgSize(&packedSize);
+    KineticRequest_QueueRequest_ExpectAndReturn(&Operation, packed, packedSize, &noTicket, true);
+    KineticRequest_UnlockSend_ExpectAndReturn(session, true);
+    KineticRequest_FlushRequest_ExpectAndReturn(session, &noTicket, false);
+    KineticCountingSemaphore_Give_Expect(session->outstandingOperations);
+
+    KineticStatus status = KineticOperation_SendRequests(ops, 1, sent);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_REQUEST_REJECTED, status);
+    TEST_ASSERT_FALSE(sent[0]);
+}
+
+static KineticCompletionData LastCompletion;
+static void completion_cb(KineticCompletionData* kcd, void* udata)
+{
+    (void)udata;
+    LastCompletion = *kcd;
+}
+
+void test_KineticOperation_Complete_should_release_the_operation_and_call_its_closure(void)
+{
+    Operation.closure.callback = completion_cb;
+
+    KineticCountingSemaphore_Give_Expect(Session.outstandingOperations);
+    KineticAllocator_FreeOperation_Expect(&Operation);
+
+    KineticOperation_Complete(&Operation, KINETIC_STATUS_NOT_FOUND);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_NOT_FOUND, LastCompletion.status);
+}
+
+void test_KineticOperation_Complete_should_update_an_adaptive_window(void)
+{
+    KineticWindow* window = (KineticWindow*)0x1234;
+    Session.window = window;
+    Operation.closure.callback = completion_cb;
+    gettimeofday(&Operation.sentTime, NULL);
+
+    KineticWindow_Update_IgnoreAndReturn(11);
+    KineticCountingSemaphore_Give_Expect(Session.outstandingOperations);
+    KineticAllocator_FreeOperation_Expect(&Operation);
+
+    KineticOperation_Complete(&Operation, KINETIC_STATUS_SUCCESS);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, LastCompletion.status);
+}
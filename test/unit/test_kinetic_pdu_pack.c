@@ -0,0 +1,152 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "unity_helper.h"
+#include "kinetic_pdu_pack.h"
+#include "kinetic_auth.h"
+#include "kinetic_hmac.h"
+#include "kinetic_nbo.h"
+#include "kinetic.pb-c.h"
+#include "kinetic_logger.h"
+#include "kinetic_types.h"
+#include "kinetic_types_internal.h"
+#include "byte_array.h"
+#include "protobuf-c/protobuf-c.h"
+#include <string.h>
+#include <openssl/hmac.h>
+
+static KineticSession Session;
+static KineticRequest Request;
+static KineticHMACKey Key;
+static uint8_t KeyBytes[300];
+
+void setUp(void)
+{
+    KineticLogger_Init("stdout", 3);
+    const char* hmacKey = "asdfasdf";
+    memset(&Session, 0, sizeof(Session));
+    strcpy((char*)Session.config.keyData, hmacKey);
+    Session.config.hmacKey = ByteArray_Create(Session.config.keyData, strlen(hmacKey));
+    Session.config.identity = 1;
+    Session.config.useSsl = true;
+    Session.connectionID = 12345;
+    KineticHMAC_KeyInit(&Key, Session.config.hmacKey);
+
+    KineticRequest_Init(&Request, &Session);
+    Request.message.header.sequence = 77;
+    Request.message.header.messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GET;
+    Request.message.header.has_messagetype = true;
+}
+
+void tearDown(void)
+{
+    KineticLogger_Close();
+}
+
+static void add_key(size_t len)
+{
+    for (size_t i = 0; i < len; i++) { KeyBytes[i] = (uint8_t)i; }
+    com__seagate__kinetic__proto__command__body__init(&Request.message.body);
+    com__seagate__kinetic__proto__command__key_value__init(&Request.message.keyValue);
+    Request.message.keyValue.key = (ProtobufCBinaryData) {.data = KeyBytes, .len = len};
+    Request.message.keyValue.has_key = true;
+    Request.message.body.keyvalue = &Request.message.keyValue;
+    Request.message.command.body = &Request.message.body;
+}
+
+/* Check BUF against the PDU as packed the long way: the command packed
+ * separately, then the whole message packed with protobuf-c. */
+static void assert_packed_as_protobuf_c_would(uint8_t const * buf, size_t len, uint32_t valueLength)
+{
+    Com__Seagate__Kinetic__Proto__Message* proto = &Request.message.message;
+    uint8_t command[1024];
+    size_t commandLength = com__seagate__kinetic__proto__command__pack(&Request.message.command, command);
+    TEST_ASSERT_EQUAL_SIZET(commandLength, proto->commandbytes.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(command, proto->commandbytes.data, commandLength);
+
+    uint8_t expected[2048];
+    size_t protobufLength = com__seagate__kinetic__proto__message__pack(proto, expected);
+    TEST_ASSERT_EQUAL_SIZET(PDU_HEADER_LEN + protobufLength, len);
+
+    TEST_ASSERT_EQUAL('F', buf[0]);
+    uint32_t nboProtoLength = KineticNBO_FromHostU32(protobufLength);
+    uint32_t nboValueLength = KineticNBO_FromHostU32(valueLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&nboProtoLength, &buf[1], sizeof(nboProtoLength));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&nboValueLength, &buf[5], sizeof(nboValueLength));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, &buf[PDU_HEADER_LEN], protobufLength);
+}
+
+void test_KineticPDU_Pack_should_pack_the_command_in_place_and_sign_it(void)
+{
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, KineticAuth_PopulateHmac(&Session.config, &Request));
+    add_key(10);
+
+    uint8_t buf[1024];
+    size_t len = KineticPDU_PackedLength(&Request);
+    TEST_ASSERT(len <= sizeof(buf));
+    KineticPDU_Pack(&Request, 1234, &Key, buf, len);
+
+    // commandBytes are left pointing into the packed PDU
+    Com__Seagate__Kinetic__Proto__Message* proto = &Request.message.message;
+    TEST_ASSERT_TRUE(proto->commandbytes.data > buf);
+    TEST_ASSERT_EQUAL_PTR(&buf[len], proto->commandbytes.data + proto->commandbytes.len);
+
+    assert_packed_as_protobuf_c_would(buf, len, 1234);
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(proto, &Key));
+
+    // The packed HMAC is over the command's NBO length and bytes
+    uint8_t signedData[1024];
+    uint32_t nboCommandLength = KineticNBO_FromHostU32(proto->commandbytes.len);
+    memcpy(signedData, &nboCommandLength, sizeof(nboCommandLength));
+    memcpy(&signedData[sizeof(nboCommandLength)], proto->commandbytes.data, proto->commandbytes.len);
+    uint8_t expected[KINETIC_HMAC_SHA1_LEN];
+    unsigned int expectedLen = 0;
+    HMAC(EVP_sha1(), Session.config.hmacKey.data, Session.config.hmacKey.len,
+        signedData, sizeof(nboCommandLength) + proto->commandbytes.len, expected, &expectedLen);
+    TEST_ASSERT_EQUAL(KINETIC_HMAC_SHA1_LEN, expectedLen);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, Request.message.hmacData, KINETIC_HMAC_SHA1_LEN);
+}
+
+void test_KineticPDU_Pack_should_handle_commands_needing_a_multibyte_length(void)
+{
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, KineticAuth_PopulateHmac(&Session.config, &Request));
+    add_key(sizeof(KeyBytes));
+
+    uint8_t buf[1024];
+    size_t len = KineticPDU_PackedLength(&Request);
+    TEST_ASSERT(Request.message.message.commandbytes.len > 127);
+    TEST_ASSERT(len <= sizeof(buf));
+    KineticPDU_Pack(&Request, 0, &Key, buf, len);
+
+    assert_packed_as_protobuf_c_would(buf, len, 0);
+    TEST_ASSERT_TRUE(KineticHMAC_Validate(&Request.message.message, &Key));
+}
+
+void test_KineticPDU_Pack_should_pack_PIN_authenticated_requests_without_an_HMAC(void)
+{
+    ByteArray pin = ByteArray_CreateWithCString("1234");
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, KineticAuth_PopulatePin(&Session.config, &Request, pin));
+    add_key(10);
+
+    uint8_t buf[1024];
+    size_t len = KineticPDU_PackedLength(&Request);
+    TEST_ASSERT(len <= sizeof(buf));
+    KineticPDU_Pack(&Request, 5, NULL, buf, len);
+
+    assert_packed_as_protobuf_c_would(buf, len, 5);
+}
@@ -21,9 +21,10 @@
 
 #include "kinetic_logger.h"
 #include "byte_array.h"
+#include <string.h>
 
 #include "mock_kinetic_auth.h"
-#include "mock_kinetic_nbo.h"
+#include "mock_kinetic_pdu_pack.h"
 #include "mock_bus.h"
 #include "mock_kinetic_operation.h"
 #include "mock_kinetic_allocator.h"
@@ -32,8 +33,8 @@
 #include "mock_kinetic_countingsemaphore.h"
 #include "mock_kinetic.pb-c.h"
 
-extern uint8_t *cmdBuf;
 extern uint8_t *msg;
+bool inline_completion(KineticOperation const * const operation);
 
 void setUp(void)
 {
@@ -45,42 +46,6 @@ void tearDown(void)
     KineticLogger_Close();
 }
 
-void test_KineticRequest_PackCommand_should_return_KINETIC_REQUEST_PACK_FAILURE_on_malloc_fail(void)
-{
-    KineticMessage message;
-    memset(&message, 0, sizeof(message));
-    KineticRequest request;
-    memset(&request, 0, sizeof(request));
-    request.message = message;
-
-    com__seagate__kinetic__proto__command__get_packed_size_ExpectAndReturn(&request.message.command,
-        ((size_t)-1));
-
-    cmdBuf = NULL;  // fake malloc failure
-    TEST_ASSERT_EQUAL(KINETIC_REQUEST_PACK_FAILURE, KineticRequest_PackCommand(&request));
-}
-
-void test_KineticRequest_PackCommand_should_return_size_when_packing_command(void)
-{
-    KineticMessage message;
-    memset(&message, 0, sizeof(message));
-    KineticRequest request;
-    memset(&request, 0, sizeof(request));
-    request.message = message;
-
-    uint8_t buf[12345];
-    cmdBuf = buf;
-    com__seagate__kinetic__proto__command__get_packed_size_ExpectAndReturn(&request.message.command,
-        (size_t)12345);
-
-    com__seagate__kinetic__proto__command__pack_ExpectAndReturn(&request.message.command,
-        cmdBuf, 12345);
-    TEST_ASSERT_EQUAL(12345, KineticRequest_PackCommand(&request));
-
-    TEST_ASSERT_EQUAL(12345, request.message.message.commandbytes.len);
-    TEST_ASSERT_TRUE(request.message.message.has_commandbytes);
-}
-
 void test_KineticRequest_PopulateAuthentication_should_use_PIN_if_provided(void)
 {
     KineticSessionConfig config;
@@ -113,80 +78,112 @@ void test_KineticRequest_PackMessage_should_return_MEMORY_ERROR_on_alloc_fail(vo
     uint8_t *out_msg = NULL;
     size_t msgSize = 0;
 
-    Com__Seagate__Kinetic__Proto__Message* proto = &operation.request->message.message;
-    com__seagate__kinetic__proto__message__get_packed_size_ExpectAndReturn(proto, 12345);
-
-    KineticNBO_FromHostU32_ExpectAndReturn(12345, 0xaabbccdd);
-    KineticNBO_FromHostU32_ExpectAndReturn(9999, 0xddccbbaa);
+    KineticPDU_PackedLength_ExpectAndReturn(&request, 12345);
 
     msg = NULL;  // fake malloc failure
     KineticStatus status = KineticRequest_PackMessage(&operation, &out_msg, &msgSize);
     TEST_ASSERT_EQUAL(KINETIC_STATUS_MEMORY_ERROR, status);
 }
 
-void test_KineticRequest_PackMessage_should_return_SUCCESS_on_message_packing(void)
+void test_KineticRequest_PackMessage_should_pack_PDU_into_a_single_buffer_and_return_SUCCESS(void)
 {
+    KineticSession session;
+    memset(&session, 0, sizeof(session));
     KineticRequest request;
     memset(&request, 0, sizeof(request));
 
-    size_t valueLen = 5;
-    size_t packedSize = 6 + 16;  // mostly for nice alignment in hexdump
-
+    uint8_t valueBuf[] = "value";
     KineticOperation operation = {
+        .session = &session,
         .request = &request,
-        .value.len = valueLen,
+        .value = ByteArray_Create(valueBuf, 5),
     };
 
-    uint8_t valueBuf[] = "value";
-    operation.value.data = valueBuf;
-
     uint8_t *out_msg = NULL;
     size_t msgSize = 0;
 
-    Com__Seagate__Kinetic__Proto__Message* proto = &operation.request->message.message;
-    com__seagate__kinetic__proto__message__get_packed_size_ExpectAndReturn(proto, packedSize);
+    uint8_t buf[64];
+    msg = &buf[0];  // fake malloc
+    size_t packedLen = PDU_HEADER_LEN + 22;
 
-    // size of filler protobuf, mainly to get things nicely aligned w/ 9-byte header
-    KineticNBO_FromHostU32_ExpectAndReturn(packedSize, 0xaabbccdd);
+    KineticPDU_PackedLength_ExpectAndReturn(&request, packedLen);
+    KineticPDU_Pack_Expect(&request, 5, &session.hmacKey, buf, packedLen);
 
-    KineticNBO_FromHostU32_ExpectAndReturn(valueLen, 0xddccbbaa);
+    KineticStatus status = KineticRequest_PackMessage(&operation, &out_msg, &msgSize);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_EQUAL_PTR(buf, out_msg);
+    TEST_ASSERT_EQUAL(packedLen, msgSize);
+}
 
-    uint8_t buf[64 * 1024];
-    memset(buf, 0, sizeof(buf));
-    msg = &buf[0];  // fake malloc
-    size_t offset = sizeof(uint8_t) + 2*sizeof(uint32_t);
+static bool completes_inline(KineticMessageType type, KineticEntry *entry)
+{
+    KineticSession session = {.config = {.inlineCompletion = true}};
+    KineticRequest request;
+    memset(&request, 0, sizeof(request));
+    request.message.header.messagetype =
+        (Com__Seagate__Kinetic__Proto__Command__MessageType)type;
+    KineticOperation operation = {
+        .session = &session,
+        .request = &request,
+        .entry = entry,
+        .closure = {.nonBlocking = true},
+    };
+    return inline_completion(&operation);
+}
 
-    // filler where protobuf message would be
-    for (size_t i = 0; i < packedSize; i++) { buf[i + offset] = 0x33; }
+void test_inline_completion_should_require_a_nonBlocking_closure_and_the_session_option(void)
+{
+    KineticSession session = {.config = {.inlineCompletion = false}};
+    KineticRequest request;
+    memset(&request, 0, sizeof(request));
+    request.message.header.messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__NOOP;
+    KineticOperation operation = {
+        .session = &session,
+        .request = &request,
+        .closure = {.nonBlocking = true},
+    };
+    TEST_ASSERT_FALSE(inline_completion(&operation));
 
-    com__seagate__kinetic__proto__message__pack_ExpectAndReturn(&request.message.message, &buf[offset], packedSize);
+    session.config.inlineCompletion = true;
+    TEST_ASSERT_TRUE(inline_completion(&operation));
 
-    KineticStatus status = KineticRequest_PackMessage(&operation, &out_msg, &msgSize);
-    TEST_ASSERT_EQUAL(out_msg, msg);
-    TEST_ASSERT(msgSize > 0);
+    operation.closure.nonBlocking = false;
+    TEST_ASSERT_FALSE(inline_completion(&operation));
+}
 
-    #if 0
-    for (size_t i = 0; i < msgSize; i++) {
-        if (i > 0 && (i & 15) == 15) { printf("\n"); }
-        printf("%02x ", out_msg[i]);
-    }
-    printf("\n");
-    #endif
+void test_inline_completion_should_allow_cheap_operations(void)
+{
+    uint8_t value[KINETIC_INLINE_COMPLETION_MAX_VALUE_LEN];
+    KineticEntry entry = {.value = ByteBuffer_Create(value, sizeof(value), 0)};
+
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_PUT, &entry));
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_DELETE, &entry));
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_NOOP, NULL));
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_FLUSHALLDATA, NULL));
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_GET, &entry));
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_GETNEXT, &entry));
+}
 
-    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, status);
+void test_inline_completion_should_leave_tag_checked_and_large_GETs_to_the_threadpool(void)
+{
+    uint8_t value[KINETIC_INLINE_COMPLETION_MAX_VALUE_LEN + 1];
+    KineticEntry entry = {.value = ByteBuffer_Create(value, sizeof(value), 0)};
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_GET, &entry));
+
+    entry.metadataOnly = true;
+    TEST_ASSERT_TRUE(completes_inline(KINETIC_MESSAGE_TYPE_GET, &entry));
+
+    entry.metadataOnly = false;
+    entry.value.array.len = 16;
+    entry.computeTag = true;
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_GET, &entry));
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_GETPREVIOUS, &entry));
+}
 
-    uint8_t expected[] = {
-        'F',  // versionPrefix
-        0xdd, 0xcc, 0xbb, 0xaa,  // proto length
-        0xaa, 0xbb, 0xcc, 0xdd,  // value length
-    };
-    for (size_t i = 0; i < sizeof(expected); i++) {
-        TEST_ASSERT_EQUAL(expected[i], out_msg[i]);
-    }
-    for (size_t i = 0; i < packedSize; i++) {
-        TEST_ASSERT_EQUAL(0x33, out_msg[i + offset]);
-    }
-    for (size_t i = 0; i < valueLen; i++) {
-        TEST_ASSERT_EQUAL(valueBuf[i], out_msg[i + offset + packedSize]);
-    }
+void test_inline_completion_should_leave_other_operations_to_the_threadpool(void)
+{
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_GETLOG, NULL));
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_GETKEYRANGE, NULL));
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_PEER2PEERPUSH, NULL));
+    TEST_ASSERT_FALSE(completes_inline(KINETIC_MESSAGE_TYPE_SECURITY, NULL));
 }
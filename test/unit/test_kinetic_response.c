@@ -20,6 +20,7 @@
 #include "kinetic_types.h"
 #include "kinetic_types_internal.h"
 #include "kinetic_bus.h"
+#include "kinetic_arena.h"
 #include "kinetic_response.h"
 #include "kinetic_nbo.h"
 #include "kinetic.pb-c.h"
@@ -125,3 +126,233 @@ void test_KineticResponse_GetKeyRange_should_return_the_Com__Seagate__Kinetic__P
     range = KineticResponse_GetKeyRange(&Response);
     TEST_ASSERT_EQUAL_PTR(&Range, range);
 }
+
+/* Pack a response to request ACK_SEQUENCE into BUF, returning its length. */
+static size_t pack_response(uint8_t * buf, size_t size,
+    Com__Seagate__Kinetic__Proto__Message__AuthType authType, int64_t ackSequence)
+{
+    Com__Seagate__Kinetic__Proto__Command__Header header =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    header.has_connectionid = true;
+    header.connectionid = 1234;
+    header.has_acksequence = true;
+    header.acksequence = ackSequence;
+    Com__Seagate__Kinetic__Proto__Command__Status status =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__STATUS__INIT;
+    status.has_code = true;
+    status.code = COM__SEAGATE__KINETIC__PROTO__COMMAND__STATUS__STATUS_CODE__SUCCESS;
+    Com__Seagate__Kinetic__Proto__Command command =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.header = &header;
+    command.status = &status;
+    uint8_t command_buf[64];
+    TEST_ASSERT(com__seagate__kinetic__proto__command__get_packed_size(&command) <= sizeof(command_buf));
+
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    msg.has_authtype = true;
+    msg.authtype = authType;
+    msg.has_commandbytes = true;
+    msg.commandbytes = (ProtobufCBinaryData) {
+        .len = com__seagate__kinetic__proto__command__pack(&command, command_buf),
+        .data = command_buf,
+    };
+    TEST_ASSERT(com__seagate__kinetic__proto__message__get_packed_size(&msg) <= size);
+    return com__seagate__kinetic__proto__message__pack(&msg, buf);
+}
+
+void test_KineticResponse_ScanAckSequence_should_find_the_ackSequence_without_unpacking(void)
+{
+    int64_t acks[] = {0, 1, 0x12345678, INT64_MAX, -1};
+    for (size_t i = 0; i < sizeof(acks) / sizeof(acks[0]); i++) {
+        uint8_t buf[128];
+        size_t len = pack_response(buf, sizeof(buf),
+            COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH, acks[i]);
+
+        int64_t ackSequence = 0;
+        bool unsolicited = true;
+        TEST_ASSERT_TRUE(KineticResponse_ScanAckSequence(buf, len, &ackSequence, &unsolicited));
+        TEST_ASSERT_EQUAL_INT64(acks[i], ackSequence);
+        TEST_ASSERT_FALSE(unsolicited);
+    }
+}
+
+void test_KineticResponse_ScanAckSequence_should_flag_unsolicited_status(void)
+{
+    uint8_t buf[128];
+    size_t len = pack_response(buf, sizeof(buf),
+        COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__UNSOLICITEDSTATUS, 0);
+
+    int64_t ackSequence = -1;
+    bool unsolicited = false;
+    TEST_ASSERT_TRUE(KineticResponse_ScanAckSequence(buf, len, &ackSequence, &unsolicited));
+    TEST_ASSERT_EQUAL_INT64(0, ackSequence);
+    TEST_ASSERT_TRUE(unsolicited);
+}
+
+void test_KineticResponse_ScanAckSequence_should_fail_without_a_command_header(void)
+{
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    msg.has_authtype = true;
+    msg.authtype = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH;
+    uint8_t buf[16];
+    size_t len = com__seagate__kinetic__proto__message__pack(&msg, buf);
+
+    int64_t ackSequence = 0;
+    bool unsolicited = false;
+    TEST_ASSERT_FALSE(KineticResponse_ScanAckSequence(buf, len, &ackSequence, &unsolicited));
+    TEST_ASSERT_FALSE(KineticResponse_ScanAckSequence(buf, 0, &ackSequence, &unsolicited));
+}
+
+void test_KineticResponse_ScanAckSequence_should_fail_on_truncated_messages(void)
+{
+    uint8_t buf[128];
+    size_t len = pack_response(buf, sizeof(buf),
+        COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH, 0x12345678);
+
+    for (size_t i = 0; i < len; i++) {
+        int64_t ackSequence = 0;
+        bool unsolicited = false;
+        TEST_ASSERT_FALSE(KineticResponse_ScanAckSequence(buf, i, &ackSequence, &unsolicited));
+    }
+}
+
+void test_KineticResponse_Unpack_should_decode_common_responses_without_protobuf_c(void)
+{
+    Com__Seagate__Kinetic__Proto__Command__Header header =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__HEADER__INIT;
+    header.has_connectionid = true;
+    header.connectionid = 1234;
+    header.has_acksequence = true;
+    header.acksequence = 7;
+    header.has_messagetype = true;
+    header.messagetype = COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GET_RESPONSE;
+    Com__Seagate__Kinetic__Proto__Command__Status status =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__STATUS__INIT;
+    status.has_code = true;
+    status.code = COM__SEAGATE__KINETIC__PROTO__COMMAND__STATUS__STATUS_CODE__SUCCESS;
+    status.statusmessage = "ok";
+    Com__Seagate__Kinetic__Proto__Command__KeyValue keyValue =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__KEY_VALUE__INIT;
+    keyValue.has_key = true;
+    keyValue.key = (ProtobufCBinaryData) {.len = 3, .data = (uint8_t *)"key"};
+    keyValue.has_dbversion = true;
+    keyValue.dbversion = (ProtobufCBinaryData) {.len = 2, .data = (uint8_t *)"v1"};
+    keyValue.has_tag = true;
+    keyValue.tag = (ProtobufCBinaryData) {.len = 0, .data = NULL};
+    keyValue.has_algorithm = true;
+    keyValue.algorithm = COM__SEAGATE__KINETIC__PROTO__COMMAND__ALGORITHM__SHA1;
+    Com__Seagate__Kinetic__Proto__Command__Body body =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__BODY__INIT;
+    body.keyvalue = &keyValue;
+    Com__Seagate__Kinetic__Proto__Command command =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.header = &header;
+    command.body = &body;
+    command.status = &status;
+    uint8_t command_buf[128];
+    size_t command_len = com__seagate__kinetic__proto__command__pack(&command, command_buf);
+
+    uint8_t hmac[20];
+    memset(hmac, 0xaa, sizeof(hmac));
+    Com__Seagate__Kinetic__Proto__Message__HMACauth hmacAuth =
+        COM__SEAGATE__KINETIC__PROTO__MESSAGE__HMACAUTH__INIT;
+    hmacAuth.has_identity = true;
+    hmacAuth.identity = 1;
+    hmacAuth.has_hmac = true;
+    hmacAuth.hmac = (ProtobufCBinaryData) {.len = sizeof(hmac), .data = hmac};
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    msg.has_authtype = true;
+    msg.authtype = COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH;
+    msg.hmacauth = &hmacAuth;
+    msg.has_commandbytes = true;
+    msg.commandbytes = (ProtobufCBinaryData) {.len = command_len, .data = command_buf};
+    uint8_t buf[256];
+    Response.header.protobufLength = com__seagate__kinetic__proto__message__pack(&msg, buf);
+    Response.protobuf = buf;
+
+    TEST_ASSERT_TRUE(KineticResponse_Unpack(&Response));
+    TEST_ASSERT_EQUAL_PTR(&Response.fields.message, Response.proto);
+    TEST_ASSERT_EQUAL_PTR(&Response.fields.command, Response.command);
+    TEST_ASSERT_NULL(Response.arena.chunks);
+
+    TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__MESSAGE__AUTH_TYPE__HMACAUTH, Response.proto->authtype);
+    TEST_ASSERT_EQUAL(1, Response.proto->hmacauth->identity);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(hmac, Response.proto->hmacauth->hmac.data, sizeof(hmac));
+    TEST_ASSERT_EQUAL(command_len, Response.proto->commandbytes.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(command_buf, Response.proto->commandbytes.data, command_len);
+
+    TEST_ASSERT_EQUAL(1234, Response.command->header->connectionid);
+    TEST_ASSERT_EQUAL(7, Response.command->header->acksequence);
+    TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__MESSAGE_TYPE__GET_RESPONSE,
+        Response.command->header->messagetype);
+    TEST_ASSERT_FALSE(Response.command->header->has_sequence);
+    TEST_ASSERT_EQUAL(KINETIC_STATUS_SUCCESS, KineticResponse_GetStatus(&Response));
+    TEST_ASSERT_EQUAL_STRING("ok", Response.command->status->statusmessage);
+
+    Com__Seagate__Kinetic__Proto__Command__KeyValue * kv = KineticResponse_GetKeyValue(&Response);
+    TEST_ASSERT_NOT_NULL(kv);
+    TEST_ASSERT_EQUAL(3, kv->key.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("key", kv->key.data, 3);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("v1", kv->dbversion.data, 2);
+    TEST_ASSERT_TRUE(kv->has_tag);
+    TEST_ASSERT_NULL(kv->tag.data);
+    TEST_ASSERT_EQUAL(COM__SEAGATE__KINETIC__PROTO__COMMAND__ALGORITHM__SHA1, kv->algorithm);
+    TEST_ASSERT_FALSE(kv->has_newversion);
+}
+
+void test_KineticResponse_Unpack_should_unpack_other_responses_with_protobuf_c(void)
+{
+    Com__Seagate__Kinetic__Proto__Command__Range range =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__RANGE__INIT;
+    Com__Seagate__Kinetic__Proto__Command__Body body =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__BODY__INIT;
+    body.range = &range;
+    Com__Seagate__Kinetic__Proto__Command command =
+        COM__SEAGATE__KINETIC__PROTO__COMMAND__INIT;
+    command.body = &body;
+    uint8_t command_buf[32];
+    Com__Seagate__Kinetic__Proto__Message msg = COM__SEAGATE__KINETIC__PROTO__MESSAGE__INIT;
+    msg.has_commandbytes = true;
+    msg.commandbytes = (ProtobufCBinaryData) {
+        .len = com__seagate__kinetic__proto__command__pack(&command, command_buf),
+        .data = command_buf,
+    };
+    uint8_t buf[64];
+    Response.header.protobufLength = com__seagate__kinetic__proto__message__pack(&msg, buf);
+    Response.protobuf = buf;
+
+    Com__Seagate__Kinetic__Proto__Message Message;
+    memset(&Message, 0, sizeof(Message));
+    Message.has_commandbytes = true;
+    Message.commandbytes = (ProtobufCBinaryData) {.len = 4, .data = (uint8_t *)"data"};
+    Com__Seagate__Kinetic__Proto__Command Command;
+    memset(&Command, 0, sizeof(Command));
+
+    KineticPDU_unpack_message_ExpectAndReturn(&Response.arena.allocator,
+        Response.header.protobufLength, buf, &Message);
+    KineticPDU_unpack_command_ExpectAndReturn(&Response.arena.allocator,
+        4, Message.commandbytes.data, &Command);
+
+    TEST_ASSERT_TRUE(KineticResponse_Unpack(&Response));
+    TEST_ASSERT_EQUAL_PTR(&Message, Response.proto);
+    TEST_ASSERT_EQUAL_PTR(&Command, Response.command);
+
+    /* Once unpacked, it isn't unpacked again. */
+    TEST_ASSERT_TRUE(KineticResponse_Unpack(&Response));
+    KineticArena_Reset(&Response.arena);
+}
+
+void test_KineticResponse_Unpack_should_fail_if_the_message_cannot_be_unpacked(void)
+{
+    uint8_t buf[] = {0xff};
+    Response.header.protobufLength = sizeof(buf);
+    Response.protobuf = buf;
+
+    KineticPDU_unpack_message_ExpectAndReturn(&Response.arena.allocator,
+        sizeof(buf), buf, NULL);
+
+    TEST_ASSERT_FALSE(KineticResponse_Unpack(&Response));
+    TEST_ASSERT_NULL(Response.proto);
+    TEST_ASSERT_NULL(Response.command);
+    KineticArena_Reset(&Response.arena);
+}
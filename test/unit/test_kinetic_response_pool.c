@@ -0,0 +1,148 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "unity_helper.h"
+#include "kinetic_response_pool.h"
+#include "kinetic_response_pool_types.h"
+#include "mock_kinetic_types_internal.h"
+#include "kinetic_logger.h"
+#include "kinetic.pb-c.h"
+#include "protobuf-c/protobuf-c.h"
+#include <string.h>
+
+extern uint8_t size_class(size_t valueLength);
+
+#define UNPOOLED_CLASS KINETIC_RESPONSE_POOL_CLASSES
+#define MAX_VALUE_LENGTH (1024 * 1024)
+
+static KineticResponsePool * Pool = NULL;
+
+void setUp(void)
+{
+    KineticLogger_Init("stdout", 3);
+    Pool = KineticResponsePool_Create();
+    TEST_ASSERT_NOT_NULL(Pool);
+}
+
+void tearDown(void)
+{
+    KineticResponsePool_Destroy(Pool);
+    KineticLogger_Close();
+}
+
+static KineticResponsePoolStats get_stats(void)
+{
+    KineticResponsePoolStats stats;
+    KineticResponsePool_GetStats(Pool, &stats);
+    return stats;
+}
+
+void test_size_class_should_pick_the_smallest_class_that_fits_the_value(void)
+{
+    TEST_ASSERT_EQUAL(0, size_class(0));
+    TEST_ASSERT_EQUAL(0, size_class(64));
+    TEST_ASSERT_EQUAL(1, size_class(65));
+    TEST_ASSERT_EQUAL(1, size_class(128));
+    TEST_ASSERT_EQUAL(4, size_class(1000));
+    TEST_ASSERT_EQUAL(KINETIC_RESPONSE_POOL_CLASSES - 1, size_class(MAX_VALUE_LENGTH));
+    TEST_ASSERT_EQUAL(UNPOOLED_CLASS, size_class(MAX_VALUE_LENGTH + 1));
+}
+
+void test_KineticResponsePool_Alloc_should_return_a_response_with_a_zeroed_header(void)
+{
+    KineticResponse * response = KineticResponsePool_Alloc(Pool, 100);
+    TEST_ASSERT_NOT_NULL(response);
+    TEST_ASSERT_EQUAL_PTR(Pool, response->pool);
+    TEST_ASSERT_EQUAL(1, response->sizeClass);
+    TEST_ASSERT_NULL(response->proto);
+    TEST_ASSERT_NULL(response->command);
+    TEST_ASSERT_FALSE(response->valueInEntry);
+    memset(response->value, 0xaa, 100);
+
+    KineticResponsePoolStats stats = get_stats();
+    TEST_ASSERT_EQUAL(1, stats.allocations);
+    TEST_ASSERT_EQUAL(0, stats.hits);
+    TEST_ASSERT_EQUAL(1, stats.misses);
+
+    KineticResponsePool_Free(response);
+}
+
+void test_KineticResponsePool_Free_should_cache_the_response_for_reuse_in_its_size_class(void)
+{
+    KineticResponse * response = KineticResponsePool_Alloc(Pool, 1000);
+    response->header.valueLength = 1000;
+    response->valueInEntry = true;
+    KineticResponsePool_Free(response);
+
+    KineticResponsePoolStats stats = get_stats();
+    TEST_ASSERT_EQUAL(1, stats.recycled);
+    TEST_ASSERT_EQUAL(sizeof(KineticResponse) + 1024, stats.cachedBytes);
+
+    /* A different size class gets a new buffer... */
+    KineticResponse * other = KineticResponsePool_Alloc(Pool, 10);
+    TEST_ASSERT_NOT_EQUAL(response, other);
+
+    /* ...but the same one reuses it, with a clean header. */
+    KineticResponse * reused = KineticResponsePool_Alloc(Pool, 513);
+    TEST_ASSERT_EQUAL_PTR(response, reused);
+    TEST_ASSERT_EQUAL(0, reused->header.valueLength);
+    TEST_ASSERT_FALSE(reused->valueInEntry);
+    TEST_ASSERT_NULL(reused->nextFree);
+
+    stats = get_stats();
+    TEST_ASSERT_EQUAL(3, stats.allocations);
+    TEST_ASSERT_EQUAL(1, stats.hits);
+    TEST_ASSERT_EQUAL(2, stats.misses);
+    TEST_ASSERT_EQUAL(0, stats.cachedBytes);
+
+    KineticResponsePool_Free(other);
+    KineticResponsePool_Free(reused);
+}
+
+void test_KineticResponsePool_Free_should_release_responses_once_the_size_class_is_full(void)
+{
+    size_t max = KINETIC_RESPONSE_POOL_CLASS_BYTES / MAX_VALUE_LENGTH;
+    KineticResponse * responses[max + 1];
+    for (size_t i = 0; i < max + 1; i++) {
+        responses[i] = KineticResponsePool_Alloc(Pool, MAX_VALUE_LENGTH);
+        TEST_ASSERT_NOT_NULL(responses[i]);
+    }
+    for (size_t i = 0; i < max + 1; i++) {
+        KineticResponsePool_Free(responses[i]);
+    }
+
+    KineticResponsePoolStats stats = get_stats();
+    TEST_ASSERT_EQUAL(max, stats.recycled);
+    TEST_ASSERT_EQUAL(1, stats.released);
+    TEST_ASSERT_EQUAL(max * (sizeof(KineticResponse) + MAX_VALUE_LENGTH), stats.cachedBytes);
+}
+
+void test_KineticResponsePool_should_not_cache_responses_too_large_for_any_size_class(void)
+{
+    KineticResponse * response = KineticResponsePool_Alloc(Pool, MAX_VALUE_LENGTH + 1);
+    TEST_ASSERT_NOT_NULL(response);
+    TEST_ASSERT_EQUAL_PTR(Pool, response->pool);
+    TEST_ASSERT_EQUAL(UNPOOLED_CLASS, response->sizeClass);
+    KineticResponsePool_Free(response);
+
+    KineticResponsePoolStats stats = get_stats();
+    TEST_ASSERT_EQUAL(1, stats.misses);
+    TEST_ASSERT_EQUAL(0, stats.recycled);
+    TEST_ASSERT_EQUAL(1, stats.released);
+    TEST_ASSERT_EQUAL(0, stats.cachedBytes);
+}
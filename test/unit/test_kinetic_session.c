@@ -30,7 +30,9 @@
 #include "mock_kinetic_client.h"
 #include "mock_kinetic_pdu_unpack.h"
 #include "mock_kinetic_countingsemaphore.h"
+#include "mock_kinetic_window.h"
 #include "mock_kinetic_resourcewaiter.h"
+#include "kinetic_response_pool_types.h"
 
 #include "mock_bus.h"
 #include "byte_array.h"
@@ -38,12 +40,14 @@
 #include <sys/time.h>
 
 static KineticCountingSemaphore Semaphore;
+static KineticWindow* Window = (KineticWindow*)0x1234;
 static KineticSession Session;
 static KineticRequest Request;
 static int OperationCompleteCallbackCount;
 static KineticStatus LastStatus;
 static struct _KineticClient Client;
 static struct bus MessageBus;
+static KineticResponsePool ResponsePool;
 
 void setUp(void)
 {
@@ -54,6 +58,7 @@ void setUp(void)
         .clusterVersion = 6,
     };
     Client.bus = &MessageBus;
+    Client.responsePool = &ResponsePool;
     KineticCountingSemaphore_Create_ExpectAndReturn(KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION, &Semaphore);
 
     KineticStatus status = KineticSession_Create(&Session, &Client);
@@ -61,6 +66,7 @@ void setUp(void)
     TEST_ASSERT_FALSE(Session.connected);
     TEST_ASSERT_EQUAL_STRING(Session.config.host, "somehost.com");
     TEST_ASSERT_EQUAL(17, Session.config.port);
+    TEST_ASSERT_EQUAL_PTR(&ResponsePool, Session.responsePool);
 
     KineticRequest_Init(&Request, &Session);
     OperationCompleteCallbackCount = 0;
@@ -107,6 +113,78 @@ void test_KineticSession_Create_should_allocate_and_destroy_KineticConnections(v
     TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
 }
 
+void test_KineticSession_Create_should_allow_the_configured_number_of_outstanding_operations(void)
+{
+    KineticSession session;
+    memset(&session, 0, sizeof(session));
+    session.config.maxOutstandingOperations = 32;
+
+    KineticCountingSemaphore_Create_ExpectAndReturn(32, &Semaphore);
+
+    KineticStatus status = KineticSession_Create(&session, &Client);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_NULL(session.window);
+}
+
+void test_KineticSession_Create_should_create_and_destroy_an_adaptive_window_if_configured(void)
+{
+    KineticSession session;
+    memset(&session, 0, sizeof(session));
+    session.config.adaptiveWindow = true;
+
+    KineticCountingSemaphore_Create_ExpectAndReturn(KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION, &Semaphore);
+    KineticWindow_Create_ExpectAndReturn(&Semaphore, KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION,
+        KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS, Window);
+    KineticAllocator_SetOperationPoolLimit_Expect(&session, KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS);
+
+    KineticStatus status = KineticSession_Create(&session, &Client);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+    TEST_ASSERT_EQUAL_PTR(Window, session.window);
+
+    KineticWindow_Destroy_Expect(Window);
+    KineticCountingSemaphore_Destroy_Expect(&Semaphore);
+    KineticAllocator_FreeSession_Expect(&session);
+
+    status = KineticSession_Destroy(&session);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS, status);
+}
+
+void test_KineticSession_Create_should_report_a_failure_to_create_an_adaptive_window(void)
+{
+    KineticSession session;
+    memset(&session, 0, sizeof(session));
+    session.config.adaptiveWindow = true;
+
+    KineticCountingSemaphore_Create_ExpectAndReturn(KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION, &Semaphore);
+    KineticWindow_Create_ExpectAndReturn(&Semaphore, KINETIC_MAX_OUTSTANDING_OPERATIONS_PER_SESSION,
+        KINETIC_MAX_ADAPTIVE_OUTSTANDING_OPERATIONS, NULL);
+    KineticCountingSemaphore_Destroy_Expect(&Semaphore);
+
+    KineticStatus status = KineticSession_Create(&session, &Client);
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_MEMORY_ERROR, status);
+}
+
+void test_KineticSession_SetOutstandingOperationsLimit_should_set_the_semaphore_and_operation_pool_max(void)
+{
+    KineticCountingSemaphore_SetMax_Expect(&Semaphore, 48);
+    KineticAllocator_SetOperationPoolLimit_Expect(&Session, 48);
+
+    KineticSession_SetOutstandingOperationsLimit(&Session, 48);
+}
+
+void test_KineticSession_SetOutstandingOperationsLimit_should_limit_an_adaptive_window(void)
+{
+    Session.window = Window;
+    KineticWindow_SetLimit_Expect(Window, 48);
+    KineticAllocator_SetOperationPoolLimit_Expect(&Session, 48);
+
+    KineticSession_SetOutstandingOperationsLimit(&Session, 48);
+}
+
 void test_KineticSession_Connect_should_return_KINETIC_SESSION_EMPTY_upon_NULL_session(void)
 {
     KineticStatus status = KineticSession_Connect(NULL);
@@ -281,3 +359,18 @@ void test_KineticSession_Connect_should_connect_to_specified_host(void)
     TEST_ASSERT_EQUAL_INT64(expected.config.identity, session.config.identity);
     TEST_ASSERT_EQUAL_ByteArray(expected.config.hmacKey, session.config.hmacKey);
 }
+
+void test_KineticSession_SetMessageLimits_should_set_the_largest_response_accepted(void)
+{
+    socket_info si;
+    memset(&si, 0, sizeof(si));
+    Session.si = &si;
+
+    KineticSession_SetMessageLimits(&Session, 2048, 0);
+    TEST_ASSERT_EQUAL(2048, si.max_protobuf_len);
+    TEST_ASSERT_EQUAL(0, si.max_value_len);
+
+    KineticSession_SetMessageLimits(&Session, 0, 4096);
+    TEST_ASSERT_EQUAL(2048, si.max_protobuf_len);
+    TEST_ASSERT_EQUAL(4096, si.max_value_len);
+}
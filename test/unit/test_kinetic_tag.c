@@ -0,0 +1,176 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "unity_helper.h"
+#include "kinetic_tag.h"
+#include "kinetic_logger.h"
+#include "kinetic_types.h"
+#include "kinetic_types_internal.h"
+#include "byte_array.h"
+#include <string.h>
+#include <stdlib.h>
+
+static uint8_t TagData[64];
+static ByteBuffer Tag;
+static const ByteArray Check = {.data = (uint8_t *)"123456789", .len = 9};
+
+void setUp(void)
+{
+    KineticLogger_Init("stdout", 3);
+    memset(TagData, 0, sizeof(TagData));
+    Tag = ByteBuffer_Create(TagData, sizeof(TagData), 0);
+}
+
+void tearDown(void)
+{
+    KineticLogger_Close();
+}
+
+/* Bit-at-a-time reference implementations */
+static uint32_t ref_crc32c(uint8_t const * data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) { crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1; }
+    }
+    return ~crc;
+}
+
+static uint64_t ref_crc64(uint8_t const * data, size_t len)
+{
+    uint64_t crc = ~(uint64_t)0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) { crc = (crc & 1) ? (crc >> 1) ^ 0xC96C5795D7870F42ull : crc >> 1; }
+    }
+    return ~crc;
+}
+
+void test_KineticTag_Length_should_return_the_length_of_supported_tags(void)
+{
+    TEST_ASSERT_EQUAL_SIZET(4, KineticTag_Length(KINETIC_ALGORITHM_CRC32));
+    TEST_ASSERT_EQUAL_SIZET(8, KineticTag_Length(KINETIC_ALGORITHM_CRC64));
+    TEST_ASSERT_EQUAL_SIZET(20, KineticTag_Length(KINETIC_ALGORITHM_SHA1));
+    TEST_ASSERT_EQUAL_SIZET(32, KineticTag_Length(KINETIC_ALGORITHM_SHA2));
+    TEST_ASSERT_EQUAL_SIZET(0, KineticTag_Length(KINETIC_ALGORITHM_SHA3));
+    TEST_ASSERT_EQUAL_SIZET(0, KineticTag_Length(KINETIC_ALGORITHM_INVALID));
+}
+
+void test_KineticTag_Compute_should_compute_CRC32C_big_endian(void)
+{
+    const uint8_t expected[] = {0xe3, 0x06, 0x92, 0x83};
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        KineticTag_Compute(KINETIC_ALGORITHM_CRC32, Check, &Tag));
+    TEST_ASSERT_EQUAL_SIZET(sizeof(expected), Tag.bytesUsed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, TagData, sizeof(expected));
+}
+
+void test_KineticTag_Compute_should_compute_CRC64_big_endian(void)
+{
+    const uint8_t expected[] = {0x99, 0x5d, 0xc9, 0xbb, 0xdf, 0x19, 0x39, 0xfa};
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        KineticTag_Compute(KINETIC_ALGORITHM_CRC64, Check, &Tag));
+    TEST_ASSERT_EQUAL_SIZET(sizeof(expected), Tag.bytesUsed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, TagData, sizeof(expected));
+}
+
+void test_KineticTag_Compute_should_compute_SHA1_and_SHA2_digests(void)
+{
+    const ByteArray abc = ByteArray_CreateWithCString("abc");
+    const uint8_t sha1[] = {
+        0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+        0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d,
+    };
+    const uint8_t sha256[] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        KineticTag_Compute(KINETIC_ALGORITHM_SHA1, abc, &Tag));
+    TEST_ASSERT_EQUAL_SIZET(sizeof(sha1), Tag.bytesUsed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(sha1, TagData, sizeof(sha1));
+
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+        KineticTag_Compute(KINETIC_ALGORITHM_SHA2, abc, &Tag));
+    TEST_ASSERT_EQUAL_SIZET(sizeof(sha256), Tag.bytesUsed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(sha256, TagData, sizeof(sha256));
+}
+
+void test_KineticTag_Compute_should_reject_unsupported_algorithms_and_short_buffers(void)
+{
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_INVALID_REQUEST,
+        KineticTag_Compute(KINETIC_ALGORITHM_SHA3, Check, &Tag));
+
+    ByteBuffer small = ByteBuffer_Create(TagData, 7, 0);
+    TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_BUFFER_OVERRUN,
+        KineticTag_Compute(KINETIC_ALGORITHM_CRC64, Check, &small));
+    TEST_ASSERT_EQUAL_SIZET(0, small.bytesUsed);
+}
+
+void test_KineticTag_CRCs_should_match_reference_for_all_lengths_and_alignments(void)
+{
+    uint8_t data[4096 + 16];
+    srand(1234);
+    for (size_t i = 0; i < sizeof(data); i++) { data[i] = (uint8_t)rand(); }
+
+    for (size_t len = 0; len <= 4096; len += (len < 300) ? 1 : 97) {
+        size_t offset = len % 16;
+        TEST_ASSERT_EQUAL(ref_crc32c(&data[offset], len),
+            KineticTag_CRC32C(0, &data[offset], len));
+        TEST_ASSERT_TRUE(ref_crc64(&data[offset], len) ==
+            KineticTag_CRC64(0, &data[offset], len));
+    }
+}
+
+void test_KineticTag_CRCs_should_continue_across_pieces(void)
+{
+    uint8_t data[1000];
+    for (size_t i = 0; i < sizeof(data); i++) { data[i] = (uint8_t)(i * 31); }
+
+    uint32_t crc32 = KineticTag_CRC32C(0, data, 333);
+    crc32 = KineticTag_CRC32C(crc32, &data[333], sizeof(data) - 333);
+    TEST_ASSERT_EQUAL(KineticTag_CRC32C(0, data, sizeof(data)), crc32);
+
+    uint64_t crc64 = KineticTag_CRC64(0, data, 333);
+    crc64 = KineticTag_CRC64(crc64, &data[333], sizeof(data) - 333);
+    TEST_ASSERT_TRUE(KineticTag_CRC64(0, data, sizeof(data)) == crc64);
+}
+
+void test_KineticTag_Verify_should_check_the_tag(void)
+{
+    const KineticAlgorithm algorithms[] = {
+        KINETIC_ALGORITHM_CRC32, KINETIC_ALGORITHM_CRC64,
+        KINETIC_ALGORITHM_SHA1, KINETIC_ALGORITHM_SHA2,
+    };
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+        TEST_ASSERT_EQUAL_KineticStatus(KINETIC_STATUS_SUCCESS,
+            KineticTag_Compute(algorithms[i], Check, &Tag));
+        ByteArray tag = ByteArray_Create(TagData, Tag.bytesUsed);
+        TEST_ASSERT_TRUE(KineticTag_Verify(algorithms[i], Check, tag));
+
+        tag.len--;
+        TEST_ASSERT_FALSE(KineticTag_Verify(algorithms[i], Check, tag));
+        tag.len++;
+        TagData[0] ^= 1;
+        TEST_ASSERT_FALSE(KineticTag_Verify(algorithms[i], Check, tag));
+    }
+    TEST_ASSERT_FALSE(KineticTag_Verify(KINETIC_ALGORITHM_SHA3, Check,
+        ByteArray_Create(TagData, 32)));
+}
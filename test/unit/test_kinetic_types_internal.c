@@ -89,6 +89,26 @@ void test_KineticRequest_Init_should_set_the_exchange_fields_in_the_embedded_pro
     TEST_ASSERT_EQUAL_INT64(KINETIC_SEQUENCE_NOT_YET_BOUND, request.message.header.sequence);
 }
 
+void test_KineticRequest_Init_should_reset_a_previously_used_Request(void)
+{
+    KineticRequest request;
+    KineticSession session;
+    memset(&session, 0, sizeof(session));
+    memset(&request, 0xA5, sizeof(request));
+
+    KineticRequest_Init(&request, &session);
+
+    TEST_ASSERT_FALSE(request.pinAuth);
+    TEST_ASSERT_EQUAL_PTR(&request.message.command, request.command);
+    TEST_ASSERT_EQUAL_PTR(&request.message.header, request.command->header);
+    TEST_ASSERT_NULL(request.command->body);
+    TEST_ASSERT_FALSE(request.message.message.has_commandbytes);
+    TEST_ASSERT_NULL(request.message.message.hmacauth);
+    TEST_ASSERT_NULL(request.message.body.keyvalue);
+    TEST_ASSERT_NULL(request.message.body.security);
+    TEST_ASSERT_FALSE(request.message.header.has_messagetype);
+}
+
 void test_KineticProtoStatusCode_to_KineticStatus_should_map_from_internal_to_public_type(void)
 {
     // These status codes have a one-to-one mapping for clarity
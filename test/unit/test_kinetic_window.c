@@ -0,0 +1,119 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+#include "kinetic_window.h"
+#include "kinetic_window_types.h"
+#include "unity.h"
+#include "unity_helper.h"
+#include "kinetic_logger.h"
+#include "kinetic_types.h"
+#include "mock_kinetic_countingsemaphore.h"
+
+static KineticCountingSemaphore* Semaphore = (KineticCountingSemaphore*)0x1234;
+static KineticWindow* Window;
+
+void setUp(void)
+{
+    Window = KineticWindow_Create(Semaphore, 4, 8);
+    TEST_ASSERT_NOT_NULL(Window);
+}
+
+void tearDown(void)
+{
+    KineticWindow_Destroy(Window);
+}
+
+static void complete(size_t count, KineticStatus status, uint64_t latencyUsec)
+{
+    for (size_t i = 0; i < count; i++) {
+        KineticWindow_Update(Window, status, latencyUsec);
+    }
+}
+
+void test_KineticWindow_Create_should_start_at_the_given_size(void)
+{
+    TEST_ASSERT_EQUAL(4, KineticWindow_GetSize(Window));
+    TEST_ASSERT_EQUAL(8, Window->max);
+    TEST_ASSERT_EQUAL(1, Window->min);
+}
+
+void test_KineticWindow_Update_should_grow_by_one_per_window_while_latency_is_flat(void)
+{
+    complete(3, KINETIC_STATUS_SUCCESS, 100);
+    TEST_ASSERT_EQUAL(4, KineticWindow_GetSize(Window));
+
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 5);
+    TEST_ASSERT_EQUAL(5, KineticWindow_Update(Window, KINETIC_STATUS_SUCCESS, 120));
+
+    complete(4, KINETIC_STATUS_NOT_FOUND, 110);
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 6);
+    TEST_ASSERT_EQUAL(6, KineticWindow_Update(Window, KINETIC_STATUS_SUCCESS, 100));
+}
+
+void test_KineticWindow_Update_should_not_grow_beyond_its_max(void)
+{
+    for (uint32_t size = 5; size <= 8; size++) {
+        KineticCountingSemaphore_SetMax_Expect(Semaphore, size);
+        complete(size - 1, KINETIC_STATUS_SUCCESS, 100);
+    }
+    complete(100, KINETIC_STATUS_SUCCESS, 100);
+    TEST_ASSERT_EQUAL(8, KineticWindow_GetSize(Window));
+}
+
+void test_KineticWindow_Update_should_not_grow_while_latency_rises(void)
+{
+    complete(1, KINETIC_STATUS_SUCCESS, 100);
+    complete(3, KINETIC_STATUS_SUCCESS, 10000);
+    TEST_ASSERT_EQUAL(4, KineticWindow_GetSize(Window));
+    TEST_ASSERT_EQUAL(100, Window->baseLatencyUsec);
+    TEST_ASSERT_TRUE(Window->latencyUsec > 150);
+}
+
+void test_KineticWindow_Update_should_take_rising_latency_as_the_new_baseline_eventually(void)
+{
+    complete(1, KINETIC_STATUS_SUCCESS, 100);
+    complete(4 * 8, KINETIC_STATUS_SUCCESS, 10000);
+    TEST_ASSERT_EQUAL(Window->latencyUsec, Window->baseLatencyUsec);
+    TEST_ASSERT_EQUAL(4, KineticWindow_GetSize(Window));
+}
+
+void test_KineticWindow_Update_should_halve_the_window_on_a_timeout(void)
+{
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 2);
+    TEST_ASSERT_EQUAL(2, KineticWindow_Update(Window, KINETIC_STATUS_OPERATION_TIMEDOUT, 0));
+}
+
+void test_KineticWindow_Update_should_halve_the_window_once_per_window_when_the_device_is_busy(void)
+{
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 2);
+    complete(3, KINETIC_STATUS_DEVICE_BUSY, 100);
+    TEST_ASSERT_EQUAL(2, KineticWindow_GetSize(Window));
+
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 1);
+    complete(1, KINETIC_STATUS_DEVICE_BUSY, 100);
+    TEST_ASSERT_EQUAL(1, KineticWindow_GetSize(Window));
+
+    complete(10, KINETIC_STATUS_DEVICE_BUSY, 100);
+    TEST_ASSERT_EQUAL(1, KineticWindow_GetSize(Window));
+}
+
+void test_KineticWindow_SetLimit_should_resize_the_window_to_the_new_max(void)
+{
+    KineticCountingSemaphore_SetMax_Expect(Semaphore, 32);
+    KineticWindow_SetLimit(Window, 32);
+    TEST_ASSERT_EQUAL(32, KineticWindow_GetSize(Window));
+    TEST_ASSERT_EQUAL(32, Window->max);
+}
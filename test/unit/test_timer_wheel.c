@@ -0,0 +1,204 @@
+/**
+ * Copyright 2013-2015 Seagate Technology LLC.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla
+ * Public License, v. 2.0. If a copy of the MPL was not
+ * distributed with this file, You can obtain one at
+ * https://mozilla.org/MP:/2.0/.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but is provided AS-IS, WITHOUT ANY WARRANTY; including without
+ * the implied warranty of MERCHANTABILITY, NON-INFRINGEMENT or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the Mozilla Public
+ * License for more details.
+ *
+ * See www.openkinetic.org for more project information
+ */
+
+#include "unity.h"
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define MAX_EXPIRED 16
+
+static struct timer_wheel Wheel;
+static struct timer_wheel *w = NULL;
+static uint64_t cur_time = 0;
+
+static timer_wheel_node *expired[MAX_EXPIRED];
+static uint64_t expired_at[MAX_EXPIRED];
+static size_t expired_count = 0;
+
+void setUp(void) {
+    w = &Wheel;
+    cur_time = 0;
+    TimerWheel_Init(w, cur_time);
+    memset(expired, 0, sizeof(expired));
+    expired_count = 0;
+}
+
+void tearDown(void) {}
+
+static void expire_cb(timer_wheel_node *n, void *udata) {
+    TEST_ASSERT_EQUAL_PTR(&Wheel, udata);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(n));
+    TEST_ASSERT(expired_count < MAX_EXPIRED);
+    expired[expired_count] = n;
+    expired_at[expired_count] = cur_time;
+    expired_count++;
+}
+
+static size_t advance_to(uint64_t now) {
+    cur_time = now;
+    return TimerWheel_Advance(w, now, expire_cb, w);
+}
+
+/* Advance one msec at a time, so expirations are recorded at the
+ * earliest time they're seen. */
+static void step_to(uint64_t now) {
+    while (cur_time < now) { advance_to(cur_time + 1); }
+}
+
+void test_TimerWheel_should_have_nothing_to_do_when_empty(void) {
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+    TEST_ASSERT_EQUAL(0, advance_to(100000));
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+}
+
+void test_TimerWheel_should_expire_timer_at_its_deadline(void) {
+    timer_wheel_node n;
+    memset(&n, 0, sizeof(n));
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&n));
+
+    TimerWheel_Schedule(w, &n, 10);
+    TEST_ASSERT_TRUE(TimerWheel_IsScheduled(&n));
+    TEST_ASSERT_EQUAL(10, n.deadline);
+    TEST_ASSERT_EQUAL(10, TimerWheel_NextDelay(w));
+
+    TEST_ASSERT_EQUAL(0, advance_to(9));
+    TEST_ASSERT_EQUAL(1, TimerWheel_NextDelay(w));
+    TEST_ASSERT_EQUAL(1, advance_to(10));
+    TEST_ASSERT_EQUAL_PTR(&n, expired[0]);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&n));
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+}
+
+void test_TimerWheel_should_expire_zero_delay_timer_on_next_advance(void) {
+    timer_wheel_node n;
+    memset(&n, 0, sizeof(n));
+    TimerWheel_Schedule(w, &n, 0);
+    TEST_ASSERT_EQUAL(1, TimerWheel_NextDelay(w));
+    TEST_ASSERT_EQUAL(1, advance_to(1));
+}
+
+void test_TimerWheel_should_expire_timers_in_deadline_order(void) {
+    timer_wheel_node nodes[3];
+    memset(nodes, 0, sizeof(nodes));
+    TimerWheel_Schedule(w, &nodes[0], 300);
+    TimerWheel_Schedule(w, &nodes[1], 5);
+    TimerWheel_Schedule(w, &nodes[2], 70);
+
+    TEST_ASSERT_EQUAL(3, advance_to(1000));
+    TEST_ASSERT_EQUAL_PTR(&nodes[1], expired[0]);
+    TEST_ASSERT_EQUAL_PTR(&nodes[2], expired[1]);
+    TEST_ASSERT_EQUAL_PTR(&nodes[0], expired[2]);
+}
+
+void test_TimerWheel_should_not_expire_cancelled_timers(void) {
+    timer_wheel_node a;
+    timer_wheel_node b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    TimerWheel_Schedule(w, &a, 20);
+    TimerWheel_Schedule(w, &b, 20);
+
+    TimerWheel_Cancel(w, &a);
+    TEST_ASSERT_FALSE(TimerWheel_IsScheduled(&a));
+    TimerWheel_Cancel(w, &a);   // no-op
+
+    TEST_ASSERT_EQUAL(1, advance_to(20));
+    TEST_ASSERT_EQUAL_PTR(&b, expired[0]);
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+}
+
+void test_TimerWheel_should_reschedule_a_scheduled_timer(void) {
+    timer_wheel_node n;
+    memset(&n, 0, sizeof(n));
+    TimerWheel_Schedule(w, &n, 20);
+    TimerWheel_Schedule(w, &n, 5000);
+    TEST_ASSERT_EQUAL(0, advance_to(4999));
+    TEST_ASSERT_EQUAL(1, advance_to(5000));
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+}
+
+void test_TimerWheel_should_expire_long_timers_on_time_after_cascading(void) {
+    const uint32_t delays[] = { 63, 64, 65, 4095, 4096, 4097, 300000, 10000000 };
+    const size_t count = sizeof(delays) / sizeof(delays[0]);
+    timer_wheel_node nodes[sizeof(delays) / sizeof(delays[0])];
+    memset(nodes, 0, sizeof(nodes));
+
+    cur_time = 12345;
+    TimerWheel_Init(w, cur_time);
+    for (size_t i = 0; i < count; i++) {
+        TimerWheel_Schedule(w, &nodes[i], delays[i]);
+    }
+
+    /* Jump to just before each deadline, then step to it. */
+    for (size_t i = 0; i < count; i++) {
+        uint64_t deadline = 12345 + delays[i];
+        int64_t delay = TimerWheel_NextDelay(w);
+        TEST_ASSERT(delay > 0);
+        TEST_ASSERT(cur_time + delay <= deadline);
+        if (deadline - 1 > cur_time) { advance_to(deadline - 1); }
+        TEST_ASSERT_EQUAL(i, expired_count);
+        step_to(deadline);
+        TEST_ASSERT_EQUAL(i + 1, expired_count);
+        TEST_ASSERT_EQUAL_PTR(&nodes[i], expired[i]);
+        TEST_ASSERT_EQUAL(deadline, expired_at[i]);
+    }
+}
+
+static timer_wheel_node *rearm_node = NULL;
+
+static void rearm_cb(timer_wheel_node *n, void *udata) {
+    expire_cb(n, udata);
+    if (n == rearm_node && expired_count < 3) {
+        TimerWheel_Schedule(w, n, 100);
+    }
+}
+
+void test_TimerWheel_should_allow_callback_to_reschedule_the_timer(void) {
+    timer_wheel_node n;
+    memset(&n, 0, sizeof(n));
+    rearm_node = &n;
+    TimerWheel_Schedule(w, &n, 100);
+
+    for (uint64_t t = 100; t <= 300; t += 100) {
+        cur_time = t;
+        TEST_ASSERT_EQUAL(1, TimerWheel_Advance(w, t, rearm_cb, w));
+    }
+    TEST_ASSERT_EQUAL(3, expired_count);
+    TEST_ASSERT_EQUAL(-1, TimerWheel_NextDelay(w));
+}
+
+void test_TimerWheel_should_schedule_from_the_latest_advance_after_a_long_gap(void) {
+    timer_wheel_node a;
+    timer_wheel_node b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+
+    /* Idle (nothing scheduled) for a long time, then catch up. */
+    TEST_ASSERT_EQUAL(0, advance_to(3600000));
+    TimerWheel_Schedule(w, &a, 10);
+    TEST_ASSERT_EQUAL(3600010, a.deadline);
+    TEST_ASSERT_EQUAL(10, TimerWheel_NextDelay(w));
+
+    /* Another gap with a timer pending; later timers are relative
+     * to the new time, not the time before the gap. */
+    TEST_ASSERT_EQUAL(1, advance_to(7200000));
+    TimerWheel_Schedule(w, &b, 10);
+    TEST_ASSERT_EQUAL(0, advance_to(7200009));
+    TEST_ASSERT_EQUAL(1, advance_to(7200010));
+    TEST_ASSERT_EQUAL_PTR(&b, expired[1]);
+}